@@ -0,0 +1,506 @@
+//
+//  chop-host.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include "chop-host.hpp"
+
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+
+#include <dlfcn.h>
+
+using namespace std;
+using namespace chrono;
+
+//******************************************************************************
+// parameters appended by the plugin
+class ChopHost::ParameterManager : public OP_ParameterManager {
+public:
+    typedef struct _Par {
+        double values[4];
+        string str;
+        vector<string> menu;
+        bool enabled;
+    } Par;
+
+    map<string, Par> pars_;
+    vector<string> order_;
+
+    Par* find(const char* name)
+    {
+        map<string, Par>::iterator it = pars_.find(name);
+        return (it == pars_.end() ? nullptr : &it->second);
+    }
+
+    OP_ParAppendResult appendFloat(const OP_NumericParameter &np, int32_t size) override
+    { return appendNumeric(np, size); }
+    OP_ParAppendResult appendInt(const OP_NumericParameter &np, int32_t size) override
+    { return appendNumeric(np, size); }
+    OP_ParAppendResult appendXY(const OP_NumericParameter &np) override
+    { return appendNumeric(np, 2); }
+    OP_ParAppendResult appendXYZ(const OP_NumericParameter &np) override
+    { return appendNumeric(np, 3); }
+    OP_ParAppendResult appendUV(const OP_NumericParameter &np) override
+    { return appendNumeric(np, 2); }
+    OP_ParAppendResult appendUVW(const OP_NumericParameter &np) override
+    { return appendNumeric(np, 3); }
+    OP_ParAppendResult appendRGB(const OP_NumericParameter &np) override
+    { return appendNumeric(np, 3); }
+    OP_ParAppendResult appendRGBA(const OP_NumericParameter &np) override
+    { return appendNumeric(np, 4); }
+    OP_ParAppendResult appendToggle(const OP_NumericParameter &np) override
+    { return appendNumeric(np, 1); }
+    OP_ParAppendResult appendPulse(const OP_NumericParameter &np) override
+    { return appendNumeric(np, 1); }
+
+    OP_ParAppendResult appendString(const OP_StringParameter &sp) override
+    { return appendStr(sp, 0, nullptr); }
+    OP_ParAppendResult appendFile(const OP_StringParameter &sp) override
+    { return appendStr(sp, 0, nullptr); }
+    OP_ParAppendResult appendFolder(const OP_StringParameter &sp) override
+    { return appendStr(sp, 0, nullptr); }
+    OP_ParAppendResult appendDAT(const OP_StringParameter &sp) override
+    { return appendStr(sp, 0, nullptr); }
+    OP_ParAppendResult appendCHOP(const OP_StringParameter &sp) override
+    { return appendStr(sp, 0, nullptr); }
+    OP_ParAppendResult appendTOP(const OP_StringParameter &sp) override
+    { return appendStr(sp, 0, nullptr); }
+    OP_ParAppendResult appendObject(const OP_StringParameter &sp) override
+    { return appendStr(sp, 0, nullptr); }
+
+    OP_ParAppendResult appendMenu(const OP_StringParameter &sp, int32_t nitems,
+                                  const char **names, const char ** /*labels*/) override
+    { return appendStr(sp, nitems, names); }
+    OP_ParAppendResult appendStringMenu(const OP_StringParameter &sp, int32_t nitems,
+                                        const char **names, const char ** /*labels*/) override
+    { return appendStr(sp, nitems, names); }
+
+private:
+    Par* append(const char* name)
+    {
+        if (!name || pars_.find(name) != pars_.end())
+            return nullptr;
+
+        Par& p = pars_[name];
+        fill(p.values, p.values+4, 0.);
+        p.enabled = true;
+        order_.push_back(name);
+
+        return &p;
+    }
+
+    OP_ParAppendResult appendNumeric(const OP_NumericParameter &np, int32_t size)
+    {
+        if (size < 1 || size > 4)
+            return OP_ParAppendResult::InvalidSize;
+
+        Par *p = append(np.name);
+        if (!p)
+            return OP_ParAppendResult::InvalidName;
+
+        copy(np.defaultValues, np.defaultValues+size, p->values);
+        return OP_ParAppendResult::Success;
+    }
+
+    OP_ParAppendResult appendStr(const OP_StringParameter &sp, int32_t nItems, const char **names)
+    {
+        Par *p = append(sp.name);
+        if (!p)
+            return OP_ParAppendResult::InvalidName;
+
+        for (int i = 0; i < nItems; ++i)
+            p->menu.push_back(names[i]);
+
+        if (sp.defaultValue)
+            p->str = sp.defaultValue;
+        else if (nItems)
+            p->str = names[0];
+
+        for (int i = 0; i < nItems; ++i)
+            if (p->menu[i] == p->str)
+                p->values[0] = i;
+
+        return OP_ParAppendResult::Success;
+    }
+};
+
+//******************************************************************************
+class ChopHost::TableDat : public OP_DATInput {
+public:
+    TableDat(const string& path):path_(path)
+    {
+        ifstream f(path);
+        string line;
+
+        if (!f.is_open())
+            throw runtime_error("can't open DAT file "+path);
+
+        vector<vector<string>> rows;
+        size_t nCols = 0;
+
+        while (getline(f, line))
+        {
+            if (line.size() && line.back() == '\r')
+                line.pop_back();
+
+            vector<string> row;
+            // tab separated if there are tabs, otherwise whitespace separated
+            if (line.find('\t') != string::npos)
+            {
+                stringstream ss(line);
+                string cell;
+                while (getline(ss, cell, '\t'))
+                    row.push_back(cell);
+            }
+            else
+            {
+                stringstream ss(line);
+                string cell;
+                while (ss >> cell)
+                    row.push_back(cell);
+            }
+
+            nCols = max(nCols, row.size());
+            rows.push_back(row);
+        }
+
+        for (auto& row:rows)
+            for (size_t c = 0; c < nCols; ++c)
+                cells_.push_back(c < row.size() ? row[c] : "");
+        for (auto& c:cells_)
+            cellPtrs_.push_back(c.c_str());
+
+        opPath = path_.c_str();
+        opId = 0;
+        numRows = (int32_t)rows.size();
+        numCols = (int32_t)nCols;
+        isTable = true;
+        cellData = cellPtrs_.data();
+    }
+
+private:
+    string path_;
+    vector<string> cells_;
+    vector<const char*> cellPtrs_;
+};
+
+//******************************************************************************
+class ChopHost::Inputs : public OP_Inputs {
+public:
+    Inputs(ParameterManager& manager):manager_(manager){}
+
+    map<string, shared_ptr<TableDat>> dats_;
+
+    int32_t getNumInputs() override { return 0; }
+    const OP_TOPInput* getInputTOP(int32_t) override { return nullptr; }
+    const OP_CHOPInput* getInputCHOP(int32_t) override { return nullptr; }
+
+    const OP_DATInput* getParDAT(const char *name) override
+    {
+        ParameterManager::Par *p = manager_.find(name);
+        map<string, shared_ptr<TableDat>>::iterator it = dats_.find(name);
+
+        if (p && p->str.size() && it != dats_.end())
+            return it->second.get();
+        return nullptr;
+    }
+    const OP_TOPInput* getParTOP(const char*) override { return nullptr; }
+    const OP_CHOPInput* getParCHOP(const char*) override { return nullptr; }
+    const OP_ObjectInput* getParObject(const char*) override { return nullptr; }
+
+    double getParDouble(const char* name, int32_t index) override
+    {
+        ParameterManager::Par *p = manager_.find(name);
+        return (p && index >= 0 && index < 4 ? p->values[index] : 0.);
+    }
+    bool getParDouble2(const char* name, double &v0, double &v1) override
+    {
+        v0 = getParDouble(name, 0); v1 = getParDouble(name, 1);
+        return manager_.find(name) != nullptr;
+    }
+    bool getParDouble3(const char* name, double &v0, double &v1, double &v2) override
+    {
+        v2 = getParDouble(name, 2);
+        return getParDouble2(name, v0, v1);
+    }
+    bool getParDouble4(const char* name, double &v0, double &v1, double &v2, double &v3) override
+    {
+        v3 = getParDouble(name, 3);
+        return getParDouble3(name, v0, v1, v2);
+    }
+
+    int32_t getParInt(const char* name, int32_t index) override
+    {
+        return (int32_t)lround(getParDouble(name, index));
+    }
+    bool getParInt2(const char* name, int32_t &v0, int32_t &v1) override
+    {
+        v0 = getParInt(name, 0); v1 = getParInt(name, 1);
+        return manager_.find(name) != nullptr;
+    }
+    bool getParInt3(const char* name, int32_t &v0, int32_t &v1, int32_t &v2) override
+    {
+        v2 = getParInt(name, 2);
+        return getParInt2(name, v0, v1);
+    }
+    bool getParInt4(const char* name, int32_t &v0, int32_t &v1, int32_t &v2, int32_t &v3) override
+    {
+        v3 = getParInt(name, 3);
+        return getParInt3(name, v0, v1, v2);
+    }
+
+    const char* getParString(const char* name) override
+    {
+        ParameterManager::Par *p = manager_.find(name);
+        return (p ? p->str.c_str() : "");
+    }
+    const char* getParFilePath(const char* name) override
+    {
+        return getParString(name);
+    }
+
+    bool getRelativeTransform(const char*, const char*, double[4][4]) override { return false; }
+
+    void enablePar(const char* name, bool onoff) override
+    {
+        ParameterManager::Par *p = manager_.find(name);
+        if (p) p->enabled = onoff;
+    }
+
+    const OP_DATInput* getDAT(const char*) override { return nullptr; }
+    const OP_TOPInput* getTOP(const char*) override { return nullptr; }
+    const OP_CHOPInput* getCHOP(const char*) override { return nullptr; }
+    const OP_ObjectInput* getObject(const char*) override { return nullptr; }
+
+    void* getTOPDataInCPUMemory(const OP_TOPInput*, const OP_TOPInputDownloadOptions*) override
+    { return nullptr; }
+
+private:
+    ParameterManager& manager_;
+};
+
+//******************************************************************************
+ChopHost::ChopHost(const string& pluginPath):
+library_(nullptr),
+destroy_(nullptr),
+feed_(nullptr),
+chop_(nullptr),
+poison_(false),
+manager_(make_shared<ParameterManager>())
+{
+    inputs_ = make_shared<Inputs>(*manager_);
+
+    library_ = dlopen(pluginPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!library_)
+        throw runtime_error(string("can't load plugin: ")+dlerror());
+
+    GETCHOPAPIVERSION getVersion = (GETCHOPAPIVERSION)dlsym(library_, "GetCHOPAPIVersion");
+    CREATECHOPINSTANCE create = (CREATECHOPINSTANCE)dlsym(library_, "CreateCHOPInstance");
+    destroy_ = (DESTROYCHOPINSTANCE)dlsym(library_, "DestroyCHOPInstance");
+    feed_ = (FEEDDATAGRAM)dlsym(library_, "FeedDatagram");
+
+    if (!getVersion || !create || !destroy_)
+    {
+        dlclose(library_);
+        throw runtime_error(pluginPath+" is not a CHOP plugin");
+    }
+
+    if (getVersion() != CHOP_CPLUSPLUS_API_VERSION)
+    {
+        stringstream ss;
+        ss << "plugin API version " << getVersion() << " (host supports "
+           << CHOP_CPLUSPLUS_API_VERSION << ")";
+        dlclose(library_);
+        throw runtime_error(ss.str());
+    }
+
+    memset(&nodeInfo_, 0, sizeof(nodeInfo_));
+    nodeInfo_.opPath = "/project1/chop_host1";
+    nodeInfo_.opID = 1;
+
+    chop_ = create(&nodeInfo_);
+    chop_->setupParameters(manager_.get());
+
+    // nothing is output until the first cook
+    output_ = make_shared<CHOP_Output>(0, 0, 60.f, 0);
+}
+
+ChopHost::~ChopHost()
+{
+    if (chop_)
+        destroy_(chop_);
+    if (library_)
+        dlclose(library_);
+}
+
+void
+ChopHost::setPar(const string& name, const string& value)
+{
+    ParameterManager::Par *p = manager_->find(name.c_str());
+
+    if (!p)
+        throw runtime_error("unknown parameter "+name);
+
+    p->str = value;
+
+    if (p->menu.size())
+    {
+        vector<string>::iterator it = find(p->menu.begin(), p->menu.end(), value);
+        if (it == p->menu.end())
+            throw runtime_error("parameter "+name+" has no menu item "+value);
+        p->values[0] = (double)(it-p->menu.begin());
+    }
+    else
+    {
+        // numeric parameters may be given as comma separated tuples
+        stringstream ss(value);
+        string v;
+        for (int i = 0; i < 4 && getline(ss, v, ','); ++i)
+            p->values[i] = strtod(v.c_str(), nullptr);
+    }
+}
+
+void
+ChopHost::setDat(const string& name, const string& path)
+{
+    inputs_->dats_[name] = make_shared<TableDat>(path);
+    setPar(name, path);
+}
+
+void
+ChopHost::pulse(const string& name)
+{
+    if (!manager_->find(name.c_str()))
+        throw runtime_error("unknown parameter "+name);
+    chop_->pulsePressed(name.c_str());
+}
+
+void
+ChopHost::feed(const char* datagram, size_t len)
+{
+    if (!feed_)
+        throw runtime_error("plugin was built without CHOP_HOST, can't feed datagrams");
+    feed_(datagram, (int32_t)len);
+}
+
+ChopHost::CookStats
+ChopHost::cook()
+{
+    CookStats stats;
+    steady_clock::time_point t0 = steady_clock::now();
+
+    CHOP_GeneralInfo ginfo;
+    memset(&ginfo, 0, sizeof(ginfo));
+    chop_->getGeneralInfo(&ginfo);
+
+    CHOP_OutputInfo info;
+    memset(&info, 0, sizeof(info));
+    info.numSamples = 1;
+    info.sampleRate = 60;
+    info.opInputs = inputs_.get();
+
+    // plugins have no inputs to match, so "false" means no output
+    if (!chop_->getOutputInfo(&info))
+        info.numChannels = 0;
+    allocateOutput(info);
+    if (poison_)
+        for (auto& s:samples_)
+            fill(s.begin(), s.end(), numeric_limits<float>::quiet_NaN());
+
+    if (probe_)
+        probe_(true);
+    steady_clock::time_point t1 = steady_clock::now();
+    chop_->execute(output_.get(), inputs_.get(), nullptr);
+    steady_clock::time_point t2 = steady_clock::now();
+    if (probe_)
+        probe_(false);
+
+    // TouchDesigner copies strings right away, so does the host
+    int32_t nInfoChans = chop_->getNumInfoCHOPChans();
+    infoChans_.resize(nInfoChans);
+    for (int i = 0; i < nInfoChans; ++i)
+    {
+        OP_InfoCHOPChan chan;
+        memset(&chan, 0, sizeof(chan));
+        chop_->getInfoCHOPChan(i, &chan);
+        infoChans_[i].first = (chan.name ? chan.name : "");
+        infoChans_[i].second = chan.value;
+    }
+
+    OP_InfoDATSize datSize;
+    memset(&datSize, 0, sizeof(datSize));
+    infoDat_.clear();
+    if (chop_->getInfoDATSize(&datSize))
+    {
+        int nEntries = (datSize.byColumn ? datSize.rows : datSize.cols);
+        int nLines = (datSize.byColumn ? datSize.cols : datSize.rows);
+        vector<char*> values(nEntries);
+        OP_InfoDATEntries entries;
+
+        memset(&entries, 0, sizeof(entries));
+        entries.values = values.data();
+
+        for (int i = 0; i < nLines; ++i)
+        {
+            fill(values.begin(), values.end(), nullptr);
+            chop_->getInfoDATEntries(i, nEntries, &entries);
+
+            infoDat_.push_back(vector<string>());
+            for (auto v:values)
+                infoDat_.back().push_back(v ? v : "");
+        }
+    }
+
+    const char *warning = chop_->getWarningString();
+    const char *error = chop_->getErrorString();
+    warning_ = (warning ? warning : "");
+    error_ = (error ? error : "");
+
+    steady_clock::time_point t3 = steady_clock::now();
+    stats.cookUs = duration_cast<nanoseconds>(t3-t0).count()/1000.;
+    stats.executeUs = duration_cast<nanoseconds>(t2-t1).count()/1000.;
+
+    return stats;
+}
+
+const vector<string>&
+ChopHost::getParNames() const
+{
+    return manager_->order_;
+}
+
+//******************************************************************************
+void
+ChopHost::allocateOutput(const CHOP_OutputInfo &info)
+{
+    if (info.numChannels != output_->numChannels || info.numSamples != output_->numSamples)
+    {
+        samples_.assign(info.numChannels, vector<float>(info.numSamples, 0));
+        channels_.resize(info.numChannels);
+        for (int i = 0; i < info.numChannels; ++i)
+            channels_[i] = samples_[i].data();
+
+        output_ = make_shared<CHOP_Output>(info.numChannels, info.numSamples,
+                                           info.sampleRate, info.startIndex);
+    }
+
+    chanNames_.resize(info.numChannels);
+    chanNamePtrs_.resize(info.numChannels);
+    for (int i = 0; i < info.numChannels; ++i)
+    {
+        const char *name = chop_->getChannelName(i, nullptr);
+        chanNames_[i] = (name ? name : "");
+        chanNamePtrs_[i] = chanNames_[i].c_str();
+    }
+
+    output_->names = chanNamePtrs_.data();
+    output_->channels = channels_.data();
+}
@@ -0,0 +1,101 @@
+//
+//  chop-host.hpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#ifndef chop_host_hpp
+#define chop_host_hpp
+
+#include <stdio.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <functional>
+#include <vector>
+
+#include "CHOP_CPlusPlusBase.h"
+
+typedef void (*FEEDDATAGRAM)(const char*, int32_t);
+
+/**
+ * Headless CHOP host - loads OPT_CHOP or OM_CHOP plugin (shared library built
+ * with CHOP_HOST defined) and cooks it the same way TouchDesigner does:
+ * getGeneralInfo, getOutputInfo, getChannelName, execute, then info CHOP and
+ * info DAT queries. Parameters appended by the plugin keep their default
+ * values until changed with setPar(); DAT parameters are served from table
+ * files registered with setDat().
+ * Datagrams passed to feed() go straight into plugin's socket reader (same
+ * path as packets received from the network).
+ */
+class ChopHost {
+public:
+    typedef struct _CookStats {
+        double cookUs, executeUs;
+    } CookStats;
+    // called right before (true) and after (false) plugin's execute()
+    typedef std::function<void(bool)> ExecuteProbe;
+
+    // throws runtime_error if plugin can not be loaded
+    ChopHost(const std::string& pluginPath);
+    ~ChopHost();
+
+    // value is a number for numeric parameters and item name for menus;
+    // throws runtime_error on unknown parameter
+    void setPar(const std::string& name, const std::string& value);
+    // table DAT read from a file (tab or space separated); DAT parameter
+    // will point to it
+    void setDat(const std::string& name, const std::string& path);
+    void pulse(const std::string& name);
+
+    // whether datagrams can be fed in-process (plugin exports FeedDatagram)
+    bool canFeed() const { return feed_ != nullptr; }
+    void feed(const char* datagram, size_t len);
+
+    CookStats cook();
+    void setExecuteProbe(ExecuteProbe probe) { probe_ = probe; }
+    // fills output with NaN before every execute, so samples the plugin
+    // doesn't write show up (TouchDesigner doesn't clear output either)
+    void setPoisonOutput(bool poison) { poison_ = poison; }
+
+    const CHOP_Output& getOutput() const { return *output_; }
+    const std::vector<std::string>& getChannelNames() const { return chanNames_; }
+    const std::vector<std::pair<std::string, float>>& getInfoChannels() const { return infoChans_; }
+    const std::vector<std::vector<std::string>>& getInfoDat() const { return infoDat_; }
+    const std::string& getWarning() const { return warning_; }
+    const std::string& getError() const { return error_; }
+
+    // parameter names in order they were appended by the plugin
+    const std::vector<std::string>& getParNames() const;
+
+private:
+    class Inputs;
+    class ParameterManager;
+    class TableDat;
+
+    void *library_;
+    DESTROYCHOPINSTANCE destroy_;
+    FEEDDATAGRAM feed_;
+    CHOP_CPlusPlusBase *chop_;
+    ExecuteProbe probe_;
+    bool poison_;
+
+    std::shared_ptr<Inputs> inputs_;
+    std::shared_ptr<ParameterManager> manager_;
+    OP_NodeInfo nodeInfo_;
+
+    std::shared_ptr<CHOP_Output> output_;
+    std::vector<std::vector<float>> samples_;
+    std::vector<float*> channels_;
+    std::vector<std::string> chanNames_;
+    std::vector<const char*> chanNamePtrs_;
+
+    std::vector<std::pair<std::string, float>> infoChans_;
+    std::vector<std::vector<std::string>> infoDat_;
+    std::string warning_, error_;
+
+    void allocateOutput(const CHOP_OutputInfo& info);
+};
+
+#endif /* chop_host_hpp */
@@ -0,0 +1,623 @@
+//
+//  crowd-sim.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include "crowd-sim.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "defines.h"
+
+#define SIM_RATE            30      // minimal simulation steps per second
+#define MAX_SPEED           1.8f    // m/s
+#define WALK_NOISE          1.2f    // random walk acceleration, m/s^2
+#define WALK_DAMPING        0.6f
+#define FLOCK_RADIUS        2.f     // neighbour search radius and grid cell
+#define FLOCK_SEPARATION    0.7f
+#define FLOCK_WALL          1.f     // steer away from walls this close
+#define LANE_WIDTH          1.2f
+#define LANE_SPEED          1.3f
+
+using namespace std;
+
+CrowdSim::Config
+CrowdSim::defaultConfig(int nPeople)
+{
+    Config c;
+
+    c.nPeople = nPeople;
+    c.motion = RandomWalk;
+    c.worldRate = 30;
+    c.heartbeatRate = 1;
+    c.omRate = 0;
+    // about 2 square meters per person, but never smaller than a room
+    c.width = max(8.f, sqrt(2.f*nPeople)*1.5f);
+    c.depth = max(6.f, sqrt(2.f*nPeople)/1.5f);
+    c.churn = 0.01;
+    c.pairwiseMax = 50;
+    c.clusterRadius = 1;
+    c.clusterMinSize = 2;
+    c.seed = 1;
+    c.startStamp = 1521403105;
+
+    return c;
+}
+
+bool
+CrowdSim::parseMotion(const string &name, Motion &motion)
+{
+    if (name == "walk")
+        motion = RandomWalk;
+    else if (name == "flock")
+        motion = Flocking;
+    else if (name == "lanes")
+        motion = Lanes;
+    else
+        return false;
+    return true;
+}
+
+const char*
+CrowdSim::motionName(Motion motion)
+{
+    switch (motion) {
+        case Flocking: return "flock";
+        case Lanes: return "lanes";
+        default: return "walk";
+    }
+}
+
+CrowdSim::CrowdSim(const Config& config):
+config_(config),
+rng_(config.seed),
+noise_(0, 1),
+uniform_(0, 1),
+nextId_(0),
+time_(0),
+worldSeq_(0), heartbeatSeq_(0), omSeq_(0), omTicks_(0),
+gridCols_(0), gridRows_(0),
+tracksValid_(false)
+{
+    if (config_.nPeople < CROWD_MIN_PEOPLE || config_.nPeople > CROWD_MAX_PEOPLE)
+        throw invalid_argument("number of people must be "+to_string(CROWD_MIN_PEOPLE)+
+                               ".."+to_string(CROWD_MAX_PEOPLE));
+    if (config_.width <= 0 || config_.depth <= 0)
+        throw invalid_argument("floor size must be positive");
+    if (config_.worldRate <= 0 && config_.heartbeatRate <= 0 && config_.omRate <= 0)
+        throw invalid_argument("all packet rates are zero");
+
+    step_ = 1./max((double)SIM_RATE, max(config_.worldRate, config_.omRate));
+    nLanes_ = max(2, (int)(config_.depth/LANE_WIDTH));
+
+    const double never = numeric_limits<double>::infinity();
+    nextWorld_ = (config_.worldRate > 0 ? 0 : never);
+    nextHeartbeat_ = (config_.heartbeatRate > 0 ? 0 : never);
+    nextOm_ = (config_.omRate > 0 ? 0 : never);
+
+    people_.resize(config_.nPeople);
+    for (auto& p:people_)
+        spawn(p, false);
+}
+
+void
+CrowdSim::next(Packet &packet)
+{
+    while (pending_.empty())
+    {
+        double t = min(nextWorld_, min(nextHeartbeat_, nextOm_));
+
+        advance(t);
+
+        if (t == nextWorld_)
+        {
+            emitWorld(t);
+            nextWorld_ = ++worldSeq_/config_.worldRate;
+        }
+        else if (t == nextHeartbeat_)
+        {
+            emitHeartbeat(t);
+            nextHeartbeat_ = ++heartbeatSeq_/config_.heartbeatRate;
+        }
+        else
+        {
+            emitOm(t);
+            nextOm_ = ++omTicks_/config_.omRate;
+        }
+    }
+
+    packet = move(pending_.front());
+    pending_.pop_front();
+}
+
+const TrackTable&
+CrowdSim::getTracks()
+{
+    if (!tracksValid_)
+    {
+        vector<const Person*> sorted;
+
+        sorted.reserve(people_.size());
+        for (auto& p:people_)
+            sorted.push_back(&p);
+        sort(sorted.begin(), sorted.end(),
+             [](const Person* a, const Person* b){ return a->id < b->id; });
+
+        tracks_.clear();
+        for (auto p:sorted)
+            tracks_.append(p->id, p->x, p->y, p->height);
+        tracksValid_ = true;
+    }
+
+    return tracks_;
+}
+
+//******************************************************************************
+static void appendNum(string& s, double v)
+{
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%.6g", v);
+    s.append(buf, len);
+}
+
+static void appendInt(string& s, long v)
+{
+    char buf[24];
+    int len = snprintf(buf, sizeof(buf), "%ld", v);
+    s.append(buf, len);
+}
+
+static void appendPair(string& s, double a, double b)
+{
+    s += '[';
+    appendNum(s, a);
+    s += ", ";
+    appendNum(s, b);
+    s += ']';
+}
+
+void
+CrowdSim::spawn(Person &p, bool atEdge)
+{
+    float w = config_.width, d = config_.depth;
+
+    p.id = nextId_++;
+    p.born = time_;
+    p.height = 1.5f+0.4f*uniform_(rng_);
+    p.confidence = 0.5f+0.5f*uniform_(rng_);
+    p.ax = p.ay = 0;
+
+    if (config_.motion == Lanes)
+    {
+        p.lane = (int)(uniform_(rng_)*nLanes_)%nLanes_;
+
+        float dir = (p.lane%2 ? -1.f : 1.f);
+
+        p.x = (atEdge ? -dir*w/2 : (uniform_(rng_)-.5f)*w);
+        p.y = -d/2+(p.lane+.5f)*d/nLanes_+0.1f*noise_(rng_);
+        p.vx = dir*LANE_SPEED*(0.8f+0.4f*uniform_(rng_));
+        p.vy = 0;
+    }
+    else
+    {
+        p.lane = 0;
+        p.x = (uniform_(rng_)-.5f)*w;
+        p.y = (uniform_(rng_)-.5f)*d;
+        p.vx = 0.3f*noise_(rng_);
+        p.vy = 0.3f*noise_(rng_);
+    }
+}
+
+void
+CrowdSim::advance(double time)
+{
+    while (time_+step_ <= time+1E-9)
+    {
+        step((float)step_);
+        time_ += step_;
+    }
+}
+
+void
+CrowdSim::step(float dt)
+{
+    for (auto& p:people_)
+    {
+        // keep previous velocity in acceleration for now
+        p.ax = p.vx;
+        p.ay = p.vy;
+    }
+
+    switch (config_.motion) {
+        case Flocking: stepFlocking(dt); break;
+        case Lanes: stepLanes(dt); break;
+        default: stepRandomWalk(dt); break;
+    }
+
+    float w = config_.width/2, d = config_.depth/2;
+
+    for (auto& p:people_)
+    {
+        float speed = hypot(p.vx, p.vy);
+
+        if (speed > MAX_SPEED)
+        {
+            p.vx *= MAX_SPEED/speed;
+            p.vy *= MAX_SPEED/speed;
+        }
+
+        p.ax = (p.vx-p.ax)/dt;
+        p.ay = (p.vy-p.ay)/dt;
+        p.x += p.vx*dt;
+        p.y += p.vy*dt;
+
+        if (config_.motion == Lanes && (p.x < -w || p.x > w))
+        {
+            spawn(p, true);
+            continue;
+        }
+
+        // bounce off the walls
+        if (p.x < -w || p.x > w)
+        {
+            p.x = max(-w, min(w, (p.x < -w ? -2*w-p.x : 2*w-p.x)));
+            p.vx = -p.vx;
+        }
+        if (p.y < -d || p.y > d)
+        {
+            p.y = max(-d, min(d, (p.y < -d ? -2*d-p.y : 2*d-p.y)));
+            p.vy = -p.vy;
+        }
+
+        if (config_.churn > 0 && uniform_(rng_) < config_.churn*dt)
+            spawn(p, config_.motion == Lanes);
+    }
+
+    tracksValid_ = false;
+}
+
+void
+CrowdSim::stepRandomWalk(float dt)
+{
+    for (auto& p:people_)
+    {
+        p.vx += (WALK_NOISE*noise_(rng_)-WALK_DAMPING*p.vx)*dt;
+        p.vy += (WALK_NOISE*noise_(rng_)-WALK_DAMPING*p.vy)*dt;
+    }
+}
+
+void
+CrowdSim::stepFlocking(float dt)
+{
+    size_t n = people_.size();
+    float w = config_.width/2, d = config_.depth/2;
+
+    buildGrid(FLOCK_RADIUS);
+    newVx_.resize(n);
+    newVy_.resize(n);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        const Person& p = people_[i];
+        int cx = personCell_[i]%gridCols_, cy = personCell_[i]/gridCols_;
+        float sumX = 0, sumY = 0, sumVx = 0, sumVy = 0, sepX = 0, sepY = 0;
+        int count = 0;
+
+        for (int y = max(0, cy-1); y <= min(gridRows_-1, cy+1); ++y)
+            for (int x = max(0, cx-1); x <= min(gridCols_-1, cx+1); ++x)
+            {
+                int cell = x+y*gridCols_;
+
+                for (int k = cellStart_[cell]; k < cellStart_[cell+1]; ++k)
+                {
+                    const Person& q = people_[cellPeople_[k]];
+                    float dx = p.x-q.x, dy = p.y-q.y, d2 = dx*dx+dy*dy;
+
+                    if ((size_t)cellPeople_[k] == i || d2 > FLOCK_RADIUS*FLOCK_RADIUS)
+                        continue;
+
+                    sumX += q.x;
+                    sumY += q.y;
+                    sumVx += q.vx;
+                    sumVy += q.vy;
+                    count++;
+
+                    if (d2 < FLOCK_SEPARATION*FLOCK_SEPARATION)
+                    {
+                        d2 = max(d2, 1E-4f);
+                        sepX += dx/d2;
+                        sepY += dy/d2;
+                    }
+                }
+            }
+
+        float ax = 0.3f*noise_(rng_), ay = 0.3f*noise_(rng_);
+
+        if (count)
+        {
+            // cohesion, alignment, separation
+            ax += 0.3f*(sumX/count-p.x)+0.8f*(sumVx/count-p.vx)+0.5f*sepX;
+            ay += 0.3f*(sumY/count-p.y)+0.8f*(sumVy/count-p.vy)+0.5f*sepY;
+        }
+
+        if (p.x < -w+FLOCK_WALL) ax += 2;
+        if (p.x > w-FLOCK_WALL) ax -= 2;
+        if (p.y < -d+FLOCK_WALL) ay += 2;
+        if (p.y > d-FLOCK_WALL) ay -= 2;
+
+        newVx_[i] = p.vx+ax*dt;
+        newVy_[i] = p.vy+ay*dt;
+    }
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        people_[i].vx = newVx_[i];
+        people_[i].vy = newVy_[i];
+    }
+}
+
+void
+CrowdSim::stepLanes(float dt)
+{
+    for (auto& p:people_)
+    {
+        float dir = (p.lane%2 ? -1.f : 1.f);
+        float laneY = -config_.depth/2+(p.lane+.5f)*config_.depth/nLanes_;
+
+        p.vx += (0.5f*(dir*LANE_SPEED-p.vx)+0.3f*noise_(rng_))*dt;
+        p.vy += (laneY-p.y-p.vy+0.3f*noise_(rng_))*dt;
+    }
+}
+
+void
+CrowdSim::buildGrid(float cellSize)
+{
+    float w = config_.width/2, d = config_.depth/2;
+    size_t n = people_.size();
+
+    gridCols_ = max(1, (int)ceil(config_.width/cellSize));
+    gridRows_ = max(1, (int)ceil(config_.depth/cellSize));
+    cellStart_.assign(gridCols_*gridRows_+1, 0);
+    cellPeople_.resize(n);
+    personCell_.resize(n);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        int cx = max(0, min(gridCols_-1, (int)((people_[i].x+w)/cellSize)));
+        int cy = max(0, min(gridRows_-1, (int)((people_[i].y+d)/cellSize)));
+
+        personCell_[i] = cx+cy*gridCols_;
+        cellStart_[personCell_[i]+1]++;
+    }
+
+    for (size_t c = 1; c < cellStart_.size(); ++c)
+        cellStart_[c] += cellStart_[c-1];
+
+    // fill each cell's range from its end
+    vector<int> end(cellStart_.begin()+1, cellStart_.end());
+
+    for (size_t i = n; i-- > 0;)
+        cellPeople_[--end[personCell_[i]]] = (int)i;
+}
+
+void
+CrowdSim::emitWorld(double time)
+{
+    buffer_.clear();
+    appendHeader(time, OPT_JSON_WORLD, worldSeq_);
+    buffer_ += ", \"" OPT_JSON_PEOPLE_TRACKS "\": [";
+
+    for (size_t i = 0; i < people_.size(); ++i)
+    {
+        const Person& p = people_[i];
+
+        buffer_ += (i ? ", {\"" : "{\"");
+        buffer_ += OPT_JSON_CONFIDENCE "\": ";
+        appendNum(buffer_, p.confidence);
+        buffer_ += ", \"" OPT_JSON_AGE "\": ";
+        appendNum(buffer_, time_-p.born);
+        buffer_ += ", \"" OPT_JSON_HEIGHT "\": ";
+        appendNum(buffer_, p.height);
+        buffer_ += ", \"" OPT_JSON_Y "\": ";
+        appendNum(buffer_, p.y);
+        buffer_ += ", \"" OPT_JSON_X "\": ";
+        appendNum(buffer_, p.x);
+        buffer_ += ", \"" OPT_JSON_ID "\": ";
+        appendInt(buffer_, p.id);
+        buffer_ += '}';
+    }
+
+    buffer_ += "]}";
+    push(time, OptStream, TagWorld, worldSeq_);
+}
+
+void
+CrowdSim::emitHeartbeat(double time)
+{
+    buffer_.clear();
+    appendHeader(time, OPT_JSON_HEARTBEAT, heartbeatSeq_);
+    buffer_ += ", \"" OPT_JSON_MAXID "\": ";
+    appendInt(buffer_, nextId_-1);
+    buffer_ += ", \"" OPT_JSON_ALIVEIDS "\": [";
+
+    for (size_t i = 0; i < people_.size(); ++i)
+    {
+        if (i)
+            buffer_ += ", ";
+        appendInt(buffer_, people_[i].id);
+    }
+
+    buffer_ += "]}";
+    push(time, OptStream, TagHeartbeat, heartbeatSeq_);
+}
+
+void
+CrowdSim::emitOm(double time)
+{
+    size_t n = people_.size();
+
+    // derivatives
+    appendOmStart(OM_JSON_SUBTYPE_DERS);
+    buffer_ += "\"" OM_JSON_FIRSTDERS "\": [";
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (i) buffer_ += ", ";
+        appendPair(buffer_, people_[i].vx, people_[i].vy);
+    }
+    // like OpenMoves, second derivatives of new tracks are not known yet
+    buffer_ += "], \"" OM_JSON_SECONDDERS "\": [";
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (i) buffer_ += ", ";
+        if (time_-people_[i].born < 2*step_)
+            buffer_ += "[NaN, NaN]";
+        else
+            appendPair(buffer_, people_[i].ax, people_[i].ay);
+    }
+    buffer_ += "], \"" OM_JSON_SPEEDS "\": [";
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (i) buffer_ += ", ";
+        appendNum(buffer_, hypot(people_[i].vx, people_[i].vy));
+    }
+    buffer_ += "], \"" OM_JSON_ACCELERATIONS "\": [";
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (i) buffer_ += ", ";
+        if (time_-people_[i].born < 2*step_)
+            buffer_ += "NaN";
+        else
+            appendNum(buffer_, hypot(people_[i].ax, people_[i].ay));
+    }
+    buffer_ += "]}}";
+    push(time, OmStream, TagDerivatives, omSeq_++);
+
+    // distance: pairwise matrix (small crowds only) and stage edges
+    appendOmStart(OM_JSON_SUBTYPE_DIST);
+    if ((int)n <= config_.pairwiseMax)
+    {
+        buffer_ += "\"" OM_JSON_PAIRWISE "\": [";
+        for (size_t i = 0; i < n; ++i)
+        {
+            buffer_ += (i ? ", [" : "[");
+            for (size_t j = 0; j < n; ++j)
+            {
+                if (j) buffer_ += ", ";
+                appendNum(buffer_, hypot(people_[i].x-people_[j].x, people_[i].y-people_[j].y));
+            }
+            buffer_ += ']';
+        }
+        buffer_ += "], ";
+    }
+    buffer_ += "\"" OM_JSON_STAGEDIST "\": [";
+    for (size_t i = 0; i < n; ++i)
+    {
+        const Person& p = people_[i];
+
+        buffer_ += (i ? ", {\"" : "{\"");
+        buffer_ += OM_JSON_STAGEDIST_US "\": ";
+        appendNum(buffer_, config_.depth/2-p.y);
+        buffer_ += ", \"" OM_JSON_STAGEDIST_DS "\": ";
+        appendNum(buffer_, p.y+config_.depth/2);
+        buffer_ += ", \"" OM_JSON_STAGEDIST_SL "\": ";
+        appendNum(buffer_, p.x+config_.width/2);
+        buffer_ += ", \"" OM_JSON_STAGEDIST_SR "\": ";
+        appendNum(buffer_, config_.width/2-p.x);
+        buffer_ += '}';
+    }
+    buffer_ += "]}}";
+    push(time, OmStream, TagDistance, omSeq_++);
+
+    // clusters, same engine OPT_CHOP uses
+    clusters_.update(getTracks(), config_.clusterRadius, config_.clusterMinSize);
+
+    const ClusterTable& c = clusters_.getClusters();
+
+    appendOmStart(OM_JSON_SUBTYPE_CLUSTER);
+    buffer_ += "\"" OM_JSON_CLUSTERCENTERS "\": [";
+    for (size_t i = 0; i < c.size(); ++i)
+    {
+        if (i) buffer_ += ", ";
+        appendPair(buffer_, c.x[i], c.y[i]);
+    }
+    buffer_ += "], \"" OM_JSON_CLUSTERSPREADS "\": [";
+    for (size_t i = 0; i < c.size(); ++i)
+    {
+        if (i) buffer_ += ", ";
+        appendNum(buffer_, c.spread[i]);
+    }
+    buffer_ += "], \"" OM_JSON_CLUSTER_POINTS "\": [";
+    for (size_t i = 0; i < c.size(); ++i)
+    {
+        buffer_ += (i ? ", [" : "[");
+        for (int m = c.offsets[i]; m < c.offsets[i+1]; ++m)
+        {
+            buffer_ += (m > c.offsets[i] ? ", [" : "[");
+            appendInt(buffer_, (long)c.memberId[m]);
+            buffer_ += ", ";
+            appendNum(buffer_, c.memberX[m]);
+            buffer_ += ", ";
+            appendNum(buffer_, c.memberY[m]);
+            buffer_ += ']';
+        }
+        buffer_ += ']';
+    }
+    buffer_ += "]}}";
+    push(time, OmStream, TagCluster, omSeq_++);
+}
+
+void
+CrowdSim::appendHeader(double time, const char *frameId, int32_t seq)
+{
+    double stamp = config_.startStamp+time;
+    double sec = floor(stamp);
+
+    buffer_ += "{\"" OPT_JSON_HEADER "\": {\"stamp\": {\"sec\": ";
+    appendInt(buffer_, (long)sec);
+    buffer_ += ", \"nsec\": ";
+    appendInt(buffer_, (long)((stamp-sec)*1E9));
+    buffer_ += "}, \"" OPT_JSON_FRAMEID "\": \"";
+    buffer_ += frameId;
+    buffer_ += "\", \"seq\": ";
+    appendInt(buffer_, seq);
+    buffer_ += '}';
+}
+
+void
+CrowdSim::appendOmStart(const char *subtype)
+{
+    buffer_.clear();
+    buffer_ += "{\"" OM_JSON_HEADER "\": {\"" OM_JSON_SEQ "\": ";
+    appendInt(buffer_, omSeq_);
+    buffer_ += "}, \"" OM_JSON_IDS "\": [";
+
+    for (size_t i = 0; i < people_.size(); ++i)
+    {
+        if (i)
+            buffer_ += ", ";
+        appendInt(buffer_, people_[i].id);
+    }
+
+    buffer_ += "], \"" OM_JSON_PACKET "\": {\"" OM_JSON_PACKET_TYPE "\": \"openmoves\", \""
+               OM_JSON_PACKET_VER "\": 1, \"" OM_JSON_SUBTYPE "\": \"";
+    buffer_ += subtype;
+    buffer_ += "\"}, \"" OM_JSON_VALUES "\": {";
+}
+
+void
+CrowdSim::push(double time, Stream stream, CaptureTag tag, int32_t seq)
+{
+    Packet p;
+
+    p.time = time;
+    p.stream = stream;
+    p.tag = tag;
+    p.seq = seq;
+    p.data = buffer_;
+    pending_.push_back(move(p));
+}
@@ -0,0 +1,147 @@
+//
+//  crowd-sim.hpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#ifndef crowd_sim_hpp
+#define crowd_sim_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <random>
+
+#include "capture-file.hpp"
+#include "track-table.hpp"
+#include "cluster-engine.hpp"
+
+#define CROWD_MIN_PEOPLE 1
+#define CROWD_MAX_PEOPLE 5000
+
+/**
+ * Synthetic crowd for load testing. People move on a rectangular floor
+ * centered at the origin by one of the motion models below; the simulation
+ * emits a time ordered stream of datagrams, byte compatible with what OPT
+ * (world tracks, heartbeats) and OpenMoves (derivatives, distance, cluster
+ * packets) send. Same seed and config give the same stream.
+ *
+ * Motion models:
+ *      RandomWalk  damped random acceleration, people bounce off the walls
+ *      Flocking    boids - separation, alignment and cohesion with
+ *                  neighbours found in a uniform grid
+ *      Lanes       counter-flowing lanes along x; people leaving the floor
+ *                  re-enter at the other end with a new id
+ *
+ * People are also replaced (new id, random position) at churn rate, so
+ * consumers see ids appear and disappear as they do with a real tracker.
+ */
+class CrowdSim {
+public:
+    typedef enum _Motion {
+        RandomWalk,
+        Flocking,
+        Lanes
+    } Motion;
+
+    typedef enum _Stream {
+        OptStream,
+        OmStream
+    } Stream;
+
+    typedef struct _Config {
+        int nPeople;
+        Motion motion;
+        // packets per second; 0 disables the stream
+        double worldRate, heartbeatRate, omRate;
+        // floor size, meters
+        float width, depth;
+        // fraction of people replaced per second
+        double churn;
+        // distance packets carry the pairwise matrix only up to this many
+        // people, stage distances are always sent
+        int pairwiseMax;
+        // OM cluster packets
+        float clusterRadius;
+        int clusterMinSize;
+        uint32_t seed;
+        // header stamp of the first packet, seconds since epoch
+        double startStamp;
+    } Config;
+
+    typedef struct _Packet {
+        double time;        // seconds from simulation start
+        Stream stream;
+        CaptureTag tag;
+        int32_t seq;
+        std::string data;
+    } Packet;
+
+    static Config defaultConfig(int nPeople = 100);
+    // "walk", "flock" or "lanes"
+    static bool parseMotion(const std::string& name, Motion& motion);
+    static const char* motionName(Motion motion);
+
+    // throws invalid_argument if config is out of range
+    CrowdSim(const Config& config);
+
+    // next datagram in time order; the stream never ends
+    void next(Packet& packet);
+
+    const Config& getConfig() const { return config_; }
+    double getTime() const { return time_; }
+    // current positions, sorted by id
+    const TrackTable& getTracks();
+
+private:
+    typedef struct _Person {
+        int id;
+        float x, y, vx, vy, ax, ay;
+        float height, confidence;
+        double born;
+        int lane;
+    } Person;
+
+    Config config_;
+    std::mt19937 rng_;
+    std::normal_distribution<float> noise_;
+    std::uniform_real_distribution<float> uniform_;
+
+    std::vector<Person> people_;
+    int nextId_, nLanes_;
+    double time_, step_;
+    // next due time per packet kind
+    double nextWorld_, nextHeartbeat_, nextOm_;
+    int32_t worldSeq_, heartbeatSeq_, omSeq_, omTicks_;
+    std::deque<Packet> pending_;
+
+    // flocking neighbour grid, counting sorted
+    int gridCols_, gridRows_;
+    std::vector<int> cellStart_, cellPeople_, personCell_;
+    std::vector<float> newVx_, newVy_;
+
+    TrackTable tracks_;
+    bool tracksValid_;
+    ClusterEngine clusters_;
+    std::string buffer_;
+
+    void spawn(Person& p, bool atEdge);
+    void advance(double time);
+    void step(float dt);
+    void stepRandomWalk(float dt);
+    void stepFlocking(float dt);
+    void stepLanes(float dt);
+    void buildGrid(float cellSize);
+
+    void emitWorld(double time);
+    void emitHeartbeat(double time);
+    void emitOm(double time);
+    void appendHeader(double time, const char* frameId, int32_t seq);
+    void appendOmStart(const char* subtype);
+    void push(double time, Stream stream, CaptureTag tag, int32_t seq);
+};
+
+#endif /* crowd_sim_hpp */
@@ -0,0 +1,255 @@
+//
+//  host-main.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <cmath>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "chop-host.hpp"
+#include "capture-file.hpp"
+#include "opt-log.hpp"
+
+using namespace std;
+using namespace chrono;
+
+static void usage()
+{
+    cerr << "usage: chop-host [options] <plugin.so> [capture ...]" << endl
+         << "  captures are .opt logs or binary captures (" CAPTURE_EXT ")" << endl
+         << "  -p Name=value  set parameter (menu item name, number or x,y,...)" << endl
+         << "  -d Name=file   table file for DAT parameter" << endl
+         << "  -P Name@N      pulse parameter before cook N (first cook is 0)" << endl
+         << "  -r hz          cook rate (default 60; 0 - as fast as possible)" << endl
+         << "  -n cooks       number of cooks (default: until all datagrams are fed)" << endl
+         << "  -b count       datagrams fed before each cook (default 1)" << endl
+         << "  -l             loop datagrams" << endl
+         << "  -u port        send datagrams to 127.0.0.1:port instead of feeding in-process" << endl
+         << "  -o file        write output of the last cook (channel per column)" << endl
+         << "  -v             print info channels, warnings and errors after every cook" << endl;
+}
+
+static bool splitArg(const string& arg, char sep, string& a, string& b)
+{
+    size_t pos = arg.find(sep);
+
+    if (pos == string::npos || pos == 0)
+        return false;
+
+    a = arg.substr(0, pos);
+    b = arg.substr(pos+1);
+    return true;
+}
+
+static double percentile(vector<double>& v, double p)
+{
+    if (v.empty())
+        return 0;
+
+    size_t k = min(v.size()-1, (size_t)(p*(v.size()-1)+0.5));
+    nth_element(v.begin(), v.begin()+k, v.end());
+    return v[k];
+}
+
+static void printTimes(const char* what, vector<double> v)
+{
+    double sum = 0;
+    for (auto t:v) sum += t;
+
+    cout << what << " us: mean " << (v.size() ? sum/v.size() : 0)
+         << " p50 " << percentile(v, .5)
+         << " p99 " << percentile(v, .99)
+         << " max " << (v.size() ? *max_element(v.begin(), v.end()) : 0) << endl;
+}
+
+static void printState(const ChopHost& host)
+{
+    for (auto& c:host.getInfoChannels())
+        cout << c.first << "=" << c.second << " ";
+    cout << endl;
+
+    if (host.getWarning().size())
+        cout << "warning: " << host.getWarning() << endl;
+    if (host.getError().size())
+        cout << "error: " << host.getError() << endl;
+}
+
+static void writeOutput(const ChopHost& host, const string& path)
+{
+    ofstream f(path);
+    const CHOP_Output& output = host.getOutput();
+
+    for (int c = 0; c < output.numChannels; ++c)
+        f << (c ? "\t" : "") << host.getChannelNames()[c];
+    f << endl;
+
+    for (int i = 0; i < output.numSamples; ++i)
+    {
+        for (int c = 0; c < output.numChannels; ++c)
+            f << (c ? "\t" : "") << output.channels[c][i];
+        f << endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    vector<pair<string, string>> pars, dats;
+    vector<pair<int, string>> pulses;
+    double rate = 60;
+    long nCooks = -1;
+    int perCook = 1, udpPort = 0;
+    bool loop = false, verbose = false;
+    string outputPath;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:d:P:r:n:b:lu:o:v")) != -1)
+    {
+        string a, b;
+
+        switch (opt) {
+            case 'p':
+                if (!splitArg(optarg, '=', a, b)) { usage(); return 1; }
+                pars.push_back(make_pair(a, b));
+                break;
+            case 'd':
+                if (!splitArg(optarg, '=', a, b)) { usage(); return 1; }
+                dats.push_back(make_pair(a, b));
+                break;
+            case 'P':
+                if (!splitArg(optarg, '@', a, b)) { usage(); return 1; }
+                pulses.push_back(make_pair(atoi(b.c_str()), a));
+                break;
+            case 'r': rate = atof(optarg); break;
+            case 'n': nCooks = atol(optarg); break;
+            case 'b': perCook = max(0, atoi(optarg)); break;
+            case 'l': loop = true; break;
+            case 'u': udpPort = atoi(optarg); break;
+            case 'o': outputPath = optarg; break;
+            case 'v': verbose = true; break;
+            default: usage(); return 1;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        usage();
+        return 1;
+    }
+
+    try
+    {
+        vector<string> datagrams;
+        for (int i = optind+1; i < argc; ++i)
+            if (CaptureReader::isCapture(argv[i]))
+            {
+                CaptureReader reader(argv[i]);
+                for (size_t r = 0; r < reader.size(); ++r)
+                    datagrams.push_back(string(reader.getPayload(r), reader.getHeader(r).length));
+            }
+            else
+                loadOptLog(argv[i], datagrams);
+
+        if (nCooks < 0)
+            nCooks = (perCook && datagrams.size() ? (datagrams.size()+perCook-1)/perCook : 1);
+        if (loop && datagrams.empty())
+            loop = false;
+
+        ChopHost host(argv[optind]);
+
+        for (auto& p:pars) host.setPar(p.first, p.second);
+        for (auto& d:dats) host.setDat(d.first, d.second);
+
+        int sock = -1;
+        struct sockaddr_in dest;
+
+        if (udpPort)
+        {
+            memset(&dest, 0, sizeof(dest));
+            dest.sin_family = AF_INET;
+            dest.sin_port = htons(udpPort);
+            dest.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+            if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+                throw runtime_error("can't create socket");
+        }
+
+        vector<double> cookTimes, executeTimes;
+        size_t next = 0, nFed = 0;
+        steady_clock::time_point start = steady_clock::now(), tick = start;
+        duration<double> period(rate > 0 ? 1./rate : 0);
+
+        cookTimes.reserve(nCooks);
+        executeTimes.reserve(nCooks);
+
+        for (long cookNo = 0; cookNo < nCooks; ++cookNo)
+        {
+            for (int i = 0; i < perCook && next < datagrams.size(); ++i)
+            {
+                const string& d = datagrams[next];
+
+                if (udpPort)
+                    sendto(sock, d.data(), d.size(), 0, (struct sockaddr*)&dest, sizeof(dest));
+                else
+                    host.feed(d.data(), d.size());
+
+                nFed++;
+                if (++next == datagrams.size() && loop)
+                    next = 0;
+            }
+
+            for (auto& p:pulses)
+                if (p.first == cookNo)
+                    host.pulse(p.second);
+
+            ChopHost::CookStats stats = host.cook();
+            cookTimes.push_back(stats.cookUs);
+            executeTimes.push_back(stats.executeUs);
+
+            if (verbose)
+            {
+                cout << "cook " << cookNo << ": ";
+                printState(host);
+            }
+
+            if (rate > 0)
+            {
+                tick += duration_cast<steady_clock::duration>(period);
+                this_thread::sleep_until(tick);
+            }
+        }
+
+        double elapsed = duration_cast<duration<double>>(steady_clock::now()-start).count();
+
+        if (sock >= 0)
+            close(sock);
+
+        cout << "cooks " << nCooks << " datagrams " << nFed
+             << " seconds " << elapsed << endl;
+        printTimes("cook", cookTimes);
+        printTimes("execute", executeTimes);
+        printState(host);
+
+        if (outputPath.size())
+            writeOutput(host, outputPath);
+
+        return (host.getError().size() ? 2 : 0);
+    }
+    catch (exception& e)
+    {
+        cerr << "chop-host: " << e.what() << endl;
+        return 1;
+    }
+}
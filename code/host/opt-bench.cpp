@@ -0,0 +1,589 @@
+//
+//  opt-bench.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include <unistd.h>
+
+#include "rapidjson/document.h"
+
+#include "JsonSocketReader.hpp"
+#include "o-base.hpp"
+#include "om-json-parser.hpp"
+#include "binary-frame.hpp"
+#include "defines.h"
+#include "chop-host.hpp"
+#include "opt-log.hpp"
+#include "crowd-sim.hpp"
+
+#define DEFAULT_MIN_SECONDS 0.3
+#define SYNTHETIC_FRAMES 300
+#define OM_MAXMATSIZE 25
+#define OPT_MAXTRACKED 25
+
+using namespace std;
+using namespace chrono;
+
+//******************************************************************************
+// every heap allocation of the process is counted, including rapidjson's
+// (malloc based) and the ones made inside the plugin
+static atomic<uint64_t> NumAllocs(0), NumBytes(0);
+
+#ifdef __GLIBC__
+extern "C" {
+    void* __libc_malloc(size_t);
+    void* __libc_calloc(size_t, size_t);
+    void* __libc_realloc(void*, size_t);
+    void __libc_free(void*);
+
+    void* malloc(size_t n)
+    {
+        NumAllocs.fetch_add(1, memory_order_relaxed);
+        NumBytes.fetch_add(n, memory_order_relaxed);
+        return __libc_malloc(n);
+    }
+
+    void* calloc(size_t n, size_t size)
+    {
+        NumAllocs.fetch_add(1, memory_order_relaxed);
+        NumBytes.fetch_add(n*size, memory_order_relaxed);
+        return __libc_calloc(n, size);
+    }
+
+    void* realloc(void* p, size_t n)
+    {
+        NumAllocs.fetch_add(1, memory_order_relaxed);
+        NumBytes.fetch_add(n, memory_order_relaxed);
+        return __libc_realloc(p, n);
+    }
+
+    void free(void* p)
+    {
+        __libc_free(p);
+    }
+}
+#endif
+
+//******************************************************************************
+typedef enum _InputKind {
+    OptInput,
+    OmInput
+} InputKind;
+
+typedef struct _Input {
+    string name;
+    InputKind kind;
+    vector<string> datagrams;
+} Input;
+
+typedef struct _Result {
+    string input, stage;
+    size_t packets;
+    double nsPerPacket, allocsPerPacket, bytesPerPacket;
+} Result;
+
+/**
+ * Counts time and allocations of measured sections, per packet.
+ */
+class Meter {
+public:
+    Meter():packets_(0), ns_(0), allocs_(0), bytes_(0) {}
+
+    void begin()
+    {
+        allocs0_ = NumAllocs;
+        bytes0_ = NumBytes;
+        t0_ = steady_clock::now();
+    }
+
+    void end(size_t packets)
+    {
+        steady_clock::time_point t1 = steady_clock::now();
+
+        ns_ += duration_cast<nanoseconds>(t1-t0_).count();
+        allocs_ += NumAllocs-allocs0_;
+        bytes_ += NumBytes-bytes0_;
+        packets_ += packets;
+    }
+
+    void reset() { packets_ = 0; ns_ = allocs_ = bytes_ = 0; }
+
+    Result result(const string& input, const string& stage) const
+    {
+        Result r;
+        double n = (packets_ ? (double)packets_ : 1.);
+
+        r.input = input;
+        r.stage = stage;
+        r.packets = packets_;
+        r.nsPerPacket = ns_/n;
+        r.allocsPerPacket = allocs_/n;
+        r.bytesPerPacket = bytes_/n;
+        return r;
+    }
+
+private:
+    size_t packets_;
+    uint64_t ns_, allocs_, bytes_, allocs0_, bytes0_;
+    steady_clock::time_point t0_;
+};
+
+/**
+ * OBase is only driven through its protected interface, the way CHOPs do.
+ */
+class BenchBase : public OBase {
+public:
+    BenchBase():OBase(1, 0), nBundles_(0) {}
+
+    void push(const JsonDocumentPtr& d) { onNewJsonObjectReceived(d); }
+
+    void process()
+    {
+        processQueue();
+        processBundle([this](const Bundle& b){ nBundles_ += b.size(); });
+    }
+
+private:
+    size_t nBundles_;
+};
+
+//******************************************************************************
+static void usage()
+{
+    cerr << "usage: opt-bench [options] [log.opt ...]" << endl
+         << "  runs every stage over every log and synthetic 100 and 1000 person frames" << endl
+         << "  -m seconds   minimal measured time per stage and input (default " << DEFAULT_MIN_SECONDS << ")" << endl
+         << "  -p plugin    OPT_CHOP plugin for opt-execute stage (default build/OPT_CHOP.so)" << endl
+         << "  -s stages    comma separated stages to run (default all)" << endl
+         << "  -o file      write results as JSON" << endl
+         << "  -c file      compare with results of an earlier run (written by -o)" << endl
+         << "stages: nan-rewrite parse copy ingest ingest-binary obase om-parse om-subtypes" << endl
+         << "        opt-execute execute-binary" << endl;
+}
+
+static string inputName(const string& path)
+{
+    size_t slash = path.rfind('/');
+    string name = (slash == string::npos ? path : path.substr(slash+1));
+    size_t dot = name.rfind('.');
+
+    return (dot == string::npos ? name : name.substr(0, dot));
+}
+
+// crowd generator's OPT stream: world frames and heartbeats
+static Input syntheticOpt(int nPeople)
+{
+    CrowdSim::Config config = CrowdSim::defaultConfig(nPeople);
+    CrowdSim sim(config);
+    CrowdSim::Packet packet;
+    Input in;
+
+    in.name = "synthetic-"+to_string(nPeople);
+    in.kind = OptInput;
+
+    while (in.datagrams.size() < SYNTHETIC_FRAMES)
+    {
+        sim.next(packet);
+        in.datagrams.push_back(packet.data);
+    }
+
+    return in;
+}
+
+// crowd generator's OM stream: derivatives, distance and cluster packets
+static Input syntheticOm(int nPeople)
+{
+    CrowdSim::Config config = CrowdSim::defaultConfig(nPeople);
+    Input in;
+
+    config.worldRate = 0;
+    config.heartbeatRate = 0;
+    config.omRate = 30;
+    config.churn = 0.2; // fresh tracks have NaN accelerations
+
+    CrowdSim sim(config);
+    CrowdSim::Packet packet;
+
+    in.name = "om-"+to_string(nPeople);
+    in.kind = OmInput;
+
+    while (in.datagrams.size() < SYNTHETIC_FRAMES)
+    {
+        sim.next(packet);
+        in.datagrams.push_back(packet.data);
+    }
+
+    return in;
+}
+
+// runs pass() until at least minSeconds were measured; first pass is a warm up
+static Result run(const Input& in, const string& stage, double minSeconds,
+                  function<void(Meter&)> pass)
+{
+    Meter meter;
+    steady_clock::time_point start;
+
+    pass(meter);
+    meter.reset();
+    start = steady_clock::now();
+
+    do {
+        pass(meter);
+    } while (duration_cast<duration<double>>(steady_clock::now()-start).count() < minSeconds);
+
+    return meter.result(in.name, stage);
+}
+
+static vector<JsonDocumentPtr> parseAll(const Input& in)
+{
+    vector<JsonDocumentPtr> docs;
+    string error;
+
+    for (auto& d:in.datagrams)
+    {
+        JsonDocumentPtr doc = JsonSocketReader::parse(d.data(), d.size(), error);
+        if (doc)
+            docs.push_back(doc);
+    }
+
+    return docs;
+}
+
+static void benchInput(const Input& in, const set<string>& stages, double minSeconds,
+                       const string& pluginPath, vector<Result>& results)
+{
+    vector<string> rewritten;
+    vector<JsonDocumentPtr> docs = parseAll(in);
+    vector<string> binary;
+
+    for (auto& d:in.datagrams)
+        rewritten.push_back(do_replace(d, "NaN", "\"Null\""));
+
+    // same OPT frames as binary frames, for the binary stages
+    if (in.kind == OptInput)
+        for (auto& d:docs)
+        {
+            string packed;
+            if (transcodeJson(*d, packed))
+                binary.push_back(packed);
+        }
+
+    if (stages.count("nan-rewrite"))
+        results.push_back(run(in, "nan-rewrite", minSeconds, [&](Meter& m){
+            m.begin();
+            for (auto& d:in.datagrams)
+                do_replace(d, "NaN", "\"Null\"");
+            m.end(in.datagrams.size());
+        }));
+
+    if (stages.count("parse"))
+        results.push_back(run(in, "parse", minSeconds, [&](Meter& m){
+            m.begin();
+            for (auto& json:rewritten)
+            {
+                rapidjson::Document d;
+                d.Parse(json.c_str());
+            }
+            m.end(rewritten.size());
+        }));
+
+    if (stages.count("copy"))
+        results.push_back(run(in, "copy", minSeconds, [&](Meter& m){
+            m.begin();
+            for (auto& src:docs)
+            {
+                rapidjson::Document d;
+                d.CopyFrom(*src, d.GetAllocator());
+            }
+            m.end(docs.size());
+        }));
+
+    // whole socket reader path: rewrite, parse and shared document
+    if (stages.count("ingest"))
+        results.push_back(run(in, "ingest", minSeconds, [&](Meter& m){
+            string error;
+            m.begin();
+            for (auto& d:in.datagrams)
+                JsonSocketReader::parse(d.data(), d.size(), error);
+            m.end(in.datagrams.size());
+        }));
+
+    // same path for binary frames transcoded from the input, with decoding
+    // of packed tracks as done by OPT_CHOP
+    if (stages.count("ingest-binary") && binary.size())
+    {
+        TrackRecords records;
+
+        results.push_back(run(in, "ingest-binary", minSeconds, [&](Meter& m){
+            string error;
+            m.begin();
+            for (auto& d:binary)
+            {
+                JsonDocumentPtr doc = JsonSocketReader::parse(d.data(), d.size(), error);
+                if (doc)
+                    unpackTracks(*doc, records);
+            }
+            m.end(binary.size());
+        }));
+    }
+
+    if (stages.count("obase"))
+    {
+        BenchBase base;
+        results.push_back(run(in, "obase", minSeconds, [&](Meter& m){
+            m.begin();
+            for (auto& d:docs)
+            {
+                base.push(d);
+                base.process();
+            }
+            m.end(docs.size());
+        }));
+    }
+
+    if (stages.count("om-parse") && in.kind == OmInput)
+    {
+        OmJsonParser parser(OM_MAXMATSIZE);
+        set<string> subtypes;
+        OBase::Bundle bundle(1);
+
+        results.push_back(run(in, "om-parse", minSeconds, [&](Meter& m){
+            m.begin();
+            for (auto& d:docs)
+            {
+                bundle[0] = d;
+                subtypes.clear();
+                parser.parse(bundle, subtypes);
+            }
+            m.end(docs.size());
+        }));
+    }
+
+    // OM_CHOP parses only the subtype of its output, so every CHOP showing
+    // one output parses the whole bundle; crowd's OM ticks are bundles of
+    // derivatives, distance and cluster packets
+    if (stages.count("om-subtypes") && in.kind == OmInput)
+    {
+        static const char* subtypes[] = { OM_JSON_SUBTYPE_DERS, OM_JSON_SUBTYPE_DIST, OM_JSON_SUBTYPE_CLUSTER };
+        const size_t nSubtypes = sizeof(subtypes)/sizeof(subtypes[0]);
+        OmJsonParser parser(OM_MAXMATSIZE);
+        set<string> parsed;
+        OBase::Bundle bundle(nSubtypes);
+
+        // one result per subtype, as their parse costs differ a lot
+        for (auto st:subtypes)
+            results.push_back(run(in, string("om-subtypes/")+st, minSeconds, [&](Meter& m){
+                for (size_t i = 0; i+nSubtypes <= docs.size(); i += nSubtypes)
+                {
+                    copy(docs.begin()+i, docs.begin()+i+nSubtypes, bundle.begin());
+                    m.begin();
+                    parsed.clear();
+                    parser.parse(bundle, parsed, st);
+                    m.end(1);
+                }
+            }));
+    }
+
+    // track extraction is part of OPT_CHOP::execute, so execute is measured
+    // (queue, bundle, extraction and Tracks output); feeding is not
+    // execute-binary is the same for binary frames
+    const pair<string, const vector<string>*> executeStages[] = {
+        { "opt-execute", &in.datagrams }, { "execute-binary", &binary }
+    };
+
+    for (auto& st:executeStages)
+        if (stages.count(st.first) && in.kind == OptInput && st.second->size() && pluginPath.size())
+        {
+            try
+            {
+                ChopHost host(pluginPath);
+                host.setPar("Maxtracked", to_string(OPT_MAXTRACKED));
+
+                if (!host.canFeed())
+                    throw runtime_error("plugin is not built for the host");
+
+                results.push_back(run(in, st.first, minSeconds, [&](Meter& m){
+                    host.setExecuteProbe([&m](bool begin){
+                        if (begin)
+                            m.begin();
+                        else
+                            m.end(1);
+                    });
+                    for (auto& d:*st.second)
+                    {
+                        host.feed(d.data(), d.size());
+                        host.cook();
+                    }
+                }));
+            }
+            catch (exception& e)
+            {
+                cerr << "opt-bench: " << st.first << " skipped: " << e.what() << endl;
+            }
+        }
+}
+
+static void writeJson(const vector<Result>& results, const string& path)
+{
+    ofstream f(path);
+
+    f << "{\"benchmark\": \"opt-bench\", \"version\": 1, \"results\": [" << endl;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& r = results[i];
+
+        f << "  {\"input\": \"" << r.input << "\", \"stage\": \"" << r.stage
+          << "\", \"packets\": " << r.packets
+          << ", \"ns_per_packet\": " << r.nsPerPacket
+          << ", \"allocs_per_packet\": " << r.allocsPerPacket
+          << ", \"bytes_per_packet\": " << r.bytesPerPacket << "}"
+          << (i+1 < results.size() ? "," : "") << endl;
+    }
+    f << "]}" << endl;
+
+    if (!f)
+        throw runtime_error("can't write "+path);
+}
+
+// results written by writeJson, by input and stage; throws runtime_error if
+// file can't be read
+static map<pair<string, string>, Result> readJson(const string& path)
+{
+    ifstream f(path);
+    stringstream ss;
+    rapidjson::Document d;
+    map<pair<string, string>, Result> results;
+
+    ss << f.rdbuf();
+    if (!f || d.Parse(ss.str().c_str()).HasParseError() || !d.IsObject() ||
+        !d.HasMember("results") || !d["results"].IsArray())
+        throw runtime_error("can't read results "+path);
+
+    for (auto& v:d["results"].GetArray())
+    {
+        Result r;
+
+        r.input = v["input"].GetString();
+        r.stage = v["stage"].GetString();
+        r.packets = v["packets"].GetUint64();
+        r.nsPerPacket = v["ns_per_packet"].GetDouble();
+        r.allocsPerPacket = v["allocs_per_packet"].GetDouble();
+        r.bytesPerPacket = v["bytes_per_packet"].GetDouble();
+        results[make_pair(r.input, r.stage)] = r;
+    }
+
+    return results;
+}
+
+int main(int argc, char **argv)
+{
+    double minSeconds = DEFAULT_MIN_SECONDS;
+    string pluginPath = "build/OPT_CHOP.so", outputPath, basePath;
+    set<string> stages = { "nan-rewrite", "parse", "copy", "ingest", "ingest-binary", "obase", "om-parse",
+                           "om-subtypes", "opt-execute", "execute-binary" };
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:p:s:o:c:")) != -1)
+    {
+        switch (opt) {
+            case 'm': minSeconds = atof(optarg); break;
+            case 'p': pluginPath = optarg; break;
+            case 's':
+            {
+                stringstream ss(optarg);
+                string s;
+
+                stages.clear();
+                while (getline(ss, s, ','))
+                    stages.insert(s);
+            }
+                break;
+            case 'o': outputPath = optarg; break;
+            case 'c': basePath = optarg; break;
+            default: usage(); return 1;
+        }
+    }
+
+    try
+    {
+        vector<Input> inputs;
+
+        for (int i = optind; i < argc; ++i)
+        {
+            Input in;
+            in.name = inputName(argv[i]);
+            in.kind = OptInput;
+            loadOptLog(argv[i], in.datagrams);
+            inputs.push_back(in);
+        }
+
+        inputs.push_back(syntheticOpt(100));
+        inputs.push_back(syntheticOpt(1000));
+        inputs.push_back(syntheticOm(100));
+        inputs.push_back(syntheticOm(1000));
+
+        vector<Result> results;
+        map<pair<string, string>, Result> base;
+
+        if (basePath.size())
+            base = readJson(basePath);
+
+        cout << left << setw(20) << "input" << setw(24) << "stage" << right
+             << setw(14) << "ns/packet" << setw(14) << "allocs/packet"
+             << setw(14) << "bytes/packet";
+        if (basePath.size())
+            cout << setw(14) << "base ns" << setw(14) << "base allocs" << setw(10) << "time";
+        cout << endl;
+
+        for (auto& in:inputs)
+        {
+            size_t first = results.size();
+            benchInput(in, stages, minSeconds, pluginPath, results);
+
+            for (size_t i = first; i < results.size(); ++i)
+            {
+                cout << left << setw(20) << results[i].input << setw(24) << results[i].stage
+                     << right << fixed << setprecision(0)
+                     << setw(14) << results[i].nsPerPacket
+                     << setprecision(1) << setw(14) << results[i].allocsPerPacket
+                     << setprecision(0) << setw(14) << results[i].bytesPerPacket;
+
+                // time is relative to the earlier run, 0.5 is twice as fast
+                auto it = base.find(make_pair(results[i].input, results[i].stage));
+                if (it != base.end())
+                    cout << setprecision(0) << setw(14) << it->second.nsPerPacket
+                         << setprecision(1) << setw(14) << it->second.allocsPerPacket
+                         << setprecision(2) << setw(10)
+                         << results[i].nsPerPacket/max(it->second.nsPerPacket, 1.);
+                cout << endl;
+            }
+        }
+
+        if (outputPath.size())
+            writeJson(results, outputPath);
+
+        return 0;
+    }
+    catch (exception& e)
+    {
+        cerr << "opt-bench: " << e.what() << endl;
+        return 1;
+    }
+}
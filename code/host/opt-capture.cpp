@@ -0,0 +1,241 @@
+//
+//  opt-capture.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstring>
+
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "rapidjson/document.h"
+
+#include "capture-file.hpp"
+#include "binary-frame.hpp"
+#include "opt-log.hpp"
+
+#define DEFAULT_RATE 30     // packets per second for logs without stamps
+
+using namespace std;
+
+static const char* TagNames[NCaptureTags] = {
+    "unknown", "world", "heartbeat", "derivatives", "distance", "cluster",
+    "massdynamics", "similarity"
+};
+
+static void usage()
+{
+    cerr << "usage: opt-capture convert [-b] <log.opt> [capture" CAPTURE_EXT "]" << endl
+         << "       opt-capture info <capture" CAPTURE_EXT ">" << endl
+         << "       opt-capture dump [-t seconds | -q tag:seq] [-c count] <capture" CAPTURE_EXT ">" << endl
+         << "convert: receive times are taken from header stamps; source addresses" << endl
+         << "         from \"ip:port -\" lines of the log; -b stores OPT world frames and" << endl
+         << "         heartbeats as binary frames (see src/binary-frame.hpp)" << endl
+         << "dump:    prints records starting at time offset (-t) or at tag and seq (-q)" << endl;
+}
+
+static void parseSource(const string& source, uint32_t& addr, uint16_t& port)
+{
+    size_t pos = source.rfind(':');
+
+    addr = 0;
+    port = 0;
+
+    if (pos != string::npos)
+    {
+        struct in_addr a;
+        if (inet_pton(AF_INET, source.substr(0, pos).c_str(), &a) == 1)
+            addr = a.s_addr;
+        port = (uint16_t)atoi(source.c_str()+pos+1);
+    }
+}
+
+static string sourceString(const CaptureRecordHeader& h)
+{
+    char buf[INET_ADDRSTRLEN] = "";
+    struct in_addr a;
+
+    a.s_addr = h.srcAddr;
+    inet_ntop(AF_INET, &a, buf, sizeof(buf));
+
+    return string(buf)+":"+to_string(h.srcPort);
+}
+
+static int convert(const string& in, string out, bool binary)
+{
+    vector<string> datagrams, sources;
+    loadOptLog(in, datagrams, &sources);
+
+    if (out.empty())
+    {
+        size_t dot = in.rfind('.');
+        out = (dot == string::npos ? in : in.substr(0, dot))+CAPTURE_EXT;
+    }
+
+    CaptureWriter writer;
+    writer.open(out);
+
+    int64_t lastTime = 0;
+    bool hasStamps = false;
+    size_t nBinary = 0;
+    string packed;
+
+    for (size_t i = 0; i < datagrams.size(); ++i)
+    {
+        CaptureRecordHeader h;
+        rapidjson::Document d;
+        int32_t seq;
+
+        memset(&h, 0, sizeof(h));
+        d.Parse<rapidjson::kParseNanAndInfFlag>(datagrams[i].c_str());
+
+        h.length = (uint32_t)datagrams[i].size();
+        h.tag = (uint8_t)(d.HasParseError() ? TagUnknown : captureTag(d, seq));
+        h.seq = (d.HasParseError() ? -1 : seq);
+        parseSource(sources[i], h.srcAddr, h.srcPort);
+
+        double stamp = packetStamp(datagrams[i]);
+        if (stamp >= 0)
+        {
+            hasStamps = true;
+            lastTime = (int64_t)llround(stamp*1E9);
+        }
+        else if (!hasStamps)
+            lastTime = (int64_t)(i*1E9/DEFAULT_RATE);
+        h.recvTimeNs = lastTime;
+
+        if (binary && !d.HasParseError() && transcodeJson(d, packed))
+        {
+            h.length = (uint32_t)packed.size();
+            if (!writer.write(h, packed.data()))
+                throw runtime_error("write error on "+out);
+            nBinary++;
+        }
+        else if (!writer.write(h, datagrams[i].data()))
+            throw runtime_error("write error on "+out);
+    }
+
+    writer.close();
+    cout << in << " -> " << out << ": " << datagrams.size() << " datagrams, "
+         << writer.getBytesWritten() << " bytes";
+    if (binary)
+        cout << ", " << nBinary << " binary";
+    cout << endl;
+
+    return 0;
+}
+
+static int info(const string& path)
+{
+    CaptureReader reader(path);
+    size_t counts[NCaptureTags] = {0};
+    uint64_t bytes = 0;
+
+    for (size_t i = 0; i < reader.size(); ++i)
+    {
+        counts[reader.getHeader(i).tag]++;
+        bytes += reader.getHeader(i).length;
+    }
+
+    double duration = (reader.getEndTime()-reader.getStartTime())/1E9;
+
+    cout << path << (reader.wasRecovered() ? " (no index, recovered)" : "") << endl
+         << "records " << reader.size() << " payload bytes " << bytes
+         << " duration " << duration << " s";
+    if (duration > 0)
+        cout << " (" << reader.size()/duration << " per s)";
+    cout << endl;
+
+    for (int t = 0; t < NCaptureTags; ++t)
+        if (counts[t])
+            cout << "  " << TagNames[t] << " " << counts[t] << endl;
+
+    return 0;
+}
+
+static int dump(const string& path, double fromSec, const string& tagSeq, long count)
+{
+    CaptureReader reader(path);
+    size_t first = 0;
+
+    if (tagSeq.size())
+    {
+        size_t pos = tagSeq.find(':');
+        int tag = 0;
+
+        while (tag < NCaptureTags && tagSeq.substr(0, pos) != TagNames[tag])
+            ++tag;
+        if (pos == string::npos || tag == NCaptureTags)
+            throw runtime_error("bad tag:seq "+tagSeq);
+
+        first = reader.seekSeq((CaptureTag)tag, atoi(tagSeq.c_str()+pos+1));
+    }
+    else
+        first = reader.seekTime(reader.getStartTime()+(int64_t)(fromSec*1E9));
+
+    for (size_t i = first; i < reader.size() && (count < 0 || (long)(i-first) < count); ++i)
+    {
+        const CaptureRecordHeader& h = reader.getHeader(i);
+
+        cout << i << " " << (reader.getTime(i)-reader.getStartTime())/1E9
+             << " " << TagNames[h.tag] << " " << h.seq << " " << sourceString(h) << " ";
+        if (isBinaryFrame(reader.getPayload(i), h.length))
+            cout << "[binary frame, " << h.length << " bytes]" << endl;
+        else
+            cout << string(reader.getPayload(i), h.length) << endl;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        usage();
+        return 1;
+    }
+
+    string command(argv[1]);
+    double fromSec = 0;
+    long count = -1;
+    string tagSeq;
+    bool binary = false;
+    int opt;
+
+    optind = 2;
+    while ((opt = getopt(argc, argv, "t:q:c:b")) != -1)
+    {
+        switch (opt) {
+            case 't': fromSec = atof(optarg); break;
+            case 'q': tagSeq = optarg; break;
+            case 'c': count = atol(optarg); break;
+            case 'b': binary = true; break;
+            default: usage(); return 1;
+        }
+    }
+
+    try
+    {
+        if (command == "convert" && optind < argc)
+            return convert(argv[optind], (optind+1 < argc ? argv[optind+1] : ""), binary);
+        if (command == "info" && optind < argc)
+            return info(argv[optind]);
+        if (command == "dump" && optind < argc)
+            return dump(argv[optind], fromSec, tagSeq, count);
+    }
+    catch (exception& e)
+    {
+        cerr << "opt-capture: " << e.what() << endl;
+        return 1;
+    }
+
+    usage();
+    return 1;
+}
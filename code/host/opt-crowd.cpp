@@ -0,0 +1,265 @@
+//
+//  opt-crowd.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "crowd-sim.hpp"
+
+#define MAX_DATAGRAM 65507  // largest IPv4 UDP payload
+
+using namespace std;
+using namespace chrono;
+
+static void usage()
+{
+    CrowdSim::Config c = CrowdSim::defaultConfig();
+
+    cerr << "usage: opt-crowd [options]" << endl
+         << "  sends a synthetic crowd as OPT and OpenMoves datagrams" << endl
+         << "  -N people      crowd size, " << CROWD_MIN_PEOPLE << ".." << CROWD_MAX_PEOPLE
+         << " (default " << c.nPeople << ")" << endl
+         << "  -m motion      walk, flock or lanes (default walk)" << endl
+         << "  -r hz          world frames per second (default " << c.worldRate << ")" << endl
+         << "  -H hz          heartbeats per second (default " << c.heartbeatRate << ")" << endl
+         << "  -O hz          OpenMoves derivatives, distance and cluster packets" << endl
+         << "                 per second (default 0 - off)" << endl
+         << "  -W meters      floor width and depth as WxD (default scales with crowd)" << endl
+         << "  -c rate        fraction of people replaced per second (default " << c.churn << ")" << endl
+         << "  -S seed        random seed (default " << c.seed << ")" << endl
+         << "  -t host:port   OPT destination (default 127.0.0.1:21234)" << endl
+         << "  -T host:port   OpenMoves destination (default 127.0.0.1:21235)" << endl
+         << "  -d seconds     simulated duration (default 0 - forever)" << endl
+         << "  -s speed       speed relative to real time (default 1; 0 - as fast as possible)" << endl
+         << "  -w file        write OPT datagrams to a capture instead of sending" << endl
+         << "  -o file        write OpenMoves datagrams to a capture instead of sending" << endl
+         << "  -v             report rates every second" << endl
+         << "datagrams larger than " << MAX_DATAGRAM << " bytes are counted and not sent" << endl;
+}
+
+static bool resolve(const string& dest, struct sockaddr_in& addr)
+{
+    size_t pos = dest.rfind(':');
+    string host = (pos == string::npos ? dest : dest.substr(0, pos));
+    int port = atoi(dest.c_str()+pos+1);
+    struct addrinfo hints, *res = nullptr;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    if (pos == string::npos || getaddrinfo(host.c_str(), nullptr, &hints, &res) != 0 || !res)
+        return false;
+
+    addr = *(struct sockaddr_in*)res->ai_addr;
+    addr.sin_port = htons(port);
+    freeaddrinfo(res);
+
+    return true;
+}
+
+typedef struct _Output {
+    const char *name;
+    string dest;
+    struct sockaddr_in addr;
+    string capturePath;
+    CaptureWriter capture;
+    size_t nPackets, nBytes, nOversize, nErrors;
+} Output;
+
+int main(int argc, char **argv)
+{
+    CrowdSim::Config config = CrowdSim::defaultConfig();
+    bool sizeSet = false, verbose = false;
+    double simDuration = 0, speed = 1;
+    Output outputs[2];
+    int opt;
+
+    outputs[CrowdSim::OptStream].name = "opt";
+    outputs[CrowdSim::OptStream].dest = "127.0.0.1:21234";
+    outputs[CrowdSim::OmStream].name = "om";
+    outputs[CrowdSim::OmStream].dest = "127.0.0.1:21235";
+
+    while ((opt = getopt(argc, argv, "N:m:r:H:O:W:c:S:t:T:d:s:w:o:v")) != -1)
+    {
+        switch (opt) {
+            case 'N': config.nPeople = atoi(optarg); break;
+            case 'm':
+                if (!CrowdSim::parseMotion(optarg, config.motion))
+                {
+                    usage();
+                    return 1;
+                }
+                break;
+            case 'r': config.worldRate = atof(optarg); break;
+            case 'H': config.heartbeatRate = atof(optarg); break;
+            case 'O': config.omRate = atof(optarg); break;
+            case 'W':
+                if (sscanf(optarg, "%fx%f", &config.width, &config.depth) != 2)
+                {
+                    usage();
+                    return 1;
+                }
+                sizeSet = true;
+                break;
+            case 'c': config.churn = atof(optarg); break;
+            case 'S': config.seed = (uint32_t)atol(optarg); break;
+            case 't': outputs[CrowdSim::OptStream].dest = optarg; break;
+            case 'T': outputs[CrowdSim::OmStream].dest = optarg; break;
+            case 'd': simDuration = atof(optarg); break;
+            case 's': speed = atof(optarg); break;
+            case 'w': outputs[CrowdSim::OptStream].capturePath = optarg; break;
+            case 'o': outputs[CrowdSim::OmStream].capturePath = optarg; break;
+            case 'v': verbose = true; break;
+            default: usage(); return 1;
+        }
+    }
+
+    if (!sizeSet)
+    {
+        CrowdSim::Config sized = CrowdSim::defaultConfig(config.nPeople);
+        config.width = sized.width;
+        config.depth = sized.depth;
+    }
+
+    for (auto& out:outputs)
+        if (out.capturePath.size() && simDuration <= 0)
+        {
+            cerr << "opt-crowd: writing a capture needs duration (-d)" << endl;
+            return 1;
+        }
+
+    try
+    {
+        CrowdSim sim(config);
+        int sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+        if (sock < 0)
+            throw runtime_error("can't create socket");
+
+        for (auto& out:outputs)
+        {
+            out.nPackets = out.nBytes = out.nOversize = out.nErrors = 0;
+
+            if (out.capturePath.size())
+                out.capture.open(out.capturePath);
+            else if (!resolve(out.dest, out.addr))
+                throw runtime_error("can't resolve "+out.dest);
+        }
+
+        cerr << "opt-crowd: " << config.nPeople << " people, "
+             << CrowdSim::motionName(config.motion) << ", "
+             << config.width << "x" << config.depth << " m, world "
+             << config.worldRate << " Hz, heartbeat " << config.heartbeatRate
+             << " Hz, om " << config.omRate << " Hz" << endl;
+
+        CrowdSim::Packet packet;
+        steady_clock::time_point start = steady_clock::now(), lastReport = start;
+        size_t lastPackets = 0, lastBytes = 0;
+
+        while (true)
+        {
+            sim.next(packet);
+
+            if (simDuration > 0 && packet.time >= simDuration)
+                break;
+
+            Output& out = outputs[packet.stream];
+
+            if (out.capture.isOpen())
+            {
+                CaptureRecordHeader h;
+                int64_t stamp = (int64_t)((config.startStamp+packet.time)*1E9);
+
+                memset(&h, 0, sizeof(h));
+                h.length = (uint32_t)packet.data.size();
+                h.srcAddr = htonl(INADDR_LOOPBACK);
+                h.tag = packet.tag;
+                h.seq = packet.seq;
+                h.recvTimeNs = stamp;
+
+                if (!out.capture.write(h, packet.data.data()))
+                    throw runtime_error("can't write "+out.capturePath);
+            }
+            else
+            {
+                if (speed > 0)
+                    this_thread::sleep_until(start+duration_cast<steady_clock::duration>(
+                                             duration<double>(packet.time/speed)));
+
+                if (packet.data.size() > MAX_DATAGRAM)
+                {
+                    if (!out.nOversize++)
+                        cerr << "opt-crowd: " << out.name << " datagram of " << packet.data.size()
+                             << " bytes is too large to send, skipping" << endl;
+                    continue;
+                }
+
+                if (sendto(sock, packet.data.data(), packet.data.size(), 0,
+                           (struct sockaddr*)&out.addr, sizeof(out.addr)) < 0)
+                    out.nErrors++;
+            }
+
+            out.nPackets++;
+            out.nBytes += packet.data.size();
+
+            if (verbose)
+            {
+                steady_clock::time_point now = steady_clock::now();
+                double sinceReport = duration_cast<duration<double>>(now-lastReport).count();
+
+                if (sinceReport >= 1)
+                {
+                    size_t nPackets = outputs[0].nPackets+outputs[1].nPackets;
+                    size_t nBytes = outputs[0].nBytes+outputs[1].nBytes;
+
+                    cout << "sim time " << packet.time
+                         << " pps " << (nPackets-lastPackets)/sinceReport
+                         << " MB/s " << (nBytes-lastBytes)/sinceReport/1E6 << endl;
+                    lastPackets = nPackets;
+                    lastBytes = nBytes;
+                    lastReport = now;
+                }
+            }
+        }
+
+        close(sock);
+
+        for (auto& out:outputs)
+        {
+            out.capture.close();
+
+            if (!out.nPackets && !out.nOversize)
+                continue;
+
+            cout << out.name << ": packets " << out.nPackets
+                 << " MB " << out.nBytes/1E6;
+            if (out.nOversize)
+                cout << " oversize " << out.nOversize;
+            if (out.nErrors)
+                cout << " send errors " << out.nErrors;
+            cout << endl;
+        }
+
+        return 0;
+    }
+    catch (exception& e)
+    {
+        cerr << "opt-crowd: " << e.what() << endl;
+        return 1;
+    }
+}
@@ -0,0 +1,64 @@
+//
+//  opt-log.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include "opt-log.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+#include "rapidjson/document.h"
+
+#include "defines.h"
+
+using namespace std;
+
+void
+loadOptLog(const string& path, vector<string>& datagrams, vector<string>* sources)
+{
+    ifstream f(path);
+    string line, source;
+
+    if (!f.is_open())
+        throw runtime_error("can't open "+path);
+
+    while (getline(f, line))
+    {
+        if (line.size() && line.back() == '\r')
+            line.pop_back();
+
+        if (line.size() && line[0] == '{')
+        {
+            datagrams.push_back(line);
+            if (sources)
+                sources->push_back(source);
+            source.clear();
+        }
+        else if (line.find(" - ") != string::npos)
+            source = line.substr(0, line.find(" - "));
+    }
+}
+
+double
+packetStamp(const string& datagram)
+{
+    rapidjson::Document d;
+    d.Parse<rapidjson::kParseNanAndInfFlag>(datagram.c_str());
+
+    if (d.HasParseError() || !d.IsObject())
+        return -1;
+
+    rapidjson::Value::ConstMemberIterator header = d.FindMember(OPT_JSON_HEADER);
+    if (header == d.MemberEnd() || !header->value.IsObject())
+        return -1;
+
+    rapidjson::Value::ConstMemberIterator stamp = header->value.FindMember("stamp");
+    if (stamp == header->value.MemberEnd() || !stamp->value.IsObject() ||
+        !stamp->value.HasMember("sec") || !stamp->value.HasMember("nsec"))
+        return -1;
+
+    return stamp->value["sec"].GetDouble() + stamp->value["nsec"].GetDouble()/1E9;
+}
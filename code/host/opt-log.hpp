@@ -0,0 +1,28 @@
+//
+//  opt-log.hpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#ifndef opt_log_hpp
+#define opt_log_hpp
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/**
+ * Reads datagrams from a text log of the receiver (sim/data/NAME.opt): JSON
+ * lines interleaved with "waiting on port" banners and "ip:port -" lines.
+ * Only lines starting with '{' are datagrams. Appends to datagrams and, if
+ * given, sources ("ip:port" line preceding each datagram, or empty string).
+ * Throws runtime_error if file can't be read.
+ */
+void loadOptLog(const std::string& path, std::vector<std::string>& datagrams,
+                std::vector<std::string>* sources = nullptr);
+
+// header.stamp of a JSON datagram in seconds, or -1 if there is none
+double packetStamp(const std::string& datagram);
+
+#endif /* opt_log_hpp */
@@ -0,0 +1,167 @@
+//
+//  opt-relay.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "rapidjson/document.h"
+
+#include "binary-frame.hpp"
+
+#define MAX_DATAGRAM 65507  // largest IPv4 UDP payload
+
+using namespace std;
+using namespace chrono;
+
+static void usage()
+{
+    cerr << "usage: opt-relay [options]" << endl
+         << "  receives OPT datagrams and forwards world frames and heartbeats as" << endl
+         << "  binary frames (see src/binary-frame.hpp); everything else, including" << endl
+         << "  frames with face names, is forwarded unchanged" << endl
+         << "  -l port        port to listen on (default 21236)" << endl
+         << "  -t host:port   destination, may be repeated (default 127.0.0.1:21234)" << endl
+         << "  -v             report rates every second" << endl;
+}
+
+static bool resolve(const string& dest, struct sockaddr_in& addr)
+{
+    size_t pos = dest.rfind(':');
+    string host = (pos == string::npos ? dest : dest.substr(0, pos));
+    int port = (pos == string::npos ? 21234 : atoi(dest.c_str()+pos+1));
+    struct addrinfo hints, *res = nullptr;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &res) != 0 || !res)
+        return false;
+
+    addr = *(struct sockaddr_in*)res->ai_addr;
+    addr.sin_port = htons(port);
+    freeaddrinfo(res);
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    vector<string> dests;
+    int port = 21236;
+    bool verbose = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:t:v")) != -1)
+    {
+        switch (opt) {
+            case 'l': port = atoi(optarg); break;
+            case 't': dests.push_back(optarg); break;
+            case 'v': verbose = true; break;
+            default: usage(); return 1;
+        }
+    }
+
+    if (dests.empty())
+        dests.push_back("127.0.0.1:21234");
+
+    try
+    {
+        vector<struct sockaddr_in> addrs(dests.size());
+
+        for (size_t i = 0; i < dests.size(); ++i)
+            if (!resolve(dests[i], addrs[i]))
+                throw runtime_error("can't resolve "+dests[i]);
+
+        int sock = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in local;
+        struct timeval timeout = { 1, 0 };
+
+        if (sock < 0)
+            throw runtime_error("can't create socket");
+
+        memset(&local, 0, sizeof(local));
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = INADDR_ANY;
+        local.sin_port = htons(port);
+
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
+        if (::bind(sock, (struct sockaddr*)&local, sizeof(local)) < 0)
+            throw runtime_error("can't bind to port "+to_string(port)+": "+strerror(errno));
+
+        cerr << "opt-relay: listening on " << port << endl;
+
+        vector<char> buffer(MAX_DATAGRAM);
+        string packed;
+        size_t nPackets = 0, nBinary = 0, nErrors = 0, bytesIn = 0, bytesOut = 0;
+        size_t lastPackets = 0, lastIn = 0, lastOut = 0;
+        steady_clock::time_point lastReport = steady_clock::now();
+
+        while (true)
+        {
+            long len = recv(sock, buffer.data(), MAX_DATAGRAM, 0);
+
+            if (len > 0)
+            {
+                const char *out = buffer.data();
+                size_t outLen = (size_t)len;
+                rapidjson::Document d;
+
+                // python's NaN parses as is, so values survive transcoding
+                d.Parse<rapidjson::kParseNanAndInfFlag>(buffer.data(), (size_t)len);
+
+                if (!d.HasParseError() && transcodeJson(d, packed))
+                {
+                    out = packed.data();
+                    outLen = packed.size();
+                    nBinary++;
+                }
+
+                for (auto& addr:addrs)
+                    if (sendto(sock, out, outLen, 0, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+                        nErrors++;
+
+                nPackets++;
+                bytesIn += len;
+                bytesOut += outLen;
+            }
+
+            if (verbose)
+            {
+                steady_clock::time_point now = steady_clock::now();
+                double sinceReport = duration_cast<duration<double>>(now-lastReport).count();
+
+                if (sinceReport >= 1)
+                {
+                    cout << "pps " << (nPackets-lastPackets)/sinceReport
+                         << " in MB/s " << (bytesIn-lastIn)/sinceReport/1E6
+                         << " out MB/s " << (bytesOut-lastOut)/sinceReport/1E6
+                         << " binary " << nBinary << " send errors " << nErrors << endl;
+                    lastPackets = nPackets;
+                    lastIn = bytesIn;
+                    lastOut = bytesOut;
+                    lastReport = now;
+                }
+            }
+        }
+    }
+    catch (exception& e)
+    {
+        cerr << "opt-relay: " << e.what() << endl;
+        return 1;
+    }
+}
@@ -0,0 +1,323 @@
+//
+//  opt-replay.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <cmath>
+
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <memory>
+
+#include "capture-file.hpp"
+#include "opt-log.hpp"
+
+#define DEFAULT_RATE 30     // packets per second for captures without stamps
+#define SPIN_US 200         // busy-wait this long before each send for accuracy
+#define MAX_LATE_US 100000  // lateness histogram range
+
+using namespace std;
+using namespace chrono;
+
+static void usage()
+{
+    cerr << "usage: opt-replay [options] capture [capture ...]" << endl
+         << "  captures are .opt logs or binary captures (" CAPTURE_EXT ")" << endl
+         << "  -t host:port   destination, may be repeated (default 127.0.0.1:21234)" << endl
+         << "  -s speed       speed relative to recorded header stamps (default 1;" << endl
+         << "                 0 - as fast as possible)" << endl
+         << "  -R pps         fixed rate instead of recorded stamps" << endl
+         << "  -n count       loop captures count times (default 1; 0 - forever)" << endl
+         << "  -S seconds     start this far into each capture" << endl
+         << "  -B             enable broadcast" << endl
+         << "  -v             report rate and jitter every second" << endl;
+}
+
+typedef struct _Packet {
+    const char *data;
+    size_t len;
+    double stamp;       // seconds, -1 if unknown
+} Packet;
+
+static bool resolve(const string& dest, struct sockaddr_in& addr)
+{
+    size_t pos = dest.rfind(':');
+    string host = (pos == string::npos ? dest : dest.substr(0, pos));
+    int port = (pos == string::npos ? 21234 : atoi(dest.c_str()+pos+1));
+    struct addrinfo hints, *res = nullptr;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &res) != 0 || !res)
+        return false;
+
+    addr = *(struct sockaddr_in*)res->ai_addr;
+    addr.sin_port = htons(port);
+    freeaddrinfo(res);
+
+    return true;
+}
+
+// send time error statistics; lateness is kept in 1 us buckets so long
+// runs use constant memory
+class Jitter {
+public:
+    Jitter():buckets_(MAX_LATE_US+1) { reset(); }
+
+    void reset()
+    {
+        n_ = 0; bytes_ = 0; sum_ = 0; max_ = 0;
+        fill(buckets_.begin(), buckets_.end(), 0);
+    }
+
+    void add(double lateUs, size_t bytes)
+    {
+        n_++;
+        bytes_ += bytes;
+        sum_ += lateUs;
+        max_ = max(max_, lateUs);
+        buckets_[min((size_t)MAX_LATE_US, (size_t)max(0., lateUs))]++;
+    }
+
+    void print(ostream& out, double seconds)
+    {
+        size_t p99 = 0, count = 0;
+
+        while (p99 < MAX_LATE_US && (count += buckets_[p99]) < .99*n_)
+            p99++;
+
+        out << "packets " << n_
+            << " pps " << n_/seconds
+            << " MB/s " << bytes_/seconds/1E6
+            << " late us: mean " << (n_ ? sum_/n_ : 0)
+            << " p99 " << p99
+            << " max " << max_ << endl;
+    }
+
+private:
+    size_t n_, bytes_;
+    double sum_, max_;
+    vector<size_t> buckets_;
+};
+
+int main(int argc, char **argv)
+{
+    vector<string> dests;
+    double speed = 1, fixedRate = 0, startSec = 0;
+    long nLoops = 1;
+    bool broadcast = false, verbose = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:s:R:n:S:Bv")) != -1)
+    {
+        switch (opt) {
+            case 't': dests.push_back(optarg); break;
+            case 's': speed = atof(optarg); break;
+            case 'R': fixedRate = atof(optarg); break;
+            case 'n': nLoops = atol(optarg); break;
+            case 'S': startSec = atof(optarg); break;
+            case 'B': broadcast = true; break;
+            case 'v': verbose = true; break;
+            default: usage(); return 1;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        usage();
+        return 1;
+    }
+
+    if (dests.empty())
+        dests.push_back("127.0.0.1:21234");
+
+    try
+    {
+        // binary captures are memory mapped and sent in place; logs are
+        // loaded into memory
+        vector<shared_ptr<CaptureReader>> readers;
+        vector<shared_ptr<vector<string>>> logs;
+        vector<Packet> packets;
+        vector<size_t> captureEnds;     // end of each capture's packets
+
+        for (int i = optind; i < argc; ++i)
+        {
+            if (CaptureReader::isCapture(argv[i]))
+            {
+                shared_ptr<CaptureReader> reader = make_shared<CaptureReader>(argv[i]);
+                size_t first = reader->seekTime(reader->getStartTime()+(int64_t)(startSec*1E9));
+
+                for (size_t r = first; r < reader->size(); ++r)
+                {
+                    Packet p = { reader->getPayload(r), reader->getHeader(r).length, reader->getTime(r)/1E9 };
+                    packets.push_back(p);
+                }
+                readers.push_back(reader);
+            }
+            else
+            {
+                shared_ptr<vector<string>> log = make_shared<vector<string>>();
+                double firstStamp = -1;
+
+                loadOptLog(argv[i], *log);
+                for (auto& d:*log)
+                {
+                    Packet p = { d.data(), d.size(), packetStamp(d) };
+
+                    if (firstStamp < 0)
+                        firstStamp = p.stamp;
+                    if (startSec > 0 && (p.stamp < 0 || p.stamp-firstStamp < startSec))
+                        continue;
+                    packets.push_back(p);
+                }
+                logs.push_back(log);
+            }
+            captureEnds.push_back(packets.size());
+        }
+
+        if (packets.empty())
+            throw runtime_error("no datagrams in captures");
+
+        // send offsets (seconds from the start of a loop); each capture goes
+        // by its own stamps and starts one average interval after the end
+        // of the previous one, as the next loop does; packets without stamps
+        // go right after the previous one
+        vector<double> offsets(packets.size(), 0);
+        double gap = 0;     // average interval of the last capture
+        size_t begin = 0;
+
+        for (size_t c = 0; c < captureEnds.size(); begin = captureEnds[c++])
+        {
+            size_t end = captureEnds[c];
+            double base = (begin ? offsets[begin-1]+gap : 0);
+            double firstStamp = -1;
+
+            if (begin == end)
+                continue;
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                double stamp = (fixedRate > 0 ? -1 : packets[i].stamp);
+
+                if (fixedRate > 0)
+                    offsets[i] = i/fixedRate;
+                else if (stamp >= 0)
+                {
+                    if (firstStamp < 0)
+                        firstStamp = stamp;
+                    // stamps of different frame ids may interleave out of order
+                    offsets[i] = max(i > begin ? offsets[i-1] : base, base+stamp-firstStamp);
+                }
+                else
+                    offsets[i] = (i > begin ? offsets[i-1] : base);
+            }
+
+            if (fixedRate <= 0 && firstStamp < 0)
+            {
+                for (size_t i = begin; i < end; ++i)
+                    offsets[i] = base+(i-begin)/(double)DEFAULT_RATE;
+                cerr << "opt-replay: no header stamps in " << argv[optind+c]
+                     << ", sending at " << DEFAULT_RATE << " pps" << endl;
+            }
+
+            gap = (end-begin > 1 ? (offsets[end-1]-offsets[begin])/(end-begin-1) : 0);
+            if (gap <= 0)
+                gap = (fixedRate > 0 ? 1./fixedRate : 1./DEFAULT_RATE);
+        }
+
+        double loopLength = offsets.back()+gap;
+
+        vector<struct sockaddr_in> addrs(dests.size());
+        for (size_t i = 0; i < dests.size(); ++i)
+            if (!resolve(dests[i], addrs[i]))
+                throw runtime_error("can't resolve "+dests[i]);
+
+        int sock = socket(AF_INET, SOCK_DGRAM, 0);
+        int on = 1;
+
+        if (sock < 0)
+            throw runtime_error("can't create socket");
+        if (broadcast)
+            setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+
+        cerr << "opt-replay: " << packets.size() << " datagrams, "
+             << loopLength << " s per loop, " << dests.size() << " destination(s)" << endl;
+
+        Jitter total, second;
+        steady_clock::time_point start = steady_clock::now(), lastReport = start;
+        size_t nErrors = 0;
+
+        for (long loopNo = 0; nLoops == 0 || loopNo < nLoops; ++loopNo)
+            for (size_t i = 0; i < packets.size(); ++i)
+            {
+                steady_clock::time_point target = start;
+
+                if (speed > 0)
+                {
+                    target += duration_cast<steady_clock::duration>(
+                        duration<double>((loopNo*loopLength + offsets[i])/speed));
+
+                    // sleep most of the way, spin the rest
+                    steady_clock::time_point wake = target-microseconds(SPIN_US);
+                    if (steady_clock::now() < wake)
+                        this_thread::sleep_until(wake);
+                    while (steady_clock::now() < target)
+                        ;
+                }
+
+                steady_clock::time_point now = steady_clock::now();
+
+                for (auto& addr:addrs)
+                    if (sendto(sock, packets[i].data, packets[i].len, 0,
+                               (struct sockaddr*)&addr, sizeof(addr)) < 0)
+                        nErrors++;
+
+                double lateUs = (speed > 0 ? duration_cast<nanoseconds>(now-target).count()/1000. : 0);
+                total.add(lateUs, packets[i].len*addrs.size());
+
+                if (verbose)
+                {
+                    second.add(lateUs, packets[i].len*addrs.size());
+
+                    double sinceReport = duration_cast<duration<double>>(now-lastReport).count();
+                    if (sinceReport >= 1)
+                    {
+                        second.print(cout, sinceReport);
+                        second.reset();
+                        lastReport = now;
+                    }
+                }
+            }
+
+        close(sock);
+
+        double elapsed = duration_cast<duration<double>>(steady_clock::now()-start).count();
+        cout << "total: ";
+        total.print(cout, elapsed);
+        if (nErrors)
+            cout << "send errors " << nErrors << endl;
+
+        return 0;
+    }
+    catch (exception& e)
+    {
+        cerr << "opt-replay: " << e.what() << endl;
+        return 1;
+    }
+}
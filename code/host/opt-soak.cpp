@@ -0,0 +1,1181 @@
+//
+//  opt-soak.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "rapidjson/document.h"
+
+#include "defines.h"
+#include "capture-file.hpp"
+#include "chop-host.hpp"
+#include "opt-log.hpp"
+#include "crowd-sim.hpp"
+#include "binary-frame.hpp"
+
+#define MAX_COOK_US 100000  // latency histogram range
+#define OPT_MAXTRACKED 25
+#define TRAIL_LENGTH 8
+#define CLUSTER_RADIUS 1    // meters
+#define CLUSTER_MIN_SIZE 1
+#define ITEM_GAP 1          // seconds of silence between playlist items
+#define LOG_RATE 30         // packets per second for logs without stamps
+#define MAX_EXAMPLES 5      // violations printed per check
+#define LATENCY_SLACK_US 2  // regressions smaller than this are noise
+#define GROWTH_SLACK_KB 1024
+
+using namespace std;
+using namespace chrono;
+
+// every OM_CHOP output, each read by a pair of instances
+static const char* OmOutputs[] = { "Derivatives", "Pairwise", "Dtw", "Clusters", "Clusterids",
+                                   "Clustersall", "Hotspots", "Pca", "Stagedist", "Templates" };
+
+typedef enum _IdLayout {
+    NoIds,
+    IdPerSample,    // channel 0 of every sample
+    IdPerChannel    // sample 0 of every channel
+} IdLayout;
+
+typedef struct _OptOutput {
+    const char* name;
+    IdLayout ids;
+    int groupChan;  // ids are sorted within runs of equal values of this channel
+} OptOutput;
+
+// OPT_CHOP outputs besides Tracks and Trails, an instance each
+static const OptOutput OptOutputs[] = {
+    { "Zones", NoIds, -1 }, { "Heatmap", NoIds, -1 }, { "Pairwise", IdPerChannel, -1 },
+    { "Similarity", IdPerChannel, -1 }, { "Clusters", NoIds, -1 },
+    { "Clusterids", IdPerSample, -1 }, { "Clustersall", IdPerSample, 3 },
+    { "Stagedist", IdPerSample, -1 }
+};
+
+static void usage()
+{
+    cerr << "usage: opt-soak [options] [capture ...]" << endl
+         << "  replays captures (.opt logs or binary " CAPTURE_EXT ") and synthetic crowds" << endl
+         << "  through OPT_CHOP and OM_CHOP in a loop, checks invariants after every cook;" << endl
+         << "  exits with 1 on a violation or a regression against the baseline" << endl
+         << "  -p path        OPT_CHOP plugin (default build/OPT_CHOP.so)" << endl
+         << "  -m path        OM_CHOP plugin (default build/OM_CHOP.so)" << endl
+         << "  -d seconds     stream time to run (default 600)" << endl
+         << "  -s speed       speed relative to real time (default 10; 0 - as fast as possible)" << endl
+         << "  -r hz          cooks per second of stream time (default 60)" << endl
+         << "  -N people      synthetic crowd size (default 20; 0 - no crowds)" << endl
+         << "  -C seconds     length of a crowd segment (default 60)" << endl
+         << "  -q depth       largest allowed queue depth after a cook (default 8)" << endl
+         << "  -a seconds     largest allowed age of an output track id (default 5)" << endl
+         << "  -g MB          largest allowed RSS growth after warm-up (default 8)" << endl
+         << "  -z file        zones table for OPT_CHOP Zonesdat parameter" << endl
+         << "  -t file        stage table for OPT_CHOP Stagedat parameter" << endl
+         << "  -k name=N[-M]  capture name has N (to M) clusters in most world frames (repeatable)" << endl
+         << "  -b file        baseline to compare with" << endl
+         << "  -x tolerance   allowed relative regression (default 0.5)" << endl
+         << "  -o file        write results; the file can be used as a baseline" << endl
+         << "  -v             report progress every 10 seconds" << endl;
+}
+
+//******************************************************************************
+typedef enum _Target {
+    OptTarget,
+    OmTarget
+} Target;
+
+typedef function<void(Target, const char*, size_t)> FeedFunc;
+
+typedef struct _Item {
+    string name;
+    vector<string> datagrams;           // .opt log
+    shared_ptr<CaptureReader> capture;  // or binary capture
+    vector<double> times;               // seconds from item start
+} Item;
+
+/**
+ * Endless stream of datagrams: captures, then a crowd segment, separated by
+ * ITEM_GAP seconds of silence; the list starts over when it ends. Every crowd
+ * segment uses the next motion model and seed, so each cycle sees different
+ * crowds. Capture payloads are fed in place, crowds are generated as they
+ * play - memory use doesn't depend on run length.
+ */
+class Playlist {
+public:
+    Playlist(int nPeople, double crowdSeconds):
+    nPeople_(nPeople), crowdSeconds_(crowdSeconds), current_(0), position_(0),
+    itemStart_(0), cycle_(0), nCrowds_(0), pending_(false) {}
+
+    // throws runtime_error if file can't be read
+    void addCapture(const string& path);
+    // feeds every datagram due up to stream time
+    void play(double time, const FeedFunc& feed);
+
+    size_t size() const { return items_.size()+(nPeople_ > 0); }
+    int getCycle() const { return cycle_; }
+    string getItemName() const;
+
+private:
+    vector<Item> items_;
+    int nPeople_;
+    double crowdSeconds_;
+    size_t current_, position_;
+    double itemStart_;
+    int cycle_, nCrowds_;
+    unique_ptr<CrowdSim> crowd_;
+    CrowdSim::Packet packet_;
+    bool pending_;
+
+    bool isCrowd() const { return current_ == items_.size(); }
+    double getItemLength() const;
+    void startItem(double time);
+};
+
+void
+Playlist::addCapture(const string &path)
+{
+    Item item;
+
+    item.name = path.substr(path.find_last_of('/')+1);
+
+    if (CaptureReader::isCapture(path))
+    {
+        item.capture = make_shared<CaptureReader>(path);
+        for (size_t i = 0; i < item.capture->size(); ++i)
+            item.times.push_back((item.capture->getTime(i)-item.capture->getStartTime())/1E9);
+    }
+    else
+    {
+        loadOptLog(path, item.datagrams);
+
+        // header stamps relative to the first one; packets without a stamp
+        // follow the previous one at LOG_RATE
+        double first = -1, last = 0;
+
+        for (size_t i = 0; i < item.datagrams.size(); ++i)
+        {
+            double stamp = packetStamp(item.datagrams[i]);
+
+            if (stamp >= 0 && first < 0)
+                first = stamp-last;
+
+            last = (stamp >= 0 ? max(last, stamp-first) : last+(i ? 1./LOG_RATE : 0));
+            item.times.push_back(last);
+        }
+    }
+
+    if (item.times.empty())
+        throw runtime_error(path+" has no datagrams");
+
+    items_.push_back(item);
+}
+
+void
+Playlist::play(double time, const FeedFunc &feed)
+{
+    if (!size())
+        return;
+
+    while (true)
+    {
+        double due;
+
+        if (isCrowd())
+        {
+            if (!crowd_)
+                startItem(itemStart_);
+            if (!pending_)
+            {
+                crowd_->next(packet_);
+                pending_ = true;
+            }
+            due = (packet_.time < crowdSeconds_ ? packet_.time : -1);
+        }
+        else
+            due = (position_ < items_[current_].times.size() ?
+                   items_[current_].times[position_] : -1);
+
+        if (due < 0)
+        {
+            // item has ended
+            double next = itemStart_+getItemLength()+ITEM_GAP;
+
+            if (next > time)
+                return;
+
+            if (++current_ >= size())
+            {
+                current_ = 0;
+                cycle_++;
+            }
+            startItem(next);
+            continue;
+        }
+
+        if (itemStart_+due > time)
+            return;
+
+        if (isCrowd())
+        {
+            feed((packet_.stream == CrowdSim::OptStream ? OptTarget : OmTarget),
+                 packet_.data.data(), packet_.data.size());
+            pending_ = false;
+        }
+        else
+        {
+            const Item& item = items_[current_];
+
+            if (item.capture)
+            {
+                CaptureTag tag = (CaptureTag)item.capture->getHeader(position_).tag;
+
+                feed((tag == TagWorld || tag == TagHeartbeat || tag == TagUnknown ?
+                      OptTarget : OmTarget), item.capture->getPayload(position_),
+                     item.capture->getHeader(position_).length);
+            }
+            else
+                feed(OptTarget, item.datagrams[position_].data(),
+                     item.datagrams[position_].size());
+            position_++;
+        }
+    }
+}
+
+string
+Playlist::getItemName() const
+{
+    if (!isCrowd())
+        return items_[current_].name;
+    return string("crowd ")+(crowd_ ? CrowdSim::motionName(crowd_->getConfig().motion) : "");
+}
+
+//******************************************************************************
+double
+Playlist::getItemLength() const
+{
+    return (isCrowd() ? crowdSeconds_ : items_[current_].times.back());
+}
+
+void
+Playlist::startItem(double time)
+{
+    itemStart_ = time;
+    position_ = 0;
+    pending_ = false;
+    crowd_.reset();
+
+    if (isCrowd())
+    {
+        static const CrowdSim::Motion motions[] = { CrowdSim::RandomWalk, CrowdSim::Flocking,
+                                                    CrowdSim::Lanes };
+        CrowdSim::Config config = CrowdSim::defaultConfig(nPeople_);
+
+        config.motion = motions[nCrowds_%3];
+        config.seed = (uint32_t)++nCrowds_;
+        config.omRate = 30;
+        config.churn = 0.05;
+        crowd_.reset(new CrowdSim(config));
+    }
+}
+
+//******************************************************************************
+// cook time distribution in 1 us buckets, constant memory for any run length
+class Latency {
+public:
+    Latency():buckets_(MAX_COOK_US+1), n_(0), max_(0) {}
+
+    void add(double us)
+    {
+        n_++;
+        max_ = max(max_, us);
+        buckets_[min((size_t)MAX_COOK_US, (size_t)max(0., us))]++;
+    }
+
+    double percentile(double p) const
+    {
+        size_t i = 0, count = 0;
+
+        while (i < MAX_COOK_US && (count += buckets_[i]) < p*n_)
+            i++;
+        return (double)i;
+    }
+
+    double getMax() const { return max_; }
+
+private:
+    vector<size_t> buckets_;
+    size_t n_;
+    double max_;
+};
+
+// field of /proc/self/status in KB (VmRSS, VmHWM), 0 if unavailable
+static size_t readMemoryKb(const string& field)
+{
+    ifstream f("/proc/self/status");
+    string line;
+
+    while (getline(f, line))
+        if (line.compare(0, field.size()+1, field+":") == 0)
+            return strtoul(line.c_str()+field.size()+1, nullptr, 10);
+    return 0;
+}
+
+//******************************************************************************
+/**
+ * Three plugin instances are cooked after every 1/rate seconds of stream
+ * time: OPT_CHOP with Tracks and with Trails output (same plugin library,
+ * so both read the same socket reader) and OM_CHOP. An OPT_CHOP for every
+ * other output (OptOutputs) is cooked along, reading zones and stage from
+ * table files if given. Checks:
+ *
+ *      stale ids       every track id in Tracks output, or in any other
+ *                      output that lists ids, was sent in a world frame or
+ *                      heartbeat in the last maxAge seconds
+ *      track order     Tracks rows, and ids of other outputs, are sorted by
+ *                      id, no duplicates
+ *      slot mapping    Trails row of every track ends at the track's position
+ *                      and continues its own history - a slot is never
+ *                      shared or handed over with another track's points
+ *      queue depth     queues of all instances stay under maxQueue after a
+ *                      cook, so messages_ can't grow without bound
+ *      plugin error    no instance reports an error, zones and stage tables
+ *                      load
+ *      output written  OPT_CHOP instances other than Tracks one write every
+ *                      output sample (host fills output with NaN before
+ *                      every cook)
+ *      parse drops     every datagram parses
+ *      cluster count   most frequent number of clusters in world frames of
+ *                      a capture is in the expected range (given per capture)
+ *      shared bundle   two instances with the same output read the same
+ *                      documents and give identical output after every
+ *                      cook - a pair for every OM_CHOP output, and a second
+ *                      OPT_CHOP with Tracks output; a consumer that alters
+ *                      a shared document breaks the other one
+ */
+class Soak {
+public:
+    typedef enum _Host {
+        TracksHost,
+        TrailsHost,
+        OmHost,
+        NHosts
+    } Host;
+
+    typedef enum _Check {
+        StaleId,
+        TrackOrder,
+        SlotMapping,
+        QueueDepth,
+        PluginError,
+        OutputWritten,
+        ParseDrops,
+        ClusterCount,
+        SharedBundle,
+        NChecks
+    } Check;
+
+    typedef struct _Options {
+        string optPlugin, omPlugin;
+        string zonesDat, stageDat;
+        double duration, speed, rate;
+        int nPeople;
+        double crowdSeconds;
+        int maxQueue;
+        double maxAge;
+        // capture name -> range of number of clusters in most of its world
+        // frames
+        map<string, pair<int, int>> nClusters;
+        bool verbose;
+    } Options;
+
+    typedef struct _Results {
+        double streamSeconds, wallSeconds;
+        size_t nItems, nCycles, nCooks, nDatagrams, nChecked;
+        double cookUs[NHosts][4];   // p50, p99, p99.9, max
+        size_t hwmKb, rssWarmKb, rssEndKb;
+        int maxQueue;
+        size_t violations[NChecks];
+    } Results;
+
+    static const char* HostNames[NHosts];
+    static const char* CheckNames[NChecks];
+
+    Soak(const Options& options, Playlist& playlist);
+
+    // throws runtime_error if plugins can't be loaded
+    Results run();
+
+private:
+    typedef struct _Position {
+        float x, y;
+    } Position;
+
+    typedef struct _Row {
+        int id;
+        float x, y;
+    } Row;
+
+    Options options_;
+    Playlist& playlist_;
+    shared_ptr<ChopHost> hosts_[NHosts];
+    Latency latency_[NHosts];
+    // an instance for each of OptOutputs
+    vector<shared_ptr<ChopHost>> outputHosts_;
+    // capture name -> number of clusters -> world frames
+    map<string, map<int, size_t>> clusterCounts_;
+    // instances compared with each other; first host of OPT pair is TracksHost
+    vector<pair<shared_ptr<ChopHost>, shared_ptr<ChopHost>>> viewPairs_;
+    vector<string> viewNames_;
+
+    map<int, double> lastSeen_;         // id -> stream time
+    TrackRecords records_;              // decoded binary world frame
+    vector<Row> rows_;
+    map<int, Position> prevPositions_;
+    bool prevValid_;
+    float lastWorldSeq_;
+
+    Results results_;
+
+    void feed(Target target, const char* data, size_t len, double time);
+    void cook(double time);
+    void checkTracks(double time);
+    void checkOutputs(double time);
+    void checkOutputIds(double time);
+    void countClusters();
+    void checkClusterCounts(double time);
+    void checkLive(double time, const string& where, int id);
+    void checkViews(double time);
+    void violation(Check check, double time, const string& what);
+    void pruneLastSeen(double time);
+};
+
+const char* Soak::HostNames[NHosts] = { "opt", "trails", "om" };
+const char* Soak::CheckNames[NChecks] = { "staleId", "trackOrder", "slotMapping",
+                                          "queueDepth", "pluginError", "outputWritten",
+                                          "parseDrops", "clusterCount", "sharedBundle" };
+
+// info channel value, or def if host doesn't have the channel (yet)
+static float infoChan(const ChopHost& host, const string& name, float def = 0)
+{
+    for (auto& c:host.getInfoChannels())
+        if (c.first == name)
+            return c.second;
+    return def;
+}
+
+// NaN samples, i.e. ones the plugin didn't write after host poisoned them
+static size_t countUnwritten(const CHOP_Output& out)
+{
+    size_t n = 0;
+
+    for (int c = 0; c < out.numChannels; ++c)
+        for (int k = 0; k < out.numSamples; ++k)
+            n += (out.channels[c][k] != out.channels[c][k]);
+    return n;
+}
+
+Soak::Soak(const Options &options, Playlist &playlist):
+options_(options), playlist_(playlist), prevValid_(false), lastWorldSeq_(-1)
+{
+    memset(&results_, 0, sizeof(results_));
+}
+
+Soak::Results
+Soak::run()
+{
+    for (int h = 0; h < NHosts; ++h)
+    {
+        hosts_[h] = make_shared<ChopHost>(h == OmHost ? options_.omPlugin : options_.optPlugin);
+
+        if (!hosts_[h]->canFeed())
+            throw runtime_error(string(HostNames[h])+" plugin is not built for the host");
+    }
+
+    hosts_[TracksHost]->setPar("Maxtracked", to_string(OPT_MAXTRACKED));
+    hosts_[TrailsHost]->setPar("Maxtracked", to_string(OPT_MAXTRACKED));
+    hosts_[TrailsHost]->setPar("Output", "Trails");
+    hosts_[TrailsHost]->setPar("Traillength", to_string(TRAIL_LENGTH));
+    hosts_[TrailsHost]->setPar("Traildecim", "Time");
+    hosts_[TrailsHost]->setPar("Trailstep", "1");
+    // Tracks output is only written when a world frame comes
+    hosts_[TrailsHost]->setPoisonOutput(true);
+
+    for (auto& output:OptOutputs)
+    {
+        shared_ptr<ChopHost> host = make_shared<ChopHost>(options_.optPlugin);
+
+        host->setPar("Maxtracked", to_string(OPT_MAXTRACKED));
+        host->setPar("Output", output.name);
+        host->setPar("Clusterradius", to_string(CLUSTER_RADIUS));
+        host->setPar("Clusterminsize", to_string(CLUSTER_MIN_SIZE));
+        if (options_.zonesDat.size())
+            host->setDat("Zonesdat", options_.zonesDat);
+        if (options_.stageDat.size())
+            host->setDat("Stagedat", options_.stageDat);
+        host->setPoisonOutput(true);
+        outputHosts_.push_back(host);
+    }
+
+    viewPairs_.push_back(make_pair(hosts_[TracksHost], make_shared<ChopHost>(options_.optPlugin)));
+    viewPairs_.back().second->setPar("Maxtracked", to_string(OPT_MAXTRACKED));
+    viewNames_.push_back("opt Tracks");
+
+    for (auto output:OmOutputs)
+    {
+        viewPairs_.push_back(make_pair(make_shared<ChopHost>(options_.omPlugin),
+                                       make_shared<ChopHost>(options_.omPlugin)));
+        viewPairs_.back().first->setPar("Output", output);
+        viewPairs_.back().second->setPar("Output", output);
+        viewNames_.push_back(string("om ")+output);
+    }
+
+    results_.nItems = playlist_.size();
+
+    FeedFunc feedFunc;
+    double time = 0, lastPrune = 0, lastReport = 0;
+    bool warm = false;
+    steady_clock::time_point start = steady_clock::now();
+
+    feedFunc = [this, &time](Target target, const char* data, size_t len){
+        feed(target, data, len, time);
+    };
+
+    while (time < options_.duration)
+    {
+        time = results_.nCooks/options_.rate;
+
+        if (options_.speed > 0)
+            this_thread::sleep_until(start+duration_cast<steady_clock::duration>(
+                                     duration<double>(time/options_.speed)));
+
+        playlist_.play(time, feedFunc);
+        cook(time);
+
+        if (time-lastPrune >= options_.maxAge)
+        {
+            pruneLastSeen(time);
+            lastPrune = time;
+        }
+
+        // everything is loaded and every path has run once by the end of
+        // the first cycle (or a quarter of a shorter run)
+        if (!warm && (playlist_.getCycle() > 0 || time >= options_.duration/4))
+        {
+            results_.rssWarmKb = readMemoryKb("VmRSS");
+            warm = true;
+        }
+
+        if (options_.verbose && time-lastReport >= 10)
+        {
+            cout << "stream time " << time
+                 << " cycle " << playlist_.getCycle()
+                 << " item " << playlist_.getItemName()
+                 << " rss MB " << readMemoryKb("VmRSS")/1024.
+                 << " opt p99 us " << latency_[TracksHost].percentile(.99)
+                 << " om p99 us " << latency_[OmHost].percentile(.99) << endl;
+            lastReport = time;
+        }
+    }
+
+    for (int h = 0; h < NHosts; ++h)
+    {
+        float drops = infoChan(*hosts_[h], "dropsParse");
+
+        if (drops > 0)
+        {
+            stringstream ss;
+            ss << HostNames[h] << ": " << drops << " datagrams didn't parse";
+            violation(ParseDrops, time, ss.str());
+        }
+
+        results_.cookUs[h][0] = latency_[h].percentile(.5);
+        results_.cookUs[h][1] = latency_[h].percentile(.99);
+        results_.cookUs[h][2] = latency_[h].percentile(.999);
+        results_.cookUs[h][3] = latency_[h].getMax();
+    }
+
+    checkClusterCounts(time);
+
+    results_.streamSeconds = time;
+    results_.wallSeconds = duration_cast<duration<double>>(steady_clock::now()-start).count();
+    results_.nCycles = playlist_.getCycle();
+    results_.rssEndKb = readMemoryKb("VmRSS");
+    results_.hwmKb = readMemoryKb("VmHWM");
+
+    return results_;
+}
+
+//******************************************************************************
+void
+Soak::feed(Target target, const char *data, size_t len, double time)
+{
+    results_.nDatagrams++;
+
+    if (target == OmTarget)
+    {
+        hosts_[OmHost]->feed(data, len);
+        return;
+    }
+
+    // remember when every id was last sent; both OPT instances share the
+    // socket reader, so one feed reaches both. Document is not reused -
+    // its allocator would keep every parse
+    rapidjson::Document d;
+    string error;
+    bool parsed;
+
+    if (isBinaryFrame(data, len))
+        parsed = binaryToDocument(data, len, d, error);
+    else
+        parsed = !d.Parse<rapidjson::kParseNanAndInfFlag>(data, len).HasParseError();
+
+    int32_t seq;
+    CaptureTag tag = (parsed ? captureTag(d, seq) : TagUnknown);
+
+    if (tag == TagWorld && unpackTracks(d, records_))
+    {
+        for (auto id:records_.table.ids)
+            lastSeen_[id] = time;
+    }
+    else if (tag == TagWorld && d.HasMember(OPT_JSON_PEOPLE_TRACKS) &&
+             d[OPT_JSON_PEOPLE_TRACKS].IsArray())
+    {
+        for (auto& t:d[OPT_JSON_PEOPLE_TRACKS].GetArray())
+            if (t.HasMember(OPT_JSON_ID) && t[OPT_JSON_ID].IsInt())
+                lastSeen_[t[OPT_JSON_ID].GetInt()] = time;
+    }
+    else if (tag == TagHeartbeat && d.HasMember(OPT_JSON_ALIVEIDS) &&
+             d[OPT_JSON_ALIVEIDS].IsArray())
+    {
+        for (auto& id:d[OPT_JSON_ALIVEIDS].GetArray())
+            if (id.IsInt())
+                lastSeen_[id.GetInt()] = time;
+    }
+
+    hosts_[TracksHost]->feed(data, len);
+}
+
+void
+Soak::cook(double time)
+{
+    results_.nCooks++;
+
+    for (int h = 0; h < NHosts; ++h)
+    {
+        latency_[h].add(hosts_[h]->cook().executeUs);
+
+        if (hosts_[h]->getError().size())
+            violation(PluginError, time, string(HostNames[h])+": "+hosts_[h]->getError());
+
+        int depth = (int)infoChan(*hosts_[h], "queueDepth");
+
+        results_.maxQueue = max(results_.maxQueue, depth);
+        if (depth > options_.maxQueue)
+        {
+            stringstream ss;
+            ss << HostNames[h] << ": " << depth << " bundles queued";
+            violation(QueueDepth, time, ss.str());
+        }
+    }
+
+    checkOutputs(time);
+    checkViews(time);
+
+    // outputs only change when a world frame was processed
+    float worldSeq = infoChan(*hosts_[TracksHost], "seq_world", -1);
+
+    if (worldSeq != lastWorldSeq_)
+    {
+        lastWorldSeq_ = worldSeq;
+        checkTracks(time);
+        checkOutputIds(time);
+        countClusters();
+    }
+}
+
+void
+Soak::checkTracks(double time)
+{
+    const CHOP_Output& tracks = hosts_[TracksHost]->getOutput();
+    const CHOP_Output& trails = hosts_[TrailsHost]->getOutput();
+
+    // Tracks output: id, age, confidence, x, y, ... per row; rows past the
+    // last track are all zeros
+    rows_.clear();
+    for (int i = 0; i < tracks.numSamples; ++i)
+    {
+        bool padding = true;
+
+        for (int c = 0; c < tracks.numChannels && padding; ++c)
+            padding = (tracks.channels[c][i] == 0);
+
+        if (padding)
+            break;
+
+        Row r = { (int)tracks.channels[0][i], tracks.channels[3][i], tracks.channels[4][i] };
+        rows_.push_back(r);
+    }
+
+    results_.nChecked++;
+
+    for (size_t i = 0; i < rows_.size(); ++i)
+    {
+        const Row& r = rows_[i];
+
+        if (i && r.id <= rows_[i-1].id)
+        {
+            stringstream ss;
+            ss << "id " << r.id << " follows id " << rows_[i-1].id;
+            violation(TrackOrder, time, ss.str());
+        }
+
+        checkLive(time, "Tracks", r.id);
+    }
+
+    // with more tracks than slots, some tracks legitimately have no trail;
+    // Output menu change takes effect a cook later, so the very first
+    // output doesn't have trails layout yet
+    if ((int)rows_.size() < OPT_MAXTRACKED &&
+        trails.numChannels == 3*OPT_MAXTRACKED && trails.numSamples == TRAIL_LENGTH)
+    {
+        int newest = trails.numSamples-1;
+
+        for (size_t i = 0; i < rows_.size(); ++i)
+        {
+            const Row& r = rows_[i];
+            float **chans = trails.channels+i*3;
+            map<int, Position>::const_iterator prev = prevPositions_.find(r.id);
+            // new tracks start with a history filled with their position
+            float px = (prev == prevPositions_.end() ? r.x : prev->second.x);
+            float py = (prev == prevPositions_.end() ? r.y : prev->second.y);
+            stringstream ss;
+
+            if (chans[0][0] != r.id || chans[1][newest] != r.x || chans[2][newest] != r.y)
+                ss << "trail row " << i << " (id " << chans[0][0] << ") ends at "
+                   << chans[1][newest] << "," << chans[2][newest] << ", track " << r.id
+                   << " is at " << r.x << "," << r.y;
+            else if (prevValid_ && (chans[1][newest-1] != px || chans[2][newest-1] != py))
+                ss << "trail of id " << r.id << " continues from " << chans[1][newest-1]
+                   << "," << chans[2][newest-1] << " instead of " << px << "," << py;
+
+            if (ss.tellp() > 0)
+                violation(SlotMapping, time, ss.str());
+        }
+        prevValid_ = true;
+    }
+    else
+        prevValid_ = false;
+
+    prevPositions_.clear();
+    for (auto& r:rows_)
+        prevPositions_[r.id] = { r.x, r.y };
+}
+
+void
+Soak::checkOutputs(double time)
+{
+    for (size_t i = 0; i < outputHosts_.size(); ++i)
+    {
+        ChopHost& host = *outputHosts_[i];
+        string name(OptOutputs[i].name);
+
+        host.cook();
+        if (host.getError().size())
+            violation(PluginError, time, name+": "+host.getError());
+        // fixtures are loaded by every instance, whatever its output is
+        if (host.getWarning().find("failed to load") != string::npos)
+            violation(PluginError, time, name+": "+host.getWarning());
+
+        size_t n = countUnwritten(host.getOutput());
+
+        if (n)
+            violation(OutputWritten, time, name+": "+to_string(n)+" samples not written");
+    }
+
+    size_t n = countUnwritten(hosts_[TrailsHost]->getOutput());
+
+    if (n)
+        violation(OutputWritten, time, string(HostNames[TrailsHost])+": "+to_string(n)+
+                  " samples not written");
+}
+
+void
+Soak::checkOutputIds(double time)
+{
+    for (size_t i = 0; i < outputHosts_.size(); ++i)
+    {
+        const OptOutput& layout = OptOutputs[i];
+        const CHOP_Output& out = outputHosts_[i]->getOutput();
+        bool perSample = (layout.ids == IdPerSample);
+        int n = (perSample ? out.numSamples : out.numChannels);
+        int prev = -1;
+
+        if (layout.ids == NoIds || !out.numChannels || !out.numSamples)
+            continue;
+
+        for (int k = 0; k < n; ++k)
+        {
+            float id = (perSample ? out.channels[0][k] : out.channels[k][0]);
+            // rows past the last id have id -1 or are all zeros
+            bool padding = (id == -1);
+
+            if (perSample && !padding)
+            {
+                padding = true;
+                for (int c = 0; c < out.numChannels && padding; ++c)
+                    padding = (out.channels[c][k] == 0);
+            }
+            if (padding)
+                break;
+
+            bool newGroup = (layout.groupChan >= 0 && k &&
+                             out.channels[layout.groupChan][k] != out.channels[layout.groupChan][k-1]);
+
+            if (k && !newGroup && (int)id <= prev)
+            {
+                stringstream ss;
+                ss << layout.name << ": id " << (int)id << " follows id " << prev;
+                violation(TrackOrder, time, ss.str());
+            }
+
+            checkLive(time, layout.name, (int)id);
+            prev = (int)id;
+        }
+    }
+}
+
+void
+Soak::countClusters()
+{
+    string item = playlist_.getItemName();
+
+    if (options_.nClusters.find(item) == options_.nClusters.end())
+        return;
+
+    for (size_t i = 0; i < outputHosts_.size(); ++i)
+        if (!strcmp(OptOutputs[i].name, "Clusters"))
+        {
+            // x, y, spread, size per cluster; rows past the last one are zeros
+            const CHOP_Output& out = outputHosts_[i]->getOutput();
+            int n = 0;
+
+            while (out.numChannels == 4 && n < out.numSamples && out.channels[3][n] > 0)
+                n++;
+            clusterCounts_[item][n]++;
+        }
+}
+
+void
+Soak::checkClusterCounts(double time)
+{
+    for (auto& expected:options_.nClusters)
+    {
+        const map<int, size_t>& counts = clusterCounts_[expected.first];
+        int mode = -1;
+        size_t nFrames = 0;
+
+        for (auto& c:counts)
+        {
+            if (mode < 0 || c.second > counts.at(mode))
+                mode = c.first;
+            nFrames += c.second;
+        }
+
+        if (mode < expected.second.first || mode > expected.second.second)
+        {
+            stringstream ss;
+            ss << expected.first << ": ";
+            if (mode < 0)
+                ss << "no world frames were played";
+            else
+            {
+                ss << mode << " clusters in " << counts.at(mode) << " of " << nFrames
+                   << " world frames, " << expected.second.first;
+                if (expected.second.second != expected.second.first)
+                    ss << " to " << expected.second.second;
+                ss << " expected";
+            }
+            violation(ClusterCount, time, ss.str());
+        }
+    }
+}
+
+void
+Soak::checkLive(double time, const string& where, int id)
+{
+    map<int, double>::const_iterator seen = lastSeen_.find(id);
+
+    if (seen == lastSeen_.end() || time-seen->second > options_.maxAge)
+    {
+        stringstream ss;
+        ss << where << ": id " << id
+           << (seen == lastSeen_.end() ? " was never sent" : " was last sent ")
+           << (seen == lastSeen_.end() ? "" : to_string(time-seen->second)+" s ago");
+        violation(StaleId, time, ss.str());
+    }
+}
+
+void
+Soak::checkViews(double time)
+{
+    for (size_t i = 0; i < viewPairs_.size(); ++i)
+    {
+        ChopHost* views[2] = { viewPairs_[i].first.get(), viewPairs_[i].second.get() };
+        stringstream ss;
+
+        // first host of OPT pair is cooked with the others already
+        for (int k = (views[0] == hosts_[TracksHost].get() ? 1 : 0); k < 2; ++k)
+        {
+            views[k]->cook();
+            if (views[k]->getError().size())
+                violation(PluginError, time, viewNames_[i]+": "+views[k]->getError());
+        }
+
+        const CHOP_Output& a = views[0]->getOutput();
+        const CHOP_Output& b = views[1]->getOutput();
+
+        if (a.numChannels != b.numChannels || a.numSamples != b.numSamples)
+            ss << viewNames_[i] << ": outputs are " << a.numChannels << "x" << a.numSamples
+               << " and " << b.numChannels << "x" << b.numSamples;
+        else
+            for (int c = 0; c < a.numChannels && ss.tellp() <= 0; ++c)
+                if (memcmp(a.channels[c], b.channels[c], a.numSamples*sizeof(float)))
+                    ss << viewNames_[i] << ": channel " << c << " differs";
+
+        if (ss.tellp() > 0)
+            violation(SharedBundle, time, ss.str());
+    }
+}
+
+void
+Soak::violation(Check check, double time, const string &what)
+{
+    if (results_.violations[check]++ < MAX_EXAMPLES)
+        cerr << "opt-soak: " << CheckNames[check] << " at " << time << " s ("
+             << playlist_.getItemName() << "): " << what << endl;
+}
+
+void
+Soak::pruneLastSeen(double time)
+{
+    for (map<int, double>::iterator it = lastSeen_.begin(); it != lastSeen_.end();)
+        if (time-it->second > options_.maxAge)
+            it = lastSeen_.erase(it);
+        else
+            ++it;
+}
+
+//******************************************************************************
+static void writeJson(const Soak::Results& r, const string& path)
+{
+    ofstream f(path);
+
+    f << "{\"soak\": \"opt-soak\", \"version\": 1," << endl
+      << "  \"streamSeconds\": " << r.streamSeconds << ", \"wallSeconds\": " << r.wallSeconds
+      << ", \"items\": " << r.nItems << ", \"cycles\": " << r.nCycles << "," << endl
+      << "  \"cooks\": " << r.nCooks << ", \"datagrams\": " << r.nDatagrams
+      << ", \"checked\": " << r.nChecked << ", \"maxQueue\": " << r.maxQueue << "," << endl
+      << "  \"hwmKb\": " << r.hwmKb << ", \"rssWarmKb\": " << r.rssWarmKb
+      << ", \"rssEndKb\": " << r.rssEndKb
+      << ", \"rssGrowthKb\": " << (long)r.rssEndKb-(long)r.rssWarmKb << "," << endl
+      << "  \"violations\": {";
+    for (int c = 0; c < Soak::NChecks; ++c)
+        f << (c ? ", " : "") << "\"" << Soak::CheckNames[c] << "\": " << r.violations[c];
+    f << "}," << endl << "  \"cookUs\": {" << endl;
+    for (int h = 0; h < Soak::NHosts; ++h)
+        f << "    \"" << Soak::HostNames[h] << "\": {\"p50\": " << r.cookUs[h][0]
+          << ", \"p99\": " << r.cookUs[h][1] << ", \"p999\": " << r.cookUs[h][2]
+          << ", \"max\": " << r.cookUs[h][3] << "}" << (h+1 < Soak::NHosts ? "," : "") << endl;
+    f << "  }" << endl << "}" << endl;
+
+    if (!f)
+        throw runtime_error("can't write "+path);
+}
+
+// prints and counts regressions against a baseline written by writeJson;
+// throws runtime_error if baseline can't be read
+static int compareBaseline(const Soak::Results& r, const string& path, double tolerance)
+{
+    ifstream f(path);
+    stringstream ss;
+    rapidjson::Document b;
+
+    ss << f.rdbuf();
+    if (!f || b.Parse(ss.str().c_str()).HasParseError() || !b.IsObject() ||
+        !b.HasMember("cookUs") || !b.HasMember("hwmKb") || !b.HasMember("rssGrowthKb"))
+        throw runtime_error("can't read baseline "+path);
+
+    int nRegressions = 0;
+    auto check = [&nRegressions](const string& what, double value, double limit){
+        if (value > limit)
+        {
+            cerr << "opt-soak: regression: " << what << " " << value
+                 << " (limit " << limit << ")" << endl;
+            nRegressions++;
+        }
+    };
+
+    if (b.HasMember("items") && b["items"].GetUint64() != r.nItems)
+        cerr << "opt-soak: baseline was recorded with " << b["items"].GetUint64()
+             << " playlist items, this run has " << r.nItems << endl;
+
+    for (int h = 0; h < Soak::NHosts; ++h)
+    {
+        const char *name = Soak::HostNames[h];
+
+        if (!b["cookUs"].HasMember(name))
+            continue;
+
+        const rapidjson::Value& base = b["cookUs"][name];
+
+        check(string(name)+" p50 cook us", r.cookUs[h][0],
+              base["p50"].GetDouble()*(1+tolerance)+LATENCY_SLACK_US);
+        check(string(name)+" p99 cook us", r.cookUs[h][1],
+              base["p99"].GetDouble()*(1+tolerance)+LATENCY_SLACK_US);
+    }
+
+    check("memory high-water mark KB", r.hwmKb, b["hwmKb"].GetDouble()*(1+tolerance));
+    check("RSS growth after warm-up KB", (long)r.rssEndKb-(long)r.rssWarmKb,
+          max(0., b["rssGrowthKb"].GetDouble())*(1+tolerance)+GROWTH_SLACK_KB);
+
+    return nRegressions;
+}
+
+int main(int argc, char **argv)
+{
+    Soak::Options options;
+    string baselinePath, outputPath;
+    double tolerance = 0.5, maxGrowthMb = 8;
+    int opt;
+
+    options.optPlugin = "build/OPT_CHOP.so";
+    options.omPlugin = "build/OM_CHOP.so";
+    options.duration = 600;
+    options.speed = 10;
+    options.rate = 60;
+    options.nPeople = 20;
+    options.crowdSeconds = 60;
+    options.maxQueue = 8;
+    options.maxAge = 5;
+    options.verbose = false;
+
+    while ((opt = getopt(argc, argv, "p:m:d:s:r:N:C:q:a:g:z:t:k:b:x:o:v")) != -1)
+    {
+        switch (opt) {
+            case 'p': options.optPlugin = optarg; break;
+            case 'm': options.omPlugin = optarg; break;
+            case 'd': options.duration = atof(optarg); break;
+            case 's': options.speed = atof(optarg); break;
+            case 'r': options.rate = atof(optarg); break;
+            case 'N': options.nPeople = atoi(optarg); break;
+            case 'C': options.crowdSeconds = atof(optarg); break;
+            case 'q': options.maxQueue = atoi(optarg); break;
+            case 'a': options.maxAge = atof(optarg); break;
+            case 'g': maxGrowthMb = atof(optarg); break;
+            case 'z': options.zonesDat = optarg; break;
+            case 't': options.stageDat = optarg; break;
+            case 'k':
+            {
+                const char *eq = strrchr(optarg, '=');
+                const char *dash = (eq ? strchr(eq, '-') : nullptr);
+
+                if (!eq)
+                {
+                    usage();
+                    return 1;
+                }
+                options.nClusters[string(optarg, eq-optarg)] =
+                    make_pair(atoi(eq+1), atoi(dash ? dash+1 : eq+1));
+            }
+                break;
+            case 'b': baselinePath = optarg; break;
+            case 'x': tolerance = atof(optarg); break;
+            case 'o': outputPath = optarg; break;
+            case 'v': options.verbose = true; break;
+            default: usage(); return 1;
+        }
+    }
+
+    if (options.rate <= 0 || options.duration <= 0 || options.crowdSeconds <= 0 ||
+        (options.nPeople && (options.nPeople < CROWD_MIN_PEOPLE || options.nPeople > CROWD_MAX_PEOPLE)))
+    {
+        usage();
+        return 1;
+    }
+
+    try
+    {
+        Playlist playlist(options.nPeople, options.crowdSeconds);
+
+        for (int i = optind; i < argc; ++i)
+            playlist.addCapture(argv[i]);
+
+        if (!playlist.size())
+        {
+            cerr << "opt-soak: nothing to play - no captures and no crowds" << endl;
+            return 1;
+        }
+
+        Soak soak(options, playlist);
+        Soak::Results r = soak.run();
+        size_t nViolations = 0;
+
+        cout << "stream s " << r.streamSeconds << " wall s " << r.wallSeconds
+             << " cycles " << r.nCycles << " cooks " << r.nCooks
+             << " datagrams " << r.nDatagrams << " checked " << r.nChecked << endl;
+        for (int h = 0; h < Soak::NHosts; ++h)
+            cout << Soak::HostNames[h] << " cook us: p50 " << r.cookUs[h][0]
+                 << " p99 " << r.cookUs[h][1] << " p99.9 " << r.cookUs[h][2]
+                 << " max " << r.cookUs[h][3] << endl;
+        cout << "memory MB: high-water " << r.hwmKb/1024.
+             << " after warm-up " << r.rssWarmKb/1024.
+             << " at end " << r.rssEndKb/1024.
+             << " max queue " << r.maxQueue << endl;
+        cout << "violations:";
+        for (int c = 0; c < Soak::NChecks; ++c)
+        {
+            cout << " " << Soak::CheckNames[c] << " " << r.violations[c];
+            nViolations += r.violations[c];
+        }
+        cout << endl;
+
+        int nFailures = (int)min(nViolations, (size_t)1);
+
+        if ((long)r.rssEndKb-(long)r.rssWarmKb > maxGrowthMb*1024)
+        {
+            cerr << "opt-soak: RSS grew by " << ((long)r.rssEndKb-(long)r.rssWarmKb)/1024.
+                 << " MB after warm-up" << endl;
+            nFailures++;
+        }
+
+        if (outputPath.size())
+            writeJson(r, outputPath);
+        if (baselinePath.size())
+            nFailures += compareBaseline(r, baselinePath, tolerance);
+
+        cout << (nFailures ? "FAIL" : "PASS") << endl;
+
+        return (nFailures ? 1 : 0);
+    }
+    catch (exception& e)
+    {
+        cerr << "opt-soak: " << e.what() << endl;
+        return 1;
+    }
+}
@@ -40,9 +40,17 @@
 #include <stdint.h>
 #include "GL_Extensions.h"
 #define DLLEXPORT __declspec (dllexport)
-#else
+#elif defined(__APPLE__)
 #include <OpenGL/gltypes.h>
 #define DLLEXPORT
+#else
+// headless (Linux) builds: no OpenGL headers needed, only the types
+#include <stdint.h>
+typedef unsigned int GLuint;
+typedef unsigned int GLenum;
+typedef int GLint;
+#define DLLEXPORT __attribute__((visibility("default")))
+#define __cdecl
 #endif
 
 #include <cmath>
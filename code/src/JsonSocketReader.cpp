@@ -11,11 +11,18 @@
 #include <sstream>
 #include <regex>
 #include <iostream>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <chrono>
 
 #include "rapidjson/writer.h"
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/error/en.h"
 
+#include "trace.hpp"
+#include "binary-frame.hpp"
+
 #ifdef WIN32
 	#include <ws2tcpip.h>
 #else
@@ -42,7 +49,8 @@ string do_replace( string const & in, string const & from, string const & to )
 //******************************************************************************
 
 JsonSocketReader::JsonSocketReader(int port):
-isActive_(false)
+isActive_(false),
+nRecordUsers_(0)
 {
     setupSocket(port);
 }
@@ -58,6 +66,9 @@ JsonSocketReader::start()
 {
     if (!isActive_)
     {
+        // set before the thread runs, so an instance created right after
+        // this one sees the reader running and doesn't start another thread
+        isActive_ = true;
         readThread_ = make_shared<thread>(bind(&JsonSocketReader::listenSocket, this));
     }
     else
@@ -106,7 +117,120 @@ JsonSocketReader::unregisterSlave(JsonSocketReader::ISlaveReceiver *slave)
     }
 }
 
+void
+JsonSocketReader::startRecording(const CaptureRecorder::Config& config)
+{
+    lock_guard<mutex> lock(recordMutex_);
+    
+    if (!nRecordUsers_)
+        recorder_.start(config);
+    nRecordUsers_++;
+}
+
+void
+JsonSocketReader::stopRecording()
+{
+    lock_guard<mutex> lock(recordMutex_);
+    
+    if (nRecordUsers_ && --nRecordUsers_ == 0)
+        recorder_.stop();
+}
+
+void
+JsonSocketReader::deliver(const char* datagram, size_t len)
+{
+    process(datagram, len, nullptr);
+}
+
+JsonDocumentPtr
+JsonSocketReader::parse(const char* datagram, size_t len, string& error, Metrics* metrics)
+{
+    TRACE_SCOPE("socket.parse");
+    int64_t begin = (metrics ? Metrics::now() : 0);
+    shared_ptr<rapidjson::Document> d = make_shared<rapidjson::Document>();
+    bool parsed;
+    
+    if (isBinaryFrame(datagram, len))
+    {
+        // compact binary frame - header is converted, tracks are copied as
+        // they are; there's no text to parse
+        TRACE_SCOPE("socket.binary");
+        parsed = binaryToDocument(datagram, len, *d, error);
+    }
+    else
+    {
+        string json;
+        
+        {
+            TRACE_SCOPE("socket.nan-rewrite");
+            // little hack to replace pyhton's NaN to "NaN" (strings) so that parser does not freak out
+            json = do_replace(string(datagram, len), "NaN", "\"Null\"");
+        }
+        
+        d->Parse(json.c_str());
+        parsed = !d->HasParseError();
+        
+        if (!parsed)
+        {
+            stringstream ss;
+            ss << "Error while parsing JSON (" << json << "): "
+               << rapidjson::GetParseError_En(d->GetParseError());
+            
+            error = ss.str();
+        }
+    }
+    
+    if (metrics)
+    {
+        metrics->add(Metrics::Packets);
+        metrics->add(Metrics::Bytes, (int64_t)len);
+        metrics->add(Metrics::ParseNs, Metrics::now()-begin);
+        if (!parsed)
+            metrics->add(Metrics::DropsParse);
+    }
+    
+    if (!parsed)
+    {
+        perror(error.c_str());
+        return JsonDocumentPtr();
+    }
+    
+    return d;
+}
+
 //******************************************************************************
+void
+JsonSocketReader::process(const char* datagram, size_t len, CaptureRecordHeader* record)
+{
+    TRACE_SCOPE("socket.process");
+    string error;
+    JsonDocumentPtr doc = parse(datagram, len, error, &metrics_);
+    
+    if (record && recorder_.isRecording())
+    {
+        // original bytes are recorded, so replay goes through the same path
+        record->length = (uint32_t)len;
+        record->seq = -1;
+        record->tag = (uint8_t)(doc ? captureTag(*doc, record->seq) : TagUnknown);
+        recorder_.push(*record, datagram);
+    }
+    
+    if (doc)
+    {
+        // deliver document to slaves; all of them share one copy
+        TRACE_SCOPE("socket.deliver");
+        lock_guard<mutex> lock(slavesMutex_);
+        for (auto slave:slaves_)
+            slave->onNewJsonObjectReceived(doc);
+    }
+    else
+    {
+        lock_guard<mutex> lock(slavesMutex_);
+        for (auto slave:slaves_)
+            slave->onSocketReaderError(error);
+    }
+}
+
 void
 JsonSocketReader::setupSocket(int port)
 {
@@ -149,6 +273,12 @@ JsonSocketReader::setupSocket(int port)
         throw runtime_error(ss.str());
     }
     
+#ifndef WIN32
+    // kernel receive timestamps for recording; not critical if unsupported
+    int enable = 1;
+    setsockopt(socket_, SOL_SOCKET, SO_TIMESTAMP, &enable, sizeof(enable));
+#endif
+    
     if (::bind(socket_, (struct sockaddr *)&server, sizeof(server)) == SOCKET_ERROR)
     {
         stringstream ss;
@@ -173,50 +303,58 @@ JsonSocketReader::destroySocket()
 void
 JsonSocketReader::listenSocket()
 {
-    static struct sockaddr si_other;
-    static socklen_t slen = sizeof(si_other);
+    struct sockaddr_in si_other;
+    CaptureRecordHeader record;
+#ifdef WIN32
+    int slen;
+#else
+    char control[CMSG_SPACE(sizeof(struct timeval))];
+    struct iovec iov;
+    struct msghdr msg;
+#endif
     
-	isActive_ = true;
+    TRACE_THREAD("socket");
     
     while (isActive_)
     {
         memset(buffer_, 0, BUFLEN);
+#ifdef WIN32
+        slen = sizeof(si_other);
         long recvLen = recvfrom(socket_,
                                 buffer_, BUFLEN,
                                 0,
                                 (struct sockaddr*)&si_other, &slen);
-        if (buffer_[0] != 0)
-        {
-            std::string buf(buffer_);
-            // little hack to replace pyhton's NaN to "NaN" (strings) so that parser does not freak out
-            strcpy(buffer_, do_replace(buf, "NaN", "\"Null\"").c_str());
-            
-            rapidjson::Document d;
-            d.Parse(buffer_);
-            
-            if (!d.HasParseError())
-            {
-                // deliver document to slaves
-                {
-                    lock_guard<mutex> lock(slavesMutex_);
-                    for (auto slave:slaves_)
-                        slave->onNewJsonObjectReceived(d);
-                }
-            }
-            else
+        record.recvTimeNs = chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+#else
+        iov.iov_base = buffer_;
+        iov.iov_len = BUFLEN;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &si_other;
+        msg.msg_namelen = sizeof(si_other);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        
+        long recvLen = recvmsg(socket_, &msg, 0);
+        record.recvTimeNs = 0;
+        
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c))
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMP)
             {
-                stringstream ss;
-                ss << "Error while parsing JSON (" << buffer_ << "): "
-                   << rapidjson::GetParseError_En(d.GetParseError());
-                
-                perror(ss.str().c_str());
-                {
-                    lock_guard<mutex> lock(slavesMutex_);
-                    for (auto slave:slaves_)
-                        slave->onSocketReaderError(ss.str());
-                }
+                struct timeval tv;
+                memcpy(&tv, CMSG_DATA(c), sizeof(tv));
+                record.recvTimeNs = (int64_t)tv.tv_sec*1000000000LL + (int64_t)tv.tv_usec*1000;
             }
-        }
+        if (!record.recvTimeNs)
+            record.recvTimeNs = chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+#endif
+        record.srcAddr = si_other.sin_addr.s_addr;
+        record.srcPort = ntohs(si_other.sin_port);
+        record.reserved = 0;
+        
+        if (buffer_[0] != 0)
+            process(buffer_, recvLen, &record);
 #ifdef WIN32
 		else if (recvLen == SOCKET_ERROR)
 #else
@@ -10,24 +10,36 @@
 #define SocketReader_hpp
 
 #include <stdio.h>
+#include <string>
 #include <vector>
 #include <thread>
+#include <memory>
+#include <atomic>
+#include <mutex>
 
 #include "rapidjson/document.h"
 
+#include "capture-recorder.hpp"
+#include "metrics.hpp"
+
 #ifdef WIN32
     #include <winsock2.h>
-	#include <atomic>
-	#include <mutex>
 #endif
 
 #define BUFLEN 65507
 
+typedef std::shared_ptr<const rapidjson::Document> JsonDocumentPtr;
+
+// regex replace of all matches; used for python's NaN rewrite of datagrams
+std::string do_replace(std::string const & in, std::string const & from, std::string const & to);
+
 /**
  * JSON Socket reader - provides asynchronous reading from UDP socket
- * and formatting read data as a JSON object.
+ * and formatting read data as a JSON object. Binary OPT frames are accepted
+ * on the same socket and delivered as documents too.
  * Whenever new JSON object is retrieved from the socket, all registered
- * receivers are notified. They must copy data if they need to and return
+ * receivers are notified with the same immutable document. They may keep the
+ * pointer for as long as they need (no copies are needed) and must return
  * as quickly as possible.
  */
 class JsonSocketReader {
@@ -35,7 +47,7 @@ public:
     
     class ISlaveReceiver {
     public:
-        virtual void onNewJsonObjectReceived(const rapidjson::Document&) = 0;
+        virtual void onNewJsonObjectReceived(const JsonDocumentPtr&) = 0;
         virtual void onSocketReaderError(const std::string&) = 0;
         virtual void onSocketReaderWillReset() = 0;
     };
@@ -56,6 +68,31 @@ public:
     void registerSlave(ISlaveReceiver*);
     void unregisterSlave(ISlaveReceiver*);
     
+    // parses datagram and delivers it to registered receivers, same as if
+    // it was received on the socket; may be called from any thread
+    void deliver(const char* datagram, size_t len);
+    
+    // parses datagram the way received datagrams are parsed - JSON or binary
+    // frame (see binary-frame.hpp), told apart per datagram; returns nullptr
+    // and error description if datagram is not valid; packets, bytes,
+    // parse time and parse errors are counted in metrics, if given
+    static JsonDocumentPtr parse(const char* datagram, size_t len, std::string& error,
+                                 Metrics* metrics = nullptr);
+    
+    // received and delivered datagrams
+    const Metrics& getMetrics() const { return metrics_; }
+    
+    // records every datagram received on the socket (not the delivered ones)
+    // to capture files; for recorder state and counters - receivers share
+    // it, so they start and stop it with startRecording()/stopRecording()
+    CaptureRecorder& getRecorder() { return recorder_; }
+    
+    // recording starts with the first user, with its config, and stops when
+    // the last one stops; startRecording() throws if file can't be created,
+    // the caller is not counted then
+    void startRecording(const CaptureRecorder::Config& config);
+    void stopRecording();
+    
 private:
     char buffer_[BUFLEN];
     
@@ -71,9 +108,16 @@ private:
     std::mutex slavesMutex_;
     std::vector<ISlaveReceiver*> slaves_;
     
+    CaptureRecorder recorder_;
+    std::mutex recordMutex_;
+    int nRecordUsers_;
+    Metrics metrics_;
+    
     void setupSocket(int port);
     void destroySocket();
     void listenSocket();
+    // record header is filled for datagrams received on the socket
+    void process(const char* datagram, size_t len, CaptureRecordHeader* record);
 };
 
 #endif /* SocketReader_hpp */
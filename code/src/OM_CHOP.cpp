@@ -12,6 +12,7 @@
 #include <sstream>
 #include <iomanip>
 #include <chrono>
+#include <algorithm>
 
 #include "om-json-parser.hpp"
 #include "rapidjson/writer.h"
@@ -47,18 +48,17 @@
 #define OPENMOVES_MSG_BUNDLE 1
 #define BLANK_RUN_THRESHOLD 60
 
-#define PAIRWISE_MAXDIM 25
-#define PAIRWISE_WIDTH (PAIRWISE_MAXDIM+1)
-#define PAIRWISE_HEIGHT (PAIRWISE_MAXDIM)
-#define PAIRWISE_SIZE ((PAIRWISE_WIDTH)*PAIRWISE_HEIGHT)
+#define PAIRWISE_MAXDIM 25     // initial matrix size; grows with number of ids
+#define MAXTRACKED_MAX 256
 
-#define NPAR_OUTPUT 9
-#define NINFOPAR_OUT 3
+#define NPAR_OUTPUT 10
+#define NINFOPAR_OUT 7
 #define PAR_OUTPUT  "Output"
 #define PAR_REINIT  "Init"
 #define PAR_PORTNUM "Portnum"
 #define PAR_MAXTRACKED "Maxtracked"
 #define PAR_CLUSTERID "Clusterid"
+#define PAR_MATLAYOUT "Matlayout"
 
 #define SET_CHOP_ERROR(errexpr) {\
 stringstream msg; \
@@ -76,16 +76,24 @@ if (warningMessage_ == "") warningMessage_ = msg.str(); \
 using namespace std;
 using namespace chrono;
 
-static const char* InfoChanNames[3] = { "aliveIds", "nClusters", "noData" };
-static const char* DerOutNames[7] = { "id", "d1x", "d1y", "d2x", "d2y", "speed", "accel"};
+static const char* InfoChanNames[NINFOPAR_OUT] = { "aliveIds", "nClusters", "noData", "recording", "recDropped", "playPos", "playLength" };
+static const char* DerOutNames[OM_DERIVATIVES_NCHANS] = { "id", "d1x", "d1y", "d2x", "d2y", "speed", "accel"};
+// which value each derivatives channel depends on; id is valid if 1st derivative is
+static const uint8_t DerChanMasks[OM_DERIVATIVES_NCHANS] = {
+    OmJsonParser::MaskD1, OmJsonParser::MaskD1, OmJsonParser::MaskD1,
+    OmJsonParser::MaskD2, OmJsonParser::MaskD2,
+    OmJsonParser::MaskSpeed, OmJsonParser::MaskAccel
+};
 static const char* StageDistNames[5] = { "id", "us", "ds", "sl", "sr"};
 static const char* ClusterOutNames[4] = { "x", "y", "spread", "size" };
 static const char* ClusterIdsOutNames[3] = { "id", "x", "y"};
+static const char* ClusterIdsAllOutNames[4] = { "id", "x", "y", "cluster"};
 static const char* HotspotsOutNames[3] = { "x", "y", "spread"};
 static const char* GroupTargetNames[4] = { "val", "x", "y", "z"};
+static const char* TriangleOutNames[3] = { "a", "b", "val" };
 
-static const char *menuNames[] = { "Derivatives", "Pairwise", "Dtw", "Clusters", "Clusterids", "Hotspots", "Pca", "Stagedist", "Templates" };
-static const char *labels[] = { "Derivatives", "Pairwise matrix", "Path similarity", "Clusters", "Cluster IDs", "Hotspots", "Group target", "Stage Distances", "Templates" };
+static const char *menuNames[] = { "Derivatives", "Pairwise", "Dtw", "Clusters", "Clusterids", "Clustersall", "Hotspots", "Pca", "Stagedist", "Templates" };
+static const char *labels[] = { "Derivatives", "Pairwise matrix", "Path similarity", "Clusters", "Cluster IDs", "All Cluster IDs", "Hotspots", "Group target", "Stage Distances", "Templates" };
 static map<string, OM_CHOP::OutChoice> OutputMenuMap = {
     { "Unknown", OM_CHOP::OutChoice::Unknown },
     { "Derivatives", OM_CHOP::OutChoice::Derivatives },
@@ -93,6 +101,7 @@ static map<string, OM_CHOP::OutChoice> OutputMenuMap = {
     { "Dtw", OM_CHOP::OutChoice::Dtw },
     { "Clusters", OM_CHOP::OutChoice::Cluster },
     { "Clusterids", OM_CHOP::OutChoice::ClusterIds },
+    { "Clustersall", OM_CHOP::OutChoice::ClusterIdsAll },
     { "Hotspots", OM_CHOP::OutChoice::Hotspots },
     { "Pca", OM_CHOP::OutChoice::Pca },
     { "Stagedist", OM_CHOP::OutChoice::Stagedist },
@@ -106,12 +115,16 @@ static map<OM_CHOP::OutChoice, string> OutputSubtypeMap = {
     { OM_CHOP::OutChoice::Dtw, OM_JSON_SUBTYPE_SIM },
     { OM_CHOP::OutChoice::Cluster, OM_JSON_SUBTYPE_CLUSTER },
     { OM_CHOP::OutChoice::ClusterIds, OM_JSON_SUBTYPE_CLUSTER },
+    { OM_CHOP::OutChoice::ClusterIdsAll, OM_JSON_SUBTYPE_CLUSTER },
     { OM_CHOP::OutChoice::Hotspots, OM_JSON_SUBTYPE_MDYN },
     { OM_CHOP::OutChoice::Pca, OM_JSON_SUBTYPE_MDYN },
     { OM_CHOP::OutChoice::Stagedist, OM_JSON_SUBTYPE_DIST },
     { OM_CHOP::OutChoice::Templates, OM_JSON_SUBTYPE_SIM }
 };
 
+static const char *matLayoutMenuNames[] = { "Full", "Upper" };
+static const char *matLayoutLabels[] = { "Full Matrix", "Upper Triangle" };
+
 static shared_ptr<JsonSocketReader> SocketReader;
 
 //Required functions.
@@ -140,6 +153,16 @@ extern "C"
         // if the CHOP loads a different DLL
         delete (OM_CHOP*)instance;
     }
+
+#ifdef CHOP_HOST
+    // Headless host only: feeds datagram to the socket reader as if it was
+    // received from the network
+    OM_CHOP_API void FeedDatagram(const char* datagram, int32_t len)
+    {
+        if (SocketReader)
+            SocketReader->deliver(datagram, len);
+    }
+#endif
 };
 
 //******************************************************************************
@@ -147,6 +170,7 @@ OM_CHOP::OM_CHOP(const OP_NodeInfo * info):
 OBase(OPENMOVES_MSG_BUNDLE, PORTNUM),
 errorMessage_(""), warningMessage_(""),
 outChoice_(Derivatives),
+upperTriangle_(false),
 nAliveIds_(0),nClusters_(0),
 omJsonParser_(make_shared<OmJsonParser>(PAIRWISE_MAXDIM))
 {
@@ -155,8 +179,7 @@ omJsonParser_(make_shared<OmJsonParser>(PAIRWISE_MAXDIM))
 
 OM_CHOP::~OM_CHOP()
 {
-    if (SocketReader)
-        SocketReader->unregisterSlave(this);
+    closeSources();
 }
 
 void OM_CHOP::getGeneralInfo(CHOP_GeneralInfo * ginfo)
@@ -170,12 +193,31 @@ bool OM_CHOP::getOutputInfo(CHOP_OutputInfo * info)
     
     switch (outChoice_) {
         case Derivatives:
-            info->numChannels = 7; // id d1x d1y d2x d2y speed acceleration
+            info->numChannels = OM_DERIVATIVES_NCHANS; // id d1x d1y d2x d2y speed acceleration
             break;
         case Pairwise: // fallthrough
         case Dtw:
-            info->numSamples = info->opInputs->getParInt(PAR_MAXTRACKED)+1;
-            info->numChannels = info->opInputs->getParInt(PAR_MAXTRACKED);
+        {
+            int maxTracked = info->opInputs->getParInt(PAR_MAXTRACKED);
+            
+            if (upperTriangle_)
+            {
+                info->numSamples = max(maxTracked*(maxTracked-1)/2, 1);
+                info->numChannels = 3; // a b val
+            }
+            else
+            {
+                info->numSamples = maxTracked+1;
+                info->numChannels = maxTracked;
+                
+                for (int i = (int)rowChanNames_.size(); i < maxTracked; ++i)
+                {
+                    stringstream ss;
+                    ss << "row" << i;
+                    rowChanNames_.push_back(ss.str());
+                }
+            }
+        }
             break;
         case Cluster:
             info->numChannels = 4; // x y spread size
@@ -183,17 +225,22 @@ bool OM_CHOP::getOutputInfo(CHOP_OutputInfo * info)
         case ClusterIds:
             info->numChannels = 3; // id x y of - a person
             break;
+        case ClusterIdsAll:
+            info->numChannels = 4; // id x y cluster - of every person in clusters
+            break;
         case Stagedist:
             info->numChannels = 5; // id US DS SL SR
             break;
         case Hotspots:
-            info->numChannels = 3; // x y z
+            info->numChannels = OM_HOTSPOT_NCHANS; // x y spread
             break;
         case Pca:
-            info->numSamples = 2;
-            info->numChannels = 4;
+            info->numSamples = OM_GROUPTARGET_NROWS; // trend, principal axes
+            info->numChannels = OM_GROUPTARGET_NCHANS; // val x y z
             break;
         case Templates:
+            // id followed by score for each template seen so far
+            info->numChannels = (int32_t)omJsonParser_->getTemplateNames().size()+1;
             break;
         case Unknown:
         default:
@@ -214,10 +261,9 @@ const char* OM_CHOP::getChannelName(int index, void* reserved)
         case Pairwise: // fallthrough
         case Dtw:
         {
-            stringstream ss;
-            ss << "row" << index;
-            
-            return ss.str().c_str();
+            if (upperTriangle_)
+                return TriangleOutNames[index];
+            return rowChanNames_[index].c_str();
         }
         case Cluster:
         {
@@ -229,6 +275,11 @@ const char* OM_CHOP::getChannelName(int index, void* reserved)
             return ClusterIdsOutNames[index];
         }
             break;
+        case ClusterIdsAll:
+        {
+            return ClusterIdsAllOutNames[index];
+        }
+            break;
         case Stagedist:
         {
             return StageDistNames[index];
@@ -244,6 +295,13 @@ const char* OM_CHOP::getChannelName(int index, void* reserved)
             return GroupTargetNames[index];
         }
             break;
+        case Templates:
+        {
+            if (index == 0)
+                return "id";
+            return omJsonParser_->getTemplateNames()[index-1].c_str();
+        }
+            break;
         default:
             break;
     }
@@ -253,9 +311,14 @@ const char* OM_CHOP::getChannelName(int index, void* reserved)
 
 void OM_CHOP::execute(const CHOP_Output* output, OP_Inputs* inputs, void* reserved)
 {
+    TRACE_THREAD("cook");
+    TRACE_SCOPE("om.execute");
+    MetricsTimer cookTimer(metrics_, Metrics::CookNs);
+    metrics_.add(Metrics::Cooks);
     warningMessage_ = "";
     errorMessage_ = "";
     checkInputs(output, inputs, reserved);
+    metricsWindow_.update(getSourceMetrics(), &metrics_);
     processQueue();
     
     bool blankRun = true;
@@ -266,14 +329,14 @@ void OM_CHOP::execute(const CHOP_Output* output, OP_Inputs* inputs, void* reserv
         string subtypeToParse = OutputSubtypeMap[outChoice_];
         
         processBundle([&bundleStr, &blankRun, this,
-                       subtypeToParse, parser](vector<rapidjson::Document>& msgs){
+                       subtypeToParse, parser](const Bundle& msgs){
 #ifdef PRINT_MESSAGES
             for (auto& m:msgs)
             {
                 rapidjson::StringBuffer buffer;
                 buffer.Clear();
                 rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-                m.Accept(writer);
+                m->Accept(writer);
                 cout << "got message: " << buffer.GetString() << endl;
             }
 #endif
@@ -291,159 +354,85 @@ void OM_CHOP::execute(const CHOP_Output* output, OP_Inputs* inputs, void* reserv
         switch (outChoice_) {
             case Derivatives:
             {
-                set<int> fixedSamples;
-                long sampleIdx = 0;
-                
-                for (auto pair:omJsonParser_->getD1()) // { id -> <dx,dy> }
-                {
-                    int id = pair.first;
-                    // get sample idx of this id
-                    vector<int>::const_iterator it = find(omJsonParser_->getIdOrder().begin(),
-                                                    omJsonParser_->getIdOrder().end(), id);
-                    
-                    if (it == omJsonParser_->getIdOrder().end())
-                    {
-                        SET_CHOP_WARN(msg << "1st Derivatives id (" << id << ") was not found in available id"
-                                      " list. Message bundle: " << bundleStr)
-//                        assert(it != idOrder.end());
-                    }
-                    else
-                    {
-                        sampleIdx = it-omJsonParser_->getIdOrder().begin();
-                        if (sampleIdx < output->numChannels)
-                        {
-                            fixedSamples.insert(sampleIdx);
-                            output->channels[0][sampleIdx] = id;
-                            output->channels[1][sampleIdx] = pair.second[0];
-                            output->channels[2][sampleIdx] = pair.second[1];
-                        }
-                    }
-                }
-                
-                // TODO: this prob need to be smarter than just a loop
-                for (int i = 0; i < output->numSamples; ++i)
-                    if (fixedSamples.find(i) == fixedSamples.end())
-                        output->channels[0][i] = -1;
-                
-                for (auto pair:omJsonParser_->getD2()) // { id -> <dx,dy> }
-                {
-                    int id = pair.first;
-                    // get sample idx of this id
-                    vector<int>::const_iterator it = find(omJsonParser_->getIdOrder().begin(),
-                                                    omJsonParser_->getIdOrder().end(), id);
-                    
-                    if (it == omJsonParser_->getIdOrder().end())
-                    {
-                        SET_CHOP_WARN(msg << "2nd Derivatives id (" << id << ") was not found in available id"
-                                      " list. Message bundle: " << bundleStr)
-//                        assert(it != idOrder.end());
-                    }
-                    else
-                    {
-                        sampleIdx = it-omJsonParser_->getIdOrder().begin();
-                        
-                        if (sampleIdx < output->numSamples)
-                        {
-                            output->channels[3][sampleIdx] = pair.second[0];
-                            output->channels[4][sampleIdx] = pair.second[1];
-                        }
-                    }
-                }
+                const float *ders = omJsonParser_->getDerivatives();
+                const uint8_t *mask = omJsonParser_->getDerivativesMask();
+                int stride = omJsonParser_->getDerivativesStride();
+                int n = min(omJsonParser_->getNumDerivativeRows(), output->numSamples);
                 
-                for (auto pair:omJsonParser_->getSpeeds())
-                {
-                    int id = pair.first;
-                    vector<int>::const_iterator it = find(omJsonParser_->getIdOrder().begin(),
-                                                    omJsonParser_->getIdOrder().end(), id);
-                    
-                    if (it == omJsonParser_->getIdOrder().end())
-                    {
-                        SET_CHOP_WARN(msg << "Speed id (" << id << ") was not found in available id"
-                                      " list. Message bundle: " << bundleStr)
-                    }
-                    else
-                    {
-                        long sampleIdx = it-omJsonParser_->getIdOrder().begin();
-                        if (sampleIdx < output->numSamples)
-                            output->channels[5][sampleIdx] = pair.second;
-                    }
-                }
-                for (auto pair:omJsonParser_->getAccelerations())
+                // values that weren't received are -1
+                for (int c = 0; c < output->numChannels; ++c)
                 {
-                    int id = pair.first;
-                    vector<int>::const_iterator it = find(omJsonParser_->getIdOrder().begin(),
-                                                    omJsonParser_->getIdOrder().end(), id);
+                    const float *src = ders+c*stride;
+                    float *dst = output->channels[c];
+                    uint8_t bit = DerChanMasks[c];
                     
-                    if (it == omJsonParser_->getIdOrder().end())
-                    {
-                        SET_CHOP_WARN(msg << "Acceleration id (" << id << ") was not found in available id"
-                                      " list. Message bundle: " << bundleStr)
-                    }
-                    else
-                    {
-                        long sampleIdx = it-omJsonParser_->getIdOrder().begin();
-                        if (sampleIdx < output->numChannels)
-                            output->channels[6][sampleIdx] = pair.second;
-                    }
+                    for (int i = 0; i < n; ++i)
+                        dst[i] = ((mask[i] & bit) ? src[i] : -1.f);
+                    fill(dst+n, dst+output->numSamples, -1.f);
                 }
             }
                 break;
             case Pairwise:
-            {   
-                for (int chanIdx = 0; chanIdx < output->numChannels; chanIdx++)
-                    for (int sampleIdx = 0; sampleIdx < output->numSamples; sampleIdx++)
-                        output->channels[chanIdx][sampleIdx] = omJsonParser_->getPairwiseMat()[chanIdx*PAIRWISE_WIDTH+sampleIdx];
+            {
+                outputMatrix(output, omJsonParser_->getPairwiseMat());
             }
                 break;
             case Dtw:
             {
-                
+                outputMatrix(output, omJsonParser_->getDtwMat());
             }
                 break;
             case Cluster:
             {
-                for (int sampleIdx = 0; sampleIdx < output->numSamples; sampleIdx++)
-                {
-                    if (sampleIdx < omJsonParser_->getClusters().size())
-                    {
-                        output->channels[0][sampleIdx] = omJsonParser_->getClusters()[sampleIdx][0];
-                        output->channels[1][sampleIdx] = omJsonParser_->getClusters()[sampleIdx][1];
-                        output->channels[2][sampleIdx] = omJsonParser_->getClusters()[sampleIdx][2];
-                        output->channels[3][sampleIdx] = omJsonParser_->getClusterIds()[sampleIdx].size();
-                    }
-                    else if (!blankRun)
-                    {
-                        output->channels[0][sampleIdx] = 0;
-                        output->channels[1][sampleIdx] = 0;
-                        output->channels[2][sampleIdx] = 0;
-                        output->channels[3][sampleIdx] = 0;
-                    }
-                }
+                const ClusterTable& clusters = omJsonParser_->getClusters();
+                int n = min((int)clusters.size(), output->numSamples);
                 
-                if (!blankRun) nClusters_ = omJsonParser_->getClusters().size();
+                memcpy(output->channels[0], clusters.x.data(), n*sizeof(float));
+                memcpy(output->channels[1], clusters.y.data(), n*sizeof(float));
+                memcpy(output->channels[2], clusters.spread.data(), n*sizeof(float));
+                for (int i = 0; i < n; ++i)
+                    output->channels[3][i] = (float)clusters.clusterSize(i);
+                
+                for (int chanIdx = 0; chanIdx < output->numChannels; ++chanIdx)
+                    fill(output->channels[chanIdx]+n, output->channels[chanIdx]+output->numSamples, 0.f);
+                
+                if (!blankRun) nClusters_ = clusters.size();
             }
                 break;
             case ClusterIds:
             {
+                const ClusterTable& clusters = omJsonParser_->getClusters();
                 int clusterIdx = inputs->getParInt(PAR_CLUSTERID);
-                for (int sampleIdx = 0; sampleIdx < output->numSamples; sampleIdx++)
+                int from = 0, n = 0;
+                
+                if (clusterIdx >= 0 && clusterIdx < clusters.size())
                 {
-                    bool hasData = (clusterIdx < omJsonParser_->getClusterIds().size() &&
-                                    sampleIdx < omJsonParser_->getClusterIds()[clusterIdx].size());
-                    
-                    if (hasData)
-                    {
-                        output->channels[0][sampleIdx] = omJsonParser_->getClusterIds()[clusterIdx][sampleIdx][0];
-                        output->channels[1][sampleIdx] = omJsonParser_->getClusterIds()[clusterIdx][sampleIdx][1];
-                        output->channels[2][sampleIdx] = omJsonParser_->getClusterIds()[clusterIdx][sampleIdx][2];
-                    }
-                    else if (!blankRun)
-                    {
-                        output->channels[0][sampleIdx] = 0;
-                        output->channels[1][sampleIdx] = 0;
-                        output->channels[2][sampleIdx] = 0;
-                    }
+                    from = clusters.offsets[clusterIdx];
+                    n = min(clusters.clusterSize(clusterIdx), output->numSamples);
                 }
+                
+                memcpy(output->channels[0], clusters.memberId.data()+from, n*sizeof(float));
+                memcpy(output->channels[1], clusters.memberX.data()+from, n*sizeof(float));
+                memcpy(output->channels[2], clusters.memberY.data()+from, n*sizeof(float));
+                
+                for (int chanIdx = 0; chanIdx < output->numChannels; ++chanIdx)
+                    fill(output->channels[chanIdx]+n, output->channels[chanIdx]+output->numSamples, 0.f);
+            }
+                break;
+            case ClusterIdsAll:
+            {
+                // members are stored cluster by cluster, so it's a block copy
+                const ClusterTable& clusters = omJsonParser_->getClusters();
+                int n = min((int)clusters.numMembers(), output->numSamples);
+                
+                memcpy(output->channels[0], clusters.memberId.data(), n*sizeof(float));
+                memcpy(output->channels[1], clusters.memberX.data(), n*sizeof(float));
+                memcpy(output->channels[2], clusters.memberY.data(), n*sizeof(float));
+                memcpy(output->channels[3], clusters.memberCluster.data(), n*sizeof(float));
+                
+                for (int chanIdx = 0; chanIdx < output->numChannels; ++chanIdx)
+                    fill(output->channels[chanIdx]+n, output->channels[chanIdx]+output->numSamples,
+                         (chanIdx == 0 || chanIdx == 3 ? -1.f : 0.f));
             }
                 break;
             case Stagedist:
@@ -483,34 +472,44 @@ void OM_CHOP::execute(const CHOP_Output* output, OP_Inputs* inputs, void* reserv
                 break;
             case Hotspots:
             {
-                for (int sampleIdx = 0; sampleIdx < output->numSamples; sampleIdx++)
+                const float *hotspots = omJsonParser_->getHotspots();
+                int stride = omJsonParser_->getHotspotsStride();
+                int n = min(omJsonParser_->getNumHotspots(), output->numSamples);
+                
+                for (int chanIdx = 0; chanIdx < output->numChannels; chanIdx++)
                 {
-                    if (sampleIdx < omJsonParser_->getHotspots().size() &&
-                        sampleIdx < output->numSamples)
-                    {
-                        output->channels[0][sampleIdx] = omJsonParser_->getHotspots()[sampleIdx][0];
-                        output->channels[1][sampleIdx] = omJsonParser_->getHotspots()[sampleIdx][1];
-                        output->channels[2][sampleIdx] = omJsonParser_->getHotspots()[sampleIdx][2];
-                    }
+                    if (n)
+                        memcpy(output->channels[chanIdx], hotspots+chanIdx*stride, n*sizeof(float));
+                    memset(output->channels[chanIdx]+n, 0, (output->numSamples-n)*sizeof(float));
                 }
             }
                 break;
             case Pca:
             {
-//                assert(omJsonParser_->getGroupTarget().size() <= 2);
-//
-//                int sampleIdx = 0;
-//                for (auto v:omJsonParser_->getGroupTarget())
-//                {
-//                    for (int i = 0; i < v.size(); ++i)
-//                        output->channels[i][sampleIdx] = v[i];
-//                    sampleIdx++;
-//                }
+                const float *groupTarget = omJsonParser_->getGroupTarget();
+                int n = min(OM_GROUPTARGET_NROWS, output->numSamples);
+                
+                for (int chanIdx = 0; chanIdx < output->numChannels; chanIdx++)
+                    memcpy(output->channels[chanIdx], groupTarget+chanIdx*OM_GROUPTARGET_NROWS,
+                           n*sizeof(float));
             }
                 break;
             case Templates:
             {
+                const float *templates = omJsonParser_->getTemplates();
+                int stride = omJsonParser_->getTemplatesStride();
+                int nChannels = (int)omJsonParser_->getTemplateNames().size()+1;
+                int n = min(omJsonParser_->getNumTemplateRows(), output->numSamples);
                 
+                for (int chanIdx = 0; chanIdx < output->numChannels; chanIdx++)
+                {
+                    int nValid = (chanIdx < nChannels ? n : 0);
+                    
+                    if (nValid)
+                        memcpy(output->channels[chanIdx], templates+chanIdx*stride, nValid*sizeof(float));
+                    for (int sampleIdx = nValid; sampleIdx < output->numSamples; sampleIdx++)
+                        output->channels[chanIdx][sampleIdx] = -1;
+                }
             }
                 break;
             default:
@@ -531,7 +530,7 @@ void OM_CHOP::execute(const CHOP_Output* output, OP_Inputs* inputs, void* reserv
 int32_t
 OM_CHOP::getNumInfoCHOPChans()
 {
-    return NINFOPAR_OUT+(int32_t)lastProcessedSeqs_.size();
+    return NINFOPAR_OUT+MetricsWindow::NChans+(int32_t)seqChanNames_.size();
 }
 
 void
@@ -551,17 +550,36 @@ OM_CHOP::getInfoCHOPChan(int32_t index,
             chan->name = InfoChanNames[index];
             chan->value = (float)noData_;
             break;
+        case 3:
+            chan->name = InfoChanNames[index];
+            chan->value = (float)(SocketReader && SocketReader->getRecorder().isRecording());
+            break;
+        case 4:
+            chan->name = InfoChanNames[index];
+            chan->value = (float)(SocketReader ? SocketReader->getRecorder().getNumDropped() : 0);
+            break;
+        case 5:
+            chan->name = InfoChanNames[index];
+            chan->value = (float)player_->getPosition();
+            break;
+        case 6:
+            chan->name = InfoChanNames[index];
+            chan->value = (float)player_->getDuration();
+            break;
         default:
-		{
-			map<string, int>::iterator it = lastProcessedSeqs_.begin();
-			stringstream ss;
-			advance(it, index - NINFOPAR_OUT);
-//            ss << "seq_" << index;  it->first;
-			ss << "seq_" << it->first;
-
-			chan->name = ss.str().c_str();
-			chan->value = (float)it->second;
-		}
+            // names are precomputed, so every channel is O(1)
+            if (index < NINFOPAR_OUT+MetricsWindow::NChans)
+            {
+                chan->name = MetricsWindow::getChanName(index-NINFOPAR_OUT);
+                chan->value = metricsWindow_.getChanValue(index-NINFOPAR_OUT);
+            }
+            else
+            {
+                size_t i = index-NINFOPAR_OUT-MetricsWindow::NChans;
+                
+                chan->name = seqChanNames_[i].c_str();
+                chan->value = (float)seqChanValues_[i];
+            }
             break;
     }
 }
@@ -600,7 +618,7 @@ void OM_CHOP::setupParameters(OP_ParameterManager* manager)
         maxTracked.page = "Output";
         maxTracked.defaultValues[0] = 1;
         maxTracked.minValues[0] = 1;
-        maxTracked.maxValues[0] = PAIRWISE_MAXDIM;
+        maxTracked.maxValues[0] = MAXTRACKED_MAX;
         
         OP_NumericParameter clusterId(PAR_CLUSTERID);
         
@@ -614,11 +632,24 @@ void OM_CHOP::setupParameters(OP_ParameterManager* manager)
         assert(res == OP_ParAppendResult::Success);
         res = manager->appendInt(clusterId);
         assert(res == OP_ParAppendResult::Success);
+        
+        OP_StringParameter matLayout(PAR_MATLAYOUT);
+        
+        matLayout.label = "Matrix Layout";
+        matLayout.page = "Output";
+        matLayout.defaultValue = matLayoutMenuNames[0];
+        
+        res = manager->appendMenu(matLayout, 2, matLayoutMenuNames, matLayoutLabels);
+        assert(res == OP_ParAppendResult::Success);
     }
+    setupPlaybackParameters(manager);
+    setupRecordParameters(manager, "om");
+    setupTraceParameters(manager, "om-trace.json");
 }
 
 void OM_CHOP::pulsePressed(const char *name)
 {
+    sourcePulsePressed(name);
     if (!strcmp(name, "Init"))
     {
         
@@ -635,6 +666,7 @@ OM_CHOP::setupSocketReader()
         
         if (!SocketReader)
             SocketReader = make_shared<JsonSocketReader>(PORTNUM);
+        socketReader_ = SocketReader;
         
         if (!SocketReader->isRunning())
             SocketReader->start();
@@ -663,6 +695,56 @@ OM_CHOP::checkInputs(const CHOP_Output *outputs, OP_Inputs *inputs, void *)
         inputs->enablePar(PAR_CLUSTERID, true);
     else
         inputs->enablePar(PAR_CLUSTERID, false);
+    
+    upperTriangle_ = (strcmp(inputs->getParString(PAR_MATLAYOUT), matLayoutMenuNames[1]) == 0);
+    inputs->enablePar(PAR_MATLAYOUT, outChoice_ == Pairwise || outChoice_ == Dtw);
+    
+    checkRecording(inputs);
+    checkPlayback(inputs);
+    checkTrace(inputs);
+}
+
+void
+OM_CHOP::outputMatrix(const CHOP_Output *output, const float *mat)
+{
+    int dim = omJsonParser_->getMatDim();
+    int stride = omJsonParser_->getMatStride();
+    
+    if (upperTriangle_)
+    {
+        // one sample per pair of ids: a, b, value
+        int sampleIdx = 0;
+        
+        for (int i = 0; i < dim && sampleIdx < output->numSamples; ++i)
+        {
+            const float *row = mat+(size_t)i*stride;
+            
+            for (int j = i+1; j < dim && sampleIdx < output->numSamples; ++j, ++sampleIdx)
+            {
+                output->channels[0][sampleIdx] = row[0];
+                output->channels[1][sampleIdx] = mat[(size_t)j*stride];
+                output->channels[2][sampleIdx] = row[j+1];
+            }
+        }
+        
+        for (int chanIdx = 0; chanIdx < output->numChannels; ++chanIdx)
+            for (int i = sampleIdx; i < output->numSamples; ++i)
+                output->channels[chanIdx][i] = -1;
+    }
+    else
+    {
+        // channel per matrix row: id followed by row values
+        for (int chanIdx = 0; chanIdx < output->numChannels; chanIdx++)
+        {
+            int nValid = (chanIdx < dim ? min(dim+1, output->numSamples) : 0);
+            const float *row = mat+(size_t)chanIdx*stride;
+            
+            for (int sampleIdx = 0; sampleIdx < nValid; sampleIdx++)
+                output->channels[chanIdx][sampleIdx] = row[sampleIdx];
+            for (int sampleIdx = nValid; sampleIdx < output->numSamples; sampleIdx++)
+                output->channels[chanIdx][sampleIdx] = -1;
+        }
+    }
 }
 
 void
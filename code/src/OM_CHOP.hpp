@@ -29,6 +29,7 @@
 #include "CHOP_CPlusPlusBase.h"
 #include "JsonSocketReader.hpp"
 #include "o-base.hpp"
+#include "trace.hpp"
 
 class OmJsonParser;
 
@@ -43,6 +44,7 @@ public:
         Dtw,
         Cluster,
         ClusterIds,
+        ClusterIdsAll,
         Hotspots,
         Pca,
         Stagedist,
@@ -82,6 +84,8 @@ private:
     std::string errorMessage_, warningMessage_;
     
     OutChoice outChoice_;
+    bool upperTriangle_;
+    std::vector<std::string> rowChanNames_;
     
     const OP_NodeInfo *myNodeInfo;
     
@@ -92,6 +96,7 @@ private:
     void processingError(std::string m) override;
     
     void checkInputs(const CHOP_Output *, OP_Inputs *inputs, void *);
+    void outputMatrix(const CHOP_Output *output, const float *mat);
     void blankRunsTrigger();
 };
 
@@ -18,10 +18,18 @@
 #include "defines.h"
 #include "debug.h"
 
+#include <chrono>
+#include <functional>
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+
 #include "rapidjson/document.h"
 #include "rapidjson/writer.h"
 #include "rapidjson/stringbuffer.h"
 
+#include "binary-frame.hpp"
+
 #ifdef WIN32
     #include <winsock2.h>
 
@@ -63,7 +71,7 @@ warningMessage_ = msg.str(); \
 #define PORTNUM 21234
 
 #define NPAR_OUT 8
-#define NINFOPAR_OUT 5
+#define NINFOPAR_OUT 9
 #define PAR_MAXTRACKED "Maxtracked"
 #define PAR_MINX "Minx"
 #define PAR_MAXX "Maxx"
@@ -72,11 +80,84 @@ warningMessage_ = msg.str(); \
 #define PAR_MINZ "Minz"
 #define PAR_MAXZ "Maxz"
 #define PAR_FILTERTOGGLE "Filtertoggle"
+#define PAR_OUTPUT "Output"
+#define PAR_TRAILLENGTH "Traillength"
+#define PAR_TRAILDECIM "Traildecim"
+#define PAR_TRAILSTEP "Trailstep"
+#define PAR_ZONESDAT "Zonesdat"
+#define PAR_ZONESFILE "Zonesfile"
+#define PAR_ZONESRELOAD "Zonesreload"
+#define PAR_HEATROWS "Heatrows"
+#define PAR_HEATCOLS "Heatcols"
+#define PAR_HEATSIGMA "Heatsigma"
+#define PAR_HEATHALFLIFE "Heathalflife"
+#define PAR_HEATLAYOUT "Heatlayout"
+#define PAR_HEATRESET "Heatreset"
+#define PAR_PAIRMODE "Pairmode"
+#define PAR_PAIRRADIUS "Pairradius"
+#define PAR_SIMMODE "Simmode"
+#define PAR_SIMBAND "Simband"
+#define PAR_SIMTEMPLATES "Simtemplates"
+#define PAR_SIMRELOAD "Simreload"
+#define PAR_CLUSTERRADIUS "Clusterradius"
+#define PAR_CLUSTERMINSIZE "Clusterminsize"
+#define PAR_CLUSTERID "Clusterid"
+#define PAR_STAGEDAT "Stagedat"
+#define PAR_STAGEUS "Stageus"
+#define PAR_STAGEDS "Stageds"
+#define PAR_STAGESL "Stagesl"
+#define PAR_STAGESR "Stagesr"
+
+// tracks missing from a world frame are kept while alive per heartbeat,
+// unless the heartbeat is this much older (or newer) than the frame, seconds
+#define ALIVE_TIMEOUT 5
+
+#define NPAR_OUTPUT 10
+#define NTRAIL_CHANS 3  // id x y - per track
+#define NZONE_CHANS 6
+#define NEDGE_CHANS 3
+#define NCLUSTER_CHANS 4
+#define NCLUSTERID_CHANS 3
+#define NCLUSTERSALL_CHANS 4
+#define NSTAGEDIST_CHANS 5
 
 using namespace std;
+using namespace chrono;
 
 static const char* ChanNames[8] = { "id", "age", "confidence", "x", "y", "height", "isAlive", "stableId" };
-static const char* InfoChanNames[5] = { "heartbeat", "maxId", "noData", "msgQueue", "nDropped" };
+static const char* InfoChanNames[NINFOPAR_OUT] = { "heartbeat", "maxId", "noData", "msgQueue", "nDropped", "recording", "recDropped", "playPos", "playLength" };
+static const char* TrailChanNames[NTRAIL_CHANS] = { "id", "x", "y" };
+static const char* ZoneChanNames[NZONE_CHANS] = { "zone", "count", "enter", "exit", "avgdwell", "maxdwell" };
+
+static const char* EdgeChanNames[NEDGE_CHANS] = { "a", "b", "dist" };
+static const char* ClusterChanNames[NCLUSTER_CHANS] = { "x", "y", "spread", "size" };
+static const char* ClusterIdChanNames[NCLUSTERID_CHANS] = { "id", "x", "y" };
+static const char* ClusterAllChanNames[NCLUSTERSALL_CHANS] = { "id", "x", "y", "cluster" };
+static const char* StageDistChanNames[NSTAGEDIST_CHANS] = { "id", "us", "ds", "sl", "sr" };
+
+static const char *menuNames[] = { "Tracks", "Trails", "Zones", "Heatmap", "Pairwise", "Similarity", "Clusters", "Clusterids", "Clustersall", "Stagedist" };
+static const char *labels[] = { "Tracks", "Trails", "Zones", "Heatmap", "Pairwise Distances", "Path Similarity", "Clusters", "Cluster IDs", "All Cluster IDs", "Stage Distances" };
+static map<string, OPT_CHOP::OutChoice> OutputMenuMap = {
+    { "Tracks", OPT_CHOP::OutChoice::Tracks },
+    { "Trails", OPT_CHOP::OutChoice::Trails },
+    { "Zones", OPT_CHOP::OutChoice::Zones },
+    { "Heatmap", OPT_CHOP::OutChoice::Heat },
+    { "Pairwise", OPT_CHOP::OutChoice::Pairwise },
+    { "Similarity", OPT_CHOP::OutChoice::Similarity },
+    { "Clusters", OPT_CHOP::OutChoice::Clusters },
+    { "Clusterids", OPT_CHOP::OutChoice::ClusterIds },
+    { "Clustersall", OPT_CHOP::OutChoice::ClusterIdsAll },
+    { "Stagedist", OPT_CHOP::OutChoice::Stagedist }
+};
+
+static const char *decimMenuNames[] = { "Time", "Distance" };
+static const char *decimLabels[] = { "Every N Frames", "Every N Meters" };
+static const char *heatLayoutMenuNames[] = { "Rows", "Flat" };
+static const char *heatLayoutLabels[] = { "Channel Per Row", "Single Channel" };
+static const char *pairModeMenuNames[] = { "Dense", "Edges" };
+static const char *pairModeLabels[] = { "Dense Matrix", "Edge List" };
+static const char *simModeMenuNames[] = { "Pairs", "Templates" };
+static const char *simModeLabels[] = { "Track Pairs", "Templates" };
 
 static shared_ptr<JsonSocketReader> SocketReader;
 
@@ -85,6 +166,72 @@ inline bool withinBounds(float val, float min, float max)
     return (val >= min && val <= max);
 }
 
+// drops rows outside of the bounds and marks the ones listed by heartbeat
+static void filterTracks(TrackRecords& r, const set<int>& aliveIds,
+                         float minX, float maxX, float minY, float maxY, float minZ, float maxZ)
+{
+    size_t n = 0;
+    
+    for (size_t i = 0; i < r.size(); ++i)
+        if (withinBounds(r.table.x[i], minX, maxX) &&
+            withinBounds(r.table.y[i], minY, maxY) &&
+            withinBounds(r.table.z[i], minZ, maxZ))
+        {
+            if (n != i)
+                r.copyRow(n, r, i);
+            r.alive[n] = (float)(aliveIds.find(r.table.ids[n]) != aliveIds.end());
+            n++;
+        }
+    
+    r.resize(n);
+}
+
+// header.stamp in seconds, or -1 if there is none
+static double headerStamp(const rapidjson::Document& d)
+{
+    const rapidjson::Value& header = d[OPT_JSON_HEADER];
+
+    if (!header.HasMember(OPT_JSON_STAMP) || !header[OPT_JSON_STAMP].IsObject())
+        return -1;
+
+    const rapidjson::Value& stamp = header[OPT_JSON_STAMP];
+
+    if (!stamp.HasMember(OPT_JSON_SEC) || !stamp[OPT_JSON_SEC].IsNumber() ||
+        !stamp.HasMember(OPT_JSON_NSEC) || !stamp[OPT_JSON_NSEC].IsNumber())
+        return -1;
+    return stamp[OPT_JSON_SEC].GetDouble()+stamp[OPT_JSON_NSEC].GetDouble()/1E9;
+}
+
+// tokenizes DAT rows (all cells of a row together), skipping empty rows,
+// '#' comments and a header row - first row with one of headerCols in second
+// cell; returns hash of the contents, so edits can be picked up on every cook
+static size_t readDatRows(const OP_DATInput *dat, const set<string>& headerCols,
+                          vector<vector<string>>& rows)
+{
+    string allCells;
+    
+    for (int row = 0; row < dat->numRows; ++row)
+    {
+        vector<string> tokens;
+        for (int col = 0; col < dat->numCols; ++col)
+        {
+            const char *cell = dat->getCell(row, col);
+            if (cell)
+            {
+                ZoneEngine::tokenize(cell, tokens);
+                allCells.append(cell).append(1, '\t');
+            }
+        }
+        
+        if (row == 0 && tokens.size() > 1 && headerCols.count(tokens[1]))
+            continue;
+        if (tokens.size() && tokens[0][0] != '#')
+            rows.push_back(tokens);
+    }
+    
+    return hash<string>()(allCells);
+}
+
 //Required functions.
 extern "C"
 {
@@ -111,20 +258,39 @@ extern "C"
 		// if the CHOP loads a different DLL
 		delete (OPT_CHOP*)instance;
 	}
+
+#ifdef CHOP_HOST
+	// Headless host only: feeds datagram to the socket reader as if it was
+	// received from the network
+	OPT_CHOP_API void FeedDatagram(const char* datagram, int32_t len)
+	{
+		if (SocketReader)
+			SocketReader->deliver(datagram, len);
+	}
+#endif
 };
 
 OPT_CHOP::OPT_CHOP(const OP_NodeInfo * info):
 OBase(1, PORTNUM),
 errorMessage_(""), warningMessage_(""),
-heartbeat_(0)
+outChoice_(Tracks),
+heartbeat_(0),
+heartbeatStamp_(-1),
+clockOffset_(0),
+zonesDatHash_(0),
+zonesReload_(false),
+pairEdges_(false),
+dtwTemplates_(false),
+dtwReload_(false),
+clustering_(false),
+stageDatHash_(0)
 {
     setupSocketReader();
 }
 
 OPT_CHOP::~OPT_CHOP()
 {
-    if (SocketReader)
-        SocketReader->unregisterSlave(this);
+    closeSources();
 }
 
 void OPT_CHOP::getGeneralInfo(CHOP_GeneralInfo * ginfo)
@@ -134,20 +300,193 @@ void OPT_CHOP::getGeneralInfo(CHOP_GeneralInfo * ginfo)
 
 bool OPT_CHOP::getOutputInfo(CHOP_OutputInfo * info)
 {
-	info->numChannels = NPAR_OUT;
-	info->numSamples = info->opInputs->getParInt(PAR_MAXTRACKED);
+    int maxTracked = info->opInputs->getParInt(PAR_MAXTRACKED);
+    
+    // layout follows the Output menu right away, so execute() never writes
+    // one output into another output's layout
+    outChoice_ = OutputMenuMap[info->opInputs->getParString(PAR_OUTPUT)];
+    
+    switch (outChoice_) {
+        case Trails:
+        {
+            info->numChannels = NTRAIL_CHANS*maxTracked;
+            info->numSamples = info->opInputs->getParInt(PAR_TRAILLENGTH);
+            
+            if (trailChanNames_.size() != info->numChannels)
+            {
+                trailChanNames_.clear();
+                for (int i = 0; i < maxTracked; ++i)
+                    for (int k = 0; k < NTRAIL_CHANS; ++k)
+                    {
+                        stringstream ss;
+                        ss << TrailChanNames[k] << i;
+                        trailChanNames_.push_back(ss.str());
+                    }
+            }
+        }
+            break;
+        case Zones:
+            info->numChannels = NZONE_CHANS;
+            info->numSamples = max((int)zones_.getZones().size(), 1);
+            break;
+        case Heat:
+        {
+            int rows = info->opInputs->getParInt(PAR_HEATROWS);
+            int cols = info->opInputs->getParInt(PAR_HEATCOLS);
+            bool flat = (string(info->opInputs->getParString(PAR_HEATLAYOUT)) == heatLayoutMenuNames[1]);
+            
+            info->numChannels = (flat ? 1 : rows);
+            info->numSamples = (flat ? rows*cols : cols);
+            
+            if (heatChanNames_.size() != info->numChannels)
+            {
+                heatChanNames_.clear();
+                for (int i = 0; i < info->numChannels; ++i)
+                {
+                    stringstream ss;
+                    if (flat)
+                        ss << "heat";
+                    else
+                        ss << "row" << i;
+                    heatChanNames_.push_back(ss.str());
+                }
+            }
+        }
+            break;
+        case Pairwise:
+        {
+            pairEdges_ = (string(info->opInputs->getParString(PAR_PAIRMODE)) == pairModeMenuNames[1]);
+            
+            if (pairEdges_)
+            {
+                // edge count is known only after execute(), thus it's
+                // last cook's count
+                info->numChannels = NEDGE_CHANS;
+                info->numSamples = max((int)pairwise_.getNumEdges(), 1);
+            }
+            else
+            {
+                // same layout as OM_CHOP's pairwise output: id, then distances
+                info->numChannels = maxTracked;
+                info->numSamples = maxTracked+1;
+                
+                if (pairChanNames_.size() != info->numChannels)
+                {
+                    pairChanNames_.clear();
+                    for (int i = 0; i < info->numChannels; ++i)
+                    {
+                        stringstream ss;
+                        ss << "row" << i;
+                        pairChanNames_.push_back(ss.str());
+                    }
+                }
+            }
+        }
+            break;
+        case Similarity:
+        {
+            const DtwEngine::Results& results = dtw_.getResults();
+            dtwTemplates_ = (string(info->opInputs->getParString(PAR_SIMMODE)) == simModeMenuNames[1]);
+            
+            if (dtwTemplates_)
+            {
+                // id, then score per template
+                info->numChannels = (int)results.templateNames.size()+1;
+                info->numSamples = maxTracked;
+                
+                if (simChanNames_.size() != info->numChannels ||
+                    !equal(results.templateNames.begin(), results.templateNames.end(),
+                           simChanNames_.begin()+1))
+                {
+                    simChanNames_.assign(1, "id");
+                    simChanNames_.insert(simChanNames_.end(),
+                                         results.templateNames.begin(),
+                                         results.templateNames.end());
+                }
+            }
+            else
+            {
+                // same layout as OM_CHOP's dtw output: id, then similarities
+                info->numChannels = maxTracked;
+                info->numSamples = maxTracked+1;
+                
+                if (simChanNames_.size() != info->numChannels ||
+                    (info->numChannels && simChanNames_[0] != "row0"))
+                {
+                    simChanNames_.clear();
+                    for (int i = 0; i < info->numChannels; ++i)
+                    {
+                        stringstream ss;
+                        ss << "row" << i;
+                        simChanNames_.push_back(ss.str());
+                    }
+                }
+            }
+        }
+            break;
+        case Clusters:
+            info->numChannels = NCLUSTER_CHANS;
+            info->numSamples = maxTracked;
+            break;
+        case ClusterIds:
+            info->numChannels = NCLUSTERID_CHANS;
+            info->numSamples = maxTracked;
+            break;
+        case ClusterIdsAll:
+            info->numChannels = NCLUSTERSALL_CHANS;
+            info->numSamples = maxTracked;
+            break;
+        case Stagedist:
+            info->numChannels = NSTAGEDIST_CHANS;
+            info->numSamples = maxTracked;
+            break;
+        case Tracks: // fallthrough
+        default:
+            info->numChannels = NPAR_OUT;
+            info->numSamples = maxTracked;
+            break;
+    }
 	
 	return true;
 }
 
 const char* OPT_CHOP::getChannelName(int index, void* reserved)
 {
+    switch (outChoice_) {
+        case Trails:
+            return trailChanNames_[index].c_str();
+        case Zones:
+            return ZoneChanNames[index];
+        case Heat:
+            return heatChanNames_[index].c_str();
+        case Pairwise:
+            return (pairEdges_ ? EdgeChanNames[index] : pairChanNames_[index].c_str());
+        case Similarity:
+            return simChanNames_[index].c_str();
+        case Clusters:
+            return ClusterChanNames[index];
+        case ClusterIds:
+            return ClusterIdChanNames[index];
+        case ClusterIdsAll:
+            return ClusterAllChanNames[index];
+        case Stagedist:
+            return StageDistChanNames[index];
+        case Tracks: // fallthrough
+        default:
+            break;
+    }
+    
 	return ChanNames[index];
 }
 
 void OPT_CHOP::execute(const CHOP_Output* output, OP_Inputs* inputs, void* reserved)
 {
+    TRACE_THREAD("cook");
+    TRACE_SCOPE("opt.execute");
+    MetricsTimer cookTimer(metrics_, Metrics::CookNs);
+    metrics_.add(Metrics::Cooks);
     checkInputs(output, inputs, reserved);
+    metricsWindow_.update(getSourceMetrics(), &metrics_);
     processQueue();
 #ifdef WIN32
     float minX = -FLT_MAX, maxX = FLT_MAX,
@@ -159,6 +498,29 @@ void OPT_CHOP::execute(const CHOP_Output* output, OP_Inputs* inputs, void* reser
 		minZ = -MAXFLOAT, maxZ = MAXFLOAT;
 #endif
     
+    trails_.configure(inputs->getParInt(PAR_MAXTRACKED),
+                      inputs->getParInt(PAR_TRAILLENGTH),
+                      (string(inputs->getParString(PAR_TRAILDECIM)) == decimMenuNames[0] ?
+                       TrackHistory::Temporal : TrackHistory::Spatial),
+                      (float)inputs->getParDouble(PAR_TRAILSTEP));
+    
+    if (outChoice_ == Zones)
+        loadZones(inputs);
+    
+    dtw_.setBand(inputs->getParInt(PAR_SIMBAND));
+    if (outChoice_ == Similarity)
+        loadTemplates(inputs);
+    if (outChoice_ == Stagedist)
+        loadStage(inputs);
+    
+    heatmap_.configure(inputs->getParInt(PAR_HEATROWS), inputs->getParInt(PAR_HEATCOLS),
+                       inputs->getParDouble(PAR_MINX), inputs->getParDouble(PAR_MAXX),
+                       inputs->getParDouble(PAR_MINY), inputs->getParDouble(PAR_MAXY),
+                       inputs->getParDouble(PAR_HEATSIGMA), inputs->getParDouble(PAR_HEATHALFLIFE));
+    if (outChoice_ == Heat && heatmap_.isSigmaClamped())
+        SET_CHOP_WARN(msg << "Splat size is too big for grid resolution, clamped to "
+                      << heatmap_.getSigma() << " m")
+    
     if (inputs->getParInt(PAR_FILTERTOGGLE))
     {
         minX = inputs->getParDouble(PAR_MINX);
@@ -169,22 +531,27 @@ void OPT_CHOP::execute(const CHOP_Output* output, OP_Inputs* inputs, void* reser
         maxZ = inputs->getParDouble(PAR_MAXZ);
     }
     
+    double nowTs = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+    // tracks of JSON frames; binary frames go to tracks_ directly, unless
+    // there's more than one world frame in this cook to merge
     map<int, vector<float>> newTracks;
+    int nWorldFrames = 0;
+    bool packed = false;    // tracks_ holds the only (binary) world frame
 
     bool blankRun = true;
+    double worldStamp = -1;
     
     {
-        processBundle([this, output, &blankRun, &newTracks,
-                       minX, maxX, minY, maxY, minZ, maxZ](vector<rapidjson::Document>& msgs){
+        processBundle([this, output, &blankRun, &newTracks, &worldStamp, &nWorldFrames, &packed,
+                       minX, maxX, minY, maxY, minZ, maxZ](const Bundle& msgs){
             if (msgs.size() == 0)
                 return ;
 
-            string bundleStr = bundleToString(msgs);
 #ifdef PRINT_MESSAGES
-            cout << "got message: " << bundleStr << endl;
+            cout << "got message: " << bundleToString(msgs) << endl;
 #endif
             // for OPT, expecting bundle size of 1 message only
-            rapidjson::Document& d = msgs[0];
+            const rapidjson::Document& d = *msgs[0];
             
             if (d.HasMember(OPT_JSON_HEADER) &&
                 d[OPT_JSON_HEADER].HasMember(OPT_JSON_FRAMEID))
@@ -194,6 +561,7 @@ void OPT_CHOP::execute(const CHOP_Output* output, OP_Inputs* inputs, void* reser
                 if (frameId == OPT_JSON_HEARTBEAT)
                 {
                     heartbeat_++;
+                    heartbeatStamp_ = headerStamp(d);
                     
                     if (!d.HasMember(OPT_JSON_MAXID))
                         SET_CHOP_WARN(msg << "can't find " << OPT_JSON_MAXID
@@ -203,12 +571,12 @@ void OPT_CHOP::execute(const CHOP_Output* output, OP_Inputs* inputs, void* reser
                         
                     if (!d.HasMember(OPT_JSON_ALIVEIDS))
                         SET_CHOP_WARN(msg << "can't find " << OPT_JSON_ALIVEIDS
-                                      << " field in heartbeat message: " << bundleStr)
+                                      << " field in heartbeat message: " << bundleToString(msgs))
                     else
                     {
                         aliveIds_.clear();
                         
-                        const rapidjson::Value& arr = d[OPT_JSON_ALIVEIDS].GetArray();
+                        const rapidjson::Value::ConstArray& arr = d[OPT_JSON_ALIVEIDS].GetArray();
                         
                         for (int i = 0; i < arr.Size(); ++i)
                             aliveIds_.insert(arr[i].GetInt());
@@ -216,12 +584,20 @@ void OPT_CHOP::execute(const CHOP_Output* output, OP_Inputs* inputs, void* reser
                 } // if heartbeat
                 else
                 {
+                    if (packed && frameId == OPT_JSON_WORLD)
+                    {
+                        // merged with earlier binary frame of this cook
+                        spillTracks(newTracks);
+                        packed = false;
+                    }
+                    
                     if (frameId == OPT_JSON_WORLD &&
                         d.HasMember(OPT_JSON_PEOPLE_TRACKS) &&
                         d[OPT_JSON_PEOPLE_TRACKS].IsArray())
                     {
                         vector<float> NewTracks;
-                        const rapidjson::Value& tracks = d[OPT_JSON_PEOPLE_TRACKS].GetArray();
+                        worldStamp = headerStamp(d);
+                        const rapidjson::Value::ConstArray& tracks = d[OPT_JSON_PEOPLE_TRACKS].GetArray();
                         
                         //For each new track.
                         for (rapidjson::SizeType i = 0; i < tracks.Size(); i++)
@@ -269,11 +645,31 @@ void OPT_CHOP::execute(const CHOP_Output* output, OP_Inputs* inputs, void* reser
                             }
                         } // for tracks
                         
+                        nWorldFrames++;
                         blankRun = false;
                     } // if not world frameid
+                    else if (frameId == OPT_JSON_WORLD && d.HasMember(OPT_JSON_PACKED_TRACKS))
+                    {
+                        // binary frame - columns are copied into tracks_ as they are
+                        if (!unpackTracks(d, tracks_))
+                            SET_CHOP_WARN(msg << "malformed " << OPT_JSON_PACKED_TRACKS << " in binary frame")
+                        else
+                        {
+                            worldStamp = headerStamp(d);
+                            filterTracks(tracks_, aliveIds_, minX, maxX, minY, maxY, minZ, maxZ);
+                            
+                            if (nWorldFrames)
+                                spillTracks(newTracks);
+                            else
+                                packed = true;
+                            
+                            nWorldFrames++;
+                            blankRun = false;
+                        }
+                    }
                     else
                         SET_CHOP_WARN(msg << "no " << OPT_JSON_PEOPLE_TRACKS
-                                      << " field or it's not a list in incoming message: " << bundleStr)
+                                      << " field or it's not a list in incoming message: " << bundleToString(msgs))
                 } // if not heartbeat
             }
             else
@@ -282,47 +678,124 @@ void OPT_CHOP::execute(const CHOP_Output* output, OP_Inputs* inputs, void* reser
         
         if (!blankRun)
         {
-            // check, whether there are any tracks that still alive but not in newTracks
-            set<int> remainingTracks(aliveIds_);
-            for (auto& p:newTracks)
-                if (remainingTracks.find(p.first) != remainingTracks.end())
-                    remainingTracks.erase(p.first);
+            TRACE_SCOPE("opt.engines");
+            const vector<int>& frameIds = tracks_.table.ids;
             
-            if (remainingTracks.size())
-                for (auto& id:remainingTracks)
-                    if (lastTracks_[id].size() > 5 &&
-                        withinBounds(lastTracks_[id][3], minX, maxX) &&
-                        withinBounds(lastTracks_[id][4], minY, maxY) &&
-                        withinBounds(lastTracks_[id][5], minZ, maxZ))
-                        newTracks[id] = lastTracks_[id];
+            if (!packed)
+                updateTrackTable(newTracks);
+            else if (adjacent_find(frameIds.begin(), frameIds.end(), greater_equal<int>()) != frameIds.end())
+                sortTracks();
             
-            map<int, vector<float>>::iterator it = newTracks.begin();
-            for (int i = 0; i < output->numSamples; i++) {
-                
-                if (it != newTracks.end())
-                    assert(it->second.size() == NPAR_OUT);
-                
-                for (int chanIdx = 0; chanIdx < output->numChannels; ++chanIdx)
-                    if (it != newTracks.end() && chanIdx < it->second.size())
-                    {
-                        output->channels[chanIdx][i] = it->second[chanIdx];
-                    }
-                    else
-                        output->channels[chanIdx][i] = 0;
+            // check, whether there are any tracks that still alive but not in this frame;
+            // heartbeat from before the sender restarted doesn't count
+            bool aliveCurrent = (worldStamp < 0 || heartbeatStamp_ < 0 ||
+                                 fabs(worldStamp-heartbeatStamp_) <= ALIVE_TIMEOUT);
+            size_t nTracks = tracks_.size();
+            
+            if (aliveCurrent)
+                for (auto& id:aliveIds_)
+                {
+                    const vector<int>& ids = tracks_.table.ids;
+                    const vector<int>& lastIds = lastTracks_.table.ids;
+                    
+                    if (binary_search(ids.begin(), ids.begin()+nTracks, id))
+                        continue;
+                    
+                    vector<int>::const_iterator it = lower_bound(lastIds.begin(), lastIds.end(), id);
+                    size_t row = it-lastIds.begin();
+                    
+                    if (it != lastIds.end() && *it == id &&
+                        withinBounds(lastTracks_.table.x[row], minX, maxX) &&
+                        withinBounds(lastTracks_.table.y[row], minY, maxY) &&
+                        withinBounds(lastTracks_.table.z[row], minZ, maxZ))
+                        tracks_.append(lastTracks_, row);
+                }
+            if (tracks_.size() != nTracks)
+                sortTracks();
+            
+            trails_.update(tracks_.table);
+            
+            // dwell and heat go by sender's time, so they don't depend on
+            // cook rate or replay speed; wall clock for frames without stamp
+            double frameTs = (worldStamp >= 0 ? worldStamp*1000 : nowTs);
+            
+            clockOffset_ = frameTs-nowTs;
+            if (outChoice_ == Zones)
+                zones_.update(tracks_.table, frameTs);
+            if (outChoice_ == Heat)
+                heatmap_.update(tracks_.table, frameTs);
+            if (outChoice_ == Pairwise)
+            {
+                float radius = inputs->getParDouble(PAR_PAIRRADIUS);
                 
-                if (it != newTracks.end())
-                    it++;
-            } // for i
+                if (pairEdges_)
+                {
+                    if (radius <= 0)
+                        SET_CHOP_WARN(msg << "neighbor radius must be positive for edge list output")
+                    pairwise_.updateEdges(tracks_.table, radius);
+                }
+                else
+                    pairwise_.updateDense(tracks_.table, radius);
+            }
+            // computed on a worker thread; results show up in one of the
+            // following cooks
+            if (outChoice_ == Similarity)
+                dtw_.submit(tracks_.table, trails_);
+            // clusters are tracked for cluster outputs only; labels start
+            // over when one is selected, as tracks of frames that weren't
+            // clustered are unknown to label history
+            bool clusterOutput = (outChoice_ == Clusters || outChoice_ == ClusterIds ||
+                                  outChoice_ == ClusterIdsAll);
             
-            lastTracks_ = newTracks;
+            if (clusterOutput && !clustering_)
+                clusters_.reset();
+            clustering_ = clusterOutput;
+            if (clusterOutput)
+                clusters_.update(tracks_.table, inputs->getParDouble(PAR_CLUSTERRADIUS),
+                                 inputs->getParInt(PAR_CLUSTERMINSIZE));
+            if (outChoice_ == Stagedist)
+                stage_.update(tracks_.table);
+            
+            if (outChoice_ == Tracks)
+                outputTracks(output);
+            
+            lastTracks_ = tracks_;
         }
+        
+        // engine outputs keep their state between cooks, so these are
+        // written on every cook
+        if (blankRun)
+            zones_.clearEvents();
+        // heat fades while no frames come, on sender's time estimated from
+        // the last frame
+        if (blankRun && outChoice_ == Heat)
+            heatmap_.decay(nowTs+clockOffset_);
+        
+        if (outChoice_ == Trails)
+            outputTrails(output);
+        if (outChoice_ == Zones)
+            outputZones(output);
+        if (outChoice_ == Heat)
+            outputHeatmap(output);
+        if (outChoice_ == Pairwise)
+            outputPairwise(output);
+        if (outChoice_ == Similarity)
+            outputSimilarity(output);
+        if (outChoice_ == Clusters)
+            outputClusters(output);
+        if (outChoice_ == ClusterIds)
+            outputClusterIds(output, inputs->getParInt(PAR_CLUSTERID));
+        if (outChoice_ == ClusterIdsAll)
+            outputAllClusterIds(output);
+        if (outChoice_ == Stagedist)
+            outputStageDistances(output);
     }
 }
 
 int32_t
 OPT_CHOP::getNumInfoCHOPChans()
 {
-    return NINFOPAR_OUT+(int32_t)lastProcessedSeqs_.size(); // hearbeat, max id
+    return NINFOPAR_OUT+MetricsWindow::NChans+(int32_t)seqChanNames_.size();
 }
 
 void
@@ -350,16 +823,36 @@ OPT_CHOP::getInfoCHOPChan(int32_t index,
             chan->name = InfoChanNames[index];
             chan->value = (float)nDropped_;
             break;
+        case 5:
+            chan->name = InfoChanNames[index];
+            chan->value = (float)(SocketReader && SocketReader->getRecorder().isRecording());
+            break;
+        case 6:
+            chan->name = InfoChanNames[index];
+            chan->value = (float)(SocketReader ? SocketReader->getRecorder().getNumDropped() : 0);
+            break;
+        case 7:
+            chan->name = InfoChanNames[index];
+            chan->value = (float)player_->getPosition();
+            break;
+        case 8:
+            chan->name = InfoChanNames[index];
+            chan->value = (float)player_->getDuration();
+            break;
         default:
-        {
-            map<string, int>::iterator it = lastProcessedSeqs_.begin();
-            stringstream ss;
-            advance(it, index-NINFOPAR_OUT);
-            ss << "seq_" << it->first;
-            
-            chan->name = ss.str().c_str();
-            chan->value = it->second;
-        }
+            // names are precomputed, so every channel is O(1)
+            if (index < NINFOPAR_OUT+MetricsWindow::NChans)
+            {
+                chan->name = MetricsWindow::getChanName(index-NINFOPAR_OUT);
+                chan->value = metricsWindow_.getChanValue(index-NINFOPAR_OUT);
+            }
+            else
+            {
+                size_t i = index-NINFOPAR_OUT-MetricsWindow::NChans;
+                
+                chan->name = seqChanNames_[i].c_str();
+                chan->value = (float)seqChanValues_[i];
+            }
             break;
     }
 }
@@ -367,7 +860,13 @@ OPT_CHOP::getInfoCHOPChan(int32_t index,
 bool
 OPT_CHOP::getInfoDATSize(OP_InfoDATSize *infoSize)
 {
-    infoSize->rows = (int32_t)faceNameMap_.size()+1;
+    // rows are snapshotted here, so entries are O(1) and their strings
+    // stay valid after getInfoDATEntries returns
+    faceNameRows_.clear();
+    for (auto& f:faceNameMap_)
+        faceNameRows_.push_back(make_pair(f.first, to_string(f.second)));
+    
+    infoSize->rows = (int32_t)faceNameRows_.size()+1;
     infoSize->cols = 2;
     infoSize->byColumn = false;
     
@@ -382,15 +881,10 @@ OPT_CHOP::getInfoDATEntries(int32_t index, int32_t nEntries, OP_InfoDATEntries *
         entries->values[0] = (char*)"face name";
         entries->values[1] = (char*)"track id";
     }
-    else
+    else if (index-1 < (int32_t)faceNameRows_.size())
     {
-        map<string, int>::iterator it = faceNameMap_.begin();
-        advance(it, index-1);
-        stringstream ss;
-        ss << it->second;
-        
-        entries->values[0] = (char*)it->first.c_str();
-        entries->values[1] = (char*)ss.str().c_str();
+        entries->values[0] = (char*)faceNameRows_[index-1].first.c_str();
+        entries->values[1] = (char*)faceNameRows_[index-1].second.c_str();
     }
 }
 
@@ -409,7 +903,267 @@ void OPT_CHOP::setupParameters(OP_ParameterManager* manager)
         
         OP_ParAppendResult res = manager->appendInt(maxTracked);
         assert(res == OP_ParAppendResult::Success);
+        
+        OP_StringParameter output(PAR_OUTPUT);
+        
+        output.label = "Output";
+        output.page = "General";
+        output.defaultValue = "Tracks";
+        
+        res = manager->appendMenu(output, NPAR_OUTPUT, (const char**)menuNames,
+                                  (const char**)labels);
+        assert(res == OP_ParAppendResult::Success);
     }
+    {
+        OP_NumericParameter trailLength(PAR_TRAILLENGTH), trailStep(PAR_TRAILSTEP);
+        OP_StringParameter trailDecim(PAR_TRAILDECIM);
+        
+        trailLength.label = "Trail Length";
+        trailLength.page = "Trails";
+        trailLength.defaultValues[0] = 60;
+        trailLength.minValues[0] = 2;
+        trailLength.maxValues[0] = 2000;
+        trailLength.clampMins[0] = true;
+        trailLength.clampMaxes[0] = true;
+        trailLength.minSliders[0] = 2;
+        trailLength.maxSliders[0] = 600;
+        
+        trailDecim.label = "Decimation";
+        trailDecim.page = "Trails";
+        trailDecim.defaultValue = decimMenuNames[0];
+        
+        trailStep.label = "Step";
+        trailStep.page = "Trails";
+        trailStep.defaultValues[0] = 1;
+        trailStep.minValues[0] = 0;
+        trailStep.clampMins[0] = true;
+        trailStep.minSliders[0] = 0;
+        trailStep.maxSliders[0] = 10;
+        
+        OP_ParAppendResult res = manager->appendInt(trailLength);
+        assert(res == OP_ParAppendResult::Success);
+        res = manager->appendMenu(trailDecim, 2, (const char**)decimMenuNames,
+                                  (const char**)decimLabels);
+        assert(res == OP_ParAppendResult::Success);
+        res = manager->appendFloat(trailStep);
+        assert(res == OP_ParAppendResult::Success);
+    }
+    {
+        OP_StringParameter zonesDat(PAR_ZONESDAT), zonesFile(PAR_ZONESFILE);
+        OP_NumericParameter zonesReload(PAR_ZONESRELOAD);
+        
+        zonesDat.label = "Zones DAT";
+        zonesDat.page = "Zones";
+        
+        zonesFile.label = "Zones File";
+        zonesFile.page = "Zones";
+        
+        zonesReload.label = "Reload Zones";
+        zonesReload.page = "Zones";
+        
+        OP_ParAppendResult res = manager->appendDAT(zonesDat);
+        assert(res == OP_ParAppendResult::Success);
+        res = manager->appendFile(zonesFile);
+        assert(res == OP_ParAppendResult::Success);
+        res = manager->appendPulse(zonesReload);
+        assert(res == OP_ParAppendResult::Success);
+    }
+    {
+        OP_NumericParameter rows(PAR_HEATROWS), cols(PAR_HEATCOLS),
+        sigma(PAR_HEATSIGMA), halfLife(PAR_HEATHALFLIFE), reset(PAR_HEATRESET);
+        OP_StringParameter layout(PAR_HEATLAYOUT);
+        
+        rows.label = "Rows";
+        rows.page = "Heatmap";
+        rows.defaultValues[0] = 64;
+        rows.minValues[0] = 1;
+        rows.maxValues[0] = 1024;
+        rows.clampMins[0] = true;
+        rows.clampMaxes[0] = true;
+        rows.minSliders[0] = 1;
+        rows.maxSliders[0] = 256;
+        
+        cols.label = "Columns";
+        cols.page = "Heatmap";
+        cols.defaultValues[0] = 64;
+        cols.minValues[0] = 1;
+        cols.maxValues[0] = 1024;
+        cols.clampMins[0] = true;
+        cols.clampMaxes[0] = true;
+        cols.minSliders[0] = 1;
+        cols.maxSliders[0] = 256;
+        
+        sigma.label = "Splat Size";
+        sigma.page = "Heatmap";
+        sigma.defaultValues[0] = 0.3;
+        sigma.minValues[0] = 0.01;
+        sigma.clampMins[0] = true;
+        sigma.minSliders[0] = 0.01;
+        sigma.maxSliders[0] = 2;
+        
+        halfLife.label = "Half-life (sec)";
+        halfLife.page = "Heatmap";
+        halfLife.defaultValues[0] = 60;
+        halfLife.minValues[0] = 0;
+        halfLife.clampMins[0] = true;
+        halfLife.minSliders[0] = 0;
+        halfLife.maxSliders[0] = 600;
+        
+        layout.label = "Layout";
+        layout.page = "Heatmap";
+        layout.defaultValue = heatLayoutMenuNames[0];
+        
+        reset.label = "Reset";
+        reset.page = "Heatmap";
+        
+        OP_ParAppendResult res = manager->appendInt(rows);
+        assert(res == OP_ParAppendResult::Success);
+        res = manager->appendInt(cols);
+        assert(res == OP_ParAppendResult::Success);
+        res = manager->appendFloat(sigma);
+        assert(res == OP_ParAppendResult::Success);
+        res = manager->appendFloat(halfLife);
+        assert(res == OP_ParAppendResult::Success);
+        res = manager->appendMenu(layout, 2, (const char**)heatLayoutMenuNames,
+                                  (const char**)heatLayoutLabels);
+        assert(res == OP_ParAppendResult::Success);
+        res = manager->appendPulse(reset);
+        assert(res == OP_ParAppendResult::Success);
+    }
+    {
+        OP_StringParameter mode(PAR_PAIRMODE);
+        OP_NumericParameter radius(PAR_PAIRRADIUS);
+        
+        mode.label = "Mode";
+        mode.page = "Pairwise";
+        mode.defaultValue = pairModeMenuNames[0];
+        
+        radius.label = "Neighbor Radius";
+        radius.page = "Pairwise";
+        radius.defaultValues[0] = 0;
+        radius.minValues[0] = 0;
+        radius.clampMins[0] = true;
+        radius.minSliders[0] = 0;
+        radius.maxSliders[0] = 10;
+        
+        OP_ParAppendResult res = manager->appendMenu(mode, 2, (const char**)pairModeMenuNames,
+                                                     (const char**)pairModeLabels);
+        assert(res == OP_ParAppendResult::Success);
+        res = manager->appendFloat(radius);
+        assert(res == OP_ParAppendResult::Success);
+    }
+    {
+        OP_StringParameter mode(PAR_SIMMODE), templates(PAR_SIMTEMPLATES);
+        OP_NumericParameter band(PAR_SIMBAND), reload(PAR_SIMRELOAD);
+        
+        mode.label = "Mode";
+        mode.page = "Similarity";
+        mode.defaultValue = simModeMenuNames[0];
+        
+        band.label = "Band (samples)";
+        band.page = "Similarity";
+        band.defaultValues[0] = 10;
+        band.minValues[0] = 1;
+        band.clampMins[0] = true;
+        band.minSliders[0] = 1;
+        band.maxSliders[0] = 100;
+        
+        templates.label = "Templates File";
+        templates.page = "Similarity";
+        
+        reload.label = "Reload Templates";
+        reload.page = "Similarity";
+        
+        OP_ParAppendResult res = manager->appendMenu(mode, 2, (const char**)simModeMenuNames,
+                                                     (const char**)simModeLabels);
+        assert(res == OP_ParAppendResult::Success);
+        res = manager->appendInt(band);
+        assert(res == OP_ParAppendResult::Success);
+        res = manager->appendFile(templates);
+        assert(res == OP_ParAppendResult::Success);
+        res = manager->appendPulse(reload);
+        assert(res == OP_ParAppendResult::Success);
+    }
+    {
+        OP_NumericParameter radius(PAR_CLUSTERRADIUS), minSize(PAR_CLUSTERMINSIZE),
+        clusterId(PAR_CLUSTERID);
+        
+        radius.label = "Radius";
+        radius.page = "Clusters";
+        radius.defaultValues[0] = 1;
+        radius.minValues[0] = 0.01;
+        radius.clampMins[0] = true;
+        radius.minSliders[0] = 0.01;
+        radius.maxSliders[0] = 5;
+        
+        minSize.label = "Min Size";
+        minSize.page = "Clusters";
+        minSize.defaultValues[0] = 1;
+        minSize.minValues[0] = 1;
+        minSize.clampMins[0] = true;
+        minSize.minSliders[0] = 1;
+        minSize.maxSliders[0] = 10;
+        
+        clusterId.label = "Cluster Id";
+        clusterId.page = "Clusters";
+        clusterId.defaultValues[0] = 0;
+        clusterId.minValues[0] = 0;
+        clusterId.clampMins[0] = true;
+        clusterId.minSliders[0] = 0;
+        clusterId.maxSliders[0] = 25;
+        
+        OP_ParAppendResult res = manager->appendFloat(radius);
+        assert(res == OP_ParAppendResult::Success);
+        res = manager->appendInt(minSize);
+        assert(res == OP_ParAppendResult::Success);
+        res = manager->appendInt(clusterId);
+        assert(res == OP_ParAppendResult::Success);
+    }
+    {
+        OP_StringParameter stageDat(PAR_STAGEDAT);
+        OP_NumericParameter us(PAR_STAGEUS), ds(PAR_STAGEDS), sl(PAR_STAGESL), sr(PAR_STAGESR);
+        
+        stageDat.label = "Stage DAT";
+        stageDat.page = "Stage";
+        
+        us.label = "Upstage Y";
+        us.page = "Stage";
+        us.defaultValues[0] = 5;
+        us.minSliders[0] = -100;
+        us.maxSliders[0] = 100;
+        
+        ds.label = "Downstage Y";
+        ds.page = "Stage";
+        ds.defaultValues[0] = -5;
+        ds.minSliders[0] = -100;
+        ds.maxSliders[0] = 100;
+        
+        sl.label = "Stage Left X";
+        sl.page = "Stage";
+        sl.defaultValues[0] = 5;
+        sl.minSliders[0] = -100;
+        sl.maxSliders[0] = 100;
+        
+        sr.label = "Stage Right X";
+        sr.page = "Stage";
+        sr.defaultValues[0] = -5;
+        sr.minSliders[0] = -100;
+        sr.maxSliders[0] = 100;
+        
+        OP_ParAppendResult res = manager->appendDAT(stageDat);
+        assert(res == OP_ParAppendResult::Success);
+        res = manager->appendFloat(us);
+        assert(res == OP_ParAppendResult::Success);
+        res = manager->appendFloat(ds);
+        assert(res == OP_ParAppendResult::Success);
+        res = manager->appendFloat(sl);
+        assert(res == OP_ParAppendResult::Success);
+        res = manager->appendFloat(sr);
+        assert(res == OP_ParAppendResult::Success);
+    }
+    setupPlaybackParameters(manager);
+    setupRecordParameters(manager, "opt");
+    setupTraceParameters(manager, "opt-trace.json");
     {
         OP_NumericParameter filterToggle(PAR_FILTERTOGGLE);
         OP_NumericParameter minX(PAR_MINX), maxX(PAR_MAXX),
@@ -472,6 +1226,17 @@ void OPT_CHOP::setupParameters(OP_ParameterManager* manager)
     }
 }
 
+void OPT_CHOP::pulsePressed(const char *name)
+{
+    sourcePulsePressed(name);
+    if (!strcmp(name, PAR_ZONESRELOAD))
+        zonesReload_ = true;
+    if (!strcmp(name, PAR_HEATRESET))
+        heatmap_.reset();
+    if (!strcmp(name, PAR_SIMRELOAD))
+        dtwReload_ = true;
+}
+
 //******************************************************************************
 void
 OPT_CHOP::setupSocketReader()
@@ -482,6 +1247,7 @@ OPT_CHOP::setupSocketReader()
         
         if (!SocketReader)
             SocketReader = make_shared<JsonSocketReader>(PORTNUM);
+        socketReader_ = SocketReader;
         
         if (!SocketReader->isRunning())
             SocketReader->start();
@@ -503,6 +1269,8 @@ OPT_CHOP::processingError(string m)
 void
 OPT_CHOP::checkInputs(const CHOP_Output *, OP_Inputs *inputs, void *)
 {
+    string outputChoice(inputs->getParString(PAR_OUTPUT));
+    outChoice_ = OutputMenuMap[outputChoice];
     
     bool filteringEnabled = inputs->getParInt(PAR_FILTERTOGGLE);
     
@@ -512,6 +1280,18 @@ OPT_CHOP::checkInputs(const CHOP_Output *, OP_Inputs *inputs, void *)
     inputs->enablePar(PAR_MAXY, filteringEnabled);
     inputs->enablePar(PAR_MINZ, filteringEnabled);
     inputs->enablePar(PAR_MAXZ, filteringEnabled);
+    inputs->enablePar(PAR_CLUSTERID, outChoice_ == ClusterIds);
+    
+    bool stageBounds = (inputs->getParDAT(PAR_STAGEDAT) == nullptr);
+    
+    inputs->enablePar(PAR_STAGEUS, stageBounds);
+    inputs->enablePar(PAR_STAGEDS, stageBounds);
+    inputs->enablePar(PAR_STAGESL, stageBounds);
+    inputs->enablePar(PAR_STAGESR, stageBounds);
+    
+    checkRecording(inputs);
+    checkPlayback(inputs);
+    checkTrace(inputs);
 }
 
 void
@@ -520,3 +1300,372 @@ OPT_CHOP::blankRunsTrigger()
     nAliveIds_ = 0;
 }
 
+void
+OPT_CHOP::updateTrackTable(const map<int, vector<float>>& tracks)
+{
+    size_t i = 0;
+    
+    tracks_.resize(tracks.size());
+    for (auto& p:tracks)
+    {
+        assert(p.second.size() == NPAR_OUT);
+        
+        tracks_.table.ids[i] = p.first;
+        tracks_.age[i] = p.second[1];
+        tracks_.confidence[i] = p.second[2];
+        tracks_.table.x[i] = p.second[3];
+        tracks_.table.y[i] = p.second[4];
+        tracks_.table.z[i] = p.second[5];
+        tracks_.alive[i] = p.second[6];
+        tracks_.stableId[i] = p.second[7];
+        i++;
+    }
+}
+
+void
+OPT_CHOP::spillTracks(map<int, vector<float>>& tracks) const
+{
+    for (size_t i = 0; i < tracks_.size(); ++i)
+        tracks.insert_or_assign(tracks_.table.ids[i],
+                                vector<float>{ (float)tracks_.table.ids[i], tracks_.age[i],
+                                    tracks_.confidence[i], tracks_.table.x[i], tracks_.table.y[i],
+                                    tracks_.table.z[i], tracks_.alive[i], tracks_.stableId[i] });
+}
+
+void
+OPT_CHOP::sortTracks()
+{
+    size_t n = tracks_.size();
+    
+    sortOrder_.resize(n);
+    iota(sortOrder_.begin(), sortOrder_.end(), 0);
+    stable_sort(sortOrder_.begin(), sortOrder_.end(), [this](size_t a, size_t b){
+        return tracks_.table.ids[a] < tracks_.table.ids[b];
+    });
+    
+    // of repeated ids, the last row wins - same as for JSON frames
+    sortScratch_.resize(0);
+    for (size_t k = 0; k < n; ++k)
+        if (k+1 == n || tracks_.table.ids[sortOrder_[k]] != tracks_.table.ids[sortOrder_[k+1]])
+            sortScratch_.append(tracks_, sortOrder_[k]);
+    
+    swap(tracks_, sortScratch_);
+}
+
+void
+OPT_CHOP::outputTracks(const CHOP_Output *output)
+{
+    const float* columns[NPAR_OUT] = { nullptr, tracks_.age.data(), tracks_.confidence.data(),
+        tracks_.table.x.data(), tracks_.table.y.data(), tracks_.table.z.data(),
+        tracks_.alive.data(), tracks_.stableId.data() };
+    size_t n = min((size_t)output->numSamples, tracks_.size());
+    
+    for (int chanIdx = 0; chanIdx < output->numChannels; ++chanIdx)
+    {
+        float *chan = output->channels[chanIdx];
+        size_t nRows = (chanIdx < NPAR_OUT ? n : 0);
+        
+        if (chanIdx == 0)
+            for (size_t i = 0; i < nRows; ++i)
+                chan[i] = (float)tracks_.table.ids[i];
+        else if (nRows)
+            memcpy(chan, columns[chanIdx], nRows*sizeof(float));
+        
+        memset(chan+nRows, 0, (output->numSamples-nRows)*sizeof(float));
+    }
+}
+
+void
+OPT_CHOP::outputTrails(const CHOP_Output *output)
+{
+    int nTracks = output->numChannels/NTRAIL_CHANS;
+    size_t len = min(output->numSamples, trails_.getLength());
+    
+    for (int i = 0; i < nTracks; ++i)
+    {
+        float **chans = output->channels+i*NTRAIL_CHANS;
+        int slot = (i < tracks_.table.size() ? trails_.getSlot(tracks_.table.ids[i]) : -1);
+        
+        if (slot >= 0)
+        {
+            fill(chans[0], chans[0]+output->numSamples, (float)tracks_.table.ids[i]);
+            memcpy(chans[1], trails_.getWindow(slot, TrackHistory::X), len*sizeof(float));
+            memcpy(chans[2], trails_.getWindow(slot, TrackHistory::Y), len*sizeof(float));
+        }
+        else
+            for (int k = 0; k < NTRAIL_CHANS; ++k)
+                memset(chans[k], 0, output->numSamples*sizeof(float));
+    }
+}
+
+void
+OPT_CHOP::outputZones(const CHOP_Output *output)
+{
+    const vector<ZoneEngine::Zone>& zones = zones_.getZones();
+    
+    for (int i = 0; i < output->numSamples; ++i)
+    {
+        if (i < zones.size())
+        {
+            output->channels[0][i] = (float)i;
+            output->channels[1][i] = (float)zones[i].count;
+            output->channels[2][i] = (float)zones[i].nEnter;
+            output->channels[3][i] = (float)zones[i].nExit;
+            output->channels[4][i] = (float)zones[i].avgDwell;
+            output->channels[5][i] = (float)zones[i].maxDwell;
+        }
+        else
+            for (int chanIdx = 0; chanIdx < output->numChannels; ++chanIdx)
+                output->channels[chanIdx][i] = (chanIdx == 0 ? -1 : 0);
+    }
+}
+
+void
+OPT_CHOP::outputHeatmap(const CHOP_Output *output)
+{
+    size_t gridSize = (size_t)heatmap_.getRows()*heatmap_.getCols();
+    
+    if (output->numChannels == 1 && output->numSamples == gridSize)
+        memcpy(output->channels[0], heatmap_.getGrid(), gridSize*sizeof(float));
+    else if (output->numChannels == heatmap_.getRows() &&
+             output->numSamples == heatmap_.getCols())
+        for (int r = 0; r < heatmap_.getRows(); ++r)
+            memcpy(output->channels[r], heatmap_.getRow(r), heatmap_.getCols()*sizeof(float));
+    else
+        // output shape doesn't match the grid (e.g. rows/cols just changed)
+        for (int chanIdx = 0; chanIdx < output->numChannels; ++chanIdx)
+            fill(output->channels[chanIdx], output->channels[chanIdx]+output->numSamples, 0.f);
+}
+
+void
+OPT_CHOP::outputPairwise(const CHOP_Output *output)
+{
+    if (pairEdges_)
+    {
+        size_t nEdges = min((size_t)output->numSamples, pairwise_.getNumEdges());
+        
+        for (size_t i = 0; i < nEdges; ++i)
+        {
+            output->channels[0][i] = (float)pairwise_.getEdgeA()[i];
+            output->channels[1][i] = (float)pairwise_.getEdgeB()[i];
+        }
+        memcpy(output->channels[2], pairwise_.getEdgeD().data(), nEdges*sizeof(float));
+        
+        for (int chanIdx = 0; chanIdx < output->numChannels; ++chanIdx)
+            fill(output->channels[chanIdx]+nEdges, output->channels[chanIdx]+output->numSamples, -1.f);
+    }
+    else
+    {
+        int dim = pairwise_.getDim();
+        
+        for (int i = 0; i < output->numChannels; ++i)
+        {
+            float *row = output->channels[i];
+            
+            if (i < dim && i < tracks_.table.size())
+            {
+                int n = min(dim, output->numSamples-1);
+                
+                row[0] = (float)tracks_.table.ids[i];
+                memcpy(row+1, pairwise_.getRow(i), n*sizeof(float));
+                fill(row+1+n, row+output->numSamples, -1.f);
+            }
+            else
+                fill(row, row+output->numSamples, -1.f);
+        }
+    }
+}
+
+void
+OPT_CHOP::outputSimilarity(const CHOP_Output *output)
+{
+    const DtwEngine::Results& results = dtw_.getResults();
+    int n = (int)results.ids.size();
+    
+    if (dtwTemplates_)
+    {
+        int nTemplates = (int)results.templateNames.size();
+        int nRows = min(n, output->numSamples);
+        
+        for (int i = 0; i < nRows; ++i)
+        {
+            output->channels[0][i] = (float)results.ids[i];
+            for (int t = 0; t < nTemplates && t+1 < output->numChannels; ++t)
+                output->channels[t+1][i] = results.templateScores[(size_t)i*nTemplates+t];
+        }
+        
+        for (int chanIdx = 0; chanIdx < output->numChannels; ++chanIdx)
+        {
+            int from = (chanIdx <= nTemplates ? nRows : 0);
+            fill(output->channels[chanIdx]+from, output->channels[chanIdx]+output->numSamples, -1.f);
+        }
+    }
+    else
+    {
+        for (int i = 0; i < output->numChannels; ++i)
+        {
+            float *row = output->channels[i];
+            
+            if (i < n)
+            {
+                int m = min(n, output->numSamples-1);
+                
+                row[0] = (float)results.ids[i];
+                memcpy(row+1, &results.matrix[(size_t)i*n], m*sizeof(float));
+                fill(row+1+m, row+output->numSamples, -1.f);
+            }
+            else
+                fill(row, row+output->numSamples, -1.f);
+        }
+    }
+}
+
+void
+OPT_CHOP::outputClusters(const CHOP_Output *output)
+{
+    const ClusterTable& clusters = clusters_.getClusters();
+    int n = min((int)clusters.size(), output->numSamples);
+    
+    memcpy(output->channels[0], clusters.x.data(), n*sizeof(float));
+    memcpy(output->channels[1], clusters.y.data(), n*sizeof(float));
+    memcpy(output->channels[2], clusters.spread.data(), n*sizeof(float));
+    for (int i = 0; i < n; ++i)
+        output->channels[3][i] = (float)clusters.clusterSize(i);
+    
+    for (int chanIdx = 0; chanIdx < output->numChannels; ++chanIdx)
+        fill(output->channels[chanIdx]+n, output->channels[chanIdx]+output->numSamples, 0.f);
+}
+
+void
+OPT_CHOP::outputClusterIds(const CHOP_Output *output, int clusterIdx)
+{
+    const ClusterTable& clusters = clusters_.getClusters();
+    int from = 0, n = 0;
+    
+    if (clusterIdx >= 0 && clusterIdx < clusters.size())
+    {
+        from = clusters.offsets[clusterIdx];
+        n = min(clusters.clusterSize(clusterIdx), output->numSamples);
+    }
+    
+    memcpy(output->channels[0], clusters.memberId.data()+from, n*sizeof(float));
+    memcpy(output->channels[1], clusters.memberX.data()+from, n*sizeof(float));
+    memcpy(output->channels[2], clusters.memberY.data()+from, n*sizeof(float));
+    
+    for (int chanIdx = 0; chanIdx < output->numChannels; ++chanIdx)
+        fill(output->channels[chanIdx]+n, output->channels[chanIdx]+output->numSamples, 0.f);
+}
+
+void
+OPT_CHOP::outputAllClusterIds(const CHOP_Output *output)
+{
+    // members are stored cluster by cluster, so it's a block copy
+    const ClusterTable& clusters = clusters_.getClusters();
+    int n = min((int)clusters.numMembers(), output->numSamples);
+    
+    memcpy(output->channels[0], clusters.memberId.data(), n*sizeof(float));
+    memcpy(output->channels[1], clusters.memberX.data(), n*sizeof(float));
+    memcpy(output->channels[2], clusters.memberY.data(), n*sizeof(float));
+    memcpy(output->channels[3], clusters.memberCluster.data(), n*sizeof(float));
+    
+    for (int chanIdx = 0; chanIdx < output->numChannels; ++chanIdx)
+        fill(output->channels[chanIdx]+n, output->channels[chanIdx]+output->numSamples,
+             (chanIdx == 0 || chanIdx == 3 ? -1.f : 0.f));
+}
+
+void
+OPT_CHOP::outputStageDistances(const CHOP_Output *output)
+{
+    int n = min((int)stage_.getIds().size(), output->numSamples);
+    
+    for (int i = 0; i < n; ++i)
+        output->channels[0][i] = (float)stage_.getIds()[i];
+    for (int e = 0; e < StageEngine::NEdges; ++e)
+        memcpy(output->channels[e+1], stage_.getDistances((StageEngine::Edge)e), n*sizeof(float));
+    
+    for (int chanIdx = 0; chanIdx < output->numChannels; ++chanIdx)
+        fill(output->channels[chanIdx]+n, output->channels[chanIdx]+output->numSamples,
+             (chanIdx == 0 ? -1.f : 0.f));
+}
+
+void
+OPT_CHOP::loadStage(OP_Inputs *inputs)
+{
+    const OP_DATInput *dat = inputs->getParDAT(PAR_STAGEDAT);
+    
+    if (dat)
+    {
+        vector<vector<string>> edgeTokens;
+        size_t h = readDatRows(dat, { "x0" }, edgeTokens);
+        
+        if (h != stageDatHash_)
+        {
+            stageDatHash_ = h;
+            if (!stage_.load(edgeTokens))
+                SET_CHOP_WARN(msg << "failed to load stage: " << stage_.getError())
+        }
+    }
+    else
+    {
+        stageDatHash_ = 0;
+        stage_.setBounds(inputs->getParDouble(PAR_STAGEUS), inputs->getParDouble(PAR_STAGEDS),
+                         inputs->getParDouble(PAR_STAGESL), inputs->getParDouble(PAR_STAGESR));
+    }
+}
+
+void
+OPT_CHOP::loadTemplates(OP_Inputs *inputs)
+{
+    string path(inputs->getParFilePath(PAR_SIMTEMPLATES));
+    
+    if (path != dtwTemplatesFile_ || dtwReload_)
+    {
+        dtwTemplatesFile_ = path;
+        dtwReload_ = false;
+        
+        if (!path.size())
+            dtw_.clearTemplates();
+        else if (!dtw_.loadTemplates(path))
+            SET_CHOP_WARN(msg << "failed to load templates: " << dtw_.getError())
+    }
+}
+
+void
+OPT_CHOP::loadZones(OP_Inputs *inputs)
+{
+    const OP_DATInput *dat = inputs->getParDAT(PAR_ZONESDAT);
+    bool loaded = true, reload = zonesReload_;
+    
+    zonesReload_ = false;
+    
+    if (dat)
+    {
+        vector<vector<string>> zoneTokens;
+        size_t h = readDatRows(dat, { "shape", "type" }, zoneTokens);
+        
+        if (h != zonesDatHash_ || reload)
+        {
+            zonesDatHash_ = h;
+            zonesFile_ = "";
+            loaded = zones_.load(zoneTokens);
+        }
+    }
+    else
+    {
+        string path(inputs->getParFilePath(PAR_ZONESFILE));
+        
+        if (path != zonesFile_ || reload)
+        {
+            zonesFile_ = path;
+            zonesDatHash_ = 0;
+            
+            if (path.size())
+                loaded = zones_.loadFile(path);
+            else
+                zones_.clear();
+        }
+    }
+    
+    if (!loaded)
+        SET_CHOP_WARN(msg << "failed to load zones: " << zones_.getError())
+}
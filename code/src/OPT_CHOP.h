@@ -24,11 +24,33 @@
 
 #include "CHOP_CPlusPlusBase.h"
 #include "o-base.hpp"
+#include "trace.hpp"
+#include "track-table.hpp"
+#include "track-history.hpp"
+#include "zone-engine.hpp"
+#include "heatmap.hpp"
+#include "pairwise-engine.hpp"
+#include "dtw-engine.hpp"
+#include "cluster-engine.hpp"
+#include "stage-engine.hpp"
 
 class OPT_CHOP : public CHOP_CPlusPlusBase,
 public OBase
 {
 public:
+    typedef enum _OutChoice {
+        Tracks,
+        Trails,
+        Zones,
+        Heat,
+        Pairwise,
+        Similarity,
+        Clusters,
+        ClusterIds,
+        ClusterIdsAll,
+        Stagedist
+    } OutChoice;
+    
 	OPT_CHOP(const OP_NodeInfo * info);
 
 	virtual ~OPT_CHOP();
@@ -49,6 +71,7 @@ public:
                                    int32_t nEntries,
                                    OP_InfoDATEntries* entries) override;
     virtual void setupParameters(OP_ParameterManager * manager) override;
+    virtual void pulsePressed(const char *name) override;
 
     virtual const char* getWarningString() override
     {
@@ -64,19 +87,63 @@ private:
     std::string errorMessage_, warningMessage_;
     
 	const OP_NodeInfo *myNodeInfo;
+    OutChoice outChoice_;
     
     uint64_t heartbeat_, maxId_, nAliveIds_, nBlankRuns_;
+    double heartbeatStamp_;     // header stamp of the last heartbeat, -1 if none
+    double clockOffset_;        // ms; sender's time minus wall clock at the last world frame
     
     void setupSocketReader();
     void processingError(std::string m) override;
     
     void checkInputs(const CHOP_Output *, OP_Inputs *inputs, void *);
     void blankRunsTrigger();
+    void updateTrackTable(const std::map<int, std::vector<float>>& tracks);
+    void spillTracks(std::map<int, std::vector<float>>& tracks) const;
+    void sortTracks();
+    void outputTracks(const CHOP_Output *output);
+    void outputTrails(const CHOP_Output *output);
+    void outputZones(const CHOP_Output *output);
+    void loadZones(OP_Inputs *inputs);
+    void outputHeatmap(const CHOP_Output *output);
+    void outputPairwise(const CHOP_Output *output);
+    void outputSimilarity(const CHOP_Output *output);
+    void loadTemplates(OP_Inputs *inputs);
+    void outputClusters(const CHOP_Output *output);
+    void outputClusterIds(const CHOP_Output *output, int clusterIdx);
+    void outputAllClusterIds(const CHOP_Output *output);
+    void outputStageDistances(const CHOP_Output *output);
+    void loadStage(OP_Inputs *inputs);
     
     std::map<float, std::vector<float>> data;
     std::set<int> aliveIds_;
-    std::map<int, std::vector<float>> lastTracks_;
     std::map<std::string, int> faceNameMap_;
+    std::vector<std::pair<std::string, std::string>> faceNameRows_;
+    
+    TrackRecords tracks_;           // current tracks, sorted by id
+    TrackRecords lastTracks_;
+    TrackRecords sortScratch_;
+    std::vector<size_t> sortOrder_;
+    TrackHistory trails_;
+    std::vector<std::string> trailChanNames_;
+    ZoneEngine zones_;
+    std::string zonesFile_;
+    size_t zonesDatHash_;
+    bool zonesReload_;
+    Heatmap heatmap_;
+    std::vector<std::string> heatChanNames_;
+    PairwiseEngine pairwise_;
+    bool pairEdges_;
+    std::vector<std::string> pairChanNames_;
+    DtwEngine dtw_;
+    bool dtwTemplates_;
+    std::string dtwTemplatesFile_;
+    bool dtwReload_;
+    std::vector<std::string> simChanNames_;
+    ClusterEngine clusters_;
+    bool clustering_;           // clusters were updated on the last frame
+    StageEngine stage_;
+    size_t stageDatHash_;
 };
 
 #endif
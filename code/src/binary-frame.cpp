@@ -0,0 +1,293 @@
+//
+//  binary-frame.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include "binary-frame.hpp"
+
+#include <sstream>
+#include <cstring>
+
+#include "defines.h"
+
+using namespace std;
+
+static_assert(sizeof(BinaryHeader) == 24, "binary frame header must be 24 bytes");
+static_assert(sizeof(int) == 4 && sizeof(float) == 4, "ids and values are 32 bit");
+
+bool
+isBinaryFrame(const char *datagram, size_t len)
+{
+    return (len >= 2 && datagram[0] == BINARY_MAGIC[0] && datagram[1] == BINARY_MAGIC[1]);
+}
+
+bool
+binaryToDocument(const char *datagram, size_t len, rapidjson::Document &d, string &error)
+{
+    BinaryHeader h;
+    stringstream ss;
+
+    if (len < sizeof(h))
+    {
+        ss << "binary frame of " << len << " bytes is shorter than its header";
+        error = ss.str();
+        return false;
+    }
+
+    memcpy(&h, datagram, sizeof(h));
+
+    const char *payload = datagram+sizeof(h);
+    uint64_t payloadLen = len-sizeof(h);
+
+    if (h.version != BINARY_VERSION)
+        ss << "unsupported binary frame version " << (int)h.version;
+    else if (!(h.frameId == BinaryWorld && h.schema == SchemaPeopleTracks) &&
+             !(h.frameId == BinaryHeartbeat && h.schema == SchemaAliveIds))
+        ss << "unknown binary frame id " << (int)h.frameId << " with schema " << (int)h.schema;
+    else if (h.schema == SchemaPeopleTracks && payloadLen != (uint64_t)h.count*BINARY_TRACK_BYTES)
+        ss << "binary world frame of " << h.count << " tracks has " << payloadLen << " bytes of payload";
+    else if (h.schema == SchemaAliveIds && payloadLen != ((uint64_t)h.count+1)*sizeof(int32_t))
+        ss << "binary heartbeat of " << h.count << " ids has " << payloadLen << " bytes of payload";
+
+    if (ss.tellp() > 0)
+    {
+        error = ss.str();
+        return false;
+    }
+
+    rapidjson::Document::AllocatorType& a = d.GetAllocator();
+    rapidjson::Value header(rapidjson::kObjectType);
+
+    d.SetObject();
+    header.AddMember(OPT_JSON_FRAMEID,
+                     rapidjson::StringRef(h.frameId == BinaryWorld ? OPT_JSON_WORLD : OPT_JSON_HEARTBEAT), a);
+    header.AddMember(OM_JSON_SEQ, h.seq, a);
+
+    if (h.stampSec || h.stampNsec)
+    {
+        rapidjson::Value stamp(rapidjson::kObjectType);
+
+        stamp.AddMember(OPT_JSON_SEC, h.stampSec, a);
+        stamp.AddMember(OPT_JSON_NSEC, h.stampNsec, a);
+        header.AddMember(OPT_JSON_STAMP, stamp, a);
+    }
+
+    d.AddMember(OPT_JSON_HEADER, header, a);
+
+    if (h.schema == SchemaPeopleTracks)
+    {
+        // copied as is, decoded by the consumer
+        rapidjson::Value packed(payload, (rapidjson::SizeType)payloadLen, a);
+        d.AddMember(OPT_JSON_PACKED_TRACKS, packed, a);
+    }
+    else
+    {
+        rapidjson::Value aliveIds(rapidjson::kArrayType);
+        int32_t maxId, id;
+
+        memcpy(&maxId, payload, sizeof(maxId));
+        aliveIds.Reserve(h.count, a);
+        for (uint32_t i = 0; i < h.count; ++i)
+        {
+            memcpy(&id, payload+(i+1)*sizeof(id), sizeof(id));
+            aliveIds.PushBack(id, a);
+        }
+
+        d.AddMember(OPT_JSON_MAXID, maxId, a);
+        d.AddMember(OPT_JSON_ALIVEIDS, aliveIds, a);
+    }
+
+    return true;
+}
+
+bool
+unpackTracks(const rapidjson::Document &d, TrackRecords &records)
+{
+    if (!d.IsObject())
+        return false;
+
+    rapidjson::Value::ConstMemberIterator packed = d.FindMember(OPT_JSON_PACKED_TRACKS);
+
+    if (packed == d.MemberEnd() || !packed->value.IsString() ||
+        packed->value.GetStringLength()%BINARY_TRACK_BYTES)
+        return false;
+
+    size_t n = packed->value.GetStringLength()/BINARY_TRACK_BYTES;
+    const char *p = packed->value.GetString();
+
+    records.resize(n);
+    if (!n)
+        return true;
+
+    float *columns[] = { records.age.data(), records.confidence.data(), records.table.x.data(),
+                         records.table.y.data(), records.table.z.data(), records.stableId.data() };
+
+    memcpy(records.table.ids.data(), p, n*sizeof(int32_t));
+    p += n*sizeof(int32_t);
+
+    for (float *c:columns)
+    {
+        memcpy(c, p, n*sizeof(float));
+        p += n*sizeof(float);
+    }
+    memset(records.alive.data(), 0, n*sizeof(float));
+
+    return true;
+}
+
+//******************************************************************************
+static void appendHeader(string& datagram, BinarySchema schema, BinaryFrameId frameId,
+                         int32_t seq, uint32_t count, uint32_t sec, uint32_t nsec)
+{
+    BinaryHeader h;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BINARY_MAGIC, sizeof(h.magic));
+    h.version = BINARY_VERSION;
+    h.schema = (uint8_t)schema;
+    h.frameId = (uint8_t)frameId;
+    h.seq = seq;
+    h.count = count;
+    h.stampSec = sec;
+    h.stampNsec = nsec;
+
+    datagram.assign((const char*)&h, sizeof(h));
+}
+
+static void appendWorld(string& datagram, int32_t seq, uint32_t sec, uint32_t nsec,
+                        const TrackRecords& records)
+{
+    size_t n = records.size();
+    const float *columns[] = { records.age.data(), records.confidence.data(), records.table.x.data(),
+                               records.table.y.data(), records.table.z.data(), records.stableId.data() };
+
+    appendHeader(datagram, SchemaPeopleTracks, BinaryWorld, seq, (uint32_t)n, sec, nsec);
+    datagram.reserve(sizeof(BinaryHeader)+n*BINARY_TRACK_BYTES);
+    datagram.append((const char*)records.table.ids.data(), n*sizeof(int32_t));
+    for (const float *c:columns)
+        datagram.append((const char*)c, n*sizeof(float));
+}
+
+static void appendHeartbeat(string& datagram, int32_t seq, uint32_t sec, uint32_t nsec,
+                            int32_t maxId, const vector<int>& aliveIds)
+{
+    appendHeader(datagram, SchemaAliveIds, BinaryHeartbeat, seq, (uint32_t)aliveIds.size(), sec, nsec);
+    datagram.append((const char*)&maxId, sizeof(maxId));
+    datagram.append((const char*)aliveIds.data(), aliveIds.size()*sizeof(int32_t));
+}
+
+static void splitStamp(double stamp, uint32_t& sec, uint32_t& nsec)
+{
+    sec = (stamp > 0 ? (uint32_t)stamp : 0);
+    nsec = (stamp > 0 ? (uint32_t)((stamp-sec)*1E9) : 0);
+}
+
+// member as float, -1 if missing or not a number (same default as JSON path)
+static float getFloat(const rapidjson::Value& v, const char* name)
+{
+    rapidjson::Value::ConstMemberIterator m = v.FindMember(name);
+    return (m != v.MemberEnd() && m->value.IsNumber() ? m->value.GetFloat() : -1);
+}
+
+static uint32_t getUint(const rapidjson::Value& v, const char* name)
+{
+    rapidjson::Value::ConstMemberIterator m = v.FindMember(name);
+
+    if (m == v.MemberEnd() || !m->value.IsNumber() || m->value.GetDouble() < 0)
+        return 0;
+    return (m->value.IsUint() ? m->value.GetUint() : (uint32_t)m->value.GetDouble());
+}
+
+void
+packWorld(int32_t seq, double stamp, const TrackRecords &records, string &datagram)
+{
+    uint32_t sec, nsec;
+
+    splitStamp(stamp, sec, nsec);
+    appendWorld(datagram, seq, sec, nsec, records);
+}
+
+void
+packHeartbeat(int32_t seq, double stamp, int maxId, const vector<int> &aliveIds, string &datagram)
+{
+    uint32_t sec, nsec;
+
+    splitStamp(stamp, sec, nsec);
+    appendHeartbeat(datagram, seq, sec, nsec, maxId, aliveIds);
+}
+
+bool
+transcodeJson(const rapidjson::Document &d, string &datagram)
+{
+    if (!d.IsObject() || !d.HasMember(OPT_JSON_HEADER) || !d[OPT_JSON_HEADER].IsObject())
+        return false;
+
+    const rapidjson::Value& header = d[OPT_JSON_HEADER];
+
+    if (!header.HasMember(OPT_JSON_FRAMEID) || !header[OPT_JSON_FRAMEID].IsString() ||
+        !header.HasMember(OM_JSON_SEQ) || !header[OM_JSON_SEQ].IsInt())
+        return false;
+
+    string frameId(header[OPT_JSON_FRAMEID].GetString());
+    int32_t seq = header[OM_JSON_SEQ].GetInt();
+    uint32_t sec = 0, nsec = 0;
+
+    if (header.HasMember(OPT_JSON_STAMP) && header[OPT_JSON_STAMP].IsObject())
+    {
+        sec = getUint(header[OPT_JSON_STAMP], OPT_JSON_SEC);
+        nsec = getUint(header[OPT_JSON_STAMP], OPT_JSON_NSEC);
+    }
+
+    if (frameId == OPT_JSON_WORLD)
+    {
+        if (!d.HasMember(OPT_JSON_PEOPLE_TRACKS) || !d[OPT_JSON_PEOPLE_TRACKS].IsArray())
+            return false;
+
+        const rapidjson::Value& tracks = d[OPT_JSON_PEOPLE_TRACKS];
+        TrackRecords records;
+
+        records.resize(tracks.Size());
+        for (rapidjson::SizeType i = 0; i < tracks.Size(); ++i)
+        {
+            const rapidjson::Value& t = tracks[i];
+
+            if (!t.IsObject() || !t.HasMember(OPT_JSON_ID) || !t[OPT_JSON_ID].IsInt() ||
+                t.HasMember(OPT_JSON_FACE_NAME))
+                return false;
+
+            records.table.ids[i] = t[OPT_JSON_ID].GetInt();
+            records.age[i] = getFloat(t, OPT_JSON_AGE);
+            records.confidence[i] = getFloat(t, OPT_JSON_CONFIDENCE);
+            records.table.x[i] = getFloat(t, OPT_JSON_X);
+            records.table.y[i] = getFloat(t, OPT_JSON_Y);
+            records.table.z[i] = getFloat(t, OPT_JSON_HEIGHT);
+            records.stableId[i] = getFloat(t, OPT_JSON_STABLEID);
+        }
+
+        appendWorld(datagram, seq, sec, nsec, records);
+        return true;
+    }
+
+    if (frameId == OPT_JSON_HEARTBEAT)
+    {
+        if (!d.HasMember(OPT_JSON_MAXID) || !d[OPT_JSON_MAXID].IsInt() ||
+            !d.HasMember(OPT_JSON_ALIVEIDS) || !d[OPT_JSON_ALIVEIDS].IsArray())
+            return false;
+
+        vector<int> aliveIds;
+
+        for (auto& id:d[OPT_JSON_ALIVEIDS].GetArray())
+        {
+            if (!id.IsInt())
+                return false;
+            aliveIds.push_back(id.GetInt());
+        }
+
+        appendHeartbeat(datagram, seq, sec, nsec, d[OPT_JSON_MAXID].GetInt(), aliveIds);
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,92 @@
+//
+//  binary-frame.hpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#ifndef binary_frame_hpp
+#define binary_frame_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "rapidjson/document.h"
+
+#include "track-table.hpp"
+
+#define BINARY_MAGIC        "OB"
+#define BINARY_VERSION      1
+#define BINARY_TRACK_BYTES  28  // id, age, confidence, x, y, height, stable id
+
+/**
+ * Compact binary encoding of OPT frames, an alternative to JSON on the same
+ * port. JsonSocketReader tells the formats apart by the first bytes of each
+ * datagram (JSON starts with '{' or whitespace, binary frames with magic).
+ *
+ * Datagram layout (little endian):
+ *      header          magic "OB", version, schema, frame id, reserved,
+ *                      seq, record count, stamp (24 bytes)
+ *      payload         depends on schema:
+ *          PeopleTracks    count int32 ids, then count float32 values of
+ *                          age, confidence, x, y, height and stable id -
+ *                          column after column, so each field decodes into
+ *                          TrackTable with one memcpy
+ *          AliveIds        int32 max id, count int32 alive ids
+ *
+ * Binary frames are delivered as documents with the same header members as
+ * JSON frames (frame_id, seq, stamp), so queueing, bundling and recording
+ * don't change; heartbeats carry max_ID and alive_IDs as usual, world frames
+ * carry the payload as a packed_tracks string, copied into track columns by
+ * unpackTracks().
+ * Face names are not encoded.
+ */
+typedef enum _BinarySchema {
+    SchemaPeopleTracks = 1,
+    SchemaAliveIds = 2
+} BinarySchema;
+
+typedef enum _BinaryFrameId {
+    BinaryWorld = 1,
+    BinaryHeartbeat = 2
+} BinaryFrameId;
+
+#pragma pack(push, 1)
+typedef struct _BinaryHeader {
+    char magic[2];
+    uint8_t version;
+    uint8_t schema;         // BinarySchema
+    uint8_t frameId;        // BinaryFrameId
+    uint8_t reserved[3];
+    int32_t seq;
+    uint32_t count;         // records in payload
+    uint32_t stampSec;      // header.stamp; zero if sender had none
+    uint32_t stampNsec;
+} BinaryHeader;
+#pragma pack(pop)
+
+bool isBinaryFrame(const char* datagram, size_t len);
+
+// converts binary frame into a document (see above); returns false and
+// error description if frame is malformed or of unknown version or schema
+bool binaryToDocument(const char* datagram, size_t len, rapidjson::Document& d,
+                      std::string& error);
+
+// copies packed_tracks of a world frame document made by binaryToDocument()
+// into records, a memcpy per column; alive is zeroed. Returns false if
+// document has none or its size is wrong
+bool unpackTracks(const rapidjson::Document& d, TrackRecords& records);
+
+// encoders; stamp is in seconds, 0 if unknown
+void packWorld(int32_t seq, double stamp, const TrackRecords& records, std::string& datagram);
+void packHeartbeat(int32_t seq, double stamp, int maxId, const std::vector<int>& aliveIds,
+                   std::string& datagram);
+
+// encodes OPT world frame or heartbeat JSON document; returns false for
+// anything else, including world frames with face names, which should be
+// passed on as JSON
+bool transcodeJson(const rapidjson::Document& d, std::string& datagram);
+
+#endif /* binary_frame_hpp */
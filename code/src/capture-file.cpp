@@ -0,0 +1,433 @@
+//
+//  capture-file.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include "capture-file.hpp"
+
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef WIN32
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#include "defines.h"
+
+#define ALIGN8(n) (((n)+7) & ~(uint64_t)7)
+
+using namespace std;
+
+#pragma pack(push, 1)
+typedef struct _FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+} FileHeader;
+
+typedef struct _TimeEntry {
+    int64_t time;
+    uint64_t offset;
+} TimeEntry;
+
+typedef struct _SeqIndexEntry {
+    uint32_t tag;
+    int32_t seq;
+    uint64_t record;
+} SeqIndexEntry;
+
+typedef struct _Trailer {
+    uint64_t timeIndexOffset;
+    uint64_t seqIndexOffset;
+    uint64_t count;
+    char magic[8];
+} Trailer;
+#pragma pack(pop)
+
+static const char* SubtypeTags[] = {
+    OM_JSON_SUBTYPE_DERS, OM_JSON_SUBTYPE_DIST, OM_JSON_SUBTYPE_CLUSTER,
+    OM_JSON_SUBTYPE_MDYN, OM_JSON_SUBTYPE_SIM
+};
+
+static uint64_t seqKey(uint32_t tag, int32_t seq)
+{
+    return ((uint64_t)tag << 32) | (uint32_t)((int64_t)seq + 0x80000000LL);
+}
+
+CaptureTag
+captureTag(const rapidjson::Document &d, int32_t &seq)
+{
+    seq = -1;
+
+    if (!d.IsObject())
+        return TagUnknown;
+
+    rapidjson::Value::ConstMemberIterator header = d.FindMember(OPT_JSON_HEADER);
+    rapidjson::Value::ConstMemberIterator seqIt = d.FindMember(OM_JSON_SEQ);
+
+    if (seqIt != d.MemberEnd() && seqIt->value.IsInt())
+        seq = seqIt->value.GetInt();
+
+    if (header != d.MemberEnd() && header->value.IsObject())
+    {
+        seqIt = header->value.FindMember(OM_JSON_SEQ);
+        if (seqIt != header->value.MemberEnd() && seqIt->value.IsInt())
+            seq = seqIt->value.GetInt();
+
+        rapidjson::Value::ConstMemberIterator frameId = header->value.FindMember(OPT_JSON_FRAMEID);
+        if (frameId != header->value.MemberEnd() && frameId->value.IsString())
+        {
+            if (strcmp(frameId->value.GetString(), OPT_JSON_WORLD) == 0)
+                return TagWorld;
+            if (strcmp(frameId->value.GetString(), OPT_JSON_HEARTBEAT) == 0)
+                return TagHeartbeat;
+        }
+    }
+
+    rapidjson::Value::ConstMemberIterator packet = d.FindMember(OM_JSON_PACKET);
+    if (packet != d.MemberEnd() && packet->value.IsObject())
+    {
+        rapidjson::Value::ConstMemberIterator subtype = packet->value.FindMember(OM_JSON_SUBTYPE);
+        if (subtype != packet->value.MemberEnd() && subtype->value.IsString())
+            for (int i = 0; i < 5; ++i)
+                if (strcmp(subtype->value.GetString(), SubtypeTags[i]) == 0)
+                    return (CaptureTag)(TagDerivatives+i);
+    }
+
+    return TagUnknown;
+}
+
+//******************************************************************************
+CaptureWriter::CaptureWriter():
+file_(nullptr),
+bufferUsed_(0),
+offset_(0)
+{}
+
+CaptureWriter::~CaptureWriter()
+{
+    close();
+}
+
+void
+CaptureWriter::open(const string &path, size_t bufferSize)
+{
+    close();
+
+    if (!(file_ = fopen(path.c_str(), "wb")))
+        throw runtime_error("can't create capture file "+path+": "+strerror(errno));
+
+    // stdio buffering is not needed - writes are already large
+    setvbuf(file_, nullptr, _IONBF, 0);
+
+    path_ = path;
+    buffer_.resize(max(bufferSize, (size_t)4096));
+    bufferUsed_ = 0;
+    offset_ = 0;
+    times_.clear();
+    seqs_.clear();
+
+    FileHeader header;
+    memcpy(header.magic, CAPTURE_MAGIC, 8);
+    header.version = CAPTURE_VERSION;
+    header.reserved = 0;
+
+    append(&header, sizeof(header));
+}
+
+bool
+CaptureWriter::write(const CaptureRecordHeader &header, const char *payload)
+{
+    static const char padding[8] = {0};
+
+    if (!file_)
+        return false;
+
+    int64_t time = header.recvTimeNs;
+    if (times_.size() && times_.back().first > time)
+        time = times_.back().first;
+
+    SeqEntry e = { header.tag, header.seq, times_.size() };
+
+    times_.push_back(make_pair(time, offset_));
+    seqs_.push_back(e);
+
+    size_t padLen = ALIGN8(header.length)-header.length;
+
+    return append(&header, sizeof(header)) &&
+           append(payload, header.length) &&
+           append(padding, padLen);
+}
+
+void
+CaptureWriter::close()
+{
+    if (!file_)
+        return;
+
+    uint64_t timeIndexOffset = offset_;
+
+    for (auto& t:times_)
+    {
+        TimeEntry e = { t.first, t.second };
+        append(&e, sizeof(e));
+    }
+
+    uint64_t seqIndexOffset = offset_;
+
+    stable_sort(seqs_.begin(), seqs_.end(), [](const SeqEntry& a, const SeqEntry& b){
+        return seqKey(a.tag, a.seq) < seqKey(b.tag, b.seq);
+    });
+    for (auto& s:seqs_)
+    {
+        SeqIndexEntry e = { s.tag, s.seq, s.record };
+        append(&e, sizeof(e));
+    }
+
+    Trailer trailer;
+    trailer.timeIndexOffset = timeIndexOffset;
+    trailer.seqIndexOffset = seqIndexOffset;
+    trailer.count = times_.size();
+    memcpy(trailer.magic, CAPTURE_INDEX_MAGIC, 8);
+    append(&trailer, sizeof(trailer));
+
+    flush();
+    fclose(file_);
+    file_ = nullptr;
+}
+
+//******************************************************************************
+bool
+CaptureWriter::append(const void *data, size_t len)
+{
+    const char *ptr = (const char*)data;
+    bool ok = true;
+
+    offset_ += len;
+
+    while (len)
+    {
+        size_t n = min(len, buffer_.size()-bufferUsed_);
+
+        memcpy(buffer_.data()+bufferUsed_, ptr, n);
+        bufferUsed_ += n;
+        ptr += n;
+        len -= n;
+
+        if (bufferUsed_ == buffer_.size())
+            ok = flush() && ok;
+    }
+
+    return ok;
+}
+
+bool
+CaptureWriter::flush()
+{
+    size_t n = fwrite(buffer_.data(), 1, bufferUsed_, file_);
+    bool ok = (n == bufferUsed_);
+
+    bufferUsed_ = 0;
+    return ok;
+}
+
+//******************************************************************************
+CaptureReader::CaptureReader(const string &path):
+data_(nullptr),
+length_(0),
+recovered_(false)
+{
+#ifdef WIN32
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE)
+        throw runtime_error("can't open capture file "+path);
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(file_, &size);
+    length_ = (size_t)size.QuadPart;
+    mapping_ = nullptr;
+
+    if (length_)
+    {
+        mapping_ = CreateFileMapping(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_)
+            data_ = (const char*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+    }
+#else
+    if ((fd_ = ::open(path.c_str(), O_RDONLY)) < 0)
+        throw runtime_error("can't open capture file "+path+": "+strerror(errno));
+
+    struct stat st;
+    fstat(fd_, &st);
+    length_ = (size_t)st.st_size;
+
+    if (length_)
+    {
+        void *p = mmap(nullptr, length_, PROT_READ, MAP_SHARED, fd_, 0);
+        data_ = (p == MAP_FAILED ? nullptr : (const char*)p);
+    }
+#endif
+
+    if (!data_ || length_ < sizeof(FileHeader) ||
+        memcmp(data_, CAPTURE_MAGIC, 8) != 0)
+    {
+        unmap();
+        throw runtime_error(path+" is not a capture file");
+    }
+
+    loadIndex();
+}
+
+CaptureReader::~CaptureReader()
+{
+    unmap();
+}
+
+size_t
+CaptureReader::seekTime(int64_t timeNs) const
+{
+    return lower_bound(times_.begin(), times_.end(), timeNs)-times_.begin();
+}
+
+size_t
+CaptureReader::seekSeq(CaptureTag tag, int32_t seq) const
+{
+    uint64_t key = seqKey(tag, seq);
+    vector<pair<uint64_t, uint64_t>>::const_iterator it =
+        lower_bound(seqKeys_.begin(), seqKeys_.end(), make_pair(key, (uint64_t)0));
+
+    if (it != seqKeys_.end() && it->first == key)
+        return (size_t)it->second;
+    return size();
+}
+
+bool
+CaptureReader::isCapture(const string &path)
+{
+    char magic[8];
+    FILE *f = fopen(path.c_str(), "rb");
+    bool res = (f && fread(magic, 1, 8, f) == 8 && memcmp(magic, CAPTURE_MAGIC, 8) == 0);
+
+    if (f)
+        fclose(f);
+    return res;
+}
+
+//******************************************************************************
+void
+CaptureReader::loadIndex()
+{
+    if (length_ < sizeof(FileHeader)+sizeof(Trailer))
+    {
+        scanRecords();
+        return;
+    }
+
+    const Trailer *trailer = (const Trailer*)(data_+length_-sizeof(Trailer));
+
+    if (memcmp(trailer->magic, CAPTURE_INDEX_MAGIC, 8) != 0 ||
+        trailer->count > length_/(sizeof(TimeEntry)+sizeof(SeqIndexEntry)) ||
+        trailer->timeIndexOffset < sizeof(FileHeader) ||
+        trailer->timeIndexOffset+trailer->count*sizeof(TimeEntry) != trailer->seqIndexOffset ||
+        trailer->seqIndexOffset+trailer->count*sizeof(SeqIndexEntry) != length_-sizeof(Trailer))
+    {
+        scanRecords();
+        return;
+    }
+
+    size_t n = (size_t)trailer->count;
+    const TimeEntry *timeIndex = (const TimeEntry*)(data_+trailer->timeIndexOffset);
+    const SeqIndexEntry *seqIndex = (const SeqIndexEntry*)(data_+trailer->seqIndexOffset);
+
+    offsets_.resize(n);
+    times_.resize(n);
+    seqKeys_.resize(n);
+
+    // records are before the index; one pointing anywhere else means the
+    // index is corrupt and records are scanned instead
+    uint64_t end = trailer->timeIndexOffset;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint64_t offset = timeIndex[i].offset;
+
+        if (offset < sizeof(FileHeader) || offset%8 ||
+            offset > end || end-offset < sizeof(CaptureRecordHeader) ||
+            end-offset-sizeof(CaptureRecordHeader) <
+                ALIGN8((uint64_t)((const CaptureRecordHeader*)(data_+offset))->length) ||
+            seqIndex[i].record >= n)
+        {
+            offsets_.clear();
+            times_.clear();
+            seqKeys_.clear();
+            scanRecords();
+            return;
+        }
+
+        offsets_[i] = offset;
+        times_[i] = timeIndex[i].time;
+        seqKeys_[i] = make_pair(seqKey(seqIndex[i].tag, seqIndex[i].seq), seqIndex[i].record);
+    }
+}
+
+void
+CaptureReader::scanRecords()
+{
+    uint64_t offset = sizeof(FileHeader);
+
+    recovered_ = true;
+
+    // last record may be incomplete if recording was interrupted
+    while (offset+sizeof(CaptureRecordHeader) <= length_)
+    {
+        const CaptureRecordHeader *h = (const CaptureRecordHeader*)(data_+offset);
+        uint64_t next = offset+sizeof(CaptureRecordHeader)+ALIGN8(h->length);
+
+        if (next > length_ || h->tag >= NCaptureTags)
+            break;
+
+        int64_t time = h->recvTimeNs;
+        if (times_.size() && times_.back() > time)
+            time = times_.back();
+
+        seqKeys_.push_back(make_pair(seqKey(h->tag, h->seq), (uint64_t)offsets_.size()));
+        offsets_.push_back(offset);
+        times_.push_back(time);
+        offset = next;
+    }
+
+    sort(seqKeys_.begin(), seqKeys_.end());
+}
+
+void
+CaptureReader::unmap()
+{
+#ifdef WIN32
+    if (data_)
+        UnmapViewOfFile(data_);
+    if (mapping_)
+        CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE)
+        CloseHandle(file_);
+    mapping_ = nullptr;
+    file_ = INVALID_HANDLE_VALUE;
+#else
+    if (data_)
+        munmap((void*)data_, length_);
+    if (fd_ >= 0)
+        ::close(fd_);
+    fd_ = -1;
+#endif
+    data_ = nullptr;
+}
@@ -0,0 +1,154 @@
+//
+//  capture-file.hpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#ifndef capture_file_hpp
+#define capture_file_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "rapidjson/document.h"
+
+#define CAPTURE_MAGIC       "OPTCAP01"
+#define CAPTURE_INDEX_MAGIC "OPTCIDX1"
+#define CAPTURE_VERSION     1
+#define CAPTURE_EXT         ".optcap"
+
+/**
+ * Binary capture of received datagrams.
+ *
+ * File layout (little endian):
+ *      file header     magic "OPTCAP01", version, reserved (16 bytes)
+ *      records         record header (24 bytes), payload, zero padding to
+ *                      8 bytes - so record headers stay aligned in memory
+ *      time index      { time, file offset } per record, in record order
+ *      seq index       { tag, seq, record } per record, sorted by tag, seq
+ *      trailer         offsets of both indexes, record count, magic "OPTCIDX1"
+ *
+ * Index times never decrease, so seeking by time is a binary search. Files
+ * without trailer (recording was interrupted) are still readable - reader
+ * scans records and rebuilds the index.
+ */
+typedef enum _CaptureTag {
+    TagUnknown,
+    TagWorld,           // OPT tracks
+    TagHeartbeat,       // OPT alive ids
+    TagDerivatives,     // OpenMoves packets by subtype
+    TagDistance,
+    TagCluster,
+    TagMassDynamics,
+    TagSimilarity,
+    NCaptureTags
+} CaptureTag;
+
+#pragma pack(push, 1)
+typedef struct _CaptureRecordHeader {
+    uint32_t length;        // payload length
+    uint32_t srcAddr;       // IPv4 source address, network byte order
+    uint16_t srcPort;       // source port, host byte order
+    uint8_t tag;            // CaptureTag
+    uint8_t reserved;
+    int32_t seq;            // header.seq, -1 if none
+    int64_t recvTimeNs;     // receive time, ns since epoch
+} CaptureRecordHeader;
+#pragma pack(pop)
+
+// tag and seq of a parsed datagram (header.frame_id, packet.subtype, seq)
+CaptureTag captureTag(const rapidjson::Document& d, int32_t& seq);
+
+/**
+ * Appends records to a capture file; writes are buffered and go to disk in
+ * large chunks. Index is kept in memory and written by close().
+ */
+class CaptureWriter {
+public:
+    CaptureWriter();
+    ~CaptureWriter();
+
+    // throws runtime_error if file can't be created
+    void open(const std::string& path, size_t bufferSize = 1<<20);
+    // returns false on write error (disk full etc.)
+    bool write(const CaptureRecordHeader& header, const char* payload);
+    // flushes buffer, writes index; safe to call more than once
+    void close();
+
+    bool isOpen() const { return file_ != nullptr; }
+    const std::string& getPath() const { return path_; }
+    uint64_t getBytesWritten() const { return offset_; }
+    size_t getNumRecords() const { return times_.size(); }
+
+private:
+    typedef struct _SeqEntry {
+        uint32_t tag;
+        int32_t seq;
+        uint64_t record;
+    } SeqEntry;
+
+    FILE *file_;
+    std::string path_;
+    std::vector<char> buffer_;
+    size_t bufferUsed_;
+    uint64_t offset_;
+    std::vector<std::pair<int64_t, uint64_t>> times_;
+    std::vector<SeqEntry> seqs_;
+
+    bool append(const void* data, size_t len);
+    bool flush();
+};
+
+/**
+ * Memory mapped capture file. Records are accessed in place, no copies.
+ */
+class CaptureReader {
+public:
+    // throws runtime_error if file can't be mapped or is not a capture
+    CaptureReader(const std::string& path);
+    ~CaptureReader();
+
+    size_t size() const { return offsets_.size(); }
+    const CaptureRecordHeader& getHeader(size_t i) const
+    { return *(const CaptureRecordHeader*)(data_+offsets_[i]); }
+    const char* getPayload(size_t i) const
+    { return data_+offsets_[i]+sizeof(CaptureRecordHeader); }
+    // index time of a record - receive time, never decreasing
+    int64_t getTime(size_t i) const { return times_[i]; }
+
+    int64_t getStartTime() const { return size() ? times_.front() : 0; }
+    int64_t getEndTime() const { return size() ? times_.back() : 0; }
+
+    // first record received at or after timeNs (size() if none)
+    size_t seekTime(int64_t timeNs) const;
+    // record with given tag and seq (size() if none)
+    size_t seekSeq(CaptureTag tag, int32_t seq) const;
+
+    // true if the file had no index and it was rebuilt by scanning
+    bool wasRecovered() const { return recovered_; }
+
+    static bool isCapture(const std::string& path);
+
+private:
+    const char *data_;
+    size_t length_;
+#ifdef WIN32
+    void *file_, *mapping_;
+#else
+    int fd_;
+#endif
+    bool recovered_;
+
+    std::vector<uint64_t> offsets_;
+    std::vector<int64_t> times_;
+    std::vector<std::pair<uint64_t, uint64_t>> seqKeys_; // (tag<<32 | seq, record)
+
+    void loadIndex();
+    void scanRecords();
+    void unmap();
+};
+
+#endif /* capture_file_hpp */
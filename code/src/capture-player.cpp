@@ -0,0 +1,251 @@
+//
+//  capture-player.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include "capture-player.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+#define MIN_SPEED 0.001
+
+using namespace std;
+using namespace chrono;
+
+CapturePlayer::CapturePlayer(JsonSocketReader::ISlaveReceiver *receiver):
+receiver_(receiver),
+isActive_(false), loop_(false),
+isPlaying_(false),
+speed_(1),
+generation_(0),
+next_(0),
+anchorTime_(0)
+{}
+
+CapturePlayer::~CapturePlayer()
+{
+    close();
+}
+
+void
+CapturePlayer::open(const string &path)
+{
+    close();
+
+    reader_ = make_shared<CaptureReader>(path);
+    path_ = path;
+    next_ = 0;
+    isPlaying_ = false;
+    setAnchor(reader_->getStartTime(), Clock::now());
+
+    isActive_ = true;
+    playThread_ = make_shared<thread>(bind(&CapturePlayer::playLoop, this));
+}
+
+void
+CapturePlayer::close()
+{
+    if (playThread_)
+    {
+        {
+            lock_guard<mutex> lock(stateMutex_);
+            isActive_ = false;
+        }
+        stateChanged_.notify_all();
+        playThread_->join();
+        playThread_.reset();
+    }
+
+    reader_.reset();
+    path_ = "";
+}
+
+void
+CapturePlayer::play()
+{
+    if (!reader_)
+        return;
+
+    {
+        lock_guard<mutex> lock(stateMutex_);
+        if (isPlaying_)
+            return;
+
+        setAnchor(anchorTime_, Clock::now());
+        isPlaying_ = true;
+    }
+    stateChanged_.notify_all();
+}
+
+void
+CapturePlayer::pause()
+{
+    if (!reader_)
+        return;
+
+    {
+        lock_guard<mutex> lock(stateMutex_);
+        if (!isPlaying_)
+            return;
+
+        Clock::time_point now = Clock::now();
+        setAnchor(captureTime(now), now);
+        isPlaying_ = false;
+    }
+    stateChanged_.notify_all();
+}
+
+void
+CapturePlayer::seek(double seconds)
+{
+    if (!reader_)
+        return;
+
+    int64_t time = reader_->getStartTime()+(int64_t)(seconds*1E9);
+    time = max(reader_->getStartTime(), min(reader_->getEndTime(), time));
+
+    {
+        lock_guard<mutex> lock(stateMutex_);
+        next_ = reader_->seekTime(time);
+        generation_++;
+        setAnchor(time, Clock::now());
+    }
+    stateChanged_.notify_all();
+}
+
+void
+CapturePlayer::setSpeed(double speed)
+{
+    speed = max(speed, MIN_SPEED);
+
+    {
+        lock_guard<mutex> lock(stateMutex_);
+        if (speed == speed_)
+            return;
+
+        // playback continues from where it is now at the new rate
+        Clock::time_point now = Clock::now();
+        setAnchor(captureTime(now), now);
+        speed_ = speed;
+    }
+    stateChanged_.notify_all();
+}
+
+void
+CapturePlayer::setLoop(bool loop)
+{
+    {
+        lock_guard<mutex> lock(stateMutex_);
+        if (loop == loop_)
+            return;
+        loop_ = loop;
+    }
+    stateChanged_.notify_all();
+}
+
+double
+CapturePlayer::getPosition()
+{
+    if (!reader_)
+        return 0;
+
+    lock_guard<mutex> lock(stateMutex_);
+    int64_t time = min(reader_->getEndTime(), captureTime(Clock::now()));
+
+    return (time-reader_->getStartTime())/1E9;
+}
+
+double
+CapturePlayer::getDuration() const
+{
+    return (reader_ ? (reader_->getEndTime()-reader_->getStartTime())/1E9 : 0);
+}
+
+//******************************************************************************
+void
+CapturePlayer::playLoop()
+{
+    unique_lock<mutex> lock(stateMutex_);
+
+    TRACE_THREAD("player");
+    while (isActive_)
+    {
+        if (!isPlaying_)
+        {
+            stateChanged_.wait(lock);
+            continue;
+        }
+
+        Clock::time_point now = Clock::now();
+
+        if (next_ >= reader_->size())
+        {
+            // at the end: wrap around once playback clock passes last record
+            if (!loop_ || !reader_->size())
+                stateChanged_.wait(lock);
+            else if (captureTime(now) < reader_->getEndTime())
+                stateChanged_.wait_until(lock, wallTime(reader_->getEndTime()));
+            else
+            {
+                next_ = 0;
+                setAnchor(reader_->getStartTime(), now);
+            }
+            continue;
+        }
+
+        Clock::time_point due = wallTime(reader_->getTime(next_));
+
+        if (due > now)
+        {
+            stateChanged_.wait_until(lock, due);
+            continue;
+        }
+
+        size_t record = next_++;
+        uint64_t generation = generation_;
+
+        // parsing is done unlocked, so seeking never waits for it
+        lock.unlock();
+
+        string error;
+        JsonDocumentPtr doc = JsonSocketReader::parse(reader_->getPayload(record),
+                                                      reader_->getHeader(record).length,
+                                                      error, &metrics_);
+        lock.lock();
+
+        if (generation != generation_)
+            continue;
+
+        if (doc)
+            receiver_->onNewJsonObjectReceived(doc);
+        else
+            receiver_->onSocketReaderError(error);
+    }
+}
+
+int64_t
+CapturePlayer::captureTime(Clock::time_point now) const
+{
+    if (!isPlaying_)
+        return anchorTime_;
+
+    return anchorTime_+(int64_t)(duration_cast<nanoseconds>(now-anchorWall_).count()*speed_);
+}
+
+CapturePlayer::Clock::time_point
+CapturePlayer::wallTime(int64_t time) const
+{
+    return anchorWall_+duration_cast<Clock::duration>(nanoseconds((int64_t)((time-anchorTime_)/speed_)));
+}
+
+void
+CapturePlayer::setAnchor(int64_t time, Clock::time_point now)
+{
+    anchorTime_ = time;
+    anchorWall_ = now;
+}
@@ -0,0 +1,87 @@
+//
+//  capture-player.hpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#ifndef capture_player_hpp
+#define capture_player_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "JsonSocketReader.hpp"
+#include "capture-file.hpp"
+
+/**
+ * Plays a capture file back into a receiver, as if datagrams arrived from
+ * the network at their recorded receive times (scaled by speed).
+ * The capture is memory mapped and datagrams are parsed and delivered on
+ * player's own thread, so the cook thread never touches the file. Seeking
+ * is a binary search in the capture index and takes effect immediately.
+ */
+class CapturePlayer {
+public:
+    CapturePlayer(JsonSocketReader::ISlaveReceiver* receiver);
+    ~CapturePlayer();
+
+    // throws runtime_error if file can't be opened or is not a capture;
+    // playback starts paused at the beginning
+    void open(const std::string& path);
+    void close();
+    bool isOpen() const { return (bool)reader_; }
+    const std::string& getPath() const { return path_; }
+
+    void play();
+    void pause();
+    bool isPlaying() const { return isPlaying_; }
+    // seconds from capture start
+    void seek(double seconds);
+    // playback rate relative to real time
+    void setSpeed(double speed);
+    void setLoop(bool loop);
+
+    // seconds from capture start
+    double getPosition();
+    double getDuration() const;
+    
+    // played datagrams
+    const Metrics& getMetrics() const { return metrics_; }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    JsonSocketReader::ISlaveReceiver *receiver_;
+    std::shared_ptr<CaptureReader> reader_;
+    std::string path_;
+
+    std::shared_ptr<std::thread> playThread_;
+    std::mutex stateMutex_;
+    std::condition_variable stateChanged_;
+    bool isActive_, loop_;
+    std::atomic<bool> isPlaying_;
+    double speed_;
+    // incremented on seek, so a datagram read before seek is not delivered
+    uint64_t generation_;
+    // next record to deliver
+    size_t next_;
+    // playback clock: capture time anchorTime_ corresponds to anchorWall_
+    Clock::time_point anchorWall_;
+    int64_t anchorTime_;
+    Metrics metrics_;
+
+    void playLoop();
+    int64_t captureTime(Clock::time_point now) const;
+    Clock::time_point wallTime(int64_t time) const;
+    void setAnchor(int64_t time, Clock::time_point now);
+};
+
+#endif /* capture_player_hpp */
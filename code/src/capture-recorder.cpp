@@ -0,0 +1,254 @@
+//
+//  capture-recorder.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include "capture-recorder.hpp"
+
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <ctime>
+#include <cstring>
+#include <stdexcept>
+#include <functional>
+
+#define RING_MIN_SIZE   (1<<16)
+#define RING_WRAP       0xFFFFFFFF  // record length marking unused end of the ring
+#define WRITER_IDLE_MS  2
+#define ALIGN8(n) (((n)+7) & ~(uint64_t)7)
+
+using namespace std;
+using namespace chrono;
+
+static bool fileExists(const string& path)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+
+    if (f)
+        fclose(f);
+    return (f != nullptr);
+}
+
+CaptureRecorder::CaptureRecorder():
+head_(0), tail_(0),
+isRecording_(false), isPushing_(false),
+nRecorded_(0), nDropped_(0), bytesWritten_(0)
+{}
+
+CaptureRecorder::~CaptureRecorder()
+{
+    stop();
+}
+
+void
+CaptureRecorder::start(const Config &config)
+{
+    stop();
+
+    size_t ringSize = RING_MIN_SIZE;
+    while (ringSize < config.ringSize)
+        ringSize <<= 1;
+
+    // no producer can be inside push() here
+    config_ = config;
+    if (ring_.size() != ringSize)
+        ring_.assign(ringSize, 0);
+    head_ = 0;
+    tail_ = 0;
+    nRecorded_ = 0;
+    nDropped_ = 0;
+    bytesWritten_ = 0;
+    {
+        lock_guard<mutex> lock(stateMutex_);
+        errMsg_ = "";
+    }
+
+    openFile();
+
+    isRecording_ = true;
+    writerThread_ = make_shared<thread>(bind(&CaptureRecorder::writerLoop, this));
+}
+
+void
+CaptureRecorder::stop()
+{
+    if (!writerThread_)
+        return;
+
+    isRecording_ = false;
+    while (isPushing_)
+        this_thread::yield();
+
+    writerThread_->join();
+    writerThread_.reset();
+}
+
+void
+CaptureRecorder::push(const CaptureRecordHeader &header, const char *payload)
+{
+    isPushing_ = true;
+
+    if (!isRecording_)
+    {
+        isPushing_ = false;
+        return;
+    }
+
+    uint64_t size = ring_.size();
+    uint64_t recLen = sizeof(CaptureRecordHeader)+ALIGN8(header.length);
+    uint64_t head = head_.load(memory_order_relaxed);
+    uint64_t tail = tail_.load(memory_order_acquire);
+    uint64_t pos = head & (size-1);
+    // record is never split - if it doesn't fit before the end, skip to start
+    uint64_t skip = (size-pos < recLen ? size-pos : 0);
+
+    if (recLen > size/2 || size-(head-tail) < recLen+skip)
+    {
+        nDropped_++;
+        isPushing_ = false;
+        return;
+    }
+
+    if (skip)
+    {
+        uint32_t wrap = RING_WRAP;
+        memcpy(ring_.data()+pos, &wrap, sizeof(wrap));
+        head += skip;
+        pos = 0;
+    }
+
+    memcpy(ring_.data()+pos, &header, sizeof(header));
+    memcpy(ring_.data()+pos+sizeof(header), payload, header.length);
+    head_.store(head+recLen, memory_order_release);
+
+    isPushing_ = false;
+}
+
+string
+CaptureRecorder::getCurrentFile()
+{
+    lock_guard<mutex> lock(stateMutex_);
+    return currentFile_;
+}
+
+string
+CaptureRecorder::getError()
+{
+    lock_guard<mutex> lock(stateMutex_);
+    return errMsg_;
+}
+
+//******************************************************************************
+void
+CaptureRecorder::writerLoop()
+{
+    uint64_t closedBytes = 0;
+    steady_clock::time_point fileStart = steady_clock::now();
+
+    while (true)
+    {
+        // check before draining, so nothing pushed before stop() is lost
+        bool recording = isRecording_;
+        bool wrote = drain();
+
+        if (writer_.isOpen())
+        {
+            bool rotate = (config_.rotateBytes && writer_.getBytesWritten() >= config_.rotateBytes) ||
+                (config_.rotateSeconds > 0 &&
+                 duration_cast<duration<double>>(steady_clock::now()-fileStart).count() >= config_.rotateSeconds);
+
+            if (rotate)
+            {
+                closedBytes += writer_.getBytesWritten();
+                writer_.close();
+                fileStart = steady_clock::now();
+
+                try
+                {
+                    openFile();
+                }
+                catch (runtime_error& e)
+                {
+                    lock_guard<mutex> lock(stateMutex_);
+                    errMsg_ = e.what();
+                }
+            }
+        }
+
+        bytesWritten_ = closedBytes + (writer_.isOpen() ? writer_.getBytesWritten() : 0);
+
+        if (!recording)
+            break;
+        if (!wrote)
+            this_thread::sleep_for(milliseconds(WRITER_IDLE_MS));
+    }
+
+    writer_.close();
+}
+
+bool
+CaptureRecorder::drain()
+{
+    uint64_t size = ring_.size();
+    uint64_t tail = tail_.load(memory_order_relaxed);
+    uint64_t head = head_.load(memory_order_acquire);
+    bool wrote = (tail != head);
+
+    while (tail != head)
+    {
+        uint64_t pos = tail & (size-1);
+        const CaptureRecordHeader *header = (const CaptureRecordHeader*)(ring_.data()+pos);
+
+        if (header->length == RING_WRAP)
+        {
+            tail += size-pos;
+            continue;
+        }
+
+        if (writer_.write(*header, ring_.data()+pos+sizeof(CaptureRecordHeader)))
+            nRecorded_++;
+        else
+            nDropped_++;
+
+        tail += sizeof(CaptureRecordHeader)+ALIGN8(header->length);
+        tail_.store(tail, memory_order_release);
+    }
+
+    return wrote;
+}
+
+void
+CaptureRecorder::openFile()
+{
+    string prefix = config_.path;
+    string ext(CAPTURE_EXT);
+
+    if (prefix.size() > ext.size() &&
+        prefix.compare(prefix.size()-ext.size(), ext.size(), ext) == 0)
+        prefix.resize(prefix.size()-ext.size());
+
+    time_t now = time(nullptr);
+    struct tm t;
+#ifdef WIN32
+    localtime_s(&t, &now);
+#else
+    localtime_r(&now, &t);
+#endif
+
+    stringstream ss;
+    ss << prefix << "-" << put_time(&t, "%Y%m%d-%H%M%S");
+
+    // files rotated within the same second get a counter; existing
+    // captures are never overwritten
+    string name = ss.str()+ext;
+    for (int i = 1; fileExists(name); ++i)
+        name = ss.str()+"-"+to_string(i)+ext;
+
+    writer_.open(name);
+
+    lock_guard<mutex> lock(stateMutex_);
+    currentFile_ = name;
+}
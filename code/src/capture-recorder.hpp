@@ -0,0 +1,77 @@
+//
+//  capture-recorder.hpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#ifndef capture_recorder_hpp
+#define capture_recorder_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "capture-file.hpp"
+
+/**
+ * Records datagrams to capture files without blocking the receiving thread.
+ * push() copies a record into a lock-free single producer/single consumer
+ * ring and returns; a background thread drains the ring into CaptureWriter,
+ * which writes to disk in large chunks. If the ring is full, record is
+ * dropped and counted - receiving never waits for the disk.
+ * Files are named <path>-<date>-<time>.optcap and can be rotated by size
+ * and/or duration.
+ */
+class CaptureRecorder {
+public:
+    typedef struct _Config {
+        std::string path;           // file name prefix
+        uint64_t rotateBytes;       // 0 - no rotation by size
+        double rotateSeconds;       // 0 - no rotation by time
+        size_t ringSize;            // rounded up to a power of two
+    } Config;
+
+    CaptureRecorder();
+    ~CaptureRecorder();
+
+    // throws runtime_error if first file can't be created
+    void start(const Config& config);
+    // writes everything pushed so far and closes the file
+    void stop();
+    bool isRecording() const { return isRecording_; }
+
+    // must be called from one thread only; never blocks
+    void push(const CaptureRecordHeader& header, const char* payload);
+
+    uint64_t getNumRecorded() const { return nRecorded_; }
+    // records that did not make it to disk: ring was full or write failed
+    uint64_t getNumDropped() const { return nDropped_; }
+    uint64_t getBytesWritten() const { return bytesWritten_; }
+    std::string getCurrentFile();
+    std::string getError();
+
+private:
+    Config config_;
+    std::vector<char> ring_;
+    // byte positions, only grow; ring offset is position & (ring size-1)
+    std::atomic<uint64_t> head_, tail_;
+    std::atomic<bool> isRecording_, isPushing_;
+    std::atomic<uint64_t> nRecorded_, nDropped_, bytesWritten_;
+
+    std::shared_ptr<std::thread> writerThread_;
+    std::mutex stateMutex_;
+    std::string currentFile_, errMsg_;
+    CaptureWriter writer_;
+
+    void writerLoop();
+    bool drain();
+    void openFile();
+};
+
+#endif /* capture_recorder_hpp */
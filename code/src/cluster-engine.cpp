@@ -0,0 +1,233 @@
+//
+//  cluster-engine.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include "cluster-engine.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+using namespace std;
+
+ClusterEngine::ClusterEngine():
+nextLabel_(0)
+{}
+
+ClusterEngine::~ClusterEngine()
+{}
+
+void
+ClusterEngine::update(const TrackTable &tracks, float radius, int minSize)
+{
+    int n = (int)tracks.size();
+
+    parent_.resize(n);
+    iota(parent_.begin(), parent_.end(), 0);
+    degree_.assign(n, 1);
+    cluster_.assign(n, -1);
+
+    neighbours_.updateEdges(tracks, radius);
+
+    const vector<int>& edgeA = neighbours_.getEdgeRowA();
+    const vector<int>& edgeB = neighbours_.getEdgeRowB();
+    size_t nEdges = edgeA.size();
+
+    for (size_t e = 0; e < nEdges; ++e)
+    {
+        degree_[edgeA[e]]++;
+        degree_[edgeB[e]]++;
+    }
+
+    // connected core tracks form clusters
+    for (size_t e = 0; e < nEdges; ++e)
+        if (degree_[edgeA[e]] >= minSize && degree_[edgeB[e]] >= minSize)
+        {
+            int ra = findRoot(edgeA[e]), rb = findRoot(edgeB[e]);
+            if (ra != rb)
+                parent_[max(ra, rb)] = min(ra, rb);
+        }
+
+    int nClusters = 0;
+
+    for (int i = 0; i < n; ++i)
+        if (degree_[i] >= minSize)
+        {
+            int root = findRoot(i);
+            if (cluster_[root] < 0)
+                cluster_[root] = nClusters++;
+            cluster_[i] = cluster_[root];
+        }
+
+    // border tracks join cluster of the first core neighbour
+    for (size_t e = 0; e < nEdges; ++e)
+    {
+        int a = edgeA[e], b = edgeB[e];
+
+        if (cluster_[a] < 0 && degree_[b] >= minSize)
+            cluster_[a] = cluster_[b];
+        else if (cluster_[b] < 0 && degree_[a] >= minSize)
+            cluster_[b] = cluster_[a];
+    }
+
+    count_.assign(nClusters, 0);
+    sumX_.assign(nClusters, 0);
+    sumY_.assign(nClusters, 0);
+    sumSq_.assign(nClusters, 0);
+
+    for (int i = 0; i < n; ++i)
+        if (cluster_[i] >= 0)
+        {
+            count_[cluster_[i]]++;
+            sumX_[cluster_[i]] += tracks.x[i];
+            sumY_[cluster_[i]] += tracks.y[i];
+        }
+
+    for (int c = 0; c < nClusters; ++c)
+    {
+        sumX_[c] /= count_[c];
+        sumY_[c] /= count_[c];
+    }
+
+    // spread is RMS distance of members from cluster center
+    for (int i = 0; i < n; ++i)
+        if (cluster_[i] >= 0)
+        {
+            float dx = tracks.x[i]-sumX_[cluster_[i]], dy = tracks.y[i]-sumY_[cluster_[i]];
+            sumSq_[cluster_[i]] += dx*dx + dy*dy;
+        }
+
+    assignLabels(tracks, nClusters);
+
+    // clusters are output in the order of their ids
+    order_.resize(nClusters);
+    iota(order_.begin(), order_.end(), 0);
+    sort(order_.begin(), order_.end(), [this](int a, int b){ return label_[a] < label_[b]; });
+
+    rank_.resize(nClusters);
+    table_.x.resize(nClusters);
+    table_.y.resize(nClusters);
+    table_.spread.resize(nClusters);
+    table_.offsets.resize(nClusters+1);
+    clusterLabels_.resize(nClusters);
+
+    for (int r = 0; r < nClusters; ++r)
+    {
+        int c = order_[r];
+
+        rank_[c] = r;
+        clusterLabels_[r] = label_[c];
+        table_.x[r] = sumX_[c];
+        table_.y[r] = sumY_[c];
+        table_.spread[r] = sqrtf(sumSq_[c]/count_[c]);
+        table_.offsets[r+1] = table_.offsets[r]+count_[c];
+    }
+
+    int nMembers = table_.offsets[nClusters];
+
+    table_.memberId.resize(nMembers);
+    table_.memberX.resize(nMembers);
+    table_.memberY.resize(nMembers);
+    table_.memberCluster.resize(nMembers);
+
+    // count_ is reused as fill cursor of each cluster
+    for (int r = 0; r < nClusters; ++r)
+        count_[order_[r]] = table_.offsets[r];
+
+    for (int i = 0; i < n; ++i)
+        if (cluster_[i] >= 0)
+        {
+            int m = count_[cluster_[i]]++;
+
+            table_.memberId[m] = (float)tracks.ids[i];
+            table_.memberX[m] = tracks.x[i];
+            table_.memberY[m] = tracks.y[i];
+            table_.memberCluster[m] = (float)rank_[cluster_[i]];
+        }
+
+    lastIds_ = tracks.ids;
+    lastLabels_.resize(n);
+    for (int i = 0; i < n; ++i)
+        lastLabels_[i] = (cluster_[i] >= 0 ? label_[cluster_[i]] : -1);
+}
+
+void
+ClusterEngine::reset()
+{
+    nextLabel_ = 0;
+    lastIds_.clear();
+    lastLabels_.clear();
+    table_.clear();
+    clusterLabels_.clear();
+}
+
+//******************************************************************************
+int
+ClusterEngine::findRoot(int i)
+{
+    while (parent_[i] != i)
+    {
+        parent_[i] = parent_[parent_[i]];
+        i = parent_[i];
+    }
+
+    return i;
+}
+
+void
+ClusterEngine::assignLabels(const TrackTable &tracks, int nClusters)
+{
+    int n = (int)tracks.size(), nLast = (int)lastIds_.size();
+
+    // (new cluster, previous id) for every track that was clustered before
+    votes_.clear();
+    for (int i = 0, k = 0; i < n; ++i)
+    {
+        while (k < nLast && lastIds_[k] < tracks.ids[i])
+            ++k;
+        if (k < nLast && lastIds_[k] == tracks.ids[i] &&
+            cluster_[i] >= 0 && lastLabels_[k] >= 0)
+            votes_.push_back(make_pair(cluster_[i], lastLabels_[k]));
+    }
+
+    sort(votes_.begin(), votes_.end());
+
+    overlaps_.clear();
+    for (size_t v = 0; v < votes_.size(); )
+    {
+        size_t end = v;
+        while (end < votes_.size() && votes_[end] == votes_[v])
+            ++end;
+        overlaps_.push_back(make_pair((int)(end-v), votes_[v]));
+        v = end;
+    }
+
+    // largest overlaps claim ids first; on ties, older id wins
+    sort(overlaps_.begin(), overlaps_.end(),
+         [](const pair<int, pair<int,int>>& a, const pair<int, pair<int,int>>& b){
+             if (a.first != b.first)
+                 return a.first > b.first;
+             return a.second.second < b.second.second;
+         });
+
+    label_.assign(nClusters, -1);
+    claimed_.clear();
+
+    for (auto& o:overlaps_)
+    {
+        int c = o.second.first, label = o.second.second;
+
+        if (label_[c] < 0 && find(claimed_.begin(), claimed_.end(), label) == claimed_.end())
+        {
+            label_[c] = label;
+            claimed_.push_back(label);
+        }
+    }
+
+    for (int c = 0; c < nClusters; ++c)
+        if (label_[c] < 0)
+            label_[c] = nextLabel_++;
+}
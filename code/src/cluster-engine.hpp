@@ -0,0 +1,62 @@
+//
+//  cluster-engine.hpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#ifndef cluster_engine_hpp
+#define cluster_engine_hpp
+
+#include <stdio.h>
+#include <vector>
+
+#include "track-table.hpp"
+#include "pairwise-engine.hpp"
+#include "cluster-table.hpp"
+
+/**
+ * Online clustering of tracks - DBSCAN over neighbour edges found with
+ * PairwiseEngine's spatial grid (no O(N^2) work).
+ * Track is a core track if it has at least minSize-1 neighbours within
+ * radius; connected core tracks form a cluster, other tracks within radius
+ * of a core track join its cluster, the rest is noise.
+ * Clusters keep their ids between updates: each new cluster takes the id of
+ * previous cluster it shares most tracks with. Clusters are ordered by id,
+ * i.e. longest living clusters come first.
+ * Output has the same layout as OmJsonParser's clusters.
+ */
+class ClusterEngine {
+public:
+    ClusterEngine();
+    ~ClusterEngine();
+
+    void update(const TrackTable& tracks, float radius, int minSize);
+    void reset();
+
+    const ClusterTable& getClusters() const { return table_; }
+    // persistent cluster ids, in the order of clusters
+    const std::vector<int>& getClusterLabels() const { return clusterLabels_; }
+
+private:
+    PairwiseEngine neighbours_;
+    int nextLabel_;
+
+    ClusterTable table_;
+    std::vector<int> clusterLabels_;
+
+    // per track of current update
+    std::vector<int> parent_, degree_, cluster_;
+    // per cluster of current update
+    std::vector<int> count_, label_, order_, rank_, claimed_;
+    std::vector<float> sumX_, sumY_, sumSq_;
+    std::vector<std::pair<int, int>> votes_;
+    std::vector<std::pair<int, std::pair<int, int>>> overlaps_;
+    // previous update's tracks (sorted by id) and their cluster ids
+    std::vector<int> lastIds_, lastLabels_;
+
+    int findRoot(int i);
+    void assignLabels(const TrackTable& tracks, int nClusters);
+};
+
+#endif /* cluster_engine_hpp */
@@ -0,0 +1,62 @@
+//
+//  cluster-table.hpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#ifndef cluster_table_hpp
+#define cluster_table_hpp
+
+#include <vector>
+
+/**
+ * Clusters and their members in compressed sparse row layout: cluster c has
+ * center x[c], y[c] and spread[c]; its members are rows
+ * offsets[c]..offsets[c+1] of the member arrays. Each member row also keeps
+ * index of its cluster, so all members can be output as one block.
+ * Vectors are reused between frames, so steady-state refills do not allocate.
+ */
+struct ClusterTable {
+    std::vector<float> x, y, spread;
+    std::vector<int> offsets;
+    std::vector<float> memberId, memberX, memberY, memberCluster;
+
+    ClusterTable() : offsets(1, 0) {}
+
+    size_t size() const { return x.size(); }
+    size_t numMembers() const { return memberId.size(); }
+    int clusterSize(size_t c) const { return offsets[c+1]-offsets[c]; }
+
+    void clear()
+    {
+        x.clear();
+        y.clear();
+        spread.clear();
+        offsets.assign(1, 0);
+        memberId.clear();
+        memberX.clear();
+        memberY.clear();
+        memberCluster.clear();
+    }
+
+    // members appended after this call belong to the new cluster
+    void appendCluster(float cx, float cy, float s)
+    {
+        x.push_back(cx);
+        y.push_back(cy);
+        spread.push_back(s);
+        offsets.push_back(offsets.back());
+    }
+
+    void appendMember(float id, float mx, float my)
+    {
+        memberId.push_back(id);
+        memberX.push_back(mx);
+        memberY.push_back(my);
+        memberCluster.push_back((float)(size()-1));
+        offsets.back()++;
+    }
+};
+
+#endif /* cluster_table_hpp */
@@ -25,6 +25,10 @@
 #define OPT_JSON_ID             "id"
 #define OPT_JSON_STABLEID       "stable_id"
 #define OPT_JSON_FACE_NAME      "face_name"
+#define OPT_JSON_STAMP          "stamp"
+#define OPT_JSON_SEC            "sec"
+#define OPT_JSON_NSEC           "nsec"
+#define OPT_JSON_PACKED_TRACKS  "packed_tracks"  // binary frames, see binary-frame.hpp
 
 #define OM_JSON_HEADER          "header"
 #define OM_JSON_SEQ             "seq"
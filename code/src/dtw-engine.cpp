@@ -0,0 +1,366 @@
+//
+//  dtw-engine.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include "dtw-engine.hpp"
+
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <cmath>
+#include <cstdlib>
+
+#include "simd-kernels.hpp"
+#include "zone-engine.hpp"
+
+#define SET_ERR_MSG(errexpr) {\
+stringstream msg; \
+msg << errexpr; \
+errMsg_ = msg.str(); \
+}
+
+using namespace std;
+
+static bool parseFloat(const string& s, float& v)
+{
+    char *end = nullptr;
+    v = strtof(s.c_str(), &end);
+    return (end != s.c_str() && *end == '\0');
+}
+
+// shifts path so that its centroid is at the origin
+static void center(float *x, float *y, int n)
+{
+    float cx = 0, cy = 0;
+
+    for (int i = 0; i < n; ++i)
+    {
+        cx += x[i];
+        cy += y[i];
+    }
+
+    if (n)
+    {
+        cx /= n;
+        cy /= n;
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        x[i] -= cx;
+        y[i] -= cy;
+    }
+}
+
+DtwEngine::DtwEngine():
+band_(10),
+templates_(make_shared<Library>()),
+hasJob_(false), hasResults_(false), quit_(false)
+{
+    job_.length = lastJob_.length = 0;
+    job_.band = lastJob_.band = 0;
+}
+
+DtwEngine::~DtwEngine()
+{
+    if (worker_.joinable())
+    {
+        {
+            lock_guard<mutex> lock(jobMutex_);
+            quit_ = true;
+        }
+        jobCv_.notify_one();
+        worker_.join();
+    }
+}
+
+void
+DtwEngine::setBand(int band)
+{
+    band_ = max(band, 1);
+}
+
+bool
+DtwEngine::loadTemplates(const string& path)
+{
+    ifstream f(path);
+
+    errMsg_ = "";
+
+    if (!f.is_open())
+    {
+        SET_ERR_MSG("can't open templates file " << path)
+        return false;
+    }
+
+    shared_ptr<Library> templates = make_shared<Library>();
+    string line;
+
+    while (getline(f, line))
+    {
+        vector<string> tokens;
+        ZoneEngine::tokenize(line, tokens);
+
+        if (!tokens.size() || tokens[0][0] == '#')
+            continue;
+
+        if (tokens.size() < 5 || tokens.size() % 2 == 0)
+        {
+            SET_ERR_MSG("template " << tokens[0] << ": expected name and at least two x y pairs")
+            return false;
+        }
+
+        Path p;
+        p.name = tokens[0];
+
+        for (size_t i = 1; i < tokens.size(); i += 2)
+        {
+            float x, y;
+            if (!parseFloat(tokens[i], x) || !parseFloat(tokens[i+1], y))
+            {
+                SET_ERR_MSG("template " << p.name << ": bad number in '"
+                            << tokens[i] << " " << tokens[i+1] << "'")
+                return false;
+            }
+            p.x.push_back(x);
+            p.y.push_back(y);
+        }
+
+        center(p.x.data(), p.y.data(), (int)p.x.size());
+        templates->push_back(p);
+    }
+
+    templates_ = templates;
+    return true;
+}
+
+void
+DtwEngine::clearTemplates()
+{
+    templates_ = make_shared<Library>();
+}
+
+void
+DtwEngine::submit(const TrackTable &tracks, const TrackHistory &history)
+{
+    if (!worker_.joinable())
+        worker_ = thread(bind(&DtwEngine::run, this));
+
+    int length = history.getLength();
+
+    {
+        lock_guard<mutex> lock(jobMutex_);
+
+        // if worker is still busy, previous job is replaced - only the
+        // latest snapshot matters
+        job_.ids.clear();
+        job_.versions.clear();
+        job_.paths.clear();
+        job_.length = length;
+        job_.templates = templates_;
+        job_.band = band_;
+
+        for (size_t i = 0; i < tracks.size(); ++i)
+        {
+            int slot = history.getSlot(tracks.ids[i]);
+
+            if (slot < 0)
+                continue;
+
+            const float *x = history.getWindow(slot, TrackHistory::X);
+            const float *y = history.getWindow(slot, TrackHistory::Y);
+
+            job_.ids.push_back(tracks.ids[i]);
+            job_.versions.push_back(history.getVersion(slot));
+            job_.paths.insert(job_.paths.end(), x, x+length);
+            job_.paths.insert(job_.paths.end(), y, y+length);
+        }
+
+        hasJob_ = true;
+    }
+
+    jobCv_.notify_one();
+}
+
+const DtwEngine::Results&
+DtwEngine::getResults()
+{
+    lock_guard<mutex> lock(resultsMutex_);
+
+    if (hasResults_)
+    {
+        swap(front_, pending_);
+        hasResults_ = false;
+    }
+
+    return front_;
+}
+
+float
+DtwEngine::distance(const float *ax, const float *ay, int n,
+                    const float *bx, const float *by, int m,
+                    int band, vector<float>& buffer)
+{
+    if (!n || !m)
+        return -1;
+
+    // window follows scaled diagonal; it has to be at least as wide as
+    // diagonal's slope, otherwise warping path can't get through
+    int w = max(band, (m+n-1)/n);
+    const float inf = numeric_limits<float>::infinity();
+
+    // two rows of cumulative cost (column j is stored at j+1, column -1 is
+    // the boundary), cost row and scratch row
+    buffer.resize(4*(m+1));
+
+    float *prev = buffer.data(), *cur = prev+(m+1);
+    float *cost = cur+(m+1), *tmp = cost+(m+1);
+    int prevLo = 0, prevHi = 0, curLo = 1, curHi = 0;
+
+    fill(prev, prev+2*(m+1), inf);
+    prev[0] = 0;
+
+    for (int i = 0; i < n; ++i)
+    {
+        int c = (n > 1 ? (int)((int64_t)i*(m-1)/(n-1)) : m-1);
+        int j0 = max(0, c-w), j1 = min(m-1, c+w);
+        int len = j1-j0+1;
+
+        // whatever is left in this row from two rows ago is outside the band now
+        fill(cur+curLo, cur+curHi+1, inf);
+
+        // vertical and diagonal steps don't depend on each other - vectorized;
+        // horizontal step is a running minimum
+        vecDistances(cost, bx+j0, by+j0, ax[i], ay[i], len);
+        vecMinAdd(tmp, prev+j0+1, prev+j0, cost, len);
+
+        float left = cur[j0];
+        for (int k = 0; k < len; ++k)
+        {
+            float h = cost[k]+left;
+            left = (tmp[k] < h ? tmp[k] : h);
+            cur[j0+1+k] = left;
+        }
+
+        curLo = j0+1;
+        curHi = j1+1;
+
+        swap(prev, cur);
+        swap(prevLo, curLo);
+        swap(prevHi, curHi);
+    }
+
+    return prev[m]/(n+m);
+}
+
+//******************************************************************************
+void
+DtwEngine::run()
+{
+    unique_lock<mutex> lock(jobMutex_);
+
+    while (true)
+    {
+        jobCv_.wait(lock, [this](){ return hasJob_ || quit_; });
+
+        if (quit_)
+            break;
+
+        swap(workJob_, job_);
+        hasJob_ = false;
+        lock.unlock();
+
+        process(workJob_, lastJob_, last_, work_);
+
+        {
+            lock_guard<mutex> resultsLock(resultsMutex_);
+            pending_ = work_;
+            hasResults_ = true;
+        }
+
+        // keep this pass for the next one to re-use unchanged pairs
+        swap(lastJob_, workJob_);
+        swap(last_, work_);
+
+        lock.lock();
+    }
+}
+
+void
+DtwEngine::process(const Job &job, const Job &lastJob, const Results &lastResults,
+                   Results &results)
+{
+    int n = (int)job.ids.size(), len = job.length;
+    int nLast = (int)lastJob.ids.size();
+    const Library& templates = *job.templates;
+    int nTemplates = (int)templates.size();
+
+    centered_ = job.paths;
+    for (int i = 0; i < n; ++i)
+        center(&centered_[(size_t)2*i*len], &centered_[(size_t)(2*i+1)*len], len);
+
+    // rows of the same tracks in the previous pass (ids are sorted in both)
+    vector<int> lastRow(n, -1);
+    bool canReuse = (job.band == lastJob.band && job.length == lastJob.length);
+
+    for (int i = 0, k = 0; canReuse && i < n; ++i)
+    {
+        while (k < nLast && lastJob.ids[k] < job.ids[i])
+            ++k;
+        if (k < nLast && lastJob.ids[k] == job.ids[i] &&
+            lastJob.versions[k] == job.versions[i])
+            lastRow[i] = k;
+    }
+
+    results.ids = job.ids;
+    results.matrix.assign((size_t)n*n, 0);
+
+    for (int i = 0; i < n; ++i)
+    {
+        const float *ax = &centered_[(size_t)2*i*len], *ay = ax+len;
+
+        for (int j = i+1; j < n; ++j)
+        {
+            float d;
+
+            if (lastRow[i] >= 0 && lastRow[j] >= 0)
+                d = lastResults.matrix[(size_t)lastRow[i]*nLast+lastRow[j]];
+            else
+            {
+                const float *bx = &centered_[(size_t)2*j*len], *by = bx+len;
+                d = distance(ax, ay, len, bx, by, len, job.band, dtwBuffer_);
+            }
+
+            results.matrix[(size_t)i*n+j] = results.matrix[(size_t)j*n+i] = d;
+        }
+    }
+
+    bool sameTemplates = (job.templates == lastJob.templates);
+
+    results.templateNames.resize(nTemplates);
+    for (int t = 0; t < nTemplates; ++t)
+        results.templateNames[t] = templates[t].name;
+
+    results.templateScores.resize((size_t)n*nTemplates);
+
+    for (int i = 0; i < n; ++i)
+    {
+        const float *ax = &centered_[(size_t)2*i*len], *ay = ax+len;
+        float *scores = &results.templateScores[(size_t)i*nTemplates];
+
+        if (sameTemplates && lastRow[i] >= 0)
+            copy_n(&lastResults.templateScores[(size_t)lastRow[i]*nTemplates],
+                   nTemplates, scores);
+        else
+            for (int t = 0; t < nTemplates; ++t)
+                scores[t] = distance(ax, ay, len,
+                                     templates[t].x.data(), templates[t].y.data(),
+                                     (int)templates[t].x.size(),
+                                     job.band, dtwBuffer_);
+    }
+}
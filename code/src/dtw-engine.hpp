@@ -0,0 +1,105 @@
+//
+//  dtw-engine.hpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#ifndef dtw_engine_hpp
+#define dtw_engine_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "track-table.hpp"
+#include "track-history.hpp"
+
+/**
+ * Path similarity engine - banded (Sakoe-Chiba) DTW between histories of all
+ * tracks and against a library of template paths.
+ * Paths are compared by shape: each path is centered on its centroid first.
+ * Similarity is DTW cost averaged per step (i.e. in meters), smaller values
+ * mean more similar paths.
+ * Work is done on a worker thread: submit() snapshots track histories and
+ * returns right away, getResults() returns results of the latest finished
+ * pass. Pairs whose histories did not change since previous pass are not
+ * recomputed.
+ *
+ * Templates file format (one template per line):
+ *      <name> <x0> <y0> <x1> <y1> ...
+ */
+class DtwEngine {
+public:
+    typedef struct _Results {
+        std::vector<int> ids;                   // tracks, in the order of rows
+        std::vector<float> matrix;              // ids x ids, row-major
+        std::vector<std::string> templateNames;
+        std::vector<float> templateScores;      // ids x templates, row-major
+    } Results;
+
+    DtwEngine();
+    ~DtwEngine();
+
+    // band is Sakoe-Chiba window half-width, in samples
+    void setBand(int band);
+    // on error returns false and keeps previous templates
+    bool loadTemplates(const std::string& path);
+    void clearTemplates();
+
+    void submit(const TrackTable& tracks, const TrackHistory& history);
+    // must be called from the same thread as submit()
+    const Results& getResults();
+
+    const std::string& getError() const { return errMsg_; }
+
+    // average per-step banded DTW cost between two paths
+    static float distance(const float* ax, const float* ay, int n,
+                          const float* bx, const float* by, int m,
+                          int band, std::vector<float>& buffer);
+
+private:
+    typedef struct _Path {
+        std::string name;
+        std::vector<float> x, y;
+    } Path;
+    typedef std::vector<Path> Library;
+
+    typedef struct _Job {
+        std::vector<int> ids;
+        std::vector<uint64_t> versions;
+        int length;
+        std::vector<float> paths;   // per track: length x's, then length y's
+        std::shared_ptr<const Library> templates;
+        int band;
+    } Job;
+
+    std::string errMsg_;
+    int band_;
+    std::shared_ptr<const Library> templates_;
+
+    std::thread worker_;
+    std::mutex jobMutex_, resultsMutex_;
+    std::condition_variable jobCv_;
+    bool hasJob_, hasResults_, quit_;
+    Job job_;
+
+    // owned by the worker
+    Job workJob_, lastJob_;
+    Results work_, last_;
+    std::vector<float> centered_, dtwBuffer_;
+
+    // swapped under resultsMutex_
+    Results pending_, front_;
+
+    void run();
+    void process(const Job& job, const Job& lastJob, const Results& lastResults,
+                 Results& results);
+};
+
+#endif /* dtw_engine_hpp */
@@ -0,0 +1,137 @@
+//
+//  heatmap.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include "heatmap.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "simd-kernels.hpp"
+
+#define MAX_KERNEL_RADIUS   12      // in cells
+#define MAX_UPDATE_DT       1.      // seconds; longer gaps are not accumulated, and
+                                    // time going back more than that starts over
+
+using namespace std;
+
+Heatmap::Heatmap():
+rows_(0), cols_(0),
+minX_(0), maxX_(0), minY_(0), maxY_(0),
+sigma_(0.5), halfLife_(60),
+sigmaX_(0.5), sigmaY_(0.5),
+lastTs_(0), lastDecayTs_(0)
+{}
+
+Heatmap::~Heatmap()
+{}
+
+void
+Heatmap::configure(int rows, int cols,
+                   float minX, float maxX, float minY, float maxY,
+                   float sigma, float halfLife)
+{
+    sigma_ = max(sigma, 1e-3f);
+    halfLife_ = halfLife;
+
+    if (rows != rows_ || cols != cols_ ||
+        minX != minX_ || maxX != maxX_ || minY != minY_ || maxY != maxY_)
+    {
+        rows_ = rows;
+        cols_ = cols;
+        minX_ = minX; maxX_ = maxX;
+        minY_ = minY; maxY_ = maxY;
+
+        grid_.assign((size_t)rows_*cols_, 0);
+        kernelX_.assign(2*MAX_KERNEL_RADIUS+2, 0);
+        kernelY_.assign(2*MAX_KERNEL_RADIUS+2, 0);
+    }
+
+    // kernel spans 3 sigma, so sigma can't be more than a third of its radius
+    sigmaX_ = sigmaY_ = sigma_;
+    if (cols_ > 0 && maxX_ > minX_)
+        sigmaX_ = min(sigma_, MAX_KERNEL_RADIUS*(maxX_-minX_)/cols_/3);
+    if (rows_ > 0 && maxY_ > minY_)
+        sigmaY_ = min(sigma_, MAX_KERNEL_RADIUS*(maxY_-minY_)/rows_/3);
+}
+
+void
+Heatmap::update(const TrackTable &tracks, double nowMs)
+{
+    double dt = (lastTs_ > 0 ? min((nowMs-lastTs_)/1000., MAX_UPDATE_DT) : 0);
+    lastTs_ = nowMs;
+
+    decay(nowMs);
+
+    if (dt <= 0 || !grid_.size())
+        return;
+
+    for (size_t i = 0; i < tracks.size(); ++i)
+        splat(tracks.x[i], tracks.y[i], (float)dt);
+}
+
+void
+Heatmap::decay(double nowMs)
+{
+    double dt = (lastDecayTs_ > 0 ? (nowMs-lastDecayTs_)/1000. : 0);
+
+    // small steps back (estimated time of blank cooks running ahead of the
+    // next frame) are not decayed twice
+    if (dt > 0 || dt < -MAX_UPDATE_DT || lastDecayTs_ <= 0)
+        lastDecayTs_ = nowMs;
+
+    if (dt <= 0 || halfLife_ <= 0 || !grid_.size())
+        return;
+
+    vecScale(grid_.data(), (float)exp(-dt*log(2.)/halfLife_), (int)grid_.size());
+}
+
+void
+Heatmap::reset()
+{
+    fill(grid_.begin(), grid_.end(), 0);
+    lastTs_ = lastDecayTs_ = 0;
+}
+
+//******************************************************************************
+void
+Heatmap::splat(float x, float y, float weight)
+{
+    if (maxX_ <= minX_ || maxY_ <= minY_)
+        return;
+
+    float cellW = (maxX_-minX_)/cols_, cellH = (maxY_-minY_)/rows_;
+    // continuous cell coordinates of the track
+    float cx = (x-minX_)/cellW - 0.5f, cy = (y-minY_)/cellH - 0.5f;
+    int rx = min((int)ceil(3*sigmaX_/cellW), MAX_KERNEL_RADIUS);
+    int ry = min((int)ceil(3*sigmaY_/cellH), MAX_KERNEL_RADIUS);
+    // whole kernel and its part on the grid
+    int c0 = (int)floor(cx)-rx, c1 = (int)ceil(cx)+rx;
+    int r0 = (int)floor(cy)-ry, r1 = (int)ceil(cy)+ry;
+    int col0 = max(c0, 0), col1 = min(c1, cols_-1);
+    int row0 = max(r0, 0), row1 = min(r1, rows_-1);
+
+    if (col0 > col1 || row0 > row1)
+        return;
+
+    float kx = -cellW*cellW/(2*sigmaX_*sigmaX_), ky = -cellH*cellH/(2*sigmaY_*sigmaY_);
+    // distance to the nearest cell; it gets 1, so sums are never 0 for
+    // sigma much less than a cell
+    float dx = cx-floor(cx+0.5f), dy = cy-floor(cy+0.5f);
+    float sumX = 0, sumY = 0;
+
+    // normalized over the whole kernel, so heat off the grid is lost
+    for (int c = c0; c <= c1; ++c)
+        sumX += (kernelX_[c-c0] = exp(kx*((c-cx)*(c-cx)-dx*dx)));
+    for (int r = r0; r <= r1; ++r)
+        sumY += (kernelY_[r-r0] = exp(ky*((r-cy)*(r-cy)-dy*dy)));
+
+    vecScale(kernelX_.data()+(col0-c0), weight/(sumX*sumY), col1-col0+1);
+
+    for (int r = row0; r <= row1; ++r)
+        vecAxpy(grid_.data()+(size_t)r*cols_+col0, kernelX_.data()+(col0-c0),
+                kernelY_[r-r0], col1-col0+1);
+}
@@ -0,0 +1,66 @@
+//
+//  heatmap.hpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#ifndef heatmap_hpp
+#define heatmap_hpp
+
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+
+#include "track-table.hpp"
+
+/**
+ * Occupancy heatmap - accumulates time tracks spend over a fixed floor grid.
+ * Every update splats a Gaussian for each track (weighted by time passed
+ * since previous update, up to a second) and decays whole grid
+ * exponentially by all the time passed; decay() alone runs when there are
+ * no new tracks.
+ * Gaussian is separable, so splat is an outer product of two 1D kernels,
+ * added row by row. Kernels are normalized, so a cell holds seconds spent
+ * in it regardless of grid resolution. Kernel radius is capped in cells,
+ * thus cost per track does not grow with grid resolution; sigma is clamped
+ * to a third of that radius, so the Gaussian is not cut.
+ */
+class Heatmap {
+public:
+    Heatmap();
+    ~Heatmap();
+
+    // resets accumulated heat if grid size or bounds changed
+    void configure(int rows, int cols,
+                   float minX, float maxX, float minY, float maxY,
+                   float sigma, float halfLife);
+    // timestamp is in milliseconds
+    void update(const TrackTable& tracks, double nowMs);
+    void decay(double nowMs);
+    void reset();
+
+    // sigma actually used, in meters; less than configured one if clamped
+    float getSigma() const { return std::min(sigmaX_, sigmaY_); }
+    bool isSigmaClamped() const { return sigmaX_ < sigma_ || sigmaY_ < sigma_; }
+    
+    int getRows() const { return rows_; }
+    int getCols() const { return cols_; }
+    // grid is row-major, rows go along y axis, columns - along x axis
+    const float* getGrid() const { return grid_.data(); }
+    const float* getRow(int row) const { return grid_.data()+(size_t)row*cols_; }
+
+private:
+    int rows_, cols_;
+    float minX_, maxX_, minY_, maxY_;
+    float sigma_, halfLife_;
+    float sigmaX_, sigmaY_;
+    double lastTs_, lastDecayTs_;
+
+    std::vector<float> grid_;
+    std::vector<float> kernelX_, kernelY_;
+
+    void splat(float x, float y, float weight);
+};
+
+#endif /* heatmap_hpp */
@@ -0,0 +1,108 @@
+//
+//  metrics.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include "metrics.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+static const char* ChanNames[MetricsWindow::NChans] = {
+    "packetsPerSec", "bytesPerSec", "parseUs", "cookUs", "queueDepth",
+    "dropsParse", "dropsNoSeq", "dropsStale", "dropsExpired"
+};
+
+Metrics::Metrics()
+{
+    for (auto& c:counters_) c = 0;
+    for (auto& g:gauges_) g = 0;
+}
+
+//******************************************************************************
+MetricsWindow::MetricsWindow(double windowSeconds, int nSamples):
+period_((int64_t)(windowSeconds*1E9/max(1, nSamples))),
+samples_(max(1, nSamples)+1),
+newest_(0), count_(0)
+{}
+
+void
+MetricsWindow::update(const Metrics *a, const Metrics *b)
+{
+    int64_t now = Metrics::now();
+
+    if (count_ && now-newest().time < period_)
+    {
+        // gauges are always current
+        for (int g = 0; g < Metrics::NGauges; ++g)
+            samples_[newest_].gauges[g] = (a ? a->get((Metrics::Gauge)g) : 0)+
+                                          (b ? b->get((Metrics::Gauge)g) : 0);
+        return;
+    }
+
+    newest_ = (count_ ? (newest_+1)%samples_.size() : 0);
+    count_ = min(count_+1, samples_.size());
+
+    Sample& s = samples_[newest_];
+
+    s.time = now;
+    for (int c = 0; c < Metrics::NCounters; ++c)
+        s.counters[c] = (a ? a->get((Metrics::Counter)c) : 0)+
+                        (b ? b->get((Metrics::Counter)c) : 0);
+    for (int g = 0; g < Metrics::NGauges; ++g)
+        s.gauges[g] = (a ? a->get((Metrics::Gauge)g) : 0)+
+                      (b ? b->get((Metrics::Gauge)g) : 0);
+}
+
+void
+MetricsWindow::reset()
+{
+    count_ = 0;
+}
+
+const char*
+MetricsWindow::getChanName(int chan)
+{
+    return ChanNames[chan];
+}
+
+float
+MetricsWindow::getChanValue(int chan) const
+{
+    if (!count_)
+        return 0;
+
+    double seconds = (newest().time-oldest().time)/1E9;
+
+    switch (chan) {
+        case PacketsPerSec:
+            return (seconds > 0 ? (float)(delta(Metrics::Packets)/seconds) : 0);
+        case BytesPerSec:
+            return (seconds > 0 ? (float)(delta(Metrics::Bytes)/seconds) : 0);
+        case ParseUs:
+        {
+            int64_t n = delta(Metrics::Packets);
+            return (n ? (float)(delta(Metrics::ParseNs)/1E3/n) : 0);
+        }
+        case CookUs:
+        {
+            int64_t n = delta(Metrics::Cooks);
+            return (n ? (float)(delta(Metrics::CookNs)/1E3/n) : 0);
+        }
+        case QueueDepthChan:
+            return (float)newest().gauges[Metrics::QueueDepth];
+        case DropsParseChan:
+            return (float)newest().counters[Metrics::DropsParse];
+        case DropsNoSeqChan:
+            return (float)newest().counters[Metrics::DropsNoSeq];
+        case DropsStaleChan:
+            return (float)newest().counters[Metrics::DropsStale];
+        case DropsExpiredChan:
+            return (float)newest().counters[Metrics::DropsExpired];
+        default:
+            return 0;
+    }
+}
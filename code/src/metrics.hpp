@@ -0,0 +1,128 @@
+//
+//  metrics.hpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#ifndef metrics_hpp
+#define metrics_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+/**
+ * Fixed-slot pipeline counters and gauges. Every stage owns the slots it
+ * updates (the datagram source - packets, bytes, parsing; OBase - queue and
+ * drops; CHOP - cooks), updates are relaxed atomics and never allocate,
+ * so any thread may update them.
+ */
+class Metrics {
+public:
+    typedef enum _Counter {
+        Packets,
+        Bytes,
+        ParseNs,
+        DropsParse,     // datagrams that are not valid JSON
+        DropsNoSeq,     // documents without seq
+        DropsStale,     // bundles older than the last processed one
+        DropsExpired,   // incomplete bundles that timed out
+        Cooks,
+        CookNs,
+        NCounters
+    } Counter;
+
+    typedef enum _Gauge {
+        QueueDepth,     // bundles waiting to be processed
+        NGauges
+    } Gauge;
+
+    Metrics();
+
+    void add(Counter c, int64_t value = 1)
+    { counters_[c].fetch_add(value, std::memory_order_relaxed); }
+    void set(Gauge g, int64_t value)
+    { gauges_[g].store(value, std::memory_order_relaxed); }
+
+    int64_t get(Counter c) const { return counters_[c].load(std::memory_order_relaxed); }
+    int64_t get(Gauge g) const { return gauges_[g].load(std::memory_order_relaxed); }
+
+    // steady clock, ns
+    static int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    std::atomic<int64_t> counters_[NCounters];
+    std::atomic<int64_t> gauges_[NGauges];
+};
+
+// adds duration of the enclosing scope to a ns counter
+class MetricsTimer {
+public:
+    MetricsTimer(Metrics& metrics, Metrics::Counter counter):
+    metrics_(metrics), counter_(counter), begin_(Metrics::now()) {}
+    ~MetricsTimer() { metrics_.add(counter_, Metrics::now()-begin_); }
+
+private:
+    Metrics& metrics_;
+    Metrics::Counter counter_;
+    int64_t begin_;
+};
+
+/**
+ * Rolling-window view of one or more Metrics for the info CHOP. update()
+ * is called once per cook and takes a snapshot every window/NSamples;
+ * rates and averages are differences between the newest and the oldest
+ * snapshot, so every channel is O(1) and nothing is allocated after
+ * construction. Channel names are static.
+ */
+class MetricsWindow {
+public:
+    typedef enum _Chan {
+        PacketsPerSec,
+        BytesPerSec,
+        ParseUs,        // mean per packet over the window
+        CookUs,         // mean per cook over the window
+        QueueDepthChan,
+        DropsParseChan, // totals
+        DropsNoSeqChan,
+        DropsStaleChan,
+        DropsExpiredChan,
+        NChans
+    } Chan;
+
+    MetricsWindow(double windowSeconds = 1, int nSamples = 8);
+
+    // sums counters of given registries (nullptr ones are skipped)
+    void update(const Metrics* a, const Metrics* b = nullptr);
+    // forgets history, e.g. when the source registry changes
+    void reset();
+
+    static const char* getChanName(int chan);
+    float getChanValue(int chan) const;
+
+private:
+    typedef struct _Sample {
+        int64_t time;
+        int64_t counters[Metrics::NCounters];
+        int64_t gauges[Metrics::NGauges];
+    } Sample;
+
+    int64_t period_;
+    std::vector<Sample> samples_;
+    size_t newest_, count_;
+
+    const Sample& newest() const { return samples_[newest_]; }
+    const Sample& oldest() const
+    { return samples_[(newest_+samples_.size()-count_+1)%samples_.size()]; }
+    int64_t delta(Metrics::Counter c) const
+    { return newest().counters[c]-oldest().counters[c]; }
+};
+
+#endif /* metrics_hpp */
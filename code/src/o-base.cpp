@@ -10,25 +10,57 @@
 
 #include <iostream>
 #include <sstream>
+#include <cstring>
+#include <cassert>
 
 #include "rapidjson/writer.h"
 #include "rapidjson/stringbuffer.h"
 
 #include "defines.h"
 #include "debug.h"
+#include "trace.hpp"
 
 #define MESSAGE_QUEUE_THRESHOLD 500
 #define MESSAGE_LIFETIME_MS 2000
 #define DEFAULT_FRAMEID "default"
 #define NODATA_THRES    1000     // threshold for no data detection
 
+#define PAR_SOURCE "Source"
+#define PAR_PLAYFILE "Playfile"
+#define PAR_PLAY "Play"
+#define PAR_PLAYSPEED "Playspeed"
+#define PAR_PLAYLOOP "Playloop"
+#define PAR_PLAYSEEK "Playseek"
+#define PAR_PLAYCUE "Playcue"
+#define PAR_RECORD "Record"
+#define PAR_RECORDFILE "Recordfile"
+#define PAR_RECORDROTATEMB "Recordrotatemb"
+#define PAR_RECORDROTATEMIN "Recordrotatemin"
+#define PAR_TRACE "Trace"
+#define PAR_TRACEFILE "Tracefile"
+#define PAR_TRACEDUMP "Tracedump"
+
+#define RECORD_RING_SIZE (16<<20)
+
 using namespace std;
 using namespace chrono;
 
+static const char *sourceMenuNames[] = { "Network", "File" };
+static const char *sourceLabels[] = { "Network", "File" };
+
 OBase::OBase(int msgBundleSize, int portnum):
 msgBundleSize_(msgBundleSize),
 lastDataTs_(duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count()),
-noData_(false)
+noData_(false),
+nDropped_(0),
+queueBusy_(false),
+player_(make_shared<CapturePlayer>(this)),
+fileSource_(false),
+recording_(false),
+recordUser_(false),
+playSeek_(0),
+playCue_(false),
+tracing_(false), traceDump_(false)
 {}
 
 OBase::~OBase()
@@ -38,16 +70,13 @@ OBase::~OBase()
 
 //******************************************************************************
 void
-OBase::onNewJsonObjectReceived(const rapidjson::Document &d)
+OBase::onNewJsonObjectReceived(const JsonDocumentPtr &d)
 {
-    // check thread safety for vector
-    rapidjson::Document dcopy;
-    dcopy.CopyFrom(d, dcopy.GetAllocator());
-    
+    // document is immutable and shared with other receivers - no copy needed
     {
         lock_guard<mutex> lock(documentQueueMutex_);
         queueBusy_ = true;
-        documentQueue_.push(move(dcopy));
+        documentQueue_.push(d);
         queueBusy_ = false;
     }
 }
@@ -65,6 +94,7 @@ OBase::onSocketReaderWillReset()
 void
 OBase::processQueue()
 {
+    TRACE_SCOPE("obase.queue");
     double nowTs = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
     
     lock_guard<mutex> lock(documentQueueMutex_);
@@ -77,23 +107,27 @@ OBase::processQueue()
     while (documentQueue_.size())
     {
         int seqNo = -1;
+        const rapidjson::Document& d = *documentQueue_.front();
         
-        if (documentQueue_.front().HasMember(OM_JSON_SEQ))
-            seqNo = documentQueue_.front()[OM_JSON_SEQ].GetInt(); // deprecated for v1
-        else if (documentQueue_.front().HasMember(OM_JSON_HEADER) &&
-                 documentQueue_.front()[OM_JSON_HEADER].HasMember(OM_JSON_SEQ))
+        if (d.HasMember(OM_JSON_SEQ))
+            seqNo = d[OM_JSON_SEQ].GetInt(); // deprecated for v1
+        else if (d.HasMember(OM_JSON_HEADER) &&
+                 d[OM_JSON_HEADER].HasMember(OM_JSON_SEQ))
         {
-            seqNo = documentQueue_.front()[OM_JSON_HEADER][OM_JSON_SEQ].GetInt();
+            seqNo = d[OM_JSON_HEADER][OM_JSON_SEQ].GetInt();
         }
         else
+        {
+            metrics_.add(Metrics::DropsNoSeq);
             processingError("Bad json formatting: can't locate 'seq' field");
+        }
         
         if (seqNo >= 0)
         {
             if (messages_.find(seqNo) == messages_.end())
-                messages_[seqNo] = pair<double, vector<rapidjson::Document>>(nowTs, vector<rapidjson::Document>());
+                messages_[seqNo] = pair<double, Bundle>(nowTs, Bundle());
             
-            messages_[seqNo].second.push_back(move(documentQueue_.front()));
+            messages_[seqNo].second.push_back(documentQueue_.front());
         }
         
         documentQueue_.pop();
@@ -122,6 +156,7 @@ OBase::processQueue()
 void
 OBase::processBundle(OnNewBundle handler)
 {
+    TRACE_SCOPE("obase.bundle");
     double nowTs = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
     
     if (!queueBusy_)
@@ -135,8 +170,8 @@ OBase::processBundle(OnNewBundle handler)
         {
             if ((*it).second.second.size() >= msgBundleSize_)
             {
-                vector<rapidjson::Document>& msgs = (*it).second.second;
-                string frameId = retrieveFrameId(msgs[0]);
+                const Bundle& msgs = (*it).second.second;
+                string frameId = retrieveFrameId(*msgs[0]);
                 int thisSeqNo = (*it).first;
                 
                 if (seqs.find(frameId) == seqs.end())
@@ -145,7 +180,10 @@ OBase::processBundle(OnNewBundle handler)
                 bool oldMessage = (thisSeqNo < seqs[frameId]);
                 
                 if (oldMessage)
+                {
                     nDropped_++;
+                    metrics_.add(Metrics::DropsStale);
+                }
                 else
                 {
                     handler(msgs);
@@ -168,6 +206,7 @@ OBase::processBundle(OnNewBundle handler)
                     ss << "Cleaning up old unprocessed message bundle (id " << (*it).first
                     << "). This normally should not happen, check incoming messages bundle length. Deleted: ";
                     processingError(ss.str());
+                    metrics_.add(Metrics::DropsExpired);
                     messages_.erase(it++);
                 }
                 else
@@ -177,6 +216,8 @@ OBase::processBundle(OnNewBundle handler)
         
         seqs.insert(lastProcessedSeqs_.begin(), lastProcessedSeqs_.end());
         lastProcessedSeqs_ = seqs;
+        updateSeqChans();
+        metrics_.set(Metrics::QueueDepth, (int64_t)messages_.size());
         
         //if (nDropped_)
         //{
@@ -187,8 +228,24 @@ OBase::processBundle(OnNewBundle handler)
     } // if queue not busy
 }
 
+void
+OBase::clearQueue()
+{
+    {
+        lock_guard<mutex> lock(documentQueueMutex_);
+        documentQueue_ = queue<JsonDocumentPtr>();
+    }
+    {
+        lock_guard<mutex> lock(messagesMutex_);
+        messages_.clear();
+        lastProcessedSeqs_.clear();
+        updateSeqChans();
+        metrics_.set(Metrics::QueueDepth, 0);
+    }
+}
+
 string
-OBase::bundleToString(const vector<rapidjson::Document>& bundle)
+OBase::bundleToString(const Bundle& bundle)
 {
     stringstream ss;
     
@@ -197,7 +254,7 @@ OBase::bundleToString(const vector<rapidjson::Document>& bundle)
         rapidjson::StringBuffer buffer;
         buffer.Clear();
         rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-        d.Accept(writer);
+        d->Accept(writer);
         
         ss << buffer.GetString() << endl;
     }
@@ -205,6 +262,322 @@ OBase::bundleToString(const vector<rapidjson::Document>& bundle)
     return ss.str();
 }
 
+void
+OBase::setupPlaybackParameters(OP_ParameterManager *manager)
+{
+    OP_StringParameter source(PAR_SOURCE), playFile(PAR_PLAYFILE);
+    OP_NumericParameter play(PAR_PLAY), speed(PAR_PLAYSPEED), loop(PAR_PLAYLOOP),
+    seek(PAR_PLAYSEEK), cue(PAR_PLAYCUE);
+    
+    source.label = "Source";
+    source.page = "General";
+    source.defaultValue = sourceMenuNames[0];
+    
+    playFile.label = "Capture File";
+    playFile.page = "Playback";
+    
+    play.label = "Play";
+    play.page = "Playback";
+    play.defaultValues[0] = 1;
+    
+    speed.label = "Speed";
+    speed.page = "Playback";
+    speed.defaultValues[0] = 1;
+    speed.minValues[0] = 0.001;
+    speed.clampMins[0] = true;
+    speed.minSliders[0] = 0;
+    speed.maxSliders[0] = 10;
+    
+    loop.label = "Loop";
+    loop.page = "Playback";
+    loop.defaultValues[0] = 1;
+    
+    seek.label = "Seek (s)";
+    seek.page = "Playback";
+    seek.defaultValues[0] = 0;
+    seek.minValues[0] = 0;
+    seek.clampMins[0] = true;
+    seek.maxSliders[0] = 7200;
+    
+    cue.label = "Cue";
+    cue.page = "Playback";
+    
+    OP_ParAppendResult res = manager->appendMenu(source, 2, sourceMenuNames, sourceLabels);
+    assert(res == OP_ParAppendResult::Success);
+    res = manager->appendFile(playFile);
+    assert(res == OP_ParAppendResult::Success);
+    res = manager->appendToggle(play);
+    assert(res == OP_ParAppendResult::Success);
+    res = manager->appendFloat(speed);
+    assert(res == OP_ParAppendResult::Success);
+    res = manager->appendToggle(loop);
+    assert(res == OP_ParAppendResult::Success);
+    res = manager->appendFloat(seek);
+    assert(res == OP_ParAppendResult::Success);
+    res = manager->appendPulse(cue);
+    assert(res == OP_ParAppendResult::Success);
+}
+
+void
+OBase::checkPlayback(OP_Inputs *inputs)
+{
+    bool fileSource = (strcmp(inputs->getParString(PAR_SOURCE), sourceMenuNames[1]) == 0);
+    
+    inputs->enablePar(PAR_PLAYFILE, fileSource);
+    inputs->enablePar(PAR_PLAY, fileSource);
+    inputs->enablePar(PAR_PLAYSPEED, fileSource);
+    inputs->enablePar(PAR_PLAYLOOP, fileSource);
+    inputs->enablePar(PAR_PLAYSEEK, fileSource);
+    inputs->enablePar(PAR_PLAYCUE, fileSource);
+    
+    if (fileSource != fileSource_)
+    {
+        // only one source feeds the CHOP at a time
+        fileSource_ = fileSource;
+        
+        if (socketReader_)
+        {
+            if (fileSource)
+                socketReader_->unregisterSlave(this);
+            else
+                socketReader_->registerSlave(this);
+        }
+        
+        if (!fileSource)
+        {
+            player_->close();
+            playFile_ = "";
+            playError_ = "";
+        }
+        clearQueue();
+        metricsWindow_.reset();
+    }
+    
+    if (!fileSource_)
+        return;
+    
+    string playFile(inputs->getParString(PAR_PLAYFILE));
+    
+    if (playFile != playFile_)
+    {
+        playFile_ = playFile;
+        playError_ = "";
+        player_->close();
+        clearQueue();
+        
+        try
+        {
+            if (playFile.size())
+                player_->open(playFile);
+            playCue_ = true;
+        }
+        catch (runtime_error& e)
+        {
+            playError_ = e.what();
+        }
+    }
+    
+    if (playError_.size())
+        processingError("Playback failed: "+playError_);
+    
+    if (!player_->isOpen())
+        return;
+    
+    player_->setSpeed(inputs->getParDouble(PAR_PLAYSPEED));
+    player_->setLoop(inputs->getParInt(PAR_PLAYLOOP) != 0);
+    
+    double seek = inputs->getParDouble(PAR_PLAYSEEK);
+    
+    if (seek != playSeek_ || playCue_)
+    {
+        playSeek_ = seek;
+        playCue_ = false;
+        player_->seek(seek);
+        clearQueue();
+    }
+    
+    if (inputs->getParInt(PAR_PLAY))
+        player_->play();
+    else
+        player_->pause();
+}
+
+void
+OBase::setupRecordParameters(OP_ParameterManager *manager, const char *filePrefix)
+{
+    OP_NumericParameter record(PAR_RECORD), rotateMb(PAR_RECORDROTATEMB), rotateMin(PAR_RECORDROTATEMIN);
+    OP_StringParameter recordFile(PAR_RECORDFILE);
+    
+    record.label = "Record";
+    record.page = "Record";
+    
+    recordFile.label = "File Prefix";
+    recordFile.page = "Record";
+    recordFile.defaultValue = filePrefix;
+    
+    rotateMb.label = "Rotate Size (MB)";
+    rotateMb.page = "Record";
+    rotateMb.defaultValues[0] = 0;
+    rotateMb.minValues[0] = 0;
+    rotateMb.clampMins[0] = true;
+    rotateMb.maxSliders[0] = 1024;
+    
+    rotateMin.label = "Rotate Time (min)";
+    rotateMin.page = "Record";
+    rotateMin.defaultValues[0] = 0;
+    rotateMin.minValues[0] = 0;
+    rotateMin.clampMins[0] = true;
+    rotateMin.maxSliders[0] = 60;
+    
+    OP_ParAppendResult res = manager->appendToggle(record);
+    assert(res == OP_ParAppendResult::Success);
+    res = manager->appendFile(recordFile);
+    assert(res == OP_ParAppendResult::Success);
+    res = manager->appendFloat(rotateMb);
+    assert(res == OP_ParAppendResult::Success);
+    res = manager->appendFloat(rotateMin);
+    assert(res == OP_ParAppendResult::Success);
+}
+
+void
+OBase::checkRecording(OP_Inputs *inputs)
+{
+    bool record = (inputs->getParInt(PAR_RECORD) != 0);
+    
+    // file settings apply when recording starts
+    inputs->enablePar(PAR_RECORDFILE, !record);
+    inputs->enablePar(PAR_RECORDROTATEMB, !record);
+    inputs->enablePar(PAR_RECORDROTATEMIN, !record);
+    
+    if (!socketReader_)
+        return;
+    
+    CaptureRecorder& recorder = socketReader_->getRecorder();
+    
+    if (record != recording_)
+    {
+        recording_ = record;
+        
+        if (record)
+        {
+            CaptureRecorder::Config config;
+            
+            config.path = inputs->getParString(PAR_RECORDFILE);
+            config.rotateBytes = (uint64_t)(inputs->getParDouble(PAR_RECORDROTATEMB)*(1<<20));
+            config.rotateSeconds = inputs->getParDouble(PAR_RECORDROTATEMIN)*60;
+            config.ringSize = RECORD_RING_SIZE;
+            
+            try
+            {
+                socketReader_->startRecording(config);
+                recordUser_ = true;
+            }
+            catch (runtime_error& e)
+            {
+                processingError(string("Recording failed: ")+e.what());
+            }
+        }
+        else if (recordUser_)
+        {
+            socketReader_->stopRecording();
+            recordUser_ = false;
+        }
+    }
+    
+    if (recordUser_ && recorder.getError().size())
+        processingError("Recording error: "+recorder.getError());
+}
+
+void
+OBase::setupTraceParameters(OP_ParameterManager *manager, const char *traceFile)
+{
+    OP_NumericParameter trace(PAR_TRACE), dump(PAR_TRACEDUMP);
+    OP_StringParameter traceFilePar(PAR_TRACEFILE);
+    
+    trace.label = "Trace";
+    trace.page = "Trace";
+    
+    traceFilePar.label = "Trace File";
+    traceFilePar.page = "Trace";
+    traceFilePar.defaultValue = traceFile;
+    
+    dump.label = "Dump Trace";
+    dump.page = "Trace";
+    
+    OP_ParAppendResult res = manager->appendToggle(trace);
+    assert(res == OP_ParAppendResult::Success);
+    res = manager->appendFile(traceFilePar);
+    assert(res == OP_ParAppendResult::Success);
+    res = manager->appendPulse(dump);
+    assert(res == OP_ParAppendResult::Success);
+}
+
+void
+OBase::checkTrace(OP_Inputs *inputs)
+{
+    bool trace = (inputs->getParInt(PAR_TRACE) != 0);
+    
+    if (trace != tracing_)
+    {
+        tracing_ = trace;
+        if (trace)
+            Trace::enable();
+        else
+            Trace::disable();
+    }
+    
+    // dumps whatever is in the trace buffers, even after tracing is off
+    if (traceDump_)
+    {
+        traceDump_ = false;
+        traceError_ = "";
+        
+        try
+        {
+            Trace::dump(inputs->getParString(PAR_TRACEFILE));
+        }
+        catch (runtime_error& e)
+        {
+            traceError_ = e.what();
+        }
+    }
+    
+    if (traceError_.size())
+        processingError("Trace dump failed: "+traceError_);
+}
+
+void
+OBase::sourcePulsePressed(const char *name)
+{
+    if (!strcmp(name, PAR_PLAYCUE))
+        playCue_ = true;
+    if (!strcmp(name, PAR_TRACEDUMP))
+        traceDump_ = true;
+}
+
+void
+OBase::closeSources()
+{
+    player_->close();
+    if (socketReader_)
+    {
+        socketReader_->unregisterSlave(this);
+        if (recordUser_)
+            socketReader_->stopRecording();
+    }
+    if (tracing_)
+        Trace::disable();
+}
+
+const Metrics*
+OBase::getSourceMetrics() const
+{
+    if (fileSource_)
+        return &player_->getMetrics();
+    return (socketReader_ ? &socketReader_->getMetrics() : nullptr);
+}
+
+//******************************************************************************
 string
 OBase::retrieveFrameId(const rapidjson::Document &d)
 {
@@ -213,3 +586,22 @@ OBase::retrieveFrameId(const rapidjson::Document &d)
         return string(d[OPT_JSON_HEADER][OPT_JSON_FRAMEID].GetString());
     return DEFAULT_FRAMEID; // frame ids not supported
 }
+
+void
+OBase::updateSeqChans()
+{
+    // frame ids are only ever added (or all cleared), so same size means
+    // same names
+    if (seqChanNames_.size() != lastProcessedSeqs_.size())
+    {
+        seqChanNames_.clear();
+        for (auto& s:lastProcessedSeqs_)
+            seqChanNames_.push_back("seq_"+s.first);
+    }
+    
+    seqChanValues_.resize(lastProcessedSeqs_.size());
+    
+    size_t i = 0;
+    for (auto& s:lastProcessedSeqs_)
+        seqChanValues_[i++] = s.second;
+}
@@ -18,26 +18,53 @@
 #include <set>
 #include <functional>
 
+#include "CHOP_CPlusPlusBase.h"
 #include "JsonSocketReader.hpp"
+#include "capture-player.hpp"
+#include "metrics.hpp"
 
 class OBase : public JsonSocketReader::ISlaveReceiver
 {
 public:
-    typedef std::function<void(std::vector<rapidjson::Document>&)> OnNewBundle;
+    // bundle documents are shared with other receivers and must not be modified
+    typedef std::vector<JsonDocumentPtr> Bundle;
+    typedef std::function<void(const Bundle&)> OnNewBundle;
     
     OBase(int msgBundleSize, int portnum);
     ~OBase();
     
 protected:
-    void onNewJsonObjectReceived(const rapidjson::Document&) override;
+    void onNewJsonObjectReceived(const JsonDocumentPtr&) override;
     void onSocketReaderError(const std::string&) override;
     void onSocketReaderWillReset() override;
 
     void processQueue();
     void processBundle(OnNewBundle);
+    // drops everything received but not processed yet, e.g. when input jumps
+    // to another point in time
+    void clearQueue();
     
     virtual void processingError(std::string m) {}
     
+    // Source menu and Playback page: with Source set to File, a capture file
+    // feeds the queue instead of the socket reader
+    static void setupPlaybackParameters(OP_ParameterManager*);
+    void checkPlayback(OP_Inputs*);
+    // Record page: captures what the socket reader receives, shared by all
+    // CHOPs on the reader; files are named after filePrefix by default
+    static void setupRecordParameters(OP_ParameterManager*, const char *filePrefix);
+    void checkRecording(OP_Inputs*);
+    // Trace page: process-wide tracing, dumped to traceFile by default
+    static void setupTraceParameters(OP_ParameterManager*, const char *traceFile);
+    void checkTrace(OP_Inputs*);
+    // pulse parameters of the pages above; CHOPs forward pulsePressed here
+    void sourcePulsePressed(const char *name);
+    // detaches from all sources and stops this CHOP's tracing; CHOPs call it
+    // before they are destroyed
+    void closeSources();
+    // registry of the source currently feeding the queue
+    const Metrics* getSourceMetrics() const;
+    
     double lastDataTs_;
     bool noData_;
     int nDropped_;
@@ -47,17 +74,37 @@ protected:
     std::atomic<bool> queueBusy_;
     std::mutex messagesMutex_;
     // dictionary of collected messages
-    typedef std::map<int, std::pair<double, std::vector<rapidjson::Document>>, std::greater<int>> MessagesQueue;
+    typedef std::map<int, std::pair<double, Bundle>, std::greater<int>> MessagesQueue;
     MessagesQueue messages_;
     
-    std::string bundleToString(const std::vector<rapidjson::Document>& bundle);
+    std::string bundleToString(const Bundle& bundle);
+    
+    // queue depth and drops; CHOPs add their cook times
+    Metrics metrics_;
+    // "seq_<frame id>" info channels, in lastProcessedSeqs_ order
+    std::vector<std::string> seqChanNames_;
+    std::vector<int> seqChanValues_;
+    
+    // CHOP's socket reader, set up by the CHOP; may be null
+    std::shared_ptr<JsonSocketReader> socketReader_;
+    std::shared_ptr<CapturePlayer> player_;
+    bool fileSource_;
+    MetricsWindow metricsWindow_;
     
 private:
     int msgBundleSize_;
     std::mutex documentQueueMutex_;
-    std::queue<rapidjson::Document> documentQueue_;
+    std::queue<JsonDocumentPtr> documentQueue_;
+    bool recording_;
+    bool recordUser_; // counted as recorder user on socketReader_
+    std::string playFile_, playError_;
+    double playSeek_;
+    bool playCue_;
+    bool tracing_, traceDump_;
+    std::string traceError_;
     
     std::string retrieveFrameId(const rapidjson::Document&);
+    void updateSeqChans();
 };
 
 #endif /* o_base_hpp */
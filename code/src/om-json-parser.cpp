@@ -9,12 +9,15 @@
 #include "om-json-parser.hpp"
 
 #include <sstream>
+#include <algorithm>
+#include <cmath>
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
 #include <iostream>
 
 #include "defines.h"
 #include "debug.h"
+#include "trace.hpp"
 
 using namespace std;
 
@@ -29,140 +32,167 @@ parseResult_ = false;\
 if (!parseResult_) return parseResult_; \
 }
 
-static map<string, OmJsonParser::PacketSubtype> StringSubtypeMap = {
-    { "all", OmJsonParser::PacketSubtype::All },
-    { OM_JSON_SUBTYPE_DERS, OmJsonParser::PacketSubtype::Derivatives },
-    { OM_JSON_SUBTYPE_SIM, OmJsonParser::PacketSubtype::Similarity },
-    { OM_JSON_SUBTYPE_DIST, OmJsonParser::PacketSubtype::Distance },
-    { OM_JSON_SUBTYPE_MDYN, OmJsonParser::PacketSubtype::Massdyn },
-    { OM_JSON_SUBTYPE_CLUSTER, OmJsonParser::PacketSubtype::Cluster }
+// subtype names, indexed by PacketSubtype; lengths are known at compile time,
+// so matching received subtype is a length check plus memcmp
+static const struct {
+    const char* name_;
+    size_t len_;
+} SubtypeNames[OmJsonParser::NSubtypes] = {
+#define SUBTYPE_NAME(s) { s, sizeof(s)-1 }
+    SUBTYPE_NAME("all"),
+    SUBTYPE_NAME(OM_JSON_SUBTYPE_DERS),
+    SUBTYPE_NAME(OM_JSON_SUBTYPE_DIST),
+    SUBTYPE_NAME(OM_JSON_SUBTYPE_CLUSTER),
+    SUBTYPE_NAME(OM_JSON_SUBTYPE_MDYN),
+    SUBTYPE_NAME(OM_JSON_SUBTYPE_SIM)
+#undef SUBTYPE_NAME
 };
 
-static map<OmJsonParser::PacketSubtype, string> SubtypeStringMap = {
-    { OmJsonParser::PacketSubtype::All, "all" },
-    { OmJsonParser::PacketSubtype::Derivatives, OM_JSON_SUBTYPE_DERS },
-    { OmJsonParser::PacketSubtype::Similarity, OM_JSON_SUBTYPE_SIM },
-    { OmJsonParser::PacketSubtype::Distance, OM_JSON_SUBTYPE_DIST },
-    { OmJsonParser::PacketSubtype::Massdyn, OM_JSON_SUBTYPE_MDYN },
-    { OmJsonParser::PacketSubtype::Cluster, OM_JSON_SUBTYPE_CLUSTER }
+// stage edges in the order of Stagedist output channels
+static const char* StageDistKeys[4] = {
+    OM_JSON_STAGEDIST_US, OM_JSON_STAGEDIST_DS, OM_JSON_STAGEDIST_SL, OM_JSON_STAGEDIST_SR
+};
+
+const OmJsonParser::SubtypeDecoder OmJsonParser::SubtypeDecoders[OmJsonParser::NSubtypes] = {
+    nullptr,
+    &OmJsonParser::decodeDerivatives,
+    &OmJsonParser::decodeDistances,
+    &OmJsonParser::decodeClusters,
+    &OmJsonParser::decodeMassdyn,
+    &OmJsonParser::decodeSimilarity
 };
 
 OmJsonParser::OmJsonParser(int maxMatSize):
 errMsg_(""),
 parseResult_(false),
-pairwiseStride_(maxMatSize)
+matDim_(0), matStride_(1),
+nDerivativeRows_(0), derivativesStride_(0),
+nHotspots_(0), hotspotsStride_(0),
+nTemplateRows_(0), templatesStride_(0)
 {
-    size_t len = maxMatSize*(maxMatSize+1);
-    pairwiseMat_ = (float*)malloc(len*sizeof(float));
-    dtwMat_ = (float*)malloc(len*sizeof(float));
-    
-    memset(pairwiseMat_, -1, len);
-    memset(dtwMat_, -1, len);
+    memset(groupTarget_, 0, sizeof(groupTarget_));
+    reserveMatrices(maxMatSize);
 }
 
 OmJsonParser::~OmJsonParser()
 {
-    free(pairwiseMat_);
-    free(dtwMat_);
 }
 
 bool
-OmJsonParser::parse(vector<rapidjson::Document>& messages,
+OmJsonParser::parse(const vector<shared_ptr<const rapidjson::Document>>& messages,
                     set<string> &parsedSubtypes,
                     string subtype)
 {
+    TRACE_SCOPE("om.parse");
     errMsg_ = "";
     parseResult_ = true;
     clearAll();
     
-    processIdOrder(messages, idOrder_);
-    CHECK_PARSE_RESULT()
-    
-    set<PacketSubtype> subtypesToCheck;
-    if (subtype == "all")
-        for (auto& p:StringSubtypeMap)
-            subtypesToCheck.insert(p.second);
-    else
-        subtypesToCheck.insert(StringSubtypeMap[subtype]);
+    unsigned int requested = subtypeMask(subtype);
+    const rapidjson::Value* ids = nullptr;
+    const rapidjson::Value* values[NSubtypes] = { nullptr };
     
-    for (auto& st:subtypesToCheck)
+    // single pass over the bundle: subtype of each message is read once and
+    // its values are kept for the decoder; ids may come in any message of the
+    // bundle, so decoding happens after the pass
+    for (auto& mp:messages)
     {
-        // TODO: this should be var not vector
-        vector<rapidjson::Document> subTypeMsg;
-        if (!hasSubType(messages, subtype, subTypeMsg))
+        const rapidjson::Document& m = *mp;
+        
+        if (!m.IsObject())
             continue;
         
-        switch (st) {
-            case All:
-            case Derivatives:
-            {
-                processDerivatives(subTypeMsg,
-                                   idOrder_,
-                                   derivatives1_,
-                                   derivatives2_,
-                                   speeds_,
-                                   accelerations_);
-            }
-                if (st != All)
-                    break;
-            case Distance:
-            {
-                    processDistances(subTypeMsg,
-                                     idOrder_,
-                                     pairwiseMat_,
-                                     stageDistances_);
-            }
-                if (st != All)
-                    break;
-            case Cluster:
-            {
-                    processClusters(subTypeMsg, clustersData_, clusterIds_);
-            }
-                if (st != All)
-                    break;
-            case Massdyn:
-            {
-                    processHotspots(subTypeMsg, hotspotsData_);
-                    processGroupTarget(subTypeMsg, groupTarget_);
-            }
-                if (st != All)
-                    break;
-            case Similarity:
-                {
-                    processDtw(subTypeMsg, idOrder_, dtwMat_);
-                    processTemplates(subTypeMsg, idOrder_, templatesData_);
-                }
-                if (st != All)
-                    break;
-            default:
-                break;
-        } // switch
+        if (!ids)
+        {
+            rapidjson::Value::ConstMemberIterator it = m.FindMember(OM_JSON_IDS);
+            if (it != m.MemberEnd())
+                ids = &it->value;
+        }
         
-        parsedSubtypes.insert(SubtypeStringMap[st]);
-    } // for
+        rapidjson::Value::ConstMemberIterator packet = m.FindMember(OM_JSON_PACKET);
+        if (packet == m.MemberEnd() || !packet->value.IsObject())
+            continue;
+        
+        rapidjson::Value::ConstMemberIterator st = packet->value.FindMember(OM_JSON_SUBTYPE);
+        if (st == packet->value.MemberEnd())
+            continue;
+        
+        PacketSubtype pst = lookupSubtype(st->value);
+        if (pst == All || !(requested & (1u << pst)) || values[pst])
+            continue;
+        
+        rapidjson::Value::ConstMemberIterator v = m.FindMember(OM_JSON_VALUES);
+        if (v != m.MemberEnd())
+            values[pst] = &v->value;
+        else
+            SET_ERR_MSG(SubtypeNames[pst].name_ << " subtype; can't find " << OM_JSON_VALUES)
+    }
+    
+    if (ids)
+        processIdOrder(*ids, idOrder_);
+    else
+        SET_ERR_MSG("couldn't find field " << OM_JSON_IDS << " in received json messages")
+    CHECK_PARSE_RESULT()
+    
+    for (int st = Derivatives; st < NSubtypes; ++st)
+        if (values[st])
+        {
+            (this->*SubtypeDecoders[st])(*values[st]);
+            parsedSubtypes.insert(SubtypeNames[st].name_);
+        }
     
     return parseResult_;
 }
 
 void
-OmJsonParser::processIdOrder(vector<rapidjson::Document>& messages,
+OmJsonParser::decodeDerivatives(const rapidjson::Value& values)
+{
+    processDerivatives(values);
+}
+
+void
+OmJsonParser::decodeDistances(const rapidjson::Value& values)
+{
+    reserveMatrices((int)idOrder_.size());
+    matDim_ = (int)idOrder_.size();
+    processDistances(values, idOrder_, pairwiseMat_.data(), stageDistances_);
+}
+
+void
+OmJsonParser::decodeClusters(const rapidjson::Value& values)
+{
+    processClusters(values);
+}
+
+void
+OmJsonParser::decodeMassdyn(const rapidjson::Value& values)
+{
+    processHotspots(values);
+    processGroupTarget(values);
+}
+
+void
+OmJsonParser::decodeSimilarity(const rapidjson::Value& values)
+{
+    reserveMatrices((int)idOrder_.size());
+    matDim_ = (int)idOrder_.size();
+    processDtw(values, idOrder_, dtwMat_.data());
+    processTemplates(values, idOrder_);
+}
+
+void
+OmJsonParser::processIdOrder(const rapidjson::Value& ids,
                              vector<int>& idOrder)
 { // retrieving id order
-    rapidjson::Value idorder;
-    
-    if (retireve(OM_JSON_IDS, messages, idorder))
+    if (!ids.IsArray())
+        SET_ERR_MSG(OM_JSON_IDS << " is not an array.")
+    else
     {
-        if (!idorder.IsArray())
-            SET_ERR_MSG(OM_JSON_IDS << " is not an array.")
-        else
-        {
-            const rapidjson::Value& arr = idorder.GetArray();
-            for (rapidjson::SizeType i = 0; i < arr.Size(); i++)
-                idOrder.push_back(arr[i].GetInt());
-        }
+        const rapidjson::Value::ConstArray& arr = ids.GetArray();
+        idOrder.reserve(arr.Size());
+        for (rapidjson::SizeType i = 0; i < arr.Size(); i++)
+            idOrder.push_back(arr[i].GetInt());
     }
-    else
-        SET_ERR_MSG("couldn't find field " << OM_JSON_IDS << " in received json messages")
         
 #ifdef PRINT_IDS
         cout << "filtered ids: ";
@@ -173,336 +203,355 @@ OmJsonParser::processIdOrder(vector<rapidjson::Document>& messages,
 }
 
 void
-OmJsonParser::processDerivatives(vector<rapidjson::Document>& messages,
-                            vector<int>& idOrder,
-                            map<int, vector<float>>& derivatives1,
-                            map<int, vector<float>>& derivatives2,
-                            map<int, float>& speed,
-                            map<int, float>& acceleration)
-{ // retrieving derivatives
-    rapidjson::Value values;
-    if (retireve(OM_JSON_VALUES, messages, values))
+OmJsonParser::processDerivatives(const rapidjson::Value& values)
+{
+    int n = (int)idOrder_.size();
+    
+    if (n > derivativesStride_)
     {
-        retrieveOrdered(values, OM_JSON_FIRSTDERS, idOrder, derivatives1);
-        retrieveOrdered(values, OM_JSON_SECONDDERS, idOrder, derivatives2);
-        retrieveOrdered(values, OM_JSON_SPEEDS, idOrder, speed);
-        retrieveOrdered(values, OM_JSON_ACCELERATIONS, idOrder, acceleration);
+        derivativesStride_ = max(n, 2*derivativesStride_);
+        derivatives_.assign(OM_DERIVATIVES_NCHANS*derivativesStride_, 0);
+        derivativesMask_.assign(derivativesStride_, 0);
     }
-    else
-        SET_ERR_MSG("derivatives subtype; can't find " << OM_JSON_VALUES)
+    
+    for (int i = 0; i < n; ++i)
+        derivatives_[i] = (float)idOrder_[i];
+    memset(derivativesMask_.data(), 0, n);
+    nDerivativeRows_ = n;
+    
+    retrieveDerivative(values, OM_JSON_FIRSTDERS, 1, 2, MaskD1);
+    retrieveDerivative(values, OM_JSON_SECONDDERS, 3, 2, MaskD2);
+    retrieveDerivative(values, OM_JSON_SPEEDS, 5, 1, MaskSpeed);
+    retrieveDerivative(values, OM_JSON_ACCELERATIONS, 6, 1, MaskAccel);
     
 #ifdef PRINT_DERIVATIVES
-    cout << "derivatives1: " << endl;
-    for (auto v:derivatives1)
+    cout << "derivatives: " << endl;
+    for (int i = 0; i < n; ++i)
     {
-        cout << "id " << v.first << " d1x " << v.second.first << " d1y " << v.second.second;
-        
-        if (derivatives2.find(v.first) != derivatives2.end())
-            cout << " d2x " << derivatives2[v.first].first << " d2y " << derivatives2[v.first].second;
-        else
-            cout << " no d2 data ";
-        if (speed.find(v.first) != speed.end())
-            cout << " speed " << speed[v.first];
-        else
-            cout <<  " no speed data ";
-        if (acceleration.find(v.first) != acceleration.end())
-            cout << " accel " << acceleration[v.first] << endl;
-        else
-            cout << " no acceleration data " << endl;
+        cout << "id " << idOrder_[i] << " mask " << (int)derivativesMask_[i];
+        for (int c = 1; c < OM_DERIVATIVES_NCHANS; ++c)
+            cout << " " << derivatives_[c*derivativesStride_+i];
+        cout << endl;
     }
 #endif
 }
 
 void
-OmJsonParser::processDistances(vector<rapidjson::Document>& messages,
+OmJsonParser::processDistances(const rapidjson::Value& values,
                                vector<int>& idOrder,
                                float* pairwiseMatrix,
                                map<int, vector<float>>& stageDistances)
 {
-    rapidjson::Value values;
-    if (retireve(OM_JSON_VALUES, messages, values))
-    {
-        retrieveOrdered(values, OM_JSON_PAIRWISE, idOrder, pairwiseMatrix);
-        retrieveStageDistances(values, OM_JSON_STAGEDIST, idOrder, stageDistances);
-    }
-    else
-        SET_ERR_MSG("distances subtype; can't find " << OM_JSON_VALUES);
+    retrieveOrdered(values, OM_JSON_PAIRWISE, idOrder, pairwiseMatrix);
+    retrieveStageDistances(values, OM_JSON_STAGEDIST, idOrder, stageDistances);
     
 #ifdef PRINT_PAIRWISE
     cout << "pairwise: " << endl;
-    for (int i = 0; i < output->numSamples; ++i)
+    for (int i = 0; i < matDim_; ++i)
     {
-        for (int j = 0; j < output->numSamples; ++j)
-            cout << pairwiseMatrix[i*PAIRWISE_WIDTH+j] << " ";
+        for (int j = 0; j <= matDim_; ++j)
+            cout << pairwiseMatrix[i*matStride_+j] << " ";
         cout << endl;
     }
 #endif
 }
 
 void
-OmJsonParser::processClusters(vector<rapidjson::Document>& messages,
-                              vector<vector<float> > &clustersData,
-                              vector<vector<vector<float>>>& clusterIds)
+OmJsonParser::processClusters(const rapidjson::Value& values)
 {
-    rapidjson::Value values;
-    if (retireve(OM_JSON_VALUES, messages, values))
+    rapidjson::Value::ConstMemberIterator centers = values.FindMember(OM_JSON_CLUSTERCENTERS);
+    rapidjson::Value::ConstMemberIterator spreads = values.FindMember(OM_JSON_CLUSTERSPREADS);
+    rapidjson::Value::ConstMemberIterator points = values.FindMember(OM_JSON_CLUSTER_POINTS);
+    
+    if (centers == values.MemberEnd() || !centers->value.IsArray())
     {
-        if (retrieveUnordered(values, OM_JSON_CLUSTERCENTERS, clustersData))
-        {   
-            if (!values.HasMember(OM_JSON_CLUSTERSPREADS) || !values[OM_JSON_CLUSTERCENTERS].IsArray())
-                SET_ERR_MSG("can't find field " << OM_JSON_CLUSTERSPREADS << " or field is not a list")
-            else
-            {
-                const rapidjson::Value& arr = values[OM_JSON_CLUSTERSPREADS].GetArray();
-                
-                if (arr.Size() != clustersData.size())
-                    SET_ERR_MSG("cluster spreads list size does not match cluster centers list; attempting to proceed anyways")
-                for (int i = 0; i < clustersData.size(); ++i)
-                {
-                    if (i < arr.Size())
-                        clustersData[i].push_back(arr[i].GetFloat());
-                    else
-                        clustersData[i].push_back(0);
-                }
-            }
+        SET_ERR_MSG("can't find field " << OM_JSON_CLUSTERCENTERS << " or field is not a list")
+        return;
+    }
+    
+    const rapidjson::Value& c = centers->value;
+    bool hasSpreads = (spreads != values.MemberEnd() && spreads->value.IsArray());
+    bool hasPoints = (points != values.MemberEnd() && points->value.IsArray());
+    
+    if (!hasSpreads)
+        SET_ERR_MSG("can't find field " << OM_JSON_CLUSTERSPREADS << " or field is not a list")
+    else if (spreads->value.Size() != c.Size())
+        SET_ERR_MSG("cluster spreads list size does not match cluster centers list; attempting to proceed anyways")
+    
+    if (!hasPoints)
+        SET_ERR_MSG(OM_JSON_CLUSTER_POINTS << " element not found or is not a list")
+    else if (points->value.Size() != c.Size())
+        SET_ERR_MSG("cluster points list size does not match cluster centers list; attempting to proceed anyways")
+    
+    for (rapidjson::SizeType i = 0; i < c.Size(); ++i)
+    {
+        float center[2] = { 0, 0 }, spread = 0;
+        
+        if (!c[i].IsArray())
+            SET_ERR_MSG(OM_JSON_CLUSTERCENTERS << " expected to be list of lists")
+        else
+            readFloats(c[i], 2, center, 1);
+        
+        if (hasSpreads && i < spreads->value.Size() && spreads->value[i].IsNumber())
+            spread = spreads->value[i].GetFloat();
+        
+        clusters_.appendCluster(center[0], center[1], spread);
+        
+        if (!hasPoints || i >= points->value.Size())
+            continue;
+        
+        // [[499, 0.468, 1.275], ...]
+        const rapidjson::Value& cluster = points->value[i];
+        
+        if (!cluster.IsArray())
+        {
+            SET_ERR_MSG("cluster array element is not a list")
+            continue;
         }
         
-        if (values.HasMember(OM_JSON_CLUSTER_POINTS) && values[OM_JSON_CLUSTER_POINTS].IsArray())
+        for (rapidjson::SizeType k = 0; k < cluster.Size(); ++k)
         {
-            // [[[499, 0.468, 1.275]], [[505, -3.047, 0.394]]]
-            const rapidjson::Value& clusters = values[OM_JSON_CLUSTER_POINTS].GetArray();
+            float point[3];
             
-            for (rapidjson::SizeType i = 0; i < clusters.Size(); ++i)
+            if (!cluster[k].IsArray() || cluster[k].Size() < 3)
+                SET_ERR_MSG("cluster point is not a list of 3 elements (id, x, y)")
+            else
             {
-                if (!clusters[i].IsArray())
-                    SET_ERR_MSG("cluster array element is not a list")
-                else
-                {
-                    clusterIds.push_back(vector<vector<float>>());
-                    
-                    // [[499, 0.468, 1.275]]
-                    const rapidjson::Value::ConstArray& cluster = clusters[i].GetArray();
-                    
-                    for (rapidjson::SizeType k = 0; k < cluster.Size(); ++k)
-                    {
-                        if (!cluster[k].IsArray())
-                            SET_ERR_MSG("cluster point is not a list")
-                        else
-                        {
-                            clusterIds.back().push_back(vector<float>());
-                            
-                            // [499, 0.468, 1.275]
-                            const rapidjson::Value::ConstArray& clusterPoint = cluster[k].GetArray();
-                            
-                            if (clusterPoint.Size() < 3)
-                                SET_ERR_MSG("cluster point list size is less than 3 (expected)")
-                            else
-                            {
-                                for (int idx = 0; idx < 3; ++idx)
-                                {
-                                    float val = 0;
-                                    if (!(clusterPoint[idx].IsFloat() || clusterPoint[idx].IsInt()))
-                                        SET_ERR_MSG("cluster point contains elements other than float type")
-                                    else
-                                        val = clusterPoint[idx].GetFloat();
-                                    clusterIds.back().back().push_back(val);
-                                }
-                            }
-                        } // cluster point is array
-                    } // for k
-                } // else cluster is array
-            } // for i
-        } // if has cluster field
-        else
-            SET_ERR_MSG(OM_JSON_CLUSTER_POINTS << " element not found or is not a list")
+                readFloats(cluster[k], 3, point, 1);
+                clusters_.appendMember(point[0], point[1], point[2]);
+            }
+        }
     }
-    else
-        SET_ERR_MSG("clusters subtype; can't find " << OM_JSON_VALUES)
-        
+    
 #ifdef PRINT_CLUSTERS
     cout << "clusters: " << endl;
-    if (clustersData.size() == 0)
+    if (clusters_.size() == 0)
         cout << "EMPTY" << endl;
     else
-        for (auto v:clustersData)
-            cout << "x " << v[0] << " y " << v[1] << " spread " << v[2] << endl;
+        for (size_t i = 0; i < clusters_.size(); ++i)
+            cout << "x " << clusters_.x[i] << " y " << clusters_.y[i]
+                 << " spread " << clusters_.spread[i] << " size " << clusters_.clusterSize(i) << endl;
 #endif
 }
 
 void
-OmJsonParser::processHotspots(vector<rapidjson::Document>& messages,
-                              vector<vector<float>>& hotspotsData)
+OmJsonParser::processHotspots(const rapidjson::Value& values)
 {
-    rapidjson::Value values;
-    if (retireve(OM_JSON_VALUES, messages, values))
+    if (!values.HasMember(OM_JSON_HOTSPOTS) || !values[OM_JSON_HOTSPOTS].IsArray())
     {
+        SET_ERR_MSG(OM_JSON_HOTSPOTS << " element not found or is not a list")
+        return;
+    }
+    
+    // [[x, y, spread], ...]
+    const rapidjson::Value::ConstArray& arr = values[OM_JSON_HOTSPOTS].GetArray();
+    int n = (int)arr.Size();
+    
+    if (n > hotspotsStride_)
+    {
+        hotspotsStride_ = max(n, 2*hotspotsStride_);
+        hotspots_.assign(OM_HOTSPOT_NCHANS*hotspotsStride_, 0);
+    }
+    
+    for (int i = 0; i < n; ++i)
+    {
+        int nRead = 0;
         
+        if (!arr[i].IsArray())
+            SET_ERR_MSG(OM_JSON_HOTSPOTS << " expected to be list of lists")
+        else
+            nRead = readFloats(arr[i], OM_HOTSPOT_NCHANS, hotspots_.data()+i, hotspotsStride_);
+        
+        for (int c = nRead; c < OM_HOTSPOT_NCHANS; ++c)
+            hotspots_[c*hotspotsStride_+i] = 0;
     }
-    else
-        SET_ERR_MSG("massdynamics subtype; can't find " << OM_JSON_VALUES)
+    
+    nHotspots_ = n;
 }
 
 void
-OmJsonParser::processGroupTarget(vector<rapidjson::Document>& messages,
-                        vector<vector<float>>& groupTarget)
+OmJsonParser::processGroupTarget(const rapidjson::Value& values)
 {
-    rapidjson::Value values;
-    if (retireve(OM_JSON_VALUES, messages, values))
+    const int nRows = OM_GROUPTARGET_NROWS;
+    float *val = groupTarget_, *xyz = groupTarget_+nRows;
+    
+    memset(groupTarget_, 0, sizeof(groupTarget_));
+    
+    // row 0 - trend (overall direction of crowd motion); val is its magnitude
+    if (values.HasMember(OM_JSON_TREND) && values[OM_JSON_TREND].IsArray())
+    {
+        readFloats(values[OM_JSON_TREND], 3, xyz, nRows);
+        val[0] = sqrt(xyz[0]*xyz[0] + xyz[nRows]*xyz[nRows] + xyz[2*nRows]*xyz[2*nRows]);
+    }
+    else
+        SET_ERR_MSG(OM_JSON_TREND << " element not found or is not a list")
+    
+    // rows 1.. - principal axes of the crowd; val is eigenvalue
+    if (values.HasMember(OM_JSON_EIGENVALUE) && values[OM_JSON_EIGENVALUE].IsArray() &&
+        values.HasMember(OM_JSON_EIGENVECTOR) && values[OM_JSON_EIGENVECTOR].IsArray())
     {
+        const rapidjson::Value::ConstArray& eigVecs = values[OM_JSON_EIGENVECTOR].GetArray();
+        int nAxes = readFloats(values[OM_JSON_EIGENVALUE], nRows-1, val+1, 1);
+        
+        if (nAxes != (int)eigVecs.Size())
+            SET_ERR_MSG(OM_JSON_EIGENVALUE << " list size does not match " << OM_JSON_EIGENVECTOR << " list size")
         
+        for (int k = 0; k < nAxes && k < (int)eigVecs.Size(); ++k)
+        {
+            if (!eigVecs[k].IsArray())
+                SET_ERR_MSG(OM_JSON_EIGENVECTOR << " expected to be list of lists")
+            else
+                readFloats(eigVecs[k], 3, xyz+k+1, nRows);
+        }
     }
     else
-        SET_ERR_MSG("massdynamics subtype; can't find " << OM_JSON_VALUES)
+        SET_ERR_MSG(OM_JSON_EIGENVALUE << " or " << OM_JSON_EIGENVECTOR
+                    << " element not found or is not a list")
 }
 
 void
-OmJsonParser::processDtw(vector<rapidjson::Document>& messages,
+OmJsonParser::processDtw(const rapidjson::Value& values,
                          vector<int>& idOrder,
                          float* dtwMatrix)
 {
-    rapidjson::Value values;
-    if (retireve(OM_JSON_VALUES, messages, values))
-    {
-        
-    }
-    else
-        SET_ERR_MSG("similarity subtype; can't find " << OM_JSON_VALUES)
+    retrieveOrdered(values, OM_JSON_SIMILARITY, idOrder, dtwMatrix);
 }
 
 void
-OmJsonParser::processTemplates(vector<rapidjson::Document>& messages,
-                      vector<int>& idOrder,
-                      map<string, vector<float>>& templates)
+OmJsonParser::processTemplates(const rapidjson::Value& values,
+                               vector<int>& idOrder)
 {
-    rapidjson::Value values;
-    if (retireve(OM_JSON_VALUES, messages, values))
+    if (!values.HasMember(OM_JSON_PREDICTIONS))
     {
-        
+        SET_ERR_MSG("can't find " << OM_JSON_PREDICTIONS)
+        return;
+    }
+    
+    // predictions come either as { template: [score per id], ... }
+    // or as [{ template: score, ... } per id]
+    const rapidjson::Value& predictions = values[OM_JSON_PREDICTIONS];
+    bool perTemplate = predictions.IsObject();
+    
+    if (!perTemplate && !predictions.IsArray())
+    {
+        SET_ERR_MSG(OM_JSON_PREDICTIONS << " is expected to be an object or a list")
+        return;
     }
+    
+    // intern all names first, so that table is (re)allocated once
+    if (perTemplate)
+        for (auto& m:predictions.GetObject())
+            internTemplate(m.name);
     else
-        SET_ERR_MSG("similarity subtype; can't find " << OM_JSON_VALUES)
-}
-
-bool
-OmJsonParser::retireve(const string& key,
-                  vector<rapidjson::Document>& messages,
-                  rapidjson::Value& val)
-{
+        for (auto& p:predictions.GetArray())
+            if (p.IsObject())
+                for (auto& m:p.GetObject())
+                    internTemplate(m.name);
+    
+    int n = (int)idOrder.size();
+    int nChannels = (int)templateNames_.size()+1;
+    
+    if (n > templatesStride_ || templates_.size() < (size_t)nChannels*templatesStride_)
+    {
+        templatesStride_ = max(n, templatesStride_);
+        templates_.resize((size_t)nChannels*templatesStride_);
+    }
     
-    for (auto &m:messages)
+    float *ids = templates_.data();
+    
+    for (int i = 0; i < n; ++i)
+        ids[i] = idOrder[i];
+    for (int c = 1; c < nChannels; ++c)
+        fill(ids+c*templatesStride_, ids+c*templatesStride_+n, -1);
+    
+    if (perTemplate)
     {
-#if 0
+        for (auto& m:predictions.GetObject())
         {
-            rapidjson::StringBuffer buffer;
-            buffer.Clear();
-            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-            m.Accept(writer);
+            float *scores = ids + (internTemplate(m.name)+1)*templatesStride_;
             
-            cout << "---> message: " << buffer.GetString() << endl;
+            if (!m.value.IsArray())
+                SET_ERR_MSG(OM_JSON_PREDICTIONS << " expected to hold lists of scores")
+            else
+            {
+                if (m.value.Size() != n)
+                    SET_ERR_MSG(OM_JSON_PREDICTIONS << " - id list size doesn't match list size")
+                readFloats(m.value, n, scores, 1);
+            }
         }
-#endif
+    }
+    else
+    {
+        const rapidjson::Value::ConstArray& arr = predictions.GetArray();
+        
+        if (arr.Size() != n)
+            SET_ERR_MSG(OM_JSON_PREDICTIONS << " - id list size doesn't match list size")
         
-        if (m.HasMember(key.c_str()))
+        for (int i = 0; i < n && i < (int)arr.Size(); ++i)
         {
-            val = m[key.c_str()];
-            return true;
+            if (!arr[i].IsObject())
+                SET_ERR_MSG(OM_JSON_PREDICTIONS << " expected list of objects")
+            else
+                for (auto& m:arr[i].GetObject())
+                {
+                    float *scores = ids + (internTemplate(m.name)+1)*templatesStride_;
+                    
+                    if (!m.value.IsNumber())
+                        SET_ERR_MSG(OM_JSON_PREDICTIONS << " bad type for " << i << " element: float expected")
+                    else
+                        scores[i] = m.value.GetFloat();
+                }
         }
     }
     
-    return false;
+    nTemplateRows_ = n;
 }
 
 bool
-OmJsonParser::retrieveOrdered(const rapidjson::Value& document,
-                              const char *key,
-                              const vector<int> &idOrder,
-                              map<int, vector<float> > &listOfLists)
+OmJsonParser::retrieveDerivative(const rapidjson::Value& document,
+                                 const char* key,
+                                 int firstChan, int nChans,
+                                 uint8_t maskBit)
 {
-    parseResult_ = true;
+    rapidjson::Value::ConstMemberIterator it = document.FindMember(key);
     
-    if (document.HasMember(key))
+    if (it == document.MemberEnd() || !it->value.IsArray())
     {
-        const rapidjson::Value& masterList = document[key];
-        
-        if (!masterList.IsArray())
-            SET_ERR_MSG(key << " is not an array")
-        else
-        {
-            const rapidjson::Value::ConstArray& arr = masterList.GetArray();
-            for (rapidjson::SizeType i = 0; i < arr.Size(); i++)
-            {
-                if (i >= idOrder.size())
-                    SET_ERR_MSG(key << " - id list size doesn't match list size")
-                {
-                    if (!arr[i].IsArray())
-                        SET_ERR_MSG(key << " expected to be list of lists")
-                    else
-                    {
-                        int id = idOrder[i];
-                        const rapidjson::Value::ConstArray& subArr = arr[i].GetArray();
-                        
-                        listOfLists[id] = vector<float>();
-                        
-                        for (rapidjson::SizeType k = 0; k < subArr.Size(); ++k)
-                        {
-                            float val = 0;
-                            if (!subArr[k].IsFloat())
-                                SET_ERR_MSG(key << " bad type for " << i << " sublist element "
-                                            << k << ": float expected")
-                            else
-                                val = subArr[k].GetFloat();
-                            
-                            listOfLists[id].push_back(val);
-                        }
-                    } // else - arr is list
-                } // if i >= idOrder
-            } // for i
-        } // else - masterList is array
+        SET_ERR_MSG("can't find " << key << " or it is not a list")
+        return parseResult_;
     }
-    else
-        SET_ERR_MSG("can't find " << key)
-
-   return parseResult_;
-}
-
-bool
-OmJsonParser::retrieveOrdered(const rapidjson::Value& document,
-                              const char* key,
-                              const vector<int>& idOrder,
-                              map<int, float>& list)
-{
-    parseResult_ = true;
     
-    if (document.HasMember(key))
+    const rapidjson::Value::ConstArray& arr = it->value.GetArray();
+    int n = (int)arr.Size();
+    
+    if (n != nDerivativeRows_)
     {
-        if (!document[key].IsArray())
-            SET_ERR_MSG(key << " is not a list")
-        else
-        {
-            const rapidjson::Value::ConstArray& arr = document[key].GetArray();
-            
-            for (rapidjson::SizeType i = 0; i < arr.Size(); ++i)
-            {
-                if (i >= idOrder.size())
-                    SET_ERR_MSG(key << " - id list size doesn't match list size")
-                else
-                {
-                    int id = idOrder[i];
-                    float val = 0;
-                    
-                    if (!arr[i].IsFloat())
-                        SET_ERR_MSG(key << " bad type for " << i << " element: float expected")
-                    else
-                        val = arr[i].GetFloat();
-                    
-                    list[id] = val;
-                } // if i >= idorder
-            } // for
-        } // else document[key] is array
+        SET_ERR_MSG(key << " - id list size doesn't match list size")
+        n = min(n, nDerivativeRows_);
     }
-    else
-        SET_ERR_MSG("can't find " << key)
+    
+    float *dst = derivatives_.data()+firstChan*derivativesStride_;
+    uint8_t *mask = derivativesMask_.data();
+    
+    for (int i = 0; i < n; ++i)
+    {
+        const rapidjson::Value& v = arr[i];
         
+        if (nChans == 1 && v.IsNumber())
+        {
+            dst[i] = v.GetFloat();
+            mask[i] |= maskBit;
+        }
+        else if (nChans > 1 && v.IsArray() && (int)v.Size() >= nChans)
+        {
+            readFloats(v, nChans, dst+i, derivativesStride_);
+            mask[i] |= maskBit;
+        }
+        else
+            SET_ERR_MSG(key << " bad type for " << i << " element: "
+                        << (nChans == 1 ? "float" : "list of floats") << " expected")
+    }
+    
     return parseResult_;
 }
 
@@ -512,6 +561,8 @@ OmJsonParser::retrieveOrdered(const rapidjson::Value &document,
                               const vector<int> &idOrder,
                               float *mat)
 {
+    // result of this key only; errors of earlier decoders are kept
+    bool prevResult = parseResult_;
     parseResult_ = true;
     
     if (document.HasMember(key))
@@ -521,51 +572,53 @@ OmJsonParser::retrieveOrdered(const rapidjson::Value &document,
         else
         {
             const rapidjson::Value::ConstArray& arr = document[key].GetArray();
+            int n = (int)idOrder.size();
             
-            for (int i = 0; i < pairwiseStride_; ++i)
+            if (arr.Size() != n)
+                SET_ERR_MSG(key << " - id list size doesn't match matrix size")
+            
+            // only live n x n region is filled
+            for (int i = 0; i < n; ++i)
             {
-                bool hasRow = (i < arr.Size());
+                float *row = mat+(size_t)i*matStride_;
+                int nCols = 0;
                 
-                if (hasRow && !arr[i].IsArray())
-                    SET_ERR_MSG(key << " is expected to be a list of lists")
-                else
+                row[0] = idOrder[i];
+                
+                if (i < arr.Size())
                 {
-                    int w = pairwiseStride_+1;
-                    for (int j = 0; j < w; ++j)
+                    if (!arr[i].IsArray())
+                        SET_ERR_MSG(key << " is expected to be a list of lists")
+                    else
                     {
-                        if (j == 0) // this is for ids
+                        const rapidjson::Value::ConstArray& r = arr[i].GetArray();
+                        nCols = min((int)r.Size(), n);
+                        
+                        for (int j = 0; j < nCols; ++j)
                         {
-                            if (i < idOrder.size())
+                            if (!r[j].IsNumber())
                             {
-                                int id = idOrder[i];
-                                mat[i*w+j] = id;
+                                SET_ERR_MSG(key << " expected to be list of lists of floats")
+                                row[j+1] = -1;
                             }
                             else
-                                if (hasRow)
-                                    SET_ERR_MSG(key << " can't find matching id")
+                                row[j+1] = r[j].GetFloat();
                         }
-                        else
-                        {
-                            bool hasCol = (hasRow ? j-1 < arr[i].Size() : false);
-                            if (hasRow && hasCol)
-                            {
-                                float val = 0;
-                                if (!arr[i][j-1].IsFloat())
-                                    SET_ERR_MSG(key << " expected to be list of lists of floats")
-                                else
-                                    val = arr[i][j-1].GetFloat();
-                                mat[i*w+j] = val;
-                            } // if hascol hasrow
-                        } // else - values
-                    } // for j
-                } // else arr[i] is array
+                    }
+                }
+                
+                for (int j = nCols; j < n; ++j)
+                    row[j+1] = -1;
             } // for i
         } // if document[key] is array
     }
     else
         SET_ERR_MSG("can't find " << key)
     
-    return parseResult_;
+    bool result = parseResult_;
+    parseResult_ = prevResult && result;
+    
+    return result;
 }
 
 bool
@@ -574,131 +627,142 @@ OmJsonParser::retrieveStageDistances(const rapidjson::Value &document,
                                      const vector<int> &idOrder,
                                      map<int, vector<float> > &stageDistances)
 {
+    bool prevResult = parseResult_;
     parseResult_ = true;
+    
     if (document.HasMember(key))
     {
-        const rapidjson::Value::ConstArray& arr = document[key].GetArray();
-        
-        for (rapidjson::SizeType i = 0; i < arr.Size(); ++i)
+        if (!document[key].IsArray())
+            SET_ERR_MSG(key << " is not a list")
+        else
         {
-            if (i >= idOrder.size())
-                SET_ERR_MSG(key << " id list size doesn't match list size")
-            else
+            const rapidjson::Value::ConstArray& arr = document[key].GetArray();
+            
+            for (rapidjson::SizeType i = 0; i < arr.Size(); ++i)
             {
-                int id = idOrder[i];
-                stageDistances[id] = vector<float>();
-                
-                if (!arr[i].IsObject())
-                    SET_ERR_MSG(key << " expected list of objects")
+                if (i >= idOrder.size())
+                    SET_ERR_MSG(key << " id list size doesn't match list size")
                 else
                 {
-                    if (arr[i].HasMember(OM_JSON_STAGEDIST_US))
-                        stageDistances[id].push_back(arr[i][OM_JSON_STAGEDIST_US].GetFloat());
-                    else
-                        SET_ERR_MSG(key << " can't find key " << OM_JSON_STAGEDIST_US);
-                    if (arr[i].HasMember(OM_JSON_STAGEDIST_US))
-                        stageDistances[id].push_back(arr[i][OM_JSON_STAGEDIST_DS].GetFloat());
-                    else
-                        SET_ERR_MSG(key << " can't find key " << OM_JSON_STAGEDIST_DS);
-                    if (arr[i].HasMember(OM_JSON_STAGEDIST_US))
-                        stageDistances[id].push_back(arr[i][OM_JSON_STAGEDIST_SL].GetFloat());
-                    else
-                        SET_ERR_MSG(key << " can't find key " << OM_JSON_STAGEDIST_SL);
-                    if (arr[i].HasMember(OM_JSON_STAGEDIST_US))
-                        stageDistances[id].push_back(arr[i][OM_JSON_STAGEDIST_SR].GetFloat());
+                    int id = idOrder[i];
+                    stageDistances[id] = vector<float>();
+                    
+                    if (!arr[i].IsObject())
+                        SET_ERR_MSG(key << " expected list of objects")
                     else
-                        SET_ERR_MSG(key << " can't find key " << OM_JSON_STAGEDIST_SR);
+                        for (int k = 0; k < 4; ++k)
+                        {
+                            rapidjson::Value::ConstMemberIterator it = arr[i].FindMember(StageDistKeys[k]);
+                            
+                            // missing edge keeps its slot, so others stay in place
+                            if (it != arr[i].MemberEnd() && it->value.IsNumber())
+                                stageDistances[id].push_back(it->value.GetFloat());
+                            else
+                            {
+                                stageDistances[id].push_back(-1);
+                                SET_ERR_MSG(key << " can't find key " << StageDistKeys[k]);
+                            }
+                        }
                 }
             }
-        }
+        } // if document[key] is array
     }
     else
         SET_ERR_MSG("can't find " << key)
     
-    return parseResult_;
+    bool result = parseResult_;
+    parseResult_ = prevResult && result;
+    
+    return result;
 }
 
-bool
-OmJsonParser::hasSubType(vector<rapidjson::Document>& messages,
-                         string subType,
-                         vector<rapidjson::Document> &subtypeMsg) const
+int
+OmJsonParser::internTemplate(const rapidjson::Value& name)
 {
-    for (auto& d:messages)
-        if (d.HasMember(OM_JSON_PACKET) && d[OM_JSON_PACKET].IsObject())
-        {
-            if (d[OM_JSON_PACKET].HasMember(OM_JSON_SUBTYPE))
-            {
-                const char* st = d[OM_JSON_PACKET][OM_JSON_SUBTYPE].GetString();
-                if (subType == string(st))
-                {
-                    subtypeMsg.push_back(move(d));
-                    return true;
-                }
-            }
-        }
+    size_t len = name.GetStringLength();
+    
+    for (size_t i = 0; i < templateNames_.size(); ++i)
+        if (templateNames_[i].size() == len &&
+            memcmp(templateNames_[i].data(), name.GetString(), len) == 0)
+            return (int)i;
     
-    return false;
+    templateNames_.push_back(string(name.GetString(), len));
+    return (int)templateNames_.size()-1;
 }
 
-bool
-OmJsonParser::retrieveUnordered(const rapidjson::Value& document,
-                       const char* key,
-                       vector<vector<float>>& listOfLists)
+OmJsonParser::PacketSubtype
+OmJsonParser::lookupSubtype(const rapidjson::Value& subtype)
 {
-    parseResult_ = true;
+    if (!subtype.IsString())
+        return All;
     
-    if (document.HasMember(key))
+    size_t len = subtype.GetStringLength();
+    const char* str = subtype.GetString();
+    
+    for (int st = Derivatives; st < NSubtypes; ++st)
+        if (SubtypeNames[st].len_ == len &&
+            memcmp(SubtypeNames[st].name_, str, len) == 0)
+            return (PacketSubtype)st;
+    
+    return All;
+}
+
+unsigned int
+OmJsonParser::subtypeMask(const string& subtype)
+{
+    for (int st = Derivatives; st < NSubtypes; ++st)
+        if (subtype == SubtypeNames[st].name_)
+            return (1u << st);
+    
+    // "all" (or unknown) - every subtype present in the bundle
+    return ~0u;
+}
+
+int
+OmJsonParser::readFloats(const rapidjson::Value& list, int maxCount,
+                         float* dst, int dstStride)
+{
+    const rapidjson::Value::ConstArray& arr = list.GetArray();
+    int n = min((int)arr.Size(), maxCount);
+    
+    for (int i = 0; i < n; ++i)
     {
-        const rapidjson::Value& masterList = document[key];
-        
-        if (!masterList.IsArray())
-            SET_ERR_MSG(key << " is not an array")
-        else
+        if (!arr[i].IsNumber())
         {
-            const rapidjson::Value::ConstArray& arr = masterList.GetArray();
-            for (rapidjson::SizeType i = 0; i < arr.Size(); i++)
-            {
-                if (!arr[i].IsArray())
-                    SET_ERR_MSG(key << " expected to be list of lists")
-                else
-                {
-                    const rapidjson::Value::ConstArray& subArr = arr[i].GetArray();
-                    
-                    listOfLists.push_back(vector<float>());
-                    
-                    for (rapidjson::SizeType k = 0; k < subArr.Size(); ++k)
-                    {
-                        float val = 0;
-                        if (!subArr[k].IsFloat())
-                            SET_ERR_MSG(key << " bad type for " << i << " sublist element "
-                                        << k << ": float expected")
-                        else
-                            val = subArr[k].GetFloat();
-                        
-                        listOfLists.back().push_back(val);
-                    }
-                } // else - arr is list
-            } // for i
-        } // else - masterList is array
+            SET_ERR_MSG("bad type for list element " << i << ": float expected")
+            dst[i*dstStride] = 0;
+        }
+        else
+            dst[i*dstStride] = arr[i].GetFloat();
     }
-    else
-        SET_ERR_MSG("can't find " << key)
-        
-    return parseResult_;
+    
+    return n;
+}
+
+void
+OmJsonParser::reserveMatrices(int dim)
+{
+    if (dim+1 <= matStride_)
+        return;
+    
+    // grow geometrically and never shrink, so that matrices get reallocated
+    // only a few times over the session
+    int capacity = max(dim, 2*(matStride_-1));
+    
+    matStride_ = capacity+1;
+    pairwiseMat_.assign((size_t)capacity*matStride_, -1);
+    dtwMat_.assign((size_t)capacity*matStride_, -1);
 }
 
 void
 OmJsonParser::clearAll()
 {
+    matDim_ = 0;
     idOrder_.clear();
-    derivatives1_.clear();
-    derivatives2_.clear();
-    speeds_.clear();
-    accelerations_.clear();
+    nDerivativeRows_ = 0;
     stageDistances_.clear();
-    clustersData_.clear();
-    clusterIds_.clear();
-    hotspotsData_.clear();
-    groupTarget_.clear();
-    templatesData_.clear();
+    clusters_.clear();
+    nHotspots_ = 0;
+    memset(groupTarget_, 0, sizeof(groupTarget_));
+    nTemplateRows_ = 0;
 }
@@ -15,8 +15,16 @@
 #include <string>
 #include <queue>
 #include <set>
+#include <memory>
+#include <stdint.h>
 
 #include "rapidjson/document.h"
+#include "cluster-table.hpp"
+
+#define OM_DERIVATIVES_NCHANS   7   // id d1x d1y d2x d2y speed accel
+#define OM_HOTSPOT_NCHANS       3   // x y spread
+#define OM_GROUPTARGET_NCHANS   4   // val x y z
+#define OM_GROUPTARGET_NROWS    3   // trend, 1st and 2nd principal axes
 
 class OmJsonParser {
 public:
@@ -26,13 +34,24 @@ public:
         Distance,
         Cluster,
         Massdyn,
-        Similarity
+        Similarity,
+        NSubtypes
     } PacketSubtype;
     
+    // bits of derivatives mask - which values were received for a row
+    typedef enum _DerivativeMask {
+        MaskD1 = 1,
+        MaskD2 = 1 << 1,
+        MaskSpeed = 1 << 2,
+        MaskAccel = 1 << 3
+    } DerivativeMask;
+    
     OmJsonParser(int maxMatSize);
     ~OmJsonParser();
     
-    bool parse(std::vector<rapidjson::Document>& message,
+    // documents are only read, so same bundle can be passed to any number
+    // of parsers
+    bool parse(const std::vector<std::shared_ptr<const rapidjson::Document>>& messages,
                std::set<std::string>& parsedSubtypes,
                std::string subtype = "all");
 
@@ -40,78 +59,90 @@ public:
     const bool getParseResult() const { return parseResult_; }
     
     const std::vector<int>& getIdOrder() const { return idOrder_; }
-    const std::map<int, std::vector<float>>& getD1() const { return derivatives1_; }
-    const std::map<int, std::vector<float>>& getD2() const { return derivatives2_; }
-    const std::map<int, float>& getSpeeds() const { return speeds_; }
-    const std::map<int, float>& getAccelerations() const { return accelerations_; }
-    const float* const getPairwiseMat() const { return pairwiseMat_; }
-    const float* const getDtwMat() const { return dtwMat_; }
-    const std::vector<std::vector<float>>& getClusters() const { return clustersData_; }
-    const std::vector<std::vector<std::vector<float>>>& getClusterIds() const { return clusterIds_; }
+    // derivatives are stored channel by channel (id, d1x, d1y, d2x, d2y,
+    // speed, accel), rows follow getIdOrder(); channels are
+    // getDerivativesStride() floats apart. Mask holds DerivativeMask bits
+    // per row; values without their bit set were not received
+    const float* const getDerivatives() const { return derivatives_.data(); }
+    const uint8_t* const getDerivativesMask() const { return derivativesMask_.data(); }
+    int getNumDerivativeRows() const { return nDerivativeRows_; }
+    int getDerivativesStride() const { return derivativesStride_; }
+    // matrices are row-major; row i is [id, v0, v1, ... v(dim-1)], rows are
+    // getMatStride() floats apart and only first getMatDim() rows are valid
+    const float* const getPairwiseMat() const { return pairwiseMat_.data(); }
+    const float* const getDtwMat() const { return dtwMat_.data(); }
+    int getMatDim() const { return matDim_; }
+    int getMatStride() const { return matStride_; }
+    const ClusterTable& getClusters() const { return clusters_; }
     const std::map<int, std::vector<float>>& getStageDists() const { return stageDistances_; }
-    const std::vector<std::vector<float>>& getHotspots() const { return hotspotsData_; }
-    const std::vector<std::vector<float>>& getGroupTarget() const { return groupTarget_; }
-    const std::map<std::string, std::vector<float>>& getTemplates() const { return templatesData_; }
+    // hotspots are stored channel by channel (x, y, spread); channels are
+    // getHotspotsStride() floats apart
+    const float* const getHotspots() const { return hotspots_.data(); }
+    int getNumHotspots() const { return nHotspots_; }
+    int getHotspotsStride() const { return hotspotsStride_; }
+    // group target is stored channel by channel (val, x, y, z); each channel
+    // is OM_GROUPTARGET_NROWS floats
+    const float* const getGroupTarget() const { return groupTarget_; }
+    // template names are interned as they appear and keep their index for
+    // the lifetime of the parser
+    const std::vector<std::string>& getTemplateNames() const { return templateNames_; }
+    // template scores table is stored channel by channel: ids followed by
+    // one channel per template; channels are getTemplatesStride() floats apart
+    const float* const getTemplates() const { return templates_.data(); }
+    int getNumTemplateRows() const { return nTemplateRows_; }
+    int getTemplatesStride() const { return templatesStride_; }
     
 private:
     std::string errMsg_;
     bool parseResult_;
-    int pairwiseStride_;
+    int matDim_, matStride_;
     
     std::vector<int> idOrder_;
-    std::map<int, std::vector<float>> derivatives1_;
-    std::map<int, std::vector<float>> derivatives2_;
-    std::map<int, float> speeds_;
-    std::map<int, float> accelerations_;
-    float* pairwiseMat_, *dtwMat_;
-    std::vector<std::vector<float>> clustersData_;
-    std::vector<std::vector<std::vector<float>>> clusterIds_;
+    std::vector<float> derivatives_;
+    std::vector<uint8_t> derivativesMask_;
+    int nDerivativeRows_, derivativesStride_;
+    std::vector<float> pairwiseMat_, dtwMat_;
+    ClusterTable clusters_;
     std::map<int, std::vector<float>> stageDistances_;
-    std::vector<std::vector<float>> hotspotsData_;
-    std::vector<std::vector<float>> groupTarget_;
-    std::map<std::string, std::vector<float>> templatesData_;
+    std::vector<float> hotspots_;
+    int nHotspots_, hotspotsStride_;
+    float groupTarget_[OM_GROUPTARGET_NCHANS*OM_GROUPTARGET_NROWS];
+    std::vector<std::string> templateNames_;
+    std::vector<float> templates_;
+    int nTemplateRows_, templatesStride_;
+    
+    typedef void (OmJsonParser::*SubtypeDecoder)(const rapidjson::Value& values);
+    // decoders for each subtype, indexed by PacketSubtype
+    static const SubtypeDecoder SubtypeDecoders[NSubtypes];
+    
+    void decodeDerivatives(const rapidjson::Value& values);
+    void decodeDistances(const rapidjson::Value& values);
+    void decodeClusters(const rapidjson::Value& values);
+    void decodeMassdyn(const rapidjson::Value& values);
+    void decodeSimilarity(const rapidjson::Value& values);
     
-    void processIdOrder(std::vector<rapidjson::Document>& messages,
+    void processIdOrder(const rapidjson::Value& ids,
                         std::vector<int>& idOrder);
-    void processDerivatives(std::vector<rapidjson::Document>& messages,
-                            std::vector<int>& idOrder,
-                            std::map<int, std::vector<float>>& derivatives1,
-                            std::map<int, std::vector<float>>& derivatives2,
-                            std::map<int, float>& speeds,
-                            std::map<int, float>& accelerations);
-    void processDistances(std::vector<rapidjson::Document>& messages,
+    void processDerivatives(const rapidjson::Value& values);
+    void processDistances(const rapidjson::Value& values,
                           std::vector<int>& idOrder,
                           float* pairwiseMatrix,
                           std::map<int, std::vector<float>>& stageDistances);
-    void processClusters(std::vector<rapidjson::Document>& messages,
-                         std::vector<std::vector<float>>& clustersData,
-                         std::vector<std::vector<std::vector<float>>>& clusterIds);
-    void processHotspots(std::vector<rapidjson::Document>& messages,
-                         std::vector<std::vector<float>>& hotspotsData);
-    void processDtw(std::vector<rapidjson::Document>& messages,
+    void processClusters(const rapidjson::Value& values);
+    void processHotspots(const rapidjson::Value& values);
+    void processDtw(const rapidjson::Value& values,
                     std::vector<int>& idOrder,
                     float* dtwMatrix);
-    void processGroupTarget(std::vector<rapidjson::Document>& messages,
-                            std::vector<std::vector<float>>& groupTarget);
-    void processTemplates(std::vector<rapidjson::Document>& messages,
-                          std::vector<int>& idOrder,
-                          std::map<std::string, std::vector<float>>& templates);
+    void processGroupTarget(const rapidjson::Value& values);
+    void processTemplates(const rapidjson::Value& values,
+                          std::vector<int>& idOrder);
 
-    bool retireve(const std::string& key,
-                  std::vector<rapidjson::Document>&,
-                  rapidjson::Value&);
-    
-    bool retrieveOrdered(const rapidjson::Value& document,
-                         const char* key,
-                         const std::vector<int>& idOrder,
-                         std::map<int, std::vector<float>>& listOfLists);
-    bool retrieveUnordered(const rapidjson::Value& document,
-                           const char* key,
-                           std::vector<std::vector<float>>& listOfLists);
-    bool retrieveOrdered(const rapidjson::Value& document,
-                         const char* key,
-                         const std::vector<int>& idOrder,
-                         std::map<int, float>& list);
+    // reads per-id values (numbers if nChans is 1, lists otherwise) into
+    // derivatives channels starting at firstChan; sets maskBit for rows read
+    bool retrieveDerivative(const rapidjson::Value& document,
+                            const char* key,
+                            int firstChan, int nChans,
+                            uint8_t maskBit);
     bool retrieveOrdered(const rapidjson::Value& document,
                          const char* key,
                          const std::vector<int>& idOrder,
@@ -122,10 +153,17 @@ private:
                                 const std::vector<int>& idOrder,
                                 std::map<int, std::vector<float>>& stageDistances);
     
-    bool hasSubType(std::vector<rapidjson::Document>& messages,
-                    std::string subType,
-                    std::vector<rapidjson::Document>& subtypeMsg) const;
+    // reads up to maxCount numbers from list into dst[0], dst[dstStride], ...
+    // returns number of elements read
+    int readFloats(const rapidjson::Value& list, int maxCount,
+                   float* dst, int dstStride);
+    
+    int internTemplate(const rapidjson::Value& name);
+    
+    static PacketSubtype lookupSubtype(const rapidjson::Value& subtype);
+    static unsigned int subtypeMask(const std::string& subtype);
     
+    void reserveMatrices(int dim);
     void clearAll();
 };
 
@@ -0,0 +1,133 @@
+//
+//  pairwise-engine.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include "pairwise-engine.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "simd-kernels.hpp"
+
+using namespace std;
+
+static inline unsigned int cellHash(int cx, int cy, unsigned int mask)
+{
+    return (((unsigned int)cx*73856093u) ^ ((unsigned int)cy*19349663u)) & mask;
+}
+
+PairwiseEngine::PairwiseEngine():
+dim_(0)
+{}
+
+PairwiseEngine::~PairwiseEngine()
+{}
+
+void
+PairwiseEngine::updateDense(const TrackTable &tracks, float radius)
+{
+    dim_ = (int)tracks.size();
+    matrix_.resize((size_t)dim_*dim_);
+
+    for (int i = 0; i < dim_; ++i)
+    {
+        float *row = matrix_.data()+(size_t)i*dim_;
+
+        vecDistances(row, tracks.x.data(), tracks.y.data(), tracks.x[i], tracks.y[i], dim_);
+
+        if (radius > 0)
+            for (int j = 0; j < dim_; ++j)
+                row[j] = (row[j] <= radius ? row[j] : -1);
+    }
+}
+
+void
+PairwiseEngine::updateEdges(const TrackTable &tracks, float radius)
+{
+    edgeA_.clear();
+    edgeB_.clear();
+    edgeD_.clear();
+    edgeRowA_.clear();
+    edgeRowB_.clear();
+
+    if (radius <= 0 || !tracks.size())
+        return;
+
+    unsigned int nBuckets = 1;
+    while (nBuckets < 2*tracks.size())
+        nBuckets <<= 1;
+
+    buildGrid(tracks, radius, nBuckets-1);
+
+    float r2 = radius*radius;
+
+    for (int i = 0; i < (int)tracks.size(); ++i)
+        for (int dy = -1; dy <= 1; ++dy)
+            for (int dx = -1; dx <= 1; ++dx)
+            {
+                int cx = cellX_[i]+dx, cy = cellY_[i]+dy;
+                unsigned int b = cellHash(cx, cy, nBuckets-1);
+
+                for (int k = bucketStart_[b]; k < bucketStart_[b+1]; ++k)
+                {
+                    int j = bucketItems_[k];
+
+                    // different cells may share a bucket - check actual cell
+                    if (j <= i || cellX_[j] != cx || cellY_[j] != cy)
+                        continue;
+
+                    float ddx = tracks.x[j]-tracks.x[i], ddy = tracks.y[j]-tracks.y[i];
+                    float d2 = ddx*ddx + ddy*ddy;
+
+                    if (d2 <= r2)
+                    {
+                        edgeA_.push_back(tracks.ids[i]);
+                        edgeB_.push_back(tracks.ids[j]);
+                        edgeD_.push_back(sqrtf(d2));
+                        edgeRowA_.push_back(i);
+                        edgeRowB_.push_back(j);
+                    }
+                }
+            }
+}
+
+//******************************************************************************
+void
+PairwiseEngine::buildGrid(const TrackTable &tracks, float cellSize, unsigned int mask)
+{
+    size_t n = tracks.size();
+
+    cellX_.resize(n);
+    cellY_.resize(n);
+    bucketOf_.resize(n);
+    bucketItems_.resize(n);
+    bucketStart_.assign(mask+2, 0);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        cellX_[i] = (int)floor(tracks.x[i]/cellSize);
+        cellY_[i] = (int)floor(tracks.y[i]/cellSize);
+        bucketOf_[i] = cellHash(cellX_[i], cellY_[i], mask);
+        bucketStart_[bucketOf_[i]+1]++;
+    }
+
+    for (unsigned int b = 0; b <= mask; ++b)
+        bucketStart_[b+1] += bucketStart_[b];
+
+    // counting sort of tracks by bucket; bucketOf_ is reused as fill cursor
+    for (size_t i = 0; i < n; ++i)
+    {
+        int b = bucketOf_[i];
+        bucketOf_[i] = bucketStart_[b]++;
+    }
+    for (size_t i = 0; i < n; ++i)
+        bucketItems_[bucketOf_[i]] = (int)i;
+
+    // bucketStart_ got shifted by one bucket while filling - restore it
+    for (unsigned int b = mask+1; b > 0; --b)
+        bucketStart_[b] = bucketStart_[b-1];
+    bucketStart_[0] = 0;
+}
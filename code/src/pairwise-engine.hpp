@@ -0,0 +1,60 @@
+//
+//  pairwise-engine.hpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#ifndef pairwise_engine_hpp
+#define pairwise_engine_hpp
+
+#include <stdio.h>
+#include <vector>
+
+#include "track-table.hpp"
+
+/**
+ * Pairwise distances between tracks.
+ * Dense mode computes full NxN matrix (row by row, with SIMD kernel).
+ * Thresholded mode finds only pairs closer than given radius: tracks are
+ * hashed into a uniform grid with cell size equal to the radius, so each
+ * track is tested against tracks in 3x3 neighbouring cells only and result
+ * is a sparse edge list - no O(N^2) work or storage.
+ */
+class PairwiseEngine {
+public:
+    PairwiseEngine();
+    ~PairwiseEngine();
+
+    // dense matrix; if radius > 0, distances beyond it are set to -1
+    void updateDense(const TrackTable& tracks, float radius = 0);
+    // sparse edge list of pairs closer than radius (each pair is reported once)
+    void updateEdges(const TrackTable& tracks, float radius);
+
+    int getDim() const { return dim_; }
+    // row i of dense matrix - distances from track i to all tracks
+    const float* getRow(int i) const { return matrix_.data()+(size_t)i*dim_; }
+
+    size_t getNumEdges() const { return edgeD_.size(); }
+    const std::vector<int>& getEdgeA() const { return edgeA_; }
+    const std::vector<int>& getEdgeB() const { return edgeB_; }
+    const std::vector<float>& getEdgeD() const { return edgeD_; }
+    // same edges as rows of the track table
+    const std::vector<int>& getEdgeRowA() const { return edgeRowA_; }
+    const std::vector<int>& getEdgeRowB() const { return edgeRowB_; }
+
+private:
+    int dim_;
+    std::vector<float> matrix_;
+
+    std::vector<int> edgeA_, edgeB_, edgeRowA_, edgeRowB_;
+    std::vector<float> edgeD_;
+
+    // spatial hash: tracks of bucket b are bucketItems_[bucketStart_[b]..bucketStart_[b+1])
+    std::vector<int> cellX_, cellY_;
+    std::vector<int> bucketOf_, bucketStart_, bucketItems_;
+
+    void buildGrid(const TrackTable& tracks, float cellSize, unsigned int mask);
+};
+
+#endif /* pairwise_engine_hpp */
@@ -0,0 +1,94 @@
+//
+//  simd-kernels.hpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#ifndef simd_kernels_hpp
+#define simd_kernels_hpp
+
+#include <cmath>
+
+// SSE is always available on x64 (both plugin targets); scalar code is kept
+// for other architectures
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define OPT_USE_SSE
+    #include <emmintrin.h>
+#endif
+
+// y[i] += a*x[i]
+inline void vecAxpy(float *y, const float *x, float a, int n)
+{
+    int i = 0;
+#ifdef OPT_USE_SSE
+    __m128 va = _mm_set1_ps(a);
+    for (; i+4 <= n; i += 4)
+        _mm_storeu_ps(y+i, _mm_add_ps(_mm_loadu_ps(y+i),
+                                      _mm_mul_ps(va, _mm_loadu_ps(x+i))));
+#endif
+    for (; i < n; ++i)
+        y[i] += a*x[i];
+}
+
+// y[i] *= a
+inline void vecScale(float *y, float a, int n)
+{
+    int i = 0;
+#ifdef OPT_USE_SSE
+    __m128 va = _mm_set1_ps(a);
+    for (; i+4 <= n; i += 4)
+        _mm_storeu_ps(y+i, _mm_mul_ps(va, _mm_loadu_ps(y+i)));
+#endif
+    for (; i < n; ++i)
+        y[i] *= a;
+}
+
+// d[i] = distance between (x[i], y[i]) and (px, py)
+inline void vecDistances(float *d, const float *x, const float *y,
+                         float px, float py, int n)
+{
+    int i = 0;
+#ifdef OPT_USE_SSE
+    __m128 vpx = _mm_set1_ps(px), vpy = _mm_set1_ps(py);
+    for (; i+4 <= n; i += 4)
+    {
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(x+i), vpx);
+        __m128 dy = _mm_sub_ps(_mm_loadu_ps(y+i), vpy);
+        _mm_storeu_ps(d+i, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy))));
+    }
+#endif
+    for (; i < n; ++i)
+        d[i] = sqrtf((x[i]-px)*(x[i]-px) + (y[i]-py)*(y[i]-py));
+}
+
+// d[i] = a*x[i] + b*y[i] + c, i.e. signed distance from (x[i], y[i]) to
+// line ax + by + c = 0 with unit normal (a, b)
+inline void vecLineDistances(float *d, const float *x, const float *y,
+                             float a, float b, float c, int n)
+{
+    int i = 0;
+#ifdef OPT_USE_SSE
+    __m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b), vc = _mm_set1_ps(c);
+    for (; i+4 <= n; i += 4)
+        _mm_storeu_ps(d+i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(va, _mm_loadu_ps(x+i)),
+                                                 _mm_mul_ps(vb, _mm_loadu_ps(y+i))), vc));
+#endif
+    for (; i < n; ++i)
+        d[i] = a*x[i] + b*y[i] + c;
+}
+
+// d[i] = c[i] + min(a[i], b[i])
+inline void vecMinAdd(float *d, const float *a, const float *b, const float *c, int n)
+{
+    int i = 0;
+#ifdef OPT_USE_SSE
+    for (; i+4 <= n; i += 4)
+        _mm_storeu_ps(d+i, _mm_add_ps(_mm_loadu_ps(c+i),
+                                      _mm_min_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i))));
+#endif
+    for (; i < n; ++i)
+        d[i] = c[i] + (a[i] < b[i] ? a[i] : b[i]);
+}
+
+#endif /* simd_kernels_hpp */
@@ -0,0 +1,157 @@
+//
+//  stage-engine.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include "stage-engine.hpp"
+
+#include <sstream>
+#include <cmath>
+#include <cstdlib>
+
+#include "simd-kernels.hpp"
+
+#define SET_ERR_MSG(errexpr) {\
+stringstream msg; \
+msg << errexpr; \
+errMsg_ = msg.str(); \
+}
+
+using namespace std;
+
+static const char* EdgeNames[StageEngine::NEdges] = { "us", "ds", "sl", "sr" };
+
+static bool parseFloat(const string& s, float& v)
+{
+    char *end = nullptr;
+    v = strtof(s.c_str(), &end);
+    return (end != s.c_str() && *end == '\0');
+}
+
+StageEngine::StageEngine()
+{
+    setBounds(5, -5, 5, -5);
+}
+
+StageEngine::~StageEngine()
+{}
+
+void
+StageEngine::setBounds(float us, float ds, float sl, float sr)
+{
+    float cx = (sl+sr)/2, cy = (us+ds)/2;
+
+    setLine(-1, us, 1, us, cx, cy, a_[Upstage], b_[Upstage], c_[Upstage]);
+    setLine(-1, ds, 1, ds, cx, cy, a_[Downstage], b_[Downstage], c_[Downstage]);
+    setLine(sl, -1, sl, 1, cx, cy, a_[StageLeft], b_[StageLeft], c_[StageLeft]);
+    setLine(sr, -1, sr, 1, cx, cy, a_[StageRight], b_[StageRight], c_[StageRight]);
+}
+
+bool
+StageEngine::load(const vector<vector<string>>& edgeTokens)
+{
+    float pts[NEdges][4];
+    bool found[NEdges] = { false, false, false, false };
+
+    errMsg_ = "";
+
+    for (auto& tokens:edgeTokens)
+    {
+        int e = 0;
+        while (e < NEdges && tokens[0] != EdgeNames[e])
+            ++e;
+
+        if (e == NEdges)
+        {
+            SET_ERR_MSG("unknown stage edge '" << tokens[0] << "' (us, ds, sl or sr expected)")
+            return false;
+        }
+
+        if (tokens.size() != 5)
+        {
+            SET_ERR_MSG("stage edge " << tokens[0] << ": expected two x y pairs")
+            return false;
+        }
+
+        for (int i = 0; i < 4; ++i)
+            if (!parseFloat(tokens[i+1], pts[e][i]))
+            {
+                SET_ERR_MSG("stage edge " << tokens[0] << ": bad number '" << tokens[i+1] << "'")
+                return false;
+            }
+
+        found[e] = true;
+    }
+
+    // stage side of each edge is the side where centroid of all edges lies
+    float cx = 0, cy = 0;
+
+    for (int e = 0; e < NEdges; ++e)
+    {
+        if (!found[e])
+        {
+            SET_ERR_MSG("stage edge " << EdgeNames[e] << " is missing")
+            return false;
+        }
+
+        cx += (pts[e][0]+pts[e][2])/(2*NEdges);
+        cy += (pts[e][1]+pts[e][3])/(2*NEdges);
+    }
+
+    float a[NEdges], b[NEdges], c[NEdges];
+
+    for (int e = 0; e < NEdges; ++e)
+        if (!setLine(pts[e][0], pts[e][1], pts[e][2], pts[e][3], cx, cy, a[e], b[e], c[e]))
+        {
+            SET_ERR_MSG("stage edge " << EdgeNames[e] << ": points must differ")
+            return false;
+        }
+
+    copy(a, a+NEdges, a_);
+    copy(b, b+NEdges, b_);
+    copy(c, c+NEdges, c_);
+
+    return true;
+}
+
+void
+StageEngine::update(const TrackTable &tracks)
+{
+    int n = (int)tracks.size();
+
+    ids_ = tracks.ids;
+
+    for (int e = 0; e < NEdges; ++e)
+    {
+        distances_[e].resize(n);
+        vecLineDistances(distances_[e].data(), tracks.x.data(), tracks.y.data(),
+                         a_[e], b_[e], c_[e], n);
+    }
+}
+
+//******************************************************************************
+bool
+StageEngine::setLine(float x0, float y0, float x1, float y1, float cx, float cy,
+                     float &a, float &b, float &c)
+{
+    float dx = x1-x0, dy = y1-y0;
+    float len = sqrtf(dx*dx + dy*dy);
+
+    if (len == 0)
+        return false;
+
+    a = -dy/len;
+    b = dx/len;
+    c = -(a*x0 + b*y0);
+
+    if (a*cx + b*cy + c < 0)
+    {
+        a = -a;
+        b = -b;
+        c = -c;
+    }
+
+    return true;
+}
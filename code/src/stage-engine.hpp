@@ -0,0 +1,64 @@
+//
+//  stage-engine.hpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#ifndef stage_engine_hpp
+#define stage_engine_hpp
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+
+#include "track-table.hpp"
+
+/**
+ * Distances from tracks to the four stage edges (upstage, downstage, stage
+ * left and stage right). Each edge is a line; distance is signed - positive
+ * on the stage side of the edge, negative beyond it. Distances to one edge
+ * for all tracks are computed in a single vectorized pass.
+ *
+ * Stage description format (one edge per line or DAT row, any order):
+ *      <us|ds|sl|sr> <x0> <y0> <x1> <y1>
+ */
+class StageEngine {
+public:
+    typedef enum _Edge {
+        Upstage,
+        Downstage,
+        StageLeft,
+        StageRight,
+        NEdges
+    } Edge;
+
+    StageEngine();
+    ~StageEngine();
+
+    // axis-aligned stage: upstage and downstage edges are lines y = us and
+    // y = ds, stage left and stage right - lines x = sl and x = sr
+    void setBounds(float us, float ds, float sl, float sr);
+    // arbitrary edges; on error returns false and keeps previous edges
+    bool load(const std::vector<std::vector<std::string>>& edgeTokens);
+
+    void update(const TrackTable& tracks);
+
+    // tracks of the last update and their distances to each edge
+    const std::vector<int>& getIds() const { return ids_; }
+    const float* getDistances(Edge e) const { return distances_[e].data(); }
+    const std::string& getError() const { return errMsg_; }
+
+private:
+    std::string errMsg_;
+    // edge lines: a*x + b*y + c = 0, (a, b) is unit normal facing the stage
+    float a_[NEdges], b_[NEdges], c_[NEdges];
+
+    std::vector<int> ids_;
+    std::vector<float> distances_[NEdges];
+
+    static bool setLine(float x0, float y0, float x1, float y1,
+                        float cx, float cy, float& a, float& b, float& c);
+};
+
+#endif /* stage_engine_hpp */
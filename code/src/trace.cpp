@@ -0,0 +1,195 @@
+//
+//  trace.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include "trace.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+using namespace std;
+using namespace chrono;
+
+typedef struct _TraceEvent {
+    const char *name;
+    int64_t begin, end;
+} TraceEvent;
+
+// written by its thread only; read by dump()
+typedef struct _TraceBuffer {
+    atomic<int> tid;
+    atomic<const char*> threadName;
+    atomic<uint64_t> head;
+    atomic<uint64_t> first;     // head when current thread took the buffer
+    atomic<bool> finished;      // thread exited, buffer can be taken
+    vector<TraceEvent> events;
+} TraceBuffer;
+
+// frees thread's buffer for the next thread when thread exits
+class BufferOwner {
+public:
+    BufferOwner():buffer_(nullptr) {}
+    ~BufferOwner() { if (buffer_) buffer_->finished = true; }
+
+    TraceBuffer* get() const { return buffer_; }
+    void set(TraceBuffer* buffer) { buffer_ = buffer; }
+
+private:
+    TraceBuffer* buffer_;
+};
+
+atomic<int> Trace::NumEnabled(0);
+
+// buffers outlive their threads, so events of finished threads can still be
+// dumped, until a new thread takes the buffer
+static mutex BuffersMutex;
+static vector<shared_ptr<TraceBuffer>> Buffers;
+static int NumThreads = 0;
+
+static thread_local BufferOwner ThreadBuffer;
+static thread_local const char* ThreadName = nullptr;
+
+static TraceBuffer* threadBuffer()
+{
+    if (!ThreadBuffer.get())
+    {
+        lock_guard<mutex> lock(BuffersMutex);
+        TraceBuffer *b = nullptr;
+
+        for (auto& fb:Buffers)
+            if (fb->finished)
+            {
+                b = fb.get();
+                break;
+            }
+
+        if (!b)
+        {
+            Buffers.push_back(make_shared<TraceBuffer>());
+            b = Buffers.back().get();
+            b->head = 0;
+            b->events.resize(TRACE_BUFFER_EVENTS);
+        }
+
+        b->tid = ++NumThreads;
+        b->threadName = ThreadName;
+        b->first = b->head.load();
+        b->finished = false;
+        ThreadBuffer.set(b);
+    }
+
+    return ThreadBuffer.get();
+}
+
+void
+Trace::enable()
+{
+    NumEnabled++;
+}
+
+void
+Trace::disable()
+{
+    NumEnabled--;
+}
+
+void
+Trace::setThreadName(const char *name)
+{
+    ThreadName = name;
+    if (ThreadBuffer.get())
+        ThreadBuffer.get()->threadName = name;
+}
+
+void
+Trace::record(const char *name, int64_t beginNs, int64_t endNs)
+{
+    TraceBuffer *b = threadBuffer();
+    uint64_t head = b->head.load(memory_order_relaxed);
+    TraceEvent& e = b->events[head&(TRACE_BUFFER_EVENTS-1)];
+
+    e.name = name;
+    e.begin = beginNs;
+    e.end = endNs;
+    b->head.store(head+1, memory_order_release);
+}
+
+int64_t
+Trace::now()
+{
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+size_t
+Trace::dump(const string &path)
+{
+    vector<shared_ptr<TraceBuffer>> buffers;
+    {
+        lock_guard<mutex> lock(BuffersMutex);
+        buffers = Buffers;
+    }
+
+    FILE *f = fopen(path.c_str(), "w");
+
+    if (!f)
+        throw runtime_error("can't open "+path+" for writing: "+strerror(errno));
+
+    vector<TraceEvent> events;
+    size_t nWritten = 0;
+
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+
+    for (auto& b:buffers)
+    {
+        const char *threadName = b->threadName.load();
+        int tid = b->tid;
+
+        fprintf(f, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                "\"args\": {\"name\": \"%s\"}}", (nWritten++ ? "," : ""), tid,
+                (threadName ? threadName : "thread"));
+
+        // copy the ring, then drop the oldest events if writer has lapped
+        // them while they were copied; events of the thread that had the
+        // buffer before are not copied
+        uint64_t end = b->head.load(memory_order_acquire);
+        uint64_t begin = max(b->first.load(), (end > TRACE_BUFFER_EVENTS ? end-TRACE_BUFFER_EVENTS : 0));
+
+        events.clear();
+        for (uint64_t i = begin; i < end; ++i)
+            events.push_back(b->events[i&(TRACE_BUFFER_EVENTS-1)]);
+
+        uint64_t head = b->head.load(memory_order_acquire);
+        size_t skip = (head > TRACE_BUFFER_EVENTS && head-TRACE_BUFFER_EVENTS > begin ?
+                       min((size_t)(head-TRACE_BUFFER_EVENTS-begin), events.size()) : 0);
+
+        for (size_t i = skip; i < events.size(); ++i)
+        {
+            const TraceEvent& e = events[i];
+            const char *dot = strchr(e.name, '.');
+            int catLen = (int)(dot ? dot-e.name : strlen(e.name));
+
+            fprintf(f, ",\n{\"name\": \"%s\", \"cat\": \"%.*s\", \"ph\": \"X\", "
+                    "\"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d}",
+                    e.name, catLen, e.name, e.begin/1E3, (e.end-e.begin)/1E3, tid);
+            nWritten++;
+        }
+    }
+
+    fprintf(f, "\n]}\n");
+
+    bool failed = (ferror(f) != 0);
+
+    if (fclose(f) != 0 || failed)
+        throw runtime_error("can't write "+path);
+
+    return nWritten-buffers.size();
+}
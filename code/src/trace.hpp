@@ -0,0 +1,81 @@
+//
+//  trace.hpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#ifndef trace_hpp
+#define trace_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+#define TRACE_BUFFER_EVENTS (1<<15)  // per thread, power of two
+
+/**
+ * Scoped trace points of the ingest pipeline, dumped as Chrome trace JSON
+ * (chrome://tracing or ui.perfetto.dev).
+ *
+ *      TRACE_SCOPE("obase.queue");     // times the enclosing scope
+ *      TRACE_THREAD("socket");         // names calling thread in the dump
+ *
+ * Scope names must be string literals; the part before the dot becomes
+ * event category. Each thread records into its own ring of the last
+ * TRACE_BUFFER_EVENTS events - single writer, no locks; the ring is
+ * allocated on thread's first event after tracing is enabled and goes to the
+ * next new thread when its thread exits, so there are no more rings than
+ * threads running at once. Events of a finished thread are dumped until its
+ * ring is taken.
+ * While tracing is disabled, a scope costs one relaxed load and a branch.
+ * Define OPT_NO_TRACE to compile trace points out.
+ */
+#ifdef OPT_NO_TRACE
+    #define TRACE_SCOPE(name)
+    #define TRACE_THREAD(name)
+#else
+    #define TRACE_CONCAT_(a, b) a##b
+    #define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+    #define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+    #define TRACE_THREAD(name) Trace::setThreadName(name)
+#endif
+
+class Trace {
+public:
+    // tracing is on while at least one client has it enabled
+    static void enable();
+    static void disable();
+    static bool isEnabled() { return NumEnabled.load(std::memory_order_relaxed) != 0; }
+
+    static void setThreadName(const char* name);
+    static void record(const char* name, int64_t beginNs, int64_t endNs);
+    // steady clock, ns
+    static int64_t now();
+
+    // writes events currently in all threads' rings; returns number of
+    // events written, throws runtime_error if file can't be written
+    static size_t dump(const std::string& path);
+
+private:
+    static std::atomic<int> NumEnabled;
+};
+
+class TraceScope {
+public:
+    TraceScope(const char* name):
+    name_(name), begin_(Trace::isEnabled() ? Trace::now() : 0) {}
+
+    ~TraceScope()
+    {
+        if (begin_)
+            Trace::record(name_, begin_, Trace::now());
+    }
+
+private:
+    const char* name_;
+    int64_t begin_;
+};
+
+#endif /* trace_hpp */
@@ -0,0 +1,157 @@
+//
+//  track-history.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include "track-history.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+TrackHistory::TrackHistory():
+nSlots_(0), length_(0),
+decimation_(Temporal),
+step_(1),
+lastVersion_(0)
+{}
+
+TrackHistory::~TrackHistory()
+{}
+
+void
+TrackHistory::configure(int nSlots, int length, Decimation decimation, float step)
+{
+    decimation_ = decimation;
+    step_ = step;
+
+    if (nSlots == nSlots_ && length == length_)
+        return;
+
+    nSlots_ = nSlots;
+    length_ = length;
+
+    arena_.assign((size_t)nSlots_*NAxes*2*length_, 0);
+    slotIds_.assign(nSlots_, -1);
+    writeIdx_.assign(nSlots_, 0);
+    nFramesSkipped_.assign(nSlots_, 0);
+    slotSeen_.assign(nSlots_, 0);
+    version_.assign(nSlots_, 0);
+    slotIndex_.reserve(nSlots_);
+    freeSlots_.reserve(nSlots_);
+    newTracks_.reserve(nSlots_);
+    reset();
+}
+
+void
+TrackHistory::update(const TrackTable &tracks)
+{
+    fill(slotSeen_.begin(), slotSeen_.end(), 0);
+    newTracks_.clear();
+
+    for (size_t i = 0; i < tracks.size(); ++i)
+    {
+        int slot = getSlot(tracks.ids[i]);
+
+        if (slot < 0)
+        {
+            newTracks_.push_back(i);
+            continue;
+        }
+
+        slotSeen_[slot] = 1;
+
+        if (decimation_ == Temporal)
+        {
+            if (++nFramesSkipped_[slot] >= step_)
+            {
+                nFramesSkipped_[slot] = 0;
+                push(slot, tracks.x[i], tracks.y[i]);
+            }
+        }
+        else
+        {
+            float dx = tracks.x[i] - getWindow(slot, X)[length_-1];
+            float dy = tracks.y[i] - getWindow(slot, Y)[length_-1];
+
+            if (dx*dx + dy*dy >= step_*step_)
+                push(slot, tracks.x[i], tracks.y[i]);
+        }
+    }
+
+    // release slots of tracks that are gone before new tracks claim theirs,
+    // so a track replacing another one in the same frame gets its slot
+    freeSlots_.clear();
+    for (int slot = nSlots_-1; slot >= 0; --slot)
+        if (!slotSeen_[slot])
+        {
+            slotIds_[slot] = -1;
+            freeSlots_.push_back(slot);
+        }
+    slotIndex_.erase(remove_if(slotIndex_.begin(), slotIndex_.end(),
+                               [this](const pair<int, int>& e){ return !slotSeen_[e.second]; }),
+                     slotIndex_.end());
+
+    // new tracks take free slots, if any left
+    for (size_t i:newTracks_)
+        claimSlot(tracks.ids[i], tracks.x[i], tracks.y[i]);
+}
+
+void
+TrackHistory::reset()
+{
+    fill(slotIds_.begin(), slotIds_.end(), -1);
+    slotIndex_.clear();
+    freeSlots_.clear();
+    for (int slot = nSlots_-1; slot >= 0; --slot)
+        freeSlots_.push_back(slot);
+}
+
+int
+TrackHistory::getSlot(int trackId) const
+{
+    vector<pair<int, int>>::const_iterator it =
+        lower_bound(slotIndex_.begin(), slotIndex_.end(), make_pair(trackId, -1));
+
+    if (it == slotIndex_.end() || it->first != trackId)
+        return -1;
+    return it->second;
+}
+
+//******************************************************************************
+int
+TrackHistory::claimSlot(int trackId, float x, float y)
+{
+    int slot = (freeSlots_.size() ? freeSlots_.back() : -1);
+
+    if (slot >= 0)
+    {
+        freeSlots_.pop_back();
+        slotIds_[slot] = trackId;
+        slotIndex_.insert(lower_bound(slotIndex_.begin(), slotIndex_.end(), make_pair(trackId, slot)),
+                          make_pair(trackId, slot));
+        writeIdx_[slot] = 0;
+        nFramesSkipped_[slot] = 0;
+
+        // new track has no history yet - whole trail sits at its first position
+        fill(ring(slot, X), ring(slot, X)+2*length_, x);
+        fill(ring(slot, Y), ring(slot, Y)+2*length_, y);
+        version_[slot] = ++lastVersion_;
+    }
+
+    return slot;
+}
+
+void
+TrackHistory::push(int slot, float x, float y)
+{
+    int w = writeIdx_[slot];
+
+    ring(slot, X)[w] = ring(slot, X)[w+length_] = x;
+    ring(slot, Y)[w] = ring(slot, Y)[w+length_] = y;
+
+    writeIdx_[slot] = (w+1 == length_ ? 0 : w+1);
+    version_[slot] = ++lastVersion_;
+}
@@ -0,0 +1,88 @@
+//
+//  track-history.hpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#ifndef track_history_hpp
+#define track_history_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <utility>
+
+#include "track-table.hpp"
+
+/**
+ * Keeps fixed-length history of recent positions for each track.
+ * All history lives in one arena, allocated in configure(), and is indexed by
+ * slot. Slots are claimed by new tracks and released when tracks disappear,
+ * so tracks coming and going never allocate. Occupied slots are indexed by
+ * track id in a sorted array, so looking a track up is a binary search.
+ * Each ring is stored twice back-to-back, which makes last N points always
+ * available as one contiguous window (oldest to newest) - i.e. a track's
+ * history can be copied out with a single memcpy per axis.
+ */
+class TrackHistory {
+public:
+    typedef enum _Decimation {
+        Temporal,   // store every Nth frame
+        Spatial     // store a point once track moved more than N meters
+    } Decimation;
+
+    typedef enum _Axis {
+        X,
+        Y,
+        NAxes
+    } Axis;
+
+    TrackHistory();
+    ~TrackHistory();
+
+    // re-allocates the arena if size has changed (drops all history then)
+    void configure(int nSlots, int length, Decimation decimation, float step);
+    void update(const TrackTable& tracks);
+    void reset();
+
+    // returns slot occupied by track or -1 if track has no history
+    int getSlot(int trackId) const;
+    // returns history window of getLength() samples, oldest sample first
+    const float* getWindow(int slot, Axis axis) const
+    {
+        return &arena_[((size_t)slot*NAxes+axis)*2*length_ + writeIdx_[slot]];
+    }
+
+    // changes every time slot's history changes; never repeats, even when
+    // slot gets re-used by another track
+    uint64_t getVersion(int slot) const { return version_[slot]; }
+
+    int getLength() const { return length_; }
+    int getNumSlots() const { return nSlots_; }
+
+private:
+    int nSlots_, length_;
+    Decimation decimation_;
+    float step_;
+
+    std::vector<float> arena_;
+    std::vector<int> slotIds_;
+    std::vector<std::pair<int, int>> slotIndex_;    // { track id, slot }, sorted by id
+    std::vector<int> freeSlots_;                    // lowest slot last
+    std::vector<int> writeIdx_;
+    std::vector<int> nFramesSkipped_;
+    std::vector<char> slotSeen_;
+    std::vector<size_t> newTracks_;     // update() scratch, table rows
+    std::vector<uint64_t> version_;
+    uint64_t lastVersion_;
+
+    int claimSlot(int trackId, float x, float y);
+    void push(int slot, float x, float y);
+    float* ring(int slot, Axis axis)
+    {
+        return &arena_[((size_t)slot*NAxes+axis)*2*length_];
+    }
+};
+
+#endif /* track_history_hpp */
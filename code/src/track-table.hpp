@@ -0,0 +1,84 @@
+//
+//  track-table.hpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#ifndef track_table_hpp
+#define track_table_hpp
+
+#include <vector>
+
+/**
+ * Flat (structure-of-arrays) snapshot of the tracks OPT_CHOP outputs on
+ * current cook. Rows are sorted by track id, same as OPT_CHOP's default output.
+ * Vectors are reused between cooks, so steady-state refills do not allocate.
+ */
+struct TrackTable {
+    std::vector<int> ids;
+    std::vector<float> x, y, z;
+
+    size_t size() const { return ids.size(); }
+
+    void clear()
+    {
+        ids.clear();
+        x.clear();
+        y.clear();
+        z.clear();
+    }
+
+    void append(int id, float tx, float ty, float tz)
+    {
+        ids.push_back(id);
+        x.push_back(tx);
+        y.push_back(ty);
+        z.push_back(tz);
+    }
+};
+
+/**
+ * Tracks with every field of an OPT world frame, a column per field, rows
+ * aligned with the table. Binary world frames are copied into it column by
+ * column (see binary-frame.hpp).
+ */
+struct TrackRecords {
+    TrackTable table;       // ids, x, y, z (height)
+    std::vector<float> age, confidence, stableId;
+    std::vector<float> alive;   // not sent; 1 if listed by last heartbeat
+
+    size_t size() const { return table.size(); }
+
+    void resize(size_t n)
+    {
+        table.ids.resize(n);
+        table.x.resize(n);
+        table.y.resize(n);
+        table.z.resize(n);
+        age.resize(n);
+        confidence.resize(n);
+        stableId.resize(n);
+        alive.resize(n);
+    }
+
+    void copyRow(size_t to, const TrackRecords& from, size_t row)
+    {
+        table.ids[to] = from.table.ids[row];
+        table.x[to] = from.table.x[row];
+        table.y[to] = from.table.y[row];
+        table.z[to] = from.table.z[row];
+        age[to] = from.age[row];
+        confidence[to] = from.confidence[row];
+        stableId[to] = from.stableId[row];
+        alive[to] = from.alive[row];
+    }
+
+    void append(const TrackRecords& from, size_t row)
+    {
+        resize(size()+1);
+        copyRow(size()-1, from, row);
+    }
+};
+
+#endif /* track_table_hpp */
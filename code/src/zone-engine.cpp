@@ -0,0 +1,365 @@
+//
+//  zone-engine.cpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#include "zone-engine.hpp"
+
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cfloat>
+
+#define ZONE_CIRCLE     "circle"
+#define ZONE_POLY       "poly"
+#define GRID_MAXDIM     64      // grid cells along the longest side of zones extent
+
+using namespace std;
+
+#define SET_ERR_MSG(errexpr) {\
+stringstream msg; \
+msg << errexpr; \
+errMsg_ = msg.str(); \
+}
+
+static bool parseFloat(const string& s, float& v)
+{
+    char *end = nullptr;
+    v = strtof(s.c_str(), &end);
+    return (end != s.c_str() && *end == '\0');
+}
+
+ZoneEngine::ZoneEngine():
+gridW_(0), gridH_(0),
+gridMinX_(0), gridMinY_(0), cellSize_(1)
+{}
+
+ZoneEngine::~ZoneEngine()
+{}
+
+bool
+ZoneEngine::load(const vector<vector<string>>& zoneTokens)
+{
+    vector<Zone> zones;
+    vector<float> verts;
+
+    errMsg_ = "";
+
+    for (size_t row = 0; row < zoneTokens.size(); ++row)
+    {
+        const vector<string>& tokens = zoneTokens[row];
+        Zone z;
+
+        if (tokens.size() < 2)
+        {
+            SET_ERR_MSG("zone " << row << ": expected name and shape")
+            return false;
+        }
+
+        z.name = tokens[0];
+        z.count = z.nEnter = z.nExit = 0;
+        z.avgDwell = z.maxDwell = 0;
+        z.vertOffset = (int)verts.size();
+        z.nVerts = 0;
+
+        vector<float> vals;
+        for (size_t i = 2; i < tokens.size(); ++i)
+        {
+            float v;
+            if (!parseFloat(tokens[i], v))
+            {
+                SET_ERR_MSG("zone " << z.name << ": bad number '" << tokens[i] << "'")
+                return false;
+            }
+            vals.push_back(v);
+        }
+
+        if (tokens[1] == ZONE_CIRCLE)
+        {
+            if (vals.size() != 3 || vals[2] <= 0)
+            {
+                SET_ERR_MSG("zone " << z.name << ": circle expects center x, y and positive radius")
+                return false;
+            }
+
+            z.shape = Circle;
+            z.cx = vals[0]; z.cy = vals[1]; z.r = vals[2];
+            z.minX = z.cx-z.r; z.maxX = z.cx+z.r;
+            z.minY = z.cy-z.r; z.maxY = z.cy+z.r;
+        }
+        else if (tokens[1] == ZONE_POLY)
+        {
+            if (vals.size() < 6 || vals.size()%2)
+            {
+                SET_ERR_MSG("zone " << z.name << ": polygon expects at least 3 x y pairs")
+                return false;
+            }
+
+            z.shape = Polygon;
+            z.cx = z.cy = z.r = 0;
+            z.nVerts = (int)vals.size()/2;
+            z.minX = z.minY = FLT_MAX;
+            z.maxX = z.maxY = -FLT_MAX;
+
+            for (int i = 0; i < z.nVerts; ++i)
+            {
+                z.minX = min(z.minX, vals[2*i]); z.maxX = max(z.maxX, vals[2*i]);
+                z.minY = min(z.minY, vals[2*i+1]); z.maxY = max(z.maxY, vals[2*i+1]);
+            }
+            verts.insert(verts.end(), vals.begin(), vals.end());
+        }
+        else
+        {
+            SET_ERR_MSG("zone " << z.name << ": unknown shape '" << tokens[1]
+                        << "' (" << ZONE_CIRCLE << " or " << ZONE_POLY << " expected)")
+            return false;
+        }
+
+        zones.push_back(z);
+    }
+
+    zones_.swap(zones);
+    verts_.swap(verts);
+    lastMemberships_.clear();
+    memberships_.clear();
+    buildGrid();
+
+    return true;
+}
+
+bool
+ZoneEngine::loadFile(const string& path)
+{
+    ifstream f(path);
+
+    if (!f.is_open())
+    {
+        SET_ERR_MSG("can't open zones file " << path)
+        return false;
+    }
+
+    vector<vector<string>> zoneTokens;
+    string line;
+
+    while (getline(f, line))
+    {
+        vector<string> tokens;
+        tokenize(line, tokens);
+
+        if (tokens.size() && tokens[0][0] != '#')
+            zoneTokens.push_back(tokens);
+    }
+
+    return load(zoneTokens);
+}
+
+void
+ZoneEngine::clear()
+{
+    load(vector<vector<string>>());
+}
+
+void
+ZoneEngine::update(const TrackTable &tracks, double nowMs)
+{
+    for (auto& z:zones_)
+    {
+        z.count = z.nEnter = z.nExit = 0;
+        z.avgDwell = z.maxDwell = 0;
+    }
+
+    memberships_.clear();
+
+    for (size_t i = 0; i < tracks.size(); ++i)
+    {
+        int cell = cellIndex(tracks.x[i], tracks.y[i]);
+
+        if (cell < 0)
+            continue;
+
+        for (int k = cellOffsets_[cell]; k < cellOffsets_[cell+1]; ++k)
+            if (contains(zones_[cellZones_[k]], tracks.x[i], tracks.y[i]))
+            {
+                Membership m = { tracks.ids[i], cellZones_[k], nowMs };
+                memberships_.push_back(m);
+            }
+    }
+
+    // both lists are sorted by (track id, zone) - merge them to find
+    // enter and exit events and carry over enter timestamps
+    vector<Membership>::iterator cur = memberships_.begin();
+    vector<Membership>::const_iterator last = lastMemberships_.begin();
+
+    while (cur != memberships_.end() || last != lastMemberships_.end())
+    {
+        bool hasCur = (cur != memberships_.end());
+        bool hasLast = (last != lastMemberships_.end());
+
+        if (hasCur && hasLast &&
+            cur->trackId == last->trackId && cur->zone == last->zone)
+        {
+            // time may go back if sender restarts
+            cur->enterTs = min(last->enterTs, nowMs);
+            ++cur; ++last;
+        }
+        else if (!hasLast ||
+                 (hasCur && (cur->trackId < last->trackId ||
+                             (cur->trackId == last->trackId && cur->zone < last->zone))))
+        {
+            zones_[cur->zone].nEnter++;
+            ++cur;
+        }
+        else
+        {
+            zones_[last->zone].nExit++;
+            ++last;
+        }
+    }
+
+    for (auto& m:memberships_)
+    {
+        Zone& z = zones_[m.zone];
+        double dwell = (nowMs-m.enterTs)/1000.;
+
+        z.count++;
+        z.avgDwell += dwell;
+        z.maxDwell = max(z.maxDwell, dwell);
+    }
+
+    for (auto& z:zones_)
+        if (z.count)
+            z.avgDwell /= z.count;
+
+    lastMemberships_.swap(memberships_);
+}
+
+void
+ZoneEngine::clearEvents()
+{
+    for (auto& z:zones_)
+        z.nEnter = z.nExit = 0;
+}
+
+void
+ZoneEngine::tokenize(const string& str, vector<string>& tokens)
+{
+    string token;
+
+    for (char c:str)
+    {
+        if (isspace((unsigned char)c) || c == ',')
+        {
+            if (token.size())
+                tokens.push_back(token);
+            token.clear();
+        }
+        else
+            token += c;
+    }
+
+    if (token.size())
+        tokens.push_back(token);
+}
+
+//******************************************************************************
+void
+ZoneEngine::buildGrid()
+{
+    cellOffsets_.clear();
+    cellZones_.clear();
+    gridW_ = gridH_ = 0;
+
+    if (!zones_.size())
+        return;
+
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+
+    for (auto& z:zones_)
+    {
+        minX = min(minX, z.minX); maxX = max(maxX, z.maxX);
+        minY = min(minY, z.minY); maxY = max(maxY, z.maxY);
+    }
+
+    cellSize_ = max(max(maxX-minX, maxY-minY)/GRID_MAXDIM, 1e-3f);
+    gridMinX_ = minX;
+    gridMinY_ = minY;
+    gridW_ = (int)((maxX-minX)/cellSize_)+1;
+    gridH_ = (int)((maxY-minY)/cellSize_)+1;
+
+    // counting pass, then filling pass (compressed rows, one per cell)
+    vector<int> counts(gridW_*gridH_, 0);
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        if (pass == 1)
+        {
+            cellOffsets_.assign(gridW_*gridH_+1, 0);
+            for (int c = 0; c < gridW_*gridH_; ++c)
+                cellOffsets_[c+1] = cellOffsets_[c]+counts[c];
+            cellZones_.resize(cellOffsets_.back());
+            fill(counts.begin(), counts.end(), 0);
+        }
+
+        for (int zi = 0; zi < (int)zones_.size(); ++zi)
+        {
+            const Zone& z = zones_[zi];
+            int x0 = min((int)((z.minX-gridMinX_)/cellSize_), gridW_-1);
+            int x1 = min((int)((z.maxX-gridMinX_)/cellSize_), gridW_-1);
+            int y0 = min((int)((z.minY-gridMinY_)/cellSize_), gridH_-1);
+            int y1 = min((int)((z.maxY-gridMinY_)/cellSize_), gridH_-1);
+
+            for (int cy = y0; cy <= y1; ++cy)
+                for (int cx = x0; cx <= x1; ++cx)
+                {
+                    int c = cy*gridW_+cx;
+                    if (pass == 1)
+                        cellZones_[cellOffsets_[c]+counts[c]] = zi;
+                    counts[c]++;
+                }
+        }
+    }
+}
+
+bool
+ZoneEngine::contains(const Zone &z, float x, float y) const
+{
+    if (x < z.minX || x > z.maxX || y < z.minY || y > z.maxY)
+        return false;
+
+    if (z.shape == Circle)
+        return ((x-z.cx)*(x-z.cx) + (y-z.cy)*(y-z.cy) <= z.r*z.r);
+
+    // crossing number test
+    bool inside = false;
+    const float *v = &verts_[z.vertOffset];
+
+    for (int i = 0, j = z.nVerts-1; i < z.nVerts; j = i++)
+    {
+        float xi = v[2*i], yi = v[2*i+1], xj = v[2*j], yj = v[2*j+1];
+
+        if (((yi > y) != (yj > y)) &&
+            (x < (xj-xi)*(y-yi)/(yj-yi)+xi))
+            inside = !inside;
+    }
+
+    return inside;
+}
+
+int
+ZoneEngine::cellIndex(float x, float y) const
+{
+    if (!gridW_ || x < gridMinX_ || y < gridMinY_)
+        return -1;
+
+    int cx = (int)((x-gridMinX_)/cellSize_);
+    int cy = (int)((y-gridMinY_)/cellSize_);
+
+    if (cx >= gridW_ || cy >= gridH_)
+        return -1;
+
+    return cy*gridW_+cx;
+}
@@ -0,0 +1,88 @@
+//
+//  zone-engine.hpp
+//  OPT_CHOP
+//
+//  Copyright © 2018 UCLA. All rights reserved.
+//
+
+#ifndef zone_engine_hpp
+#define zone_engine_hpp
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+
+#include "track-table.hpp"
+
+/**
+ * Zone engine - tests tracks against a set of trigger zones (circles and
+ * polygons) and keeps per-zone occupancy, enter/exit events and dwell times.
+ * Zones are bucketed into a uniform grid, so a point query only tests zones
+ * overlapping point's grid cell.
+ *
+ * Zone description format (one zone per line or DAT row):
+ *      <name> circle <cx> <cy> <radius>
+ *      <name> poly <x0> <y0> <x1> <y1> <x2> <y2> ...
+ */
+class ZoneEngine {
+public:
+    typedef enum _Shape {
+        Circle,
+        Polygon
+    } Shape;
+
+    typedef struct _Zone {
+        std::string name;
+        Shape shape;
+        float cx, cy, r;
+        int vertOffset, nVerts;
+        float minX, minY, maxX, maxY;
+
+        int count, nEnter, nExit;
+        double avgDwell, maxDwell;    // seconds
+    } Zone;
+
+    ZoneEngine();
+    ~ZoneEngine();
+
+    // replaces current zones; on error returns false and keeps previous zones
+    bool load(const std::vector<std::vector<std::string>>& zoneTokens);
+    bool loadFile(const std::string& path);
+    void clear();
+
+    // tests all tracks against zones; timestamp is in milliseconds
+    void update(const TrackTable& tracks, double nowMs);
+    // clears enter/exit counters (i.e. when there's no new tracking data)
+    void clearEvents();
+
+    const std::vector<Zone>& getZones() const { return zones_; }
+    const std::string& getError() const { return errMsg_; }
+
+    // splits zone description by whitespace and commas, appending to tokens
+    static void tokenize(const std::string& str, std::vector<std::string>& tokens);
+
+private:
+    typedef struct _Membership {
+        int trackId, zone;
+        double enterTs;
+    } Membership;
+
+    std::string errMsg_;
+    std::vector<Zone> zones_;
+    std::vector<float> verts_;
+
+    // grid: zones overlapping cell c are cellZones_[cellOffsets_[c]..cellOffsets_[c+1])
+    int gridW_, gridH_;
+    float gridMinX_, gridMinY_, cellSize_;
+    std::vector<int> cellOffsets_;
+    std::vector<int> cellZones_;
+
+    // memberships are kept sorted by track id, then zone
+    std::vector<Membership> lastMemberships_, memberships_;
+
+    void buildGrid();
+    bool contains(const Zone& z, float x, float y) const;
+    int cellIndex(float x, float y) const;
+};
+
+#endif /* zone_engine_hpp */